@@ -16,6 +16,22 @@
 
 namespace tofu::ball 
 {
+    // MainThreadで1描画フレームごとに読み取った生の入力
+    struct InputSample
+    {
+        // 次のサンプルを取りこぼさないように合成する (押下は1回でもあればtrue)
+        constexpr void Merge(const InputSample& next) noexcept
+        {
+            _cursor = next._cursor;
+            _leftPressed |= next._leftPressed;
+            _rightPressed |= next._rightPressed;
+        }
+
+        tVec2 _cursor;
+        bool _leftPressed = false;
+        bool _rightPressed = false;
+    };
+
     // 1フレームのユーザー入力データ
     struct InputState
     {
@@ -30,16 +46,16 @@ namespace tofu::ball
             _rightClick.NewFrame();
         }
 
-        constexpr void Update() noexcept
+        constexpr void Apply(const InputSample& sample) noexcept
         {
             assert(!_deployed);
             if (_deployed)
                 return;
 
-            _cursor.set(Cursor::PosF());
-            if (MouseL.pressed())
+            _cursor.set(sample._cursor);
+            if (sample._leftPressed)
                 _leftClick.press();
-            if (MouseR.pressed())
+            if (sample._rightPressed)
                 _rightClick.press();
         }
 
@@ -59,14 +75,17 @@ namespace tofu::ball
     };
 
     // ユーザー入力を管理しゲームに引き渡すひと
+    //  MainThreadで読み取った入力はSpscQueueでUpdateThreadに渡すので、どちらのスレッドも相手を待たない
     class InputSystem
     {
+        // UpdateThreadが止まっている間に溜めておけるサンプル数
+        static constexpr std::size_t SampleQueueSize = 64;
     public:
         InputSystem() noexcept
         {
         }
 
-        // NOTE: Step()とスレッドセーフな操作ではないことに注意
+        // UpdateThread側から呼ぶこと
         constexpr const InputState& GetCurrent() const noexcept
         {
             return _currentState;
@@ -74,26 +93,48 @@ namespace tofu::ball
 
         // 今フレームの入力を確定し、次フレームの準備をする
         // UpdateThread側で呼び出すことが想定されている
-        //   NOTE: GetCurrent()とスレッドセーフな操作ではないことに注意
         void Step()
         {
-            std::lock_guard lock{ _mutex };
+            _samples.pop_n(_samples.capacity(), [this](InputSample&& sample) {
+                _state.Apply(sample);
+            });
             _currentState = _state.Deploy();
             _state.NewFrame();
         }
 
-        // 今フレームの入力を処理する。
+        // 今フレームの入力を読み取ってUpdateThreadに送る。
         // MainThread側で呼び出すことが想定されている
         void Update()
         {
-            std::lock_guard lock{ _mutex };
-            _state.Update();
+            InputSample sample{
+                ._cursor = Cursor::PosF(),
+                ._leftPressed = MouseL.pressed(),
+                ._rightPressed = MouseR.pressed(),
+            };
+
+            // キューが満杯なら手元で合成しておき、次の描画フレームで送る
+            if (_pending)
+            {
+                _pending->Merge(sample);
+            }
+            else
+            {
+                _pending = sample;
+            }
+            if (_samples.try_push(*_pending))
+            {
+                _pending.reset();
+            }
         }
 
     private:
-        std::mutex _mutex;
-        InputState _state;
+        SpscQueue<InputSample, SampleQueueSize> _samples;
+
+        // MainThreadだけが触る
+        std::optional<InputSample> _pending;
 
+        // UpdateThreadだけが触る
+        InputState _state;
         InputState _currentState;
     };
 
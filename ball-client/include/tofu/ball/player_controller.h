@@ -13,11 +13,17 @@ namespace tofu::ball
         PlayerController(observer_ptr<ServiceLocator> service_locator, observer_ptr<entt::registry> registry);
         void Step();
     private:
+        // tickの入力として確定させる. SyncWindowSize個溜まったらまとめて送る
+        void Push(GameTick tick, const SyncObject& input);
+
         observer_ptr<ServiceLocator> _serviceLocator;
         observer_ptr<entt::registry> _registry;
 
         std::array<SyncObject, SyncWindowSize> _syncBuffer;
         int _objCount = 0;
+        // 次に入力を書き込むTick. 入力遅延が変わっても、Tickに抜けや重複が出ないようにする
+        //  最初のActionDelay Tick分は、SyncSystemが空の入力で埋めている (途中から参加したときは QuicControllerSystem::GetFirstInputTick まで)
+        GameTick _nextTick = ActionDelay;
     };
 
     namespace jobs
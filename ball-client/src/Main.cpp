@@ -81,7 +81,12 @@ namespace tofu::ball
                 using namespace tofu::jobs;
                 using namespace tofu::ball::jobs;
                 job_scheduler->Register(make_job<ApplySyncObject>({ get_job_tag<StartFrame>() }, {}, quic));
-                job_scheduler->GetJob(get_job_tag<StepTick>())->AddDependency(get_job_tag<ApplySyncObject>());
+                // 受信した入力を反映してから進められるか判定する
+                job_scheduler->GetJob(get_job_tag<CheckStepable>())->AddDependency(get_job_tag<ApplySyncObject>());
+                // 入力やハッシュなど、このTickに送るものは最後にまとめて送る
+                job_scheduler->Register(make_job<CorkSend>({}, {}, quic));
+                job_scheduler->GetJob(get_job_tag<StartFrame>())->AddDependency(get_job_tag<CorkSend>());
+                job_scheduler->Register(make_job<UncorkSend>({ get_job_tag<EndUpdate>() }, {}, quic));
             }
 
             _game.initEnitites();
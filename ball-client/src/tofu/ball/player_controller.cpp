@@ -19,12 +19,20 @@ namespace tofu::ball
 
     void PlayerController::Step()
     {
-        auto clock = _serviceLocator->Get<TickCounter>();
-        auto tick_after = ActionDelay;
+        auto net_system = _serviceLocator->Get<QuicControllerSystem>();
+        if (net_system && net_system->IsSpectator())
+            return;
+
+        auto tick = _serviceLocator->Get<TickCounter>()->GetCurrent();
+        std::uint32_t delay = ActionDelay;
+        if (auto input_delay = _serviceLocator->Get<net::InputDelaySchedule>())
         {
-            auto& input = _serviceLocator->Get<InputSystem>()->GetCurrent();
+            delay = input_delay->GetDelay(tick);
+        }
 
-            SyncObject sync;
+        SyncObject sync;
+        {
+            auto& input = _serviceLocator->Get<InputSystem>()->GetCurrent();
 
             for (auto&& [entity, player] : _registry->view<Player>().proxy())
             {
@@ -38,37 +46,60 @@ namespace tofu::ball
                     sync._action = actions::Move{ target };
                 }
             }
+        }
+
+        // 今進めたTickのdelay Tick後の入力にする
+        //  ApplySyncObjectと同じく、StepTickで進める前のTickで数える
+        auto target_tick = tick + GameTick{ delay } - GameTick{ 1 };
+
+        // 途中から参加したときは、サーバーが埋めた入力の次のTickから入力する
+        if (net_system && _nextTick < net_system->GetFirstInputTick())
+            _nextTick = net_system->GetFirstInputTick();
+
+        // 遅延が縮んだ直後は、既に入力を確定させたTickと重なるので捨てる
+        //  途中から参加したときは、入力を送り始めるTickに届くまで捨てる
+        if (target_tick < _nextTick)
+            return;
+
+        // 遅延が伸びた直後は、空いたTickを何もしない入力で埋める
+        while (_nextTick < target_tick)
+        {
+            Push(_nextTick, SyncObject{});
+        }
+        Push(target_tick, sync);
+    }
 
-            _syncBuffer[_objCount++] = sync;
+    void PlayerController::Push(GameTick tick, const SyncObject& input)
+    {
+        // 他のピアは詰めて送った値でシミュレーションするので、自分も同じ値を使う
+        auto sync = quantize(input);
+
+        auto current = _serviceLocator->Get<TickCounter>()->GetCurrent();
+
+        PlayerID id = 0;
+        auto net_system = _serviceLocator->Get<QuicControllerSystem>();
+        if (net_system)
+        {
+            id = net_system->GetMyID();
         }
 
+        // SyncSystemはまだStepSyncBufferされていないので、先頭は1つ前のTick
+        //  サーバーが入力を決めるときは、サーバーから返ってきたものを使うので詰めない
+        if (!net_system || !net_system->UsesArbitratedInputs())
+        {
+            _serviceLocator->Get<SyncSystem>()->SetData(*id, tick - current + GameTick{ 1 }, sync);
+        }
+
+        _syncBuffer[_objCount++] = sync;
+        _nextTick = tick + GameTick{ 1 };
+
         if (_objCount < SyncWindowSize)
             return;
 
+        if (net_system)
         {
-            PlayerID id = 0;
-            auto net_system = _serviceLocator->Get<QuicControllerSystem>();
-            if (net_system)
-            {
-                id = net_system->GetMyID();
-            }
-            auto sync_system = _serviceLocator->Get<CompletelySyncSystem>();
-
-            for (int i = 0; i < SyncWindowSize; i++)
-            {
-                sync_system->SetData(*id, tick_after - SyncWindowSize + 1 + i, _syncBuffer[i]);
-            }
-            if (net_system)
-            {
-                message_client_control::SyncPlayerAction message = {
-                    ._player = *id,
-                    ._tick = tick_after + *clock->GetCurrent() - SyncWindowSize,
-                    ._obj = _syncBuffer,
-                };
-                net_system->Send(message);
-            }
-            _objCount = 0;
+            net_system->SendInput(tick - GameTick{ SyncWindowSize - 1 }, _syncBuffer);
         }
-        
+        _objCount = 0;
     }
 }
@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include <variant>
+#include <chrono>
 #include <cstdint>
 #include <thread>
 #include <condition_variable>
@@ -16,20 +17,28 @@
 
 namespace tofu::ball
 {
+    // 1Tickの長さ
+    inline constexpr std::chrono::microseconds TickPeriod{ 16'666 };
+    // 入力遅延の初期値. 試合中は通信状況に合わせてサーバーが変更する
     inline constexpr std::uint32_t ActionDelay = 4;
 
     namespace actions 
     {
         struct Null
         {
+            bool operator==(const Null&) const = default;
         };
         struct Move
         {
             tVec2 _target;
+
+            bool operator==(const Move&) const = default;
         };
         struct Dash 
         {
             tVec2 _target;
+
+            bool operator==(const Dash&) const = default;
         };
         using Variant = std::variant<Null, Move, Dash>;
     }
@@ -41,6 +50,9 @@ namespace tofu::ball
         GameTick _tick;
     };
 
+    // 1Tick分のAction。プレイヤー数程度しか積まれないので内部領域に収める
+    using ActionList = small_vector<ActionCommand, 4>;
+
     class ActionQueue
     {
     public:
@@ -63,9 +75,9 @@ namespace tofu::ball
             }
         }
 
-        std::vector<ActionCommand> Retrieve() 
+        ActionList Retrieve() 
         {
-            std::vector<ActionCommand> ret;
+            ActionList ret;
             std::swap(ret, _queues[0]);
 
             for (int i = 0; i < _queues.size() - 1; i++) {
@@ -88,7 +100,7 @@ namespace tofu::ball
         GameTick _current;
 
         // _queues[x] : x Tick先に処理するAction
-        std::array<std::vector<ActionCommand>, QueueCount> _queues;
+        std::array<ActionList, QueueCount> _queues;
 
         // queuesに溢れるくらい未来のaction
         std::vector<ActionCommand> _futureActions;
@@ -0,0 +1,83 @@
+﻿#pragma once
+
+#include <array>
+#include <optional>
+
+#include <entt/entt.hpp>
+
+#include <tofu/utils.h>
+#include <tofu/utils/snapshot_buffer.h>
+#include <tofu/containers/concurrent_queue.h>
+
+#include <tofu/ecs/core.h>
+
+#include "tofu/ball/network.h"
+
+namespace tofu::ball
+{
+    // 状態のハッシュとスナップショットを保持するTick数
+    //  デシンクの通知が届いたときに、そのTickのスナップショットがまだ残っている長さにする
+    inline constexpr std::size_t DesyncHistorySize = 64;
+    // 受信してから処理されるまで溜めておけるデシンクの通知の数
+    inline constexpr std::size_t DesyncQueueSize = 4;
+
+    // 毎Tickの状態のハッシュを求めてサーバーに送り、デシンクが通知されたらそのTickのスナップショットをファイルに書き出す
+    class DesyncCheckSystem
+    {
+    public:
+        // final_delay: Tickをシミュレーションしてから、その結果が確定するまでのTick数
+        //  巻き戻しのない完全同期なら0, ロールバック方式なら巻き戻せる最大Tick数
+        DesyncCheckSystem(observer_ptr<ServiceLocator> service_locator, observer_ptr<entt::registry> registry, std::uint32_t final_delay);
+
+        // 今Tickをシミュレーションし終えた状態を記録する. 巻き戻して再シミュレーションしたら、同じTickを記録し直す
+        void Record();
+        // 確定したTickのハッシュをChecksumBatchSize個ずつサーバーに送り、届いているデシンクの通知を処理する
+        void Step();
+
+        // 通信スレッドから呼ぶ
+        void Receive(const message_server_control::DesyncDetected& message);
+
+    private:
+        void Dump(const message_server_control::DesyncDetected& message);
+
+        struct Entry
+        {
+            std::optional<GameTick> _tick;
+            std::uint64_t _hash = 0;
+            SnapshotBuffer _snapshot;
+        };
+
+        observer_ptr<ServiceLocator> _serviceLocator;
+        observer_ptr<entt::registry> _registry;
+        std::uint32_t _finalDelay;
+
+        std::array<Entry, DesyncHistorySize> _history;
+        // 次にサーバーへ送るTick
+        std::optional<GameTick> _nextSendTick;
+        message_client_control::StateChecksums _batch{};
+
+        // 通信スレッドが書き込み、ゲームスレッドが読む. 通信スレッドは待たない
+        OverflowQueue<SpscQueue<message_server_control::DesyncDetected, DesyncQueueSize>> _desyncQueue;
+    };
+
+    namespace jobs
+    {
+        class CheckDesync
+        {
+        public:
+            CheckDesync(observer_ptr<DesyncCheckSystem> system)
+                : _system(system)
+            {
+            }
+
+            void operator()() const
+            {
+                _system->Record();
+                _system->Step();
+            }
+
+        private:
+            observer_ptr<DesyncCheckSystem> _system;
+        };
+    }
+}
@@ -15,7 +15,9 @@ namespace tofu::ball
     public:
         UpdateSystem(observer_ptr<ServiceLocator> service_locator, observer_ptr<entt::registry> registry);
 
-        void Start();
+        void Start(std::optional<ScheduledUpdateThread::time_point> start_time = std::nullopt);
+        // 1Tickの長さを変える. 他のピアより先行しているときに少し伸ばして、差を縮める
+        void SetTickPeriod(std::chrono::microseconds period);
     
         void StartFrame();
         void StepTick();
@@ -2,13 +2,17 @@
 
 #include <variant>
 #include <cstdint>
+#include <chrono>
 #include <thread>
 #include <condition_variable>
 #include <optional>
+#include <string>
 
 #include <entt/entt.hpp>
 
 #include <tofu/utils.h>
+#include <tofu/utils/error.h>
+#include <tofu/utils/snapshot_buffer.h>
 #include <tofu/containers.h>
 #include <tofu/input.h>
 
@@ -16,19 +20,53 @@
 
 namespace tofu::ball 
 {
+    // ゲームの同期方式
+    enum class SyncMode
+    {
+        // 全員の入力が揃うまで待つ
+        Completely,
+        // 届いていない入力は予測して進め、外れていたら巻き戻す
+        Rollback,
+        // サーバーが進めた状態を配り、クライアントはそれに合わせる
+        ServerAuthoritative,
+    };
+
     class Game {
     public:
+        struct Config
+        {
+            SyncMode _syncMode = SyncMode::Completely;
+            // 参加人数. MaxPlayerNum以下
+            std::size_t _playerNum = 2;
+            // 空でなければ、毎Tickの全員の入力をこのファイルに記録する
+            std::string _replayPath;
+        };
+
         Game();
+        Game(const Config& config);
+
+        // 参加人数を変える. initBaseSystemsより前に呼ぶこと
+        void setPlayerNum(std::size_t player_num);
+        std::size_t getPlayerNum() const noexcept;
+        // 同期方式を変える. initBaseSystemsより前に呼ぶこと
+        void setSyncMode(SyncMode sync_mode);
+        // 入力を記録するリプレイファイル. initBaseSystemsより前に呼ぶこと
+        void setReplayPath(const std::string& path);
 
         void initBaseSystems();
         void initEnitites();
 
-        void start();
+        // start_timeを指定すると、その時刻から最初のTickを始める. 省略するとすぐに始める
+        void start(std::optional<std::chrono::system_clock::time_point> start_time = std::nullopt);
         void update();
 
         observer_ptr<entt::registry> getRegistry();
         observer_ptr<ServiceLocator> getServiceLocator();
 
+        // ゲーム世界の状態を保存・復元する
+        void saveSnapshot(SnapshotBuffer& buffer);
+        Error loadSnapshot(const SnapshotBuffer& buffer);
+
     private:
         void initSystems();
         void initStage();
@@ -36,6 +74,8 @@ namespace tofu::ball
         void initBall();
 
     private:
+        Config _config;
+
         entt::registry _registry;
         ServiceLocator _serviceLocator;
     };
@@ -6,6 +6,8 @@
 
 #include <tofu/net/quic.h>
 #include <tofu/net/quic_client.h>
+#include <tofu/net/clock_sync.h>
+#include <tofu/net/catch_up.h>
 
 #include <tofu/ball/player.h>
 #include <tofu/ball/network.h>
@@ -16,6 +18,9 @@ namespace tofu::ball
 {
     class Client;
 
+    // 途中から参加して追いつくときに、UpdateAtLobbyの1回でゲームを進めてよい時間. 描画や通信を止めない
+    inline constexpr std::chrono::milliseconds CatchUpFrameBudget{ 8 };
+
 	class ServerConnection
 	{
     public:
@@ -24,17 +29,29 @@ namespace tofu::ball
             WaitConnect,
             WaitJoinApproval,
             Ready,
+            // 試合が始まったが、まだ今のTickに追いついていない. メッセージはClientが追いつきながら1つずつ読む
+            CatchUp,
             InGame,
         };
 
         ServerConnection(observer_ptr<Client> client, const std::shared_ptr<net::QuicConnection>& quic);
 
         void Update();
+        // 届いているメッセージを1つ処理する. 届いていなければfalse
+        //  途中から参加したときは、これまでに配られたメッセージを読み終えてから、その後に配られたメッセージを読む
+        bool ProcessNextMessage();
+        // 追いついたので、届くメッセージを全て処理し始める
+        void FinishCatchUp();
     private:
         void UpdateWaitConnect();
         void UpdateWaitJoinApproval();
         void UpdateReady();
         void UpdateIngame();
+        // streamの先頭のメッセージを1つ処理する. 全て届いていなければfalse
+        bool ProcessMessage(const std::shared_ptr<net::QuicStream>& stream);
+        void ReceiveDatagrams();
+        // 受け取った時刻をすぐに返す. サーバーはこれで時計のずれを測る
+        void RespondClockSync(const message_server_control::ClockSyncRequest& message);
     public:
 
         State GetState() const noexcept
@@ -51,23 +68,81 @@ namespace tofu::ball
         {
             return _id;
         }
+        bool IsSpectator() const noexcept
+        {
+            return *_id < 0;
+        }
+
+        std::size_t GetPlayerNum() const noexcept
+        {
+            return _members.size();
+        }
+        // 参加者の名前. 添字はプレイヤーID
+        const std::vector<std::string>& GetMembers() const noexcept
+        {
+            return _members;
+        }
 
         std::shared_ptr<net::QuicConnection> GetConnection() const
         {
             return _quic;
         }
 
+        // 入力をDATAGRAMで送るか. StartGameでサーバーから通知される
+        bool UsesDatagramInputs() const noexcept
+        {
+            return _datagramInputs;
+        }
+
+        // 締め切りまでに届かなかった入力をサーバーが決めるか. StartGameでサーバーから通知される
+        bool UsesArbitratedInputs() const noexcept
+        {
+            return _arbitratedInputs;
+        }
+
+        // サーバーが状態を決めて配るか. StartGameでサーバーから通知される
+        bool UsesStateSync() const noexcept
+        {
+            return _stateSync;
+        }
+
+        // 最初のTickを始める時刻. StartGameでサーバーから通知される
+        net::ClockSyncEstimator::time_point GetStartTime() const noexcept
+        {
+            return _startTime;
+        }
+
+        // 自分の入力を送り始めるTick. StartGameでサーバーから通知される
+        GameTick GetFirstInputTick() const noexcept
+        {
+            return _firstInputTick;
+        }
+
+        // これまでに配られたメッセージを全て読んだ. 途中から参加したのでなければ、始めから読み終えている
+        bool IsCatchUpComplete() const noexcept
+        {
+            return _catchUp.IsComplete();
+        }
+
     private:
         observer_ptr<Client> _client;
         std::shared_ptr<net::QuicConnection> _quic;
         PlayerID _id = -1;
         std::string _name;
+        std::vector<std::string> _members;
+        bool _datagramInputs = false;
+        bool _arbitratedInputs = false;
+        bool _stateSync = false;
+        net::ClockSyncEstimator::time_point _startTime;
+        GameTick _firstInputTick = ActionDelay;
 
         State _state = State::WaitConnect;
         Error _error;
 
         std::shared_ptr<net::QuicStream> _streamControlSend;
         std::shared_ptr<net::QuicStream> _streamControlRecv;
+        std::shared_ptr<net::QuicStream> _streamCatchUp;
+        net::CatchUpReceiver _catchUp{ CatchUpChunkSize };
 	};
 
 	class Client
@@ -84,10 +159,12 @@ namespace tofu::ball
 		struct Config
 		{
             std::string _ip;
+            Game::Config _game;
 		};
 
 		Client(const Config& config)
 			: _config(config)
+			, _game(config._game)
 		{
 		}
 
@@ -106,15 +183,31 @@ namespace tofu::ball
             return _state;
         }
 
+        // 試合が始まったら、今のTickに追いつくまでゲームを進めてから InGame にする
         void UpdateAtLobby();
         void UpdateIngame();
 
-        void OnReceiveSyncObject(const message_server_control::SyncPlayerAction& message);
+        // 入力が壊れていればfalse
+        bool OnReceiveSyncObject(const message_server_control::SyncPlayerAction& message);
+        bool OnReceiveSyncObject(const message_server_control::SyncTickActions& message);
+        void OnReceiveInputDelay(const message_server_control::ChangeInputDelay& message);
+        void OnReceiveFrameAdvantage(const message_server_control::FrameAdvantageReport& message);
+        void OnReceiveInputAck(const message_datagram::InputAck& message);
+        void OnReceiveWorldState(const message_datagram::WorldState& message);
+        void OnReceiveDesync(const message_server_control::DesyncDetected& message);
 
     protected:
         virtual void InitGame();
         virtual void UpdateGame();
 
+    private:
+        // 試合のゲームを作り、サーバーから通知された設定を反映する
+        void SetUpGame();
+        // 配られた入力を読みながら、実時間より速くゲームを進める. 今のTickに追いついたらtrue
+        bool CatchUp();
+        // サーバーから読めないメッセージが届いていたら、エラーを出して終了する. 終了したらtrue
+        bool StopOnConnectionError();
+
     protected:
 		Config _config;
 
@@ -123,6 +216,7 @@ namespace tofu::ball
 
         State _state = State::Init;
         std::shared_ptr<ServerConnection> _connection;
+        bool _gameSetUp = false;
 
 		Game _game;
 	};
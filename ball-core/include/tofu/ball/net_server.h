@@ -1,16 +1,28 @@
 ﻿#pragma once
 
 #include <memory>
+#include <vector>
 
 #include <tofu/utils.h>
 
 #include <tofu/net/quic.h>
 #include <tofu/net/quic_server.h>
+#include <tofu/net/latency.h>
+#include <tofu/net/input_delay.h>
+#include <tofu/net/fan_out.h>
+#include <tofu/net/input_aggregator.h>
+#include <tofu/net/redundant_input.h>
+#include <tofu/net/desync.h>
+#include <tofu/net/clock_sync.h>
+#include <tofu/net/input_arbiter.h>
+#include <tofu/net/catch_up.h>
 
 #include <tofu/ball/player.h>
 #include <tofu/ball/network.h>
 
 #include <tofu/ball/game.h>
+#include <tofu/ball/sync.h>
+#include <tofu/ball/state_sync.h>
 
 #undef SendMessage
 
@@ -18,6 +30,21 @@ namespace tofu::ball
 {
     class Server;
 
+    // 時計合わせの要求を送る間隔. 試合が始まったら、ドリフトを追うだけなので間隔を空ける
+    inline constexpr std::chrono::milliseconds ClockSyncLobbyInterval{ 50 };
+    inline constexpr std::chrono::milliseconds ClockSyncIngameInterval{ 1000 };
+    // 試合を始めるのに要る、時計合わせのサンプルの数
+    inline constexpr std::size_t MinClockSyncSamples = 8;
+    // 開始時刻は、全クライアントにStartGameが届くまでの時間にこれだけ足して決める
+    inline constexpr std::chrono::milliseconds StartTimeMargin{ 100 };
+    // 途中から参加したクライアントは、これまでの試合を実時間のCatchUpSpeedup倍以上で進めて追いつくとみなす
+    //  追いつくまでに要る時間にLateJoinMarginを足した先のTickから、そのクライアントの入力を使う
+    inline constexpr std::uint32_t CatchUpSpeedup = 10;
+    inline constexpr std::chrono::milliseconds LateJoinMargin{ 1000 };
+    // 途中から参加したクライアントに送り直すために残しておくメッセージ列の上限
+    //  入力だけなら最大人数でも数KB/秒なので、普通の試合では超えない. 超えたら残すのをやめ、途中参加を断る
+    inline constexpr std::size_t MaxBacklogSize = 64 * 1024 * 1024;
+
     class ClientConnection
     {
     public:
@@ -27,23 +54,50 @@ namespace tofu::ball
             WaitJoinRequest,
             Ready,
             Ingame,
+            // 接続が切れた. 試合は続け、このプレイヤーの入力はサーバーが埋める
+            Disconnected,
         };
 
-        ClientConnection(observer_ptr<Server> server, const std::shared_ptr<net::QuicConnection>& quic, PlayerID player_id);
+        // player_id: 観戦者は-1. peer: 状態を配るときの相手の番号 (StateSyncServerSystem::AddPeer)
+        ClientConnection(observer_ptr<Server> server, const std::shared_ptr<net::QuicConnection>& quic, PlayerID player_id, std::size_t peer);
 
         void Update();
-        void StartGame();
+        // start_timeはサーバーの時計. クライアントには、そのクライアントの時計に直して伝える
+        void StartGame(net::ClockSyncEstimator::time_point start_time);
+        // 試合の途中から参加させる. これまでに配ったメッセージ列の先頭catch_up_sizeバイトを区切って送り、
+        //  自分の入力はfirst_input_tickから受け取る
+        void StartLateGame(net::ClockSyncEstimator::time_point start_time, GameTick first_input_tick, std::size_t catch_up_size);
+        void Disconnect();
 
         template<class T>
         void SendAsControl(const T& msg)
         {
             SendMessage(_streamControlSend, msg);
         }
+        // エンコード済みのメッセージ列を送る
+        void SendAsControl(std::span<const std::byte> messages)
+        {
+            SendMessage(_streamControlSend, messages);
+        }
+        // UncorkControlまでに送るメッセージを溜めて、1度にまとめて送る. 1Tickの始めと終わりに呼ぶ
+        void CorkControl();
+        void UncorkControl();
 
     private:
         void UpdateWaitConnect();
         void UpdateWaitJoinRequest();
+        void UpdateReady();
         void UpdateIngame();
+        // 前回からintervalが経っていれば、時計合わせの要求を送る
+        void RequestClockSync(std::chrono::microseconds interval);
+        void OnReceiveClockSync(const message_client_control::ClockSyncResponse& message);
+        // DATAGRAMで届いた入力を受け取り、受け取り状況をACKとして返す
+        void ReceiveDatagrams();
+        // ストリームとDATAGRAMのどちらで届いた入力も、Tick順に揃ってから使う
+        void AcceptInput(GameTick tick, const SyncWindow& obj);
+        void OnReceiveInput(GameTick tick, const SyncWindow& obj);
+        // 途中から参加したとき、これまでに配ったメッセージ列を送れる分だけ送る
+        void SendCatchUp();
     public:
 
         State GetState() const noexcept
@@ -60,17 +114,60 @@ namespace tofu::ball
         {
             return _id;
         }
+        bool IsSpectator() const noexcept
+        {
+            return *_id < 0;
+        }
+        std::size_t GetPeer() const noexcept
+        {
+            return _peer;
+        }
 
         const std::string& GetName() const noexcept
         {
             return _name;
         }
 
+        const std::shared_ptr<net::QuicConnection>& GetConnection() const noexcept
+        {
+            return _quic;
+        }
+
+        const net::LatencyEstimator& GetLatency() const noexcept
+        {
+            return _latency;
+        }
+
+        // 受け取った入力のうち、最も新しいTick
+        std::optional<GameTick> GetLastInputTick() const noexcept
+        {
+            return _lastInputTick;
+        }
+        // 次に使う入力のTick. これより前の入力は全て受け取った
+        GameTick GetNextInputTick() const noexcept
+        {
+            return _inputReceiver.GetNextTick();
+        }
+
+        // クライアントの時計とのずれ
+        const net::ClockSyncEstimator& GetClock() const noexcept
+        {
+            return _clock;
+        }
+        bool IsClockSynced() const noexcept
+        {
+            return MinClockSyncSamples <= _clock.GetSampleCount();
+        }
+
+        // このクライアントへのメッセージを、1Tickに何パケットで送れているか
+        net::QuicSendMetrics GetControlSendMetrics() const;
+
     private:
         std::shared_ptr<net::QuicConnection> _quic;
         observer_ptr<Server> _server;
 
         PlayerID _id;
+        std::size_t _peer;
         std::string _name;
 
         State _state = State::WaitConnect;
@@ -78,6 +175,20 @@ namespace tofu::ball
 
         std::shared_ptr<net::QuicStream> _streamControlSend;
         std::shared_ptr<net::QuicStream> _streamControlRecv;
+        // 途中から参加したときだけ使う
+        bool _lateJoin = false;
+        std::shared_ptr<net::QuicStream> _streamCatchUp;
+        net::CatchUpSender _catchUp{ CatchUpChunkSize, CatchUpWindowSize };
+
+        net::LatencyEstimator _latency{ TickPeriod };
+        std::optional<GameTick> _lastInputTick;
+
+        // 最初の入力はActionDelayのTickから届く. 途中から参加したときはStartLateGameで決め直す
+        net::RedundantInputReceiver<SyncWindow, InputHistorySize> _inputReceiver{ ActionDelay, SyncWindowSize };
+        net::LossEstimator _inputLoss;
+
+        net::ClockSyncEstimator _clock;
+        std::optional<net::ClockSyncEstimator::time_point> _lastClockSync;
     };
 
     class Server
@@ -90,7 +201,51 @@ namespace tofu::ball
             Exit,
         };
     public:
+        struct Config
+        {
+            // 参加人数もここで決める
+            Game::Config _game;
+
+            // 受け取った入力を1つずつ中継する代わりに、Tick範囲ごとに全員分をまとめて配る
+            //  パケット数とメッセージごとのヘッダが減る代わりに、揃うまで(最大_aggregateMaxWait)配るのが遅れる
+            bool _aggregateInputs = false;
+            std::chrono::microseconds _aggregateMaxWait = TickPeriod;
+
+            // クライアントからの入力をDATAGRAMで受け取る. 届かなかった分だけストリームで送り直してもらう
+            bool _datagramInputs = false;
+
+            // 誰かの入力が最初に届いてから_inputDeadlineまでに届かなかった入力を、サーバーが代わりに決めて配る
+            //  遅れて届いた本物の入力は捨てる. 1人の通信が遅くても、他の人が待たされるのは締め切りまでで済む
+            bool _arbitrateInputs = false;
+            std::chrono::microseconds _inputDeadline = TickPeriod * 4;
+
+            // 代わりに決める入力
+            enum class InputFill
+            {
+                // 何もしない
+                Null,
+                // 直前の入力が移動なら、同じ目標への移動を続ける. ダッシュのような1回きりの入力は繰り返さない
+                RepeatMove,
+            };
+            InputFill _inputFill = InputFill::RepeatMove;
+
+            // 入力を中継する代わりに、サーバーがゲームを進めて状態を配る
+            //  クライアントは自分の入力だけを予測で先に反映し、他は配られた状態を補間して表示する. 一番遅いクライアントを待たない
+            bool _stateSync = false;
+        };
+
         Server()
+            : Server(Config{})
+        {
+        }
+        Server(const Config& config)
+            : _config(config)
+            , _connections(config._game._playerNum)
+            , _spectators(MaxSpectatorNum)
+            , _game(config._game)
+            , _aggregator(config._game._playerNum, config._aggregateMaxWait)
+            , _arbiter(config._game._playerNum, config._inputDeadline, SyncWindowSize)
+            , _desync(config._game._playerNum)
         {
         }
 
@@ -101,31 +256,127 @@ namespace tofu::ball
         void Run();
         void Stop();
 
-        const std::array<std::shared_ptr<ClientConnection>, MaxPlayerNum> GetConnections() const noexcept
+        const std::vector<std::shared_ptr<ClientConnection>>& GetConnections() const noexcept
         {
             return _connections;
         }
 
-        void OnReceiveSyncObject(const message_client_control::SyncPlayerAction& message);
+        // これまでに全クライアントに配ったメッセージ列. 途中から参加したクライアントに送り直す
+        std::span<const std::byte> GetBacklog() const noexcept
+        {
+            return _backlog;
+        }
+
+        std::size_t GetPlayerNum() const noexcept
+        {
+            return _config._game._playerNum;
+        }
+
+        const Config& GetConfig() const noexcept
+        {
+            return _config;
+        }
+
+        // _arbitrateInputs のときは、締め切りに遅れた入力を捨てる
+        void OnReceiveSyncObject(PlayerID player, GameTick tick, const SyncWindow& obj);
+        // 各クライアントの状態のハッシュを突き合わせ、食い違ったら全クライアントに通知する
+        void OnReceiveChecksums(const message_client_control::StateChecksums& message);
+        // _stateSync のとき、peerがtickの状態を全て受け取った
+        void OnReceiveStateAck(std::size_t peer, GameTick tick);
+        // playerが測ったアドバンテージを、それぞれの相手に中継する. 過去の試合の再現には要らないので、_backlogには残さない
+        void OnReceiveFrameAdvantage(PlayerID player, const message_client_control::FrameAdvantageReport& message);
 
     private:
         void UpdateAtLobby();
         void UpdateAtIngame();
+        // 通信スレッドから届いた、試合中の接続と切断を処理する
+        void AcceptConnectionChanges();
+        void OnLateConnect(const std::shared_ptr<net::QuicConnection>& quic);
+        void OnDisconnect(const std::shared_ptr<net::QuicConnection>& quic);
+        // 時計合わせの済んだ途中参加のクライアントを、試合に加える
+        void StartLateJoins();
+        void StartLateJoin(ClientConnection& client);
+        // クライアントが今進めているTickの見積もり
+        GameTick EstimateLiveTick() const;
+        // 接続が切れているプレイヤーの入力を、他のプレイヤーの入力が届いているTickまで空の入力で埋める
+        void FillAbsentInputs();
+        // playerの入力を、untilより前まで空の入力で埋める
+        void FillAbsentInputs(PlayerID player, GameTick until);
+        // 見つかったデシンクを全クライアントに通知する
+        void NotifyDesync(const net::DesyncDetector<MaxPlayerNum>::Desync& desync);
+        // 各クライアントとの遅延から入力遅延を決め直し、変わったら全クライアントに通知する
+        void UpdateInputDelay();
+        // 使うことにした入力を、全クライアントに配る
+        void CommitInput(PlayerID player, GameTick tick, const SyncWindow& obj);
+        // 締め切りを過ぎても届いていない入力を決めて配る
+        void ArbitrateInputs();
+        // まとめ終わった入力を、このフレームに配るメッセージに積む
+        void CollectAggregatedInputs();
+        // このフレームに溜めたメッセージを全クライアントに送る
+        void FlushFanOut();
 
     protected:
         virtual void InitGame();
 
     private:
+        Config _config;
+
         std::unique_ptr<net::QuicServer> _quic;
         std::atomic<bool> _end = false;
 
         State _state = State::Init;
         std::atomic<int> _clientNum = 0;
 
-        std::array<std::shared_ptr<ClientConnection>, MaxPlayerNum> _connections;
+        // 添字はプレイヤーID. 接続が切れても、戻ってくるまでDisconnectedのまま残す
+        std::vector<std::shared_ptr<ClientConnection>> _connections;
+        // 空いている枠はnullptr
+        std::vector<std::shared_ptr<ClientConnection>> _spectators;
         std::mutex _mutexConnection;
+        // 試合中に通信スレッドで接続・切断されたもの. メインスレッドで処理する
+        std::vector<std::shared_ptr<net::QuicConnection>> _lateConnections;
+        std::vector<std::shared_ptr<net::QuicConnection>> _closedConnections;
+
+        // 接続が切れているプレイヤーの代わりに配る入力
+        struct AbsentInputs
+        {
+            // 次に埋めるTick
+            GameTick _next;
+            // 戻ってきたプレイヤーが入力を送り始めるTick. ここまで埋めたら終わる
+            std::optional<GameTick> _until;
+        };
+        std::array<std::optional<AbsentInputs>, MaxPlayerNum> _absent;
 
         Game _game;
+
+        net::InputDelayController _inputDelay{
+            net::InputDelayController::Config{
+                ._tickPeriod = TickPeriod,
+                ._minDelay = MinActionDelay,
+                ._maxDelay = MaxActionDelay,
+                // 入力はSyncWindowSize Tick分まとめて送るので、その分は必ず遅れる
+                ._extraDelay = SyncWindowSize - 1,
+            },
+            ActionDelay };
+        std::optional<GameTick> _lastInputDelayTick;
+
+        // 全クライアントに配るメッセージ. 受け取った入力はここで一度だけエンコードし、フレームの終わりにまとめて送る
+        net::FanOutBuffer _fanOut;
+        // これまでに配ったメッセージ列. 試合の初期状態は人数だけで決まるので、途中から参加したクライアントはこれだけで今の状態を作り直せる
+        std::vector<std::byte> _backlog;
+        // _backlogがMaxBacklogSizeを超えそうになり、残すのをやめた. 途中から参加したクライアントは今の状態を作り直せない
+        bool _backlogFull = false;
+        // _aggregateInputs のとき、受け取った入力をTick範囲ごとにまとめる
+        net::InputAggregator<SyncWindow, MaxPlayerNum> _aggregator;
+        // _arbitrateInputs のとき、入力の締め切りを管理する
+        net::InputArbiter<SyncWindow, MaxPlayerNum> _arbiter;
+
+        net::DesyncDetector<MaxPlayerNum> _desync;
+
+        // サーバーの時計で、最初のTickを始める時刻
+        std::optional<net::ClockSyncEstimator::time_point> _startTime;
+
+        // _stateSync のとき、InitGameで登録する
+        observer_ptr<StateSyncServerSystem> _stateSync = nullptr;
     };
 
 }
@@ -2,8 +2,21 @@
 
 #include <type_traits>
 #include <optional>
+#include <limits>
+#include <span>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <tuple>
+#include <variant>
 
 #include <tofu/net/quic.h>
+#include <tofu/net/fan_out.h>
+#include <tofu/net/framing.h>
+#include <tofu/net/input_codec.h>
+#include <tofu/net/message_dispatch.h>
+#include <tofu/net/wire.h>
 #undef SendMessage
 
 #include <tofu/ball/player.h>
@@ -14,78 +27,266 @@ namespace tofu::ball
 	struct SyncObject
 	{
         actions::Variant _action;
+
+		bool operator==(const SyncObject&) const = default;
 	};
 
 	inline constexpr const char* Alpn = "tofu_ball";
 
-	using PacketSize = std::uint8_t;
+	// 上位2ビットで送り手と経路 (message_server_control, message_client_control, message_datagram) を分け、下位6ビットで種類を表す
 	using MessageType = std::uint8_t;
 
-	struct MessageHeader
+	// メッセージの先頭. net::FrameHeader ([可変長の大きさ][種類 1byte]) の後に、メッセージのwire_schemaの通りに並ぶ
+	//  ストリームで送るメッセージは1フレームに収める. 続きのあるフレームは受け取らない
+	using MessageHeader = net::FrameHeader;
+	// 1メッセージ (ヘッダ込み) の最大の大きさ. 受け取る側はこれより大きなメッセージを壊れているとみなす
+	inline constexpr std::size_t MaxMessageSize = 4096;
+	using PacketBuffer = std::array<std::byte, MaxMessageSize>;
+
+	// streamの先頭のヘッダを読む. まだ全て届いていなければnullopt
+	std::tuple<std::optional<MessageHeader>, tofu::Error> PeekHeader(const std::shared_ptr<net::QuicStream>& stream);
+
+	// 1試合に参加できる最大人数. 実際の人数は試合ごとに Game::Config で決める
+	inline constexpr const int MaxPlayerNum = 16;
+	// 試合の途中から観戦できる最大人数
+	inline constexpr const int MaxSpectatorNum = 8;
+	inline constexpr const int SyncWindowSize = 2;
+	// 1メッセージで送る1プレイヤー分の入力
+	using SyncWindow = std::array<SyncObject, SyncWindowSize>;
+
+	// SyncObjectを詰めるのに使う. 種類はactions::Variantの添字
+	using SyncObjectCodec = net::InputCodec<std::variant_size_v<actions::Variant>>;
+
+	// 目標座標を、エンコードしても変わらない値に丸める
+	//  受け取った側は丸めた値でシミュレーションするので、送る側も自分の入力を丸めてから使うこと
+	SyncObject quantize(const SyncObject& obj) noexcept;
+
+	// windowsを1続きの入力として詰める. 書いたバイト数を返す. outにはEncodedInputs::Capacity以上の大きさが要る
+	std::size_t encode_sync_windows(std::span<const SyncWindow> windows, std::span<std::byte> out) noexcept;
+	// encode_sync_windowsで詰めたものをwindowsの数だけ読む. 壊れていればfalse
+	bool decode_sync_windows(std::span<const std::byte> in, std::span<SyncWindow> windows) noexcept;
+	// objsを1続きの入力として詰める. 書いたバイト数を返す. outにはSyncObjectCodec::MaxBits(objs.size())ビット以上の大きさが要る
+	std::size_t encode_sync_objects(std::span<const SyncObject> objs, std::span<std::byte> out) noexcept;
+	// encode_sync_objectsで詰めたものをobjsの数だけ読む. 壊れていればfalse
+	bool decode_sync_objects(std::span<const std::byte> in, std::span<SyncObject> objs) noexcept;
+
+	// 詰めた入力. 使った分だけを送る
+	template<std::size_t MaxWindows>
+	struct EncodedInputs
 	{
-		PacketSize _packetSize;
-		PacketSize _messageType;
+		static constexpr std::size_t Capacity = (SyncObjectCodec::MaxBits(MaxWindows * SyncWindowSize) + 7) / 8;
+
+		std::uint8_t _size = 0;
+		std::array<std::byte, Capacity> _data;
+
+		using wire_schema = net::WireSchema<net::wire::Bytes<&EncodedInputs::_data, &EncodedInputs::_size>>;
+
+		void Encode(std::span<const SyncWindow> windows) noexcept
+		{
+			assert(windows.size() <= MaxWindows);
+			_size = static_cast<std::uint8_t>(encode_sync_windows(windows, _data));
+		}
+		bool Decode(std::span<SyncWindow> windows) const noexcept
+		{
+			assert(windows.size() <= MaxWindows);
+			if (Capacity < _size)
+				return false;
+			return decode_sync_windows(std::span{ _data }.first(_size), windows);
+		}
 	};
 
-	std::optional<MessageHeader> PeekHeader(const std::shared_ptr<net::QuicStream>& stream);
+	// 状態のハッシュを、この数のTick分まとめて送る
+	inline constexpr std::size_t ChecksumBatchSize = 8;
 
-	inline constexpr const int MaxPlayerNum = 2;
-	inline constexpr const int SyncWindowSize = 2;
+	// プレイヤーごとに1ビット. MaxPlayerNum人分入ること
+	using PlayerMask = std::uint16_t;
+	static_assert(MaxPlayerNum <= std::numeric_limits<PlayerMask>::digits);
 	
+	// messageをヘッダ付きでoutに書く. 書いたバイト数を返す
+	template<class T>
+	std::size_t EncodeMessage(const T& message, std::span<std::byte> out) noexcept
+	{
+		static_assert(net::MaxFrameHeaderSize + T::wire_schema::MaxSize <= MaxMessageSize);
+		assert(net::MaxFrameHeaderSize + T::wire_schema::MaxSize <= out.size());
+
+		// ヘッダの大きさは中身の大きさで変わるので、中身を先に書いてからヘッダの直後に詰める
+		net::WireWriter writer{ out.subspan(net::MaxFrameHeaderSize) };
+		T::wire_schema::Encode(writer, message);
+		assert(!writer.HasOverflowed());
+		auto payload_size = writer.Finish();
+
+		auto header_size = net::WriteFrameHeader(out, T::message_type, payload_size);
+		std::memmove(out.data() + header_size, out.data() + net::MaxFrameHeaderSize, payload_size);
+		return header_size + payload_size;
+	}
+
+	// ヘッダから始まる1メッセージ分のバイト列を読む. 種類や大きさが違ったり、壊れていればnullopt
+	//  DATAGRAMで受け取ったものもこれで読む. 1つのDATAGRAMには1つのメッセージだけを入れる
+	template<class T>
+	std::optional<T> ParseMessage(std::span<const std::byte> bytes)
+	{
+		MessageHeader header;
+		if (net::ParseFrameHeader(bytes, header) != net::FrameStatus::Complete
+			|| header._type != T::message_type
+			|| header._more
+			|| header.FrameSize() != bytes.size())
+			return std::nullopt;
+
+		T message;
+		if (!net::wire_decode(bytes.subspan(header._headerSize), message))
+			return std::nullopt;
+		return message;
+	}
+
+	// streamの先頭のsizeバイト. 受信バッファの上でそのまま見る. バッファの終わりで折り返しているときだけcopiedにコピーする
+	//  streamをSeekするまで有効
+	inline std::span<const std::byte> PeekPacket(const std::shared_ptr<net::QuicStream>& stream, std::size_t size, PacketBuffer& copied)
+	{
+		auto bytes = stream->PeekContiguous(size);
+		if (!bytes.empty())
+			return bytes;
+		stream->Peek(copied.data(), size);
+		return std::span{ copied }.first(size);
+	}
+
 	template<class T> 
 	std::tuple<std::optional<T>, tofu::Error> ReadMessage(const std::shared_ptr<net::QuicStream>& stream)
 	{
-		// シリアライズせずバイト列をそのまま通信してるので、トリビアルコピー可能な型でなければ安全に送受信できない
-		static_assert(std::is_trivially_copyable_v<T>);
-
-        auto header = PeekHeader(stream);
+        auto [header, error] = PeekHeader(stream);
+        if (error)
+			return { std::nullopt, error };
         if (!header)
 			return { std::nullopt, std::nullopt };
 
-        if (header->_messageType != T::message_type)
+        if (header->_type != T::message_type)
         {
-			return { std::nullopt, TOFU_MAKE_ERROR("Received invalid message. type=({})", header->_messageType) };
+			return { std::nullopt, TOFU_MAKE_ERROR("Received invalid message. type=({})", header->_type) };
         }
 
-        if (stream->ReceivedSize() < header->_packetSize)
+        if (header->_more || MaxMessageSize < header->FrameSize())
+        {
+			return { std::nullopt, TOFU_MAKE_ERROR("Received too large message. type=({}), size=({})", header->_type, header->FrameSize()) };
+        }
+
+        if (stream->ReceivedSize() < header->FrameSize())
 			return { std::nullopt, std::nullopt };
 
-        T message;
-        stream->Read(reinterpret_cast<std::byte*>(&message), sizeof(message));
+		PacketBuffer copied;
+		auto message = ParseMessage<T>(PeekPacket(stream, header->FrameSize(), copied));
+		stream->Seek(header->FrameSize());
 
+		if (!message)
+		{
+			return { std::nullopt, TOFU_MAKE_ERROR("Received broken message. type=({}), size=({})", header->_type, header->FrameSize()) };
+		}
 		return { message, std::nullopt };
 	}
 
 	template<class T> 
 	void SendMessage(const std::shared_ptr<net::QuicStream>& stream, const T& message)
 	{
-		// シリアライズせずバイト列をそのまま通信してるので、トリビアルコピー可能な型でなければ安全に送受信できない
-		static_assert(std::is_trivially_copyable_v<T>);
-		
-        stream->Send(reinterpret_cast<const std::byte*>(&message), sizeof(message));
+		PacketBuffer buffer;
+		auto size = EncodeMessage(message, buffer);
+        stream->Send(buffer.data(), size);
+	}
+
+	// DATAGRAMで送る. 届かないことも、順番が入れ替わることもある
+	template<class T>
+	void SendDatagram(const std::shared_ptr<net::QuicConnection>& quic, const T& message)
+	{
+		PacketBuffer buffer;
+		auto size = EncodeMessage(message, buffer);
+		quic->SendUnreliable(buffer.data(), size);
+	}
+
+	// 全クライアントに配るメッセージ列の後ろに積む
+	template<class T>
+	void AppendMessage(net::FanOutBuffer& out, const T& message)
+	{
+		PacketBuffer buffer;
+		auto size = EncodeMessage(message, buffer);
+		out.AppendBytes(std::span{ buffer }.first(size));
 	}
 
+	// streamの先頭に全て届いているメッセージを1つ読み、TDispatcher (net::MessageDispatcher) の表からhandlerに渡す. 渡せたらtrue
+	//  まだ届いていなければfalse. 表に無い種類や壊れたメッセージはエラーにして、読み飛ばさない
+	//  handlerがfalseを返したら、そのメッセージは読んだことにしてfalseを返す
+	template<class TDispatcher, class THandler>
+	std::tuple<bool, tofu::Error> DispatchMessage(const std::shared_ptr<net::QuicStream>& stream, THandler& handler)
+	{
+		auto [header, error] = PeekHeader(stream);
+		if (error)
+			return { false, error };
+		if (!header)
+			return { false, std::nullopt };
+		if (!TDispatcher::Contains(header->_type))
+			return { false, TOFU_MAKE_ERROR("Received unknown message. type=({})", header->_type) };
+		if (header->_more || MaxMessageSize < header->FrameSize())
+			return { false, TOFU_MAKE_ERROR("Received too large message. type=({}), size=({})", header->_type, header->FrameSize()) };
+		if (stream->ReceivedSize() < header->FrameSize())
+			return { false, std::nullopt };
+
+		PacketBuffer copied;
+		auto bytes = PeekPacket(stream, header->FrameSize(), copied);
+		auto result = TDispatcher::Dispatch(header->_type, bytes.subspan(header->_headerSize), handler);
+		if (result == net::DispatchResult::Broken)
+			return { false, TOFU_MAKE_ERROR("Received broken message. type=({}), size=({})", header->_type, header->FrameSize()) };
+
+		stream->Seek(header->FrameSize());
+		return { result == net::DispatchResult::Dispatched, std::nullopt };
+	}
+
+	// streamに全て届いているメッセージを、届いている分だけ読んでhandlerに渡す. 渡した数を返す
+	//  エラーになるか、handlerがfalseを返したらそこで止める
+	template<class TDispatcher, class THandler>
+	std::tuple<std::size_t, tofu::Error> DispatchMessages(const std::shared_ptr<net::QuicStream>& stream, THandler& handler)
+	{
+		std::size_t count = 0;
+		while (true)
+		{
+			auto [dispatched, error] = DispatchMessage<TDispatcher>(stream, handler);
+			if (!dispatched)
+				return { count, error };
+			count++;
+		}
+	}
+
+	// エンコード済みのメッセージ列をそのまま送る
+	inline void SendMessage(const std::shared_ptr<net::QuicStream>& stream, std::span<const std::byte> messages)
+	{
+		stream->Send(messages.data(), messages.size());
+	}
+
+	// サーバーが受け取ったメッセージを処理して配る間隔. 中継される入力は、届いてから平均でこの半分だけ待たされる
+	inline constexpr std::chrono::milliseconds ServerUpdateInterval{ 10 };
+	// FrameAdvantageReportで送るアドバンテージの単位 (1/AdvantageScale Tick)
+	inline constexpr float AdvantageScale = 256.0f;
+	// クライアントはこの間隔で、他のプレイヤーに対するアドバンテージを報告する
+	inline constexpr std::uint32_t AdvantageReportInterval = 30;
+
 	// サーバーがクライアントに投げる操作メッセージ (Reliable)
 	inline constexpr net::StreamId ServerControlStreamId = 1;
 	namespace message_server_control
 	{
-		inline constexpr const MessageType MessageTypeBase = 0b00'0000000;
+		inline constexpr const MessageType MessageTypeBase = 0b00'000000;
 		// 参加を許可
 		struct ApproveJoin
 		{
 			static constexpr MessageType message_type = MessageTypeBase | 0x01;
 
-			const MessageHeader _header = { sizeof(ApproveJoin), message_type };
-			const std::uint8_t _messageType = MessageTypeBase | 0x01;
-			std::uint8_t _playerId; // プレイヤーIDを通知
+			std::uint8_t _playerId; // プレイヤーIDを通知. 観戦者はSpectatorPlayerId
+
+			using wire_schema = net::WireSchema<net::wire::Fixed<&ApproveJoin::_playerId>>;
 		};
+		// 空いているプレイヤーの枠が無いときは、観戦者として参加させる. PlayerIDとして読むと-1になる
+		inline constexpr std::uint8_t SpectatorPlayerId = 0xFF;
 
 		// 参加を拒絶。これを投げたら or 受け取ったら切断する
 		struct RejectJoin
 		{
 			static constexpr MessageType message_type = MessageTypeBase | 0x02;
 
-			const MessageHeader _header = { sizeof(RejectJoin), message_type };
+			using wire_schema = net::WireSchema<>;
 		};
 
 		// ゲーム終了
@@ -98,66 +299,391 @@ namespace tofu::ball
 				DisconnectClient,
 			};
 
-			const MessageHeader _header = { sizeof(CloseServer), message_type };
 			Reason _reason;
+
+			using wire_schema = net::WireSchema<net::wire::Fixed<&CloseServer::_reason>>;
 		};
 
 		// ゲームをはじめる
+		//  参加者の情報は、これより前に人数分のPlayerInfoで送る
 		struct StartGame
 		{
 			static constexpr MessageType message_type = MessageTypeBase | 0x04;
-			struct MemberInfo
-			{
-				PlayerID::value_type _id;
-				char _name[30];
-			};
-
-			const MessageHeader _header = { sizeof(StartGame), message_type };
 
 			std::uint8_t _playerNum;
-			MemberInfo _members[MaxPlayerNum];
+			// 入力をDATAGRAMで送る (message_datagram::PlayerInputs)
+			bool _datagramInputs;
+			// 締め切りまでに届かなかった入力はサーバーが決める. 自分の入力も、サーバーから返ってきたものを使う
+			bool _arbitratedInputs;
+			// サーバーが状態を決めて配る (message_datagram::WorldState). 入力はサーバーにだけ送り、他のプレイヤーの入力は届かない
+			bool _stateSync;
+			// 最初のTickを始める時刻. 受け取るクライアントの時計で、1970年からのマイクロ秒
+			//  全員がこの時刻から数え始めるので、同じ位相でTickが進む
+			std::int64_t _startTime;
+			// 自分の入力を送り始めるTick. それより前の自分の入力は、サーバーが空の入力で埋めて配る
+			GameTick _firstInputTick;
+			// 途中から参加したとき、これまでに配られたメッセージ列の大きさ. CatchUpStreamIdのストリームで区切って届く
+			std::uint32_t _catchUpSize;
+
+			using wire_schema = net::WireSchema<
+				net::wire::Fixed<&StartGame::_playerNum>,
+				net::wire::Bits<&StartGame::_datagramInputs, 1>,
+				net::wire::Bits<&StartGame::_arbitratedInputs, 1>,
+				net::wire::Bits<&StartGame::_stateSync, 1>,
+				net::wire::Fixed<&StartGame::_startTime>,
+				net::wire::Var<&StartGame::_firstInputTick>,
+				net::wire::Var<&StartGame::_catchUpSize>>;
+		};
+
+		// 参加者1人分の情報
+		//  人数が増えても1メッセージがMaxMessageSizeに収まるよう、1人ずつ送る
+		struct PlayerInfo
+		{
+			static constexpr MessageType message_type = MessageTypeBase | 0x07;
+
+			PlayerID::value_type _id;
+			char _name[30];
+
+			using wire_schema = net::WireSchema<net::wire::Fixed<&PlayerInfo::_id>, net::wire::String<&PlayerInfo::_name>>;
 		};
 
 		// プレイヤーアクション情報をクライアントに伝える
+		//  入力は詰めて送るので、SetInputs / GetInputs で読み書きすること
 		struct SyncPlayerAction
 		{
 			static constexpr MessageType message_type = MessageTypeBase | 0x05;
-			const MessageHeader _header = { sizeof(SyncPlayerAction), message_type };
 
 			PlayerID _player;
 			GameTick _tick;
-			std::array<SyncObject, SyncWindowSize> _obj;
+			EncodedInputs<1> _obj;
+
+			void SetInputs(const SyncWindow& obj) noexcept
+			{
+				_obj.Encode({ &obj, 1 });
+			}
+			std::optional<SyncWindow> GetInputs() const noexcept
+			{
+				SyncWindow obj;
+				if (!_obj.Decode({ &obj, 1 }))
+					return std::nullopt;
+				return obj;
+			}
+
+			using wire_schema = net::WireSchema<
+				net::wire::Fixed<&SyncPlayerAction::_player>,
+				net::wire::Var<&SyncPlayerAction::_tick>,
+				net::wire::Nested<&SyncPlayerAction::_obj>>;
+		};
+
+		// 入力遅延の変更を通知する. 全クライアントが_tickから_delayに切り替える
+		struct ChangeInputDelay
+		{
+			static constexpr MessageType message_type = MessageTypeBase | 0x06;
+
+			GameTick _tick;
+			std::uint8_t _delay;
+
+			using wire_schema = net::WireSchema<net::wire::Var<&ChangeInputDelay::_tick>, net::wire::Fixed<&ChangeInputDelay::_delay>>;
+		};
+
+		// 同じTick範囲の、複数プレイヤーの入力をまとめたもの. 入力をまとめて配るモードのとき、SyncPlayerActionの代わりに送る
+		//  _playersのビットが立っているプレイヤーの入力だけをID順に1続きに詰め、詰めた分だけを送る
+		//  詰めれば最大人数分でもMaxMessageSizeに収まる
+		struct SyncTickActions
+		{
+			static constexpr MessageType message_type = MessageTypeBase | 0x08;
+
+			GameTick _tick;
+			PlayerMask _players = 0;
+			EncodedInputs<MaxPlayerNum> _obj;
+
+			// inputsは_playersのビットが立っているプレイヤーの入力をID順に並べたもの
+			void SetInputs(PlayerMask players, std::span<const SyncWindow> inputs) noexcept
+			{
+				_players = players;
+				assert(Count() == inputs.size());
+				_obj.Encode(inputs);
+			}
+			// inputsにはCount()個の入力が入る. 壊れていればfalse
+			bool GetInputs(std::span<SyncWindow> inputs) const noexcept
+			{
+				assert(Count() == inputs.size());
+				return _obj.Decode(inputs);
+			}
+
+			std::size_t Count() const noexcept
+			{
+				return static_cast<std::size_t>(std::popcount(_players));
+			}
+
+			using wire_schema = net::WireSchema<
+				net::wire::Var<&SyncTickActions::_tick>,
+				net::wire::Fixed<&SyncTickActions::_players>,
+				net::wire::Nested<&SyncTickActions::_obj>>;
+		};
+
+		// 同期のずれ(デシンク)を検出した. _playersは、IDが最も小さいプレイヤーと_tickの状態が食い違っていたプレイヤー
+		struct DesyncDetected
+		{
+			static constexpr MessageType message_type = MessageTypeBase | 0x09;
+
+			PlayerMask _players;
+			GameTick _tick;
+
+			using wire_schema = net::WireSchema<net::wire::Fixed<&DesyncDetected::_players>, net::wire::Var<&DesyncDetected::_tick>>;
 		};
+
+		// 時計合わせの要求. 受け取ったらすぐClockSyncResponseを返す
+		struct ClockSyncRequest
+		{
+			static constexpr MessageType message_type = MessageTypeBase | 0x0A;
+
+			// サーバーの時計で送った時刻 (1970年からのマイクロ秒)
+			std::int64_t _sendTime;
+
+			using wire_schema = net::WireSchema<net::wire::Fixed<&ClockSyncRequest::_sendTime>>;
+		};
+
+		// _playerが測った、受け取ったクライアントに対する_playerのアドバンテージ (1/AdvantageScale Tick単位)
+		//  message_client_control::FrameAdvantageReportから、受け取るクライアントの分だけを中継する
+		struct FrameAdvantageReport
+		{
+			static constexpr MessageType message_type = MessageTypeBase | 0x0B;
+
+			PlayerID _player;
+			std::int16_t _advantage = 0;
+
+			using wire_schema = net::WireSchema<net::wire::Fixed<&FrameAdvantageReport::_player>, net::wire::Var<&FrameAdvantageReport::_advantage>>;
+		};
+
+		// 試合中にクライアントが受け取るもの
+		using IngameMessages = net::MessageDispatcher<SyncPlayerAction, SyncTickActions, ClockSyncRequest, DesyncDetected, ChangeInputDelay, FrameAdvantageReport>;
 	}
 
+	// 途中から参加したクライアントに、それまでに配ったメッセージ列をそのまま送る (Reliable, サーバーからの片方向)
+	//  区切って送り、クライアントが読んだ量を返す(CatchUpProgress)までCatchUpWindowSizeより先は送らない
+	inline constexpr net::StreamId CatchUpStreamId = 3;
+	inline constexpr std::size_t CatchUpChunkSize = 16 * 1024;
+	inline constexpr std::size_t CatchUpWindowSize = 64 * 1024;
+
 	// クライアントがサーバーに投げる操作メッセージ (Reliable)
 	inline constexpr net::StreamId ClientControlStreamId = 2;
 	namespace message_client_control
 	{
-		inline constexpr const MessageType MessageTypeBase = 0b01'0000000;
+		inline constexpr const MessageType MessageTypeBase = 0b01'000000;
 
 		// 部屋に参加することを要請する。 接続したらまずこれを投げる
 		struct RequestJoin
 		{
 			static constexpr MessageType message_type = MessageTypeBase | 0x01;
 
-			const MessageHeader _header = { sizeof(RequestJoin), message_type };
 			char _userName[30];
+
+			using wire_schema = net::WireSchema<net::wire::String<&RequestJoin::_userName>>;
 		};
-		// 32byteになってるか不安
-		static_assert(sizeof(RequestJoin) == 32);
 
 		// 自分のアクション情報をサーバーに伝える
+		//  入力は詰めて送るので、SetInputs / GetInputs で読み書きすること
 		struct SyncPlayerAction
 		{
 			static constexpr MessageType message_type = MessageTypeBase | 0x02;
-			const MessageHeader _header = { sizeof(SyncPlayerAction), message_type };
 
 			PlayerID _player;
 			GameTick _tick;
-			std::array<SyncObject, SyncWindowSize> _obj;
+			EncodedInputs<1> _obj;
+
+			void SetInputs(const SyncWindow& obj) noexcept
+			{
+				_obj.Encode({ &obj, 1 });
+			}
+			std::optional<SyncWindow> GetInputs() const noexcept
+			{
+				SyncWindow obj;
+				if (!_obj.Decode({ &obj, 1 }))
+					return std::nullopt;
+				return obj;
+			}
+
+			using wire_schema = net::WireSchema<
+				net::wire::Fixed<&SyncPlayerAction::_player>,
+				net::wire::Var<&SyncPlayerAction::_tick>,
+				net::wire::Nested<&SyncPlayerAction::_obj>>;
 		};
 
+		// 確定したTickの状態のハッシュを伝える. _tickから連続した_count Tick分
+		struct StateChecksums
+		{
+			static constexpr MessageType message_type = MessageTypeBase | 0x03;
+
+			PlayerID _player;
+			std::uint8_t _count;
+			GameTick _tick;
+			std::array<std::uint64_t, ChecksumBatchSize> _hashes;
+
+			using wire_schema = net::WireSchema<
+				net::wire::Fixed<&StateChecksums::_player>,
+				net::wire::Fixed<&StateChecksums::_count>,
+				net::wire::Var<&StateChecksums::_tick>,
+				net::wire::Array<&StateChecksums::_hashes, &StateChecksums::_count>>;
+		};
+
+		// 時計合わせの応答. 時刻はどれも1970年からのマイクロ秒
+		struct ClockSyncResponse
+		{
+			static constexpr MessageType message_type = MessageTypeBase | 0x04;
+
+			// ClockSyncRequest::_sendTime をそのまま返す
+			std::int64_t _requestTime;
+			// クライアントの時計で、要求を受け取った時刻と応答を送った時刻
+			std::int64_t _receiveTime;
+			std::int64_t _sendTime;
+
+			using wire_schema = net::WireSchema<
+				net::wire::Fixed<&ClockSyncResponse::_requestTime>,
+				net::wire::Fixed<&ClockSyncResponse::_receiveTime>,
+				net::wire::Fixed<&ClockSyncResponse::_sendTime>>;
+		};
+
+		// 途中から参加したときに、CatchUpStreamIdのストリームで届いたものを先頭から_receivedバイト読んだ
+		struct CatchUpProgress
+		{
+			static constexpr MessageType message_type = MessageTypeBase | 0x05;
+
+			std::uint32_t _received;
+
+			using wire_schema = net::WireSchema<net::wire::Var<&CatchUpProgress::_received>>;
+		};
+
+		// 他のプレイヤーに対する自分のアドバンテージ (1/AdvantageScale Tick単位) を伝える
+		//  _advantagesはID順に_count人分. _measuredのビットが立っていないプレイヤーの分は、まだ測れていないので0
+		struct FrameAdvantageReport
+		{
+			static constexpr MessageType message_type = MessageTypeBase | 0x06;
+
+			PlayerMask _measured = 0;
+			std::uint8_t _count = 0;
+			std::array<std::int16_t, MaxPlayerNum> _advantages{};
+
+			using wire_schema = net::WireSchema<
+				net::wire::Fixed<&FrameAdvantageReport::_measured>,
+				net::wire::Fixed<&FrameAdvantageReport::_count>,
+				net::wire::Array<&FrameAdvantageReport::_advantages, &FrameAdvantageReport::_count>>;
+		};
+
+		// 試合中にサーバーが受け取るもの
+		using IngameMessages = net::MessageDispatcher<SyncPlayerAction, StateChecksums, ClockSyncResponse, CatchUpProgress, FrameAdvantageReport>;
+	}
+
+	// DATAGRAMで送るメッセージ (Unreliable)
+	//  落ちても、順番が入れ替わってもよいものだけを送る
+	namespace message_datagram
+	{
+		inline constexpr const MessageType MessageTypeBase = 0b10'000000;
+
+		// 1つのDATAGRAMに載せる入力の最大数
+		inline constexpr std::size_t MaxInputRedundancy = 8;
+		// 損失がなくても載せる入力の数. 1つ落ちても次のDATAGRAMで届く
+		inline constexpr std::size_t MinInputRedundancy = 2;
+
+		// クライアントがサーバーに送る、自分の入力のうちACKされていないものの新しい方からいくつか
+		//  _tickから始まる連続した_count個の入力を詰めて送る. 送るのは詰めた分だけ
+		struct PlayerInputs
+		{
+			static constexpr MessageType message_type = MessageTypeBase | 0x01;
+
+			PlayerID _player;
+			std::uint8_t _count = 0;
+			// 損失率を推定するための通し番号
+			std::uint32_t _seq;
+			GameTick _tick;
+			EncodedInputs<MaxInputRedundancy> _obj;
+
+			void SetInputs(std::span<const SyncWindow> inputs) noexcept
+			{
+				assert(inputs.size() <= MaxInputRedundancy);
+				_count = static_cast<std::uint8_t>(inputs.size());
+				_obj.Encode(inputs);
+			}
+			// inputsには_count個の入力が入る. 壊れていればfalse
+			bool GetInputs(std::span<SyncWindow> inputs) const noexcept
+			{
+				assert(_count <= inputs.size());
+				return _obj.Decode(inputs.first(_count));
+			}
+
+			using wire_schema = net::WireSchema<
+				net::wire::Fixed<&PlayerInputs::_player>,
+				net::wire::Fixed<&PlayerInputs::_count>,
+				net::wire::Var<&PlayerInputs::_seq>,
+				net::wire::Var<&PlayerInputs::_tick>,
+				net::wire::Nested<&PlayerInputs::_obj>>;
+		};
+
+		// サーバーがクライアントに返す、入力の受け取り状況
+		struct InputAck
+		{
+			static constexpr MessageType message_type = MessageTypeBase | 0x02;
+
+			// 受け取ったDATAGRAMの損失率 (1/255単位)
+			std::uint8_t _lossRate;
+			// これより前のTickの入力は全て受け取った
+			GameTick _nextTick;
+
+			using wire_schema = net::WireSchema<net::wire::Fixed<&InputAck::_lossRate>, net::wire::Var<&InputAck::_nextTick>>;
+		};
+
+		// サーバーがクライアントに配る、_tickのゲーム世界の状態のうち[_first, _first + _count)のエンティティ
+		//  _hasBaseなら、クライアントがACKした_baseTickの状態からの差分. 1つのDATAGRAMに収まらない分は、範囲を分けて送る
+		//  エンティティの並びと詰め方は state_sync.h を参照. 送るのは詰めた分だけ
+		struct WorldState
+		{
+			static constexpr MessageType message_type = MessageTypeBase | 0x03;
+			// 1つのDATAGRAMに載る大きさ. _sizeの1byteにも収まる
+			static constexpr std::size_t Capacity = 236;
+
+			GameTick _tick;
+			GameTick _baseTick;
+			bool _hasBase = false;
+			// フレーム全体のエンティティ数
+			std::uint8_t _entityCount = 0;
+			std::uint8_t _first = 0;
+			std::uint8_t _count = 0;
+			std::uint8_t _size = 0;
+			std::array<std::byte, Capacity> _data;
+
+			void SetData(std::size_t first, std::size_t count, std::size_t size) noexcept
+			{
+				assert(size <= Capacity);
+				_first = static_cast<std::uint8_t>(first);
+				_count = static_cast<std::uint8_t>(count);
+				_size = static_cast<std::uint8_t>(size);
+			}
+			// 詰めた部分
+			std::span<const std::byte> GetData() const noexcept
+			{
+				return std::span{ _data }.first(_size);
+			}
+
+			using wire_schema = net::WireSchema<
+				net::wire::Var<&WorldState::_tick>,
+				net::wire::Var<&WorldState::_baseTick>,
+				net::wire::Bits<&WorldState::_hasBase, 1>,
+				net::wire::Fixed<&WorldState::_entityCount>,
+				net::wire::Fixed<&WorldState::_first>,
+				net::wire::Fixed<&WorldState::_count>,
+				net::wire::Bytes<&WorldState::_data, &WorldState::_size>>;
+		};
+
+		// クライアントがサーバーに返す、全て揃ったWorldStateのうち最も新しいTick
+		//  サーバーはこれを次からの差分の基準にする
+		struct WorldStateAck
+		{
+			static constexpr MessageType message_type = MessageTypeBase | 0x04;
+
+			GameTick _tick;
+
+			using wire_schema = net::WireSchema<net::wire::Var<&WorldStateAck::_tick>>;
+		};
 	}
 
 }
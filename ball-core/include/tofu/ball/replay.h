@@ -0,0 +1,106 @@
+﻿#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <type_traits>
+
+#include <tofu/utils.h>
+#include <tofu/utils/error.h>
+#include <tofu/utils/background_file_writer.h>
+#include <tofu/utils/mapped_file.h>
+
+#include <tofu/ecs/core.h>
+
+#include "tofu/ball/game.h"
+#include "tofu/ball/network.h"
+
+namespace tofu::ball
+{
+    // リプレイファイル
+    //  ReplayHeaderの後に、Tick 1から順に1Tick分ずつ全員の入力が続く
+    //  1Tick分は [大きさ(1バイト)][SyncObjectCodecで全員分を詰めたもの]
+    //  ゲームに乱数はなく、初期状態は人数だけで決まるので、これだけで試合を再現できる
+    inline constexpr std::array<char, 8> ReplayMagic{ 'T', 'O', 'F', 'U', 'R', 'P', 'L', '\0' };
+    inline constexpr std::uint16_t ReplayVersion = 1;
+
+    struct ReplayHeader
+    {
+        std::array<char, 8> _magic = ReplayMagic;
+        std::uint16_t _version = ReplayVersion;
+        // 記録したときの同期方式(SyncMode). 記録するのは確定した入力なので、再生はどれでも完全同期で行う
+        //  ロールバック方式なら、記録したときと同じく毎Tickワールドを作り直しながら進める
+        std::uint8_t _syncMode = 0;
+        std::uint8_t _playerNum = 0;
+        // 記録したときの1Tickの長さ(us)
+        std::uint32_t _tickPeriod = 0;
+    };
+    static_assert(std::is_trivially_copyable_v<ReplayHeader>);
+
+    // 1Tick分の入力を詰めたものの最大の大きさ
+    inline constexpr std::size_t ReplayRecordCapacity = (SyncObjectCodec::MaxBits(MaxPlayerNum) + 7) / 8;
+    static_assert(ReplayRecordCapacity <= UINT8_MAX);
+
+    // 毎Tick、シミュレーションに使った全員の入力をリプレイファイルに追記する
+    //  ファイルへの書き込みは別スレッドで行うので、ゲームスレッドは止まらない
+    class ReplayRecorder
+    {
+    public:
+        Error Open(const std::string& path, const Game::Config& config);
+
+        // tickの全員の入力を記録する. Tick 1から1つずつ順に呼ぶこと
+        void Record(GameTick tick, std::span<const SyncObject> inputs);
+
+    private:
+        BackgroundFileWriter _writer;
+        GameTick _nextTick = 1;
+    };
+
+    // リプレイファイルを通信なしで、できるだけ速く再シミュレーションする
+    class ReplayPlayer
+    {
+    public:
+        Error Open(const std::string& path);
+
+        // 最後のTickまで再シミュレーションする. 記録が壊れていればエラー
+        //  書き込み中に落ちて最後のTickが途中で切れていたら、その手前で止める
+        Error Run();
+
+        const ReplayHeader& GetHeader() const noexcept
+        {
+            return _header;
+        }
+        // 再シミュレーションしたTick数
+        std::uint32_t GetTickCount() const noexcept
+        {
+            return _tickCount;
+        }
+        // 最後のTickが途中で切れていたか
+        bool IsTruncated() const noexcept
+        {
+            return _truncated;
+        }
+        std::chrono::steady_clock::duration GetElapsed() const noexcept
+        {
+            return _elapsed;
+        }
+        // 最後のTickを終えた状態のハッシュ. 記録したピアのハッシュと比べれば、再現できたか分かる
+        std::uint64_t GetChecksum() const noexcept
+        {
+            return _checksum;
+        }
+
+    private:
+        MappedFile _file;
+        ReplayHeader _header;
+        std::unique_ptr<Game> _game;
+
+        std::uint32_t _tickCount = 0;
+        bool _truncated = false;
+        std::chrono::steady_clock::duration _elapsed{};
+        std::uint64_t _checksum = 0;
+    };
+}
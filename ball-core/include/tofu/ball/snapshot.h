@@ -0,0 +1,20 @@
+﻿#pragma once
+
+#include <entt/entt.hpp>
+
+#include <tofu/utils.h>
+#include <tofu/utils/error.h>
+#include <tofu/utils/snapshot_buffer.h>
+
+namespace tofu::ball
+{
+    // ゲーム世界の状態(Tick, ゲームのコンポーネント, box2dの状態)をbufferに書き込む
+    //  bufferはClearしてから書き込むので、同じバッファを使い回せば毎Tickの確保は起きない
+    void save_world_snapshot(observer_ptr<ServiceLocator> service_locator, observer_ptr<entt::registry> registry, SnapshotBuffer& buffer);
+    // save_world_snapshotで保存した状態に戻す
+    //  エンティティの構成が保存時と変わっていないこと
+    Error load_world_snapshot(observer_ptr<ServiceLocator> service_locator, observer_ptr<entt::registry> registry, const SnapshotBuffer& buffer);
+
+    // ゲーム世界の状態(Tick, Transform, box2dの剛体)のハッシュ. 全ピアで同じTickの値が一致していなければ、同期がずれている
+    std::uint64_t compute_world_checksum(observer_ptr<ServiceLocator> service_locator, observer_ptr<entt::registry> registry);
+}
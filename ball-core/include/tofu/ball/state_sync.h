@@ -0,0 +1,200 @@
+﻿#pragma once
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+
+#include <entt/entt.hpp>
+
+#include <tofu/utils.h>
+#include <tofu/containers/concurrent_queue.h>
+#include <tofu/net/quic.h>
+#include <tofu/net/state_delta.h>
+#include <tofu/net/state_replication.h>
+
+#include <tofu/ecs/core.h>
+
+#include "tofu/ball/game.h"
+#include "tofu/ball/network.h"
+#include "tofu/ball/sync.h"
+
+namespace tofu::ball
+{
+    // 状態を配るエンティティの数. プレイヤーのID順に並べ、最後にボールを置く
+    inline constexpr std::size_t MaxStateEntities = MaxPlayerNum + 1;
+    // 1エンティティの状態. 位置x, y, 角度, 速度x, y, 角速度
+    inline constexpr std::size_t StateFieldCount = 6;
+    // 状態は1/StateScale単位の整数に丸めて送る
+    inline constexpr float StateScale = 1000.0f;
+    // 差分の基準として、送った(受け取った)状態を保持するTick数
+    inline constexpr std::uint32_t StateHistorySize = 32;
+    // 他のエンティティは、届いた最新の状態よりこれだけ前を補間して表示する. 1, 2個落ちても補間を続けられる
+    inline constexpr double StateInterpolationTicks = 2;
+    // 自分のプレイヤーの予測がサーバーの状態とこれ以上(丸めた単位で)ずれていたら直す
+    inline constexpr std::int32_t StateCorrectionThreshold = 10;
+    // 受信してからゲームスレッドで処理されるまで溜めておけるメッセージの数
+    inline constexpr std::size_t StateMessageQueueSize = 64;
+    // 状態を配る相手の数. プレイヤーはIDを、観戦者はMaxPlayerNumからの通し番号を、相手の番号にする
+    inline constexpr std::size_t MaxStatePeers = MaxPlayerNum + MaxSpectatorNum;
+
+    using StateFrame = net::StateFrame<StateFieldCount, MaxStateEntities>;
+    using StateCodec = net::StateDeltaCodec<StateFieldCount, MaxStateEntities>;
+    static_assert(StateCodec::MaxEntityBits <= message_datagram::WorldState::Capacity * 8);
+
+    // 状態を配るエンティティをentitiesに並べ、その数を返す
+    std::size_t collect_state_entities(observer_ptr<entt::registry> registry, std::span<entt::entity, MaxStateEntities> entities);
+    // entityの今の状態を丸めたもの
+    StateFrame::Fields capture_state(observer_ptr<entt::registry> registry, entt::entity entity);
+    // 今のゲーム世界の状態を丸めてframeに書く. _tickは書かない
+    void capture_state(observer_ptr<entt::registry> registry, StateFrame& frame);
+    // entityの状態を、丸めたfieldsに置き換える
+    void apply_state(observer_ptr<entt::registry> registry, entt::entity entity, const StateFrame::Fields& fields);
+
+    // サーバーが状態を決めるときの、サーバー側のシステム
+    //  クライアントから届いた入力をSyncSystemに詰め、毎Tickシミュレーションした状態を各クライアントにDATAGRAMで配る
+    //  状態は、クライアントがACKした状態からの差分だけを送る. ACKが無ければ全体を送る
+    class StateSyncServerSystem
+    {
+        struct InputMessage
+        {
+            PlayerID _player;
+            GameTick _tick;
+            SyncWindow _obj;
+        };
+
+    public:
+        StateSyncServerSystem(observer_ptr<ServiceLocator> service_locator, observer_ptr<entt::registry> registry);
+
+        // gameに登録する. gameはinitBaseSystems済みで、SyncMode::ServerAuthoritativeであること
+        static observer_ptr<StateSyncServerSystem> Attach(Game& game);
+
+        // 状態を配る相手. 試合の途中で加えても、外してもよい
+        //  同じ番号の相手が入れ替わったら、差分の基準にできるものは無いので全体から送る
+        void AddPeer(std::size_t peer, const std::shared_ptr<net::QuicConnection>& quic);
+        void RemovePeer(std::size_t peer);
+
+        // 通信スレッドから呼ぶ. playerの_tickからの入力
+        void Receive(PlayerID player, GameTick tick, const SyncWindow& obj);
+        // 通信スレッドから呼ぶ. peerがtickの状態を全て受け取った
+        void Ack(std::size_t peer, GameTick tick);
+
+        // 届いた入力をSyncSystemに詰める. 遅れて届いた入力は今Tickの入力として使う
+        void ApplyInputs();
+        // 今Tickの状態を各クライアントに配る
+        void Broadcast();
+
+    private:
+        observer_ptr<ServiceLocator> _serviceLocator;
+        observer_ptr<entt::registry> _registry;
+
+        // 通信スレッドが加え・外し、ゲームスレッドが配るときに読む
+        std::array<std::shared_ptr<net::QuicConnection>, MaxStatePeers> _peers;
+        std::mutex _mutexPeers;
+        // 入力は落とせないので、ゲームスレッドが詰まっていたら溢れさせて通信スレッドは待たない
+        OverflowQueue<SpscQueue<InputMessage, SyncMessageQueueSize>> _inputQueue;
+
+        // ゲームスレッドが書き込み、通信スレッドがACKを書き込む
+        net::StateBaselines<StateFrame, StateHistorySize, MaxStatePeers> _baselines;
+    };
+
+    // サーバーが状態を決めるときの、クライアント側のシステム
+    //  自分のプレイヤーは自分の入力で先に進め(予測)、サーバーの状態とずれていたら直す
+    //  他のエンティティは、届いた状態を少し遅らせて補間したものに置き換える
+    class StateSyncClientSystem
+    {
+        // 自分のプレイヤーを予測で進めた結果
+        struct Prediction
+        {
+            GameTick _tick;
+            StateFrame::Fields _fields;
+        };
+
+    public:
+        StateSyncClientSystem(observer_ptr<ServiceLocator> service_locator, observer_ptr<entt::registry> registry, const std::shared_ptr<net::QuicConnection>& quic, PlayerID my_id);
+
+        // gameに登録する. gameはinitBaseSystems, initEnitites済みで、SyncMode::ServerAuthoritativeであること
+        static observer_ptr<StateSyncClientSystem> Attach(Game& game, const std::shared_ptr<net::QuicConnection>& quic, PlayerID my_id);
+
+        // 通信スレッドから呼ぶ
+        void Receive(const message_datagram::WorldState& message);
+
+        // 届いた状態を組み立て、今Tickの状態に反映する
+        void Apply();
+
+    private:
+        // 届いた状態を組み立て、揃った最新のTickをACKする
+        void ReceiveStates();
+        // 自分のプレイヤーの予測を、サーバーの状態と比べて直す
+        void Reconcile(entt::entity entity, std::size_t index);
+        // 他のエンティティを、補間した状態に置き換える
+        void Interpolate(std::span<const entt::entity> entities, std::size_t own_index);
+
+        observer_ptr<ServiceLocator> _serviceLocator;
+        observer_ptr<entt::registry> _registry;
+        std::shared_ptr<net::QuicConnection> _quic;
+        PlayerID _myId;
+
+        SpscQueue<message_datagram::WorldState, StateMessageQueueSize> _stateQueue;
+
+        // ゲームスレッドだけが触る
+        net::StateReceiver<StateFrame, StateHistorySize> _receiver;
+        net::StateHistory<Prediction, StateHistorySize> _predictions;
+        std::optional<GameTick> _reconciledTick;
+    };
+
+    namespace jobs
+    {
+        class ApplyStateSyncInputs
+        {
+        public:
+            ApplyStateSyncInputs(observer_ptr<StateSyncServerSystem> system)
+                : _system(system)
+            {
+            }
+
+            void operator()() const
+            {
+                _system->ApplyInputs();
+            }
+
+        private:
+            observer_ptr<StateSyncServerSystem> _system;
+        };
+
+        class BroadcastState
+        {
+        public:
+            BroadcastState(observer_ptr<StateSyncServerSystem> system)
+                : _system(system)
+            {
+            }
+
+            void operator()() const
+            {
+                _system->Broadcast();
+            }
+
+        private:
+            observer_ptr<StateSyncServerSystem> _system;
+        };
+
+        class ApplyState
+        {
+        public:
+            ApplyState(observer_ptr<StateSyncClientSystem> system)
+                : _system(system)
+            {
+            }
+
+            void operator()() const
+            {
+                _system->Apply();
+            }
+
+        private:
+            observer_ptr<StateSyncClientSystem> _system;
+        };
+    }
+}
@@ -1,54 +1,184 @@
 ﻿#pragma once
 
-#include <type_traits>
+#include <atomic>
 #include <tofu/net/quic.h>
 
 #include <tofu/net/completely_sync.h>
+#include <tofu/net/rollback_sync.h>
+#include <tofu/net/input_delay.h>
+#include <tofu/net/redundant_input.h>
+#include <tofu/net/frame_advantage.h>
+#include <tofu/containers/concurrent_queue.h>
 #include "tofu/ball/actions.h"
 #include "tofu/ball/network.h"
+#include "tofu/ball/snapshot.h"
 
 #undef SendMessage
 
 namespace tofu::ball
 {
-	// シリアライズせずバイト列をそのまま通信してるので、トリビアルコピー可能な型でなければ安全に送受信できない
-	static_assert(std::is_trivially_copyable_v<SyncObject>);
-
 	inline constexpr std::uint32_t SyncBufferSize = 8;
+	// 受信してからApplySyncObjectされるまで溜めておけるメッセージの数
+	inline constexpr std::size_t SyncMessageQueueSize = 64;
+	// 受信してからApplySyncObjectされるまで溜めておける入力遅延の変更の数
+	inline constexpr std::size_t InputDelayQueueSize = 8;
+	// 受信してからApplySyncObjectされるまで溜めておけるアドバンテージの報告の数. 溢れた分は次の報告で上書きされるので捨てる
+	inline constexpr std::size_t AdvantageReportQueueSize = MaxPlayerNum * 2;
+
+	// 入力遅延の範囲. 遅延分先のTickまでSyncBufferに書き込むので、バッファに収まる範囲にする
+	inline constexpr std::uint32_t MinActionDelay = 1;
+	inline constexpr std::uint32_t MaxActionDelay = SyncBufferSize - SyncWindowSize;
+
+	// ロールバック方式で保持するTick数と、巻き戻せる最大Tick数
+	inline constexpr std::uint32_t RollbackBufferSize = 32;
+	inline constexpr std::uint32_t MaxRollbackTick = 12;
+
+	// この回数続けて進められなかったら、誰を待っているかを出力する
+	inline constexpr std::uint32_t StallReportFrames = 60;
+
+	// DATAGRAMで送った入力のうち、ACKを待っておける数 (SyncWindowSize Tick単位)
+	inline constexpr std::size_t InputHistorySize = 32;
+	// DATAGRAMでこれだけ(とRTTの2倍の長い方)待ってもACKされない入力は、ストリームで送り直す
+	inline constexpr std::chrono::milliseconds MinInputFallbackTimeout{ 50 };
 
-	class CompletelySyncSystem : public tofu::net::CompletelySyncSystem<SyncObject, SyncBufferSize>
+	// 同期方式によらず、ゲームの進行を制御するシステムのインターフェース
+	class SyncSystem
+	{
+	public:
+		virtual ~SyncSystem() = default;
+
+		// 今Tickを進めてよいか
+		virtual bool CanStep() const = 0;
+		// tick_after: 現在のTickからの相対Tick
+		virtual void SetData(std::size_t player_id, GameTick tick_after, const SyncObject& data) = 0;
+		// 今Tickの入力をActionQueueに積む
+		virtual void ApplyToActionQueue() = 0;
+		// 次のTickへ進める
+		virtual void Step() = 0;
+		// 入力が届かず進められない原因になっているプレイヤーのビットマスク
+		virtual std::uint64_t GetWaitingPlayers() const = 0;
+
+		// CanStep()の結果を記録する. 長く止まっていたら待っているプレイヤーを出力する
+		void RecordStepable(bool can_step);
+
+	private:
+		std::uint32_t _stallFrames = 0;
+	};
+
+	// 完全同期方式. 全員の入力が揃うまで待つ
+	class CompletelySyncSystem : public SyncSystem
 	{
 	public:
 		CompletelySyncSystem(observer_ptr<ServiceLocator> service_locator, observer_ptr<entt::registry> registry, std::size_t player_num, std::uint32_t default_delay)
-			: tofu::net::CompletelySyncSystem<SyncObject, SyncBufferSize>(player_num, default_delay)
-			, _serviceLocator(service_locator)
+			: _serviceLocator(service_locator)
 			, _registry(registry)
+			, _sync(player_num, default_delay)
 		{
 		}
 
-		void ApplyToActionQueue()
+		bool CanStep() const override
+		{
+			return _sync.CanStep();
+		}
+		void SetData(std::size_t player_id, GameTick tick_after, const SyncObject& data) override
+		{
+			_sync.SetData(player_id, tick_after, data);
+		}
+		void ApplyToActionQueue() override;
+		void Step() override
 		{
-			assert(CanStep());
+			_sync.Step();
+		}
+		std::uint64_t GetWaitingPlayers() const override
+		{
+			return _sync.GetWaitingPlayers();
+		}
 
-			auto tick = _serviceLocator->Get<TickCounter>()->GetCurrent();
-			auto action_queue = _serviceLocator->Get<ActionQueue>();
-			auto data = Top();
-			for (PlayerID::value_type i = 0; i < MaxPlayerNum; i++)
-			{
-				auto res_find = Player::Find(_registry, i);
-				assert(res_find);
-
-				action_queue->Enqueue(tofu::ball::ActionCommand{
-					._entity = std::get<0>(*res_find),
-					._action = data[i]->_action,
-					._tick = tick,
-					});
-			}
+	private:
+		observer_ptr<ServiceLocator> _serviceLocator;
+		observer_ptr<entt::registry> _registry;
+
+		tofu::net::CompletelySyncSystem<SyncObject, SyncBufferSize, MaxPlayerNum> _sync;
+	};
+
+	// ロールバック方式. 届いていない入力は予測して進め、外れていたら巻き戻して再シミュレーションする
+	class RollbackSyncSystem : public SyncSystem
+	{
+	public:
+		RollbackSyncSystem(observer_ptr<ServiceLocator> service_locator, observer_ptr<entt::registry> registry, std::size_t player_num, std::uint32_t default_delay);
+
+		bool CanStep() const override
+		{
+			return _sync.CanStep();
+		}
+		void SetData(std::size_t player_id, GameTick tick_after, const SyncObject& data) override
+		{
+			_sync.SetData(player_id, tick_after, data);
 		}
+		void ApplyToActionQueue() override;
+		void Step() override
+		{
+			_sync.Step();
+		}
+		std::uint64_t GetWaitingPlayers() const override
+		{
+			return _sync.GetWaitingPlayers();
+		}
+
+		// 今Tickのシミュレーション前の状態を保存する
+		void SaveSnapshot();
+		// 予測が外れていたTickまで巻き戻し、今Tickまで再シミュレーションする
+		void Rollback();
 
 	private:
+		void SaveSnapshot(SnapshotBuffer& snapshot);
+		// ActionQueueへの積み込みからPhysicsまで、1Tick分のシミュレーションを行う
+		void Resimulate();
+
+		observer_ptr<ServiceLocator> _serviceLocator;
 		observer_ptr<entt::registry> _registry;
+
+		tofu::net::RollbackSyncSystem<SyncObject, SnapshotBuffer, RollbackBufferSize> _sync;
+	};
+
+	// サーバーが状態を決める方式. 入力が揃うのを待たずに進め、届いていない入力は直前の入力から予測する
+	//  サーバーは届いた入力でシミュレーションした状態を配り、クライアントは配られた状態に合わせる (StateSyncClientSystem)
+	class AuthoritativeSyncSystem : public SyncSystem
+	{
+		struct Frame
+		{
+			std::array<SyncObject, MaxPlayerNum> _data{};
+			// 入力が届いたプレイヤーのビット
+			PlayerMask _received = 0;
+		};
+
+	public:
+		AuthoritativeSyncSystem(observer_ptr<ServiceLocator> service_locator, observer_ptr<entt::registry> registry, std::size_t player_num);
+
+		bool CanStep() const override
+		{
+			return true;
+		}
+		void SetData(std::size_t player_id, GameTick tick_after, const SyncObject& data) override;
+		void ApplyToActionQueue() override;
+		void Step() override
+		{
+			_buffer.pop_front();
+			_buffer.emplace_back();
+		}
+		std::uint64_t GetWaitingPlayers() const override
+		{
+			return 0;
+		}
+
+	private:
 		observer_ptr<ServiceLocator> _serviceLocator;
+		observer_ptr<entt::registry> _registry;
+		std::size_t _playerNum;
+
+		RingBuffer<Frame, SyncBufferSize> _buffer;
+		// 各プレイヤーが最後に使った入力. 届いていないTickはここから予測する
+		std::array<SyncObject, MaxPlayerNum> _last{};
 	};
 
 	class QuicControllerSystem
@@ -56,16 +186,10 @@ namespace tofu::ball
 		struct SyncMessage
 		{
 			SyncMessage() = default;
-			SyncMessage(const message_server_control::SyncPlayerAction& message)
-				: _player(message._player)
-				, _tick(message._tick)
-				, _obj(message._obj)
-			{
-			}
-			SyncMessage(const message_client_control::SyncPlayerAction& message)
-				: _player(message._player)
-				, _tick(message._tick)
-				, _obj(message._obj)
+			SyncMessage(PlayerID player, GameTick tick, const std::array<SyncObject, SyncWindowSize>& obj)
+				: _player(player)
+				, _tick(tick)
+				, _obj(obj)
 			{
 			}
 
@@ -83,6 +207,26 @@ namespace tofu::ball
 		{
 			tofu::ball::SendMessage(_sendStream, message);
 		}
+		// このTickに送るメッセージを溜めて、UncorkSendで1度にまとめて送る. Tickの始めと終わりにゲームスレッドで呼ぶ
+		void CorkSend();
+		void UncorkSend();
+		// 自分の入力を送る. DATAGRAMを使うときは、ACKされていない入力も一緒に送り直す
+		//  objはquantizeしたものであること
+		void SendInput(GameTick tick, const SyncWindow& obj);
+
+		void SetDatagramInputs(bool enabled)
+		{
+			_datagramInputs = enabled;
+		}
+		// サーバーが入力を決めるときは、自分の入力もサーバーから返ってきたものをSyncSystemに詰める
+		void SetArbitratedInputs(bool enabled)
+		{
+			_arbitratedInputs = enabled;
+		}
+		bool UsesArbitratedInputs() const noexcept
+		{
+			return _arbitratedInputs;
+		}
 		
 		void SetMyID(PlayerID id)
 		{
@@ -92,24 +236,74 @@ namespace tofu::ball
 		{
 			return _playerId;
 		}
+		// 観戦者は入力を送らない
+		bool IsSpectator() const noexcept
+		{
+			return *_playerId < 0;
+		}
 
-		// データを受信して一旦バッファに貯める
-		void Receive(const message_server_control::SyncPlayerAction& message);
-		void Receive(const message_client_control::SyncPlayerAction& message);
+		// 自分の入力を送り始めるTick. 途中から参加したときは、それより前をサーバーが空の入力で埋めている
+		void SetFirstInputTick(GameTick tick)
+		{
+			_firstInputTick = tick;
+		}
+		GameTick GetFirstInputTick() const noexcept
+		{
+			return _firstInputTick;
+		}
 
-		// バッファに溜まっているデータをSyncSystemに詰める. 1フレームに1度行う
+		// データを受信して一旦キューに貯める
+		// 入力を詰めたメッセージは、壊れていればfalse
+		bool Receive(const message_server_control::SyncPlayerAction& message);
+		bool Receive(const message_client_control::SyncPlayerAction& message);
+		// まとめて届いた入力は、自分以外のプレイヤーの分をキューに貯める (サーバーが入力を決めるときは自分の分も)
+		bool Receive(const message_server_control::SyncTickActions& message);
+		void Receive(const message_server_control::ChangeInputDelay& message);
+		void Receive(const message_server_control::FrameAdvantageReport& message);
+		void Receive(const message_datagram::InputAck& message);
+
+		// キューに溜まっているデータをSyncSystemに詰める. 1フレームに1度行う
+		//  届いた入力のTickから他のピアとのTickの差を測り、先行していれば1Tickを少し伸ばす
+		//  測った差はAdvantageReportInterval Tickごとに他のピアに報告する
 		void ApplySyncObject();
+
+		const net::FrameAdvantageBalancer<MaxPlayerNum>& GetFrameAdvantage() const noexcept
+		{
+			return _frameAdvantage;
+		}
 	private:
+		void Enqueue(const SyncMessage& message);
+		void ReportFrameAdvantage(GameTick current_tick);
+
 		std::shared_ptr<tofu::net::QuicConnection> _quic;
 		std::shared_ptr<tofu::net::QuicStream> _sendStream;
 		PlayerID _playerId;
+		// 最初のActionDelay Tick分は、SyncSystemが空の入力で埋めている
+		GameTick _firstInputTick = ActionDelay;
 
         observer_ptr<ServiceLocator> _serviceLocator;
         observer_ptr<entt::registry> _registry;
 
 		// 次フレームで適用する予定のSyncObject
-		std::mutex _syncObjectMutex;
-		std::vector<SyncMessage> _syncObjectBuffer;
+		//  通信スレッドが書き込み、ゲームスレッドが読み込む. 落とせないので、ゲームスレッドが詰まっていたら溢れさせて通信スレッドは待たない
+		OverflowQueue<MpscQueue<SyncMessage, SyncMessageQueueSize>> _syncObjectQueue;
+		// 次フレームで予約する入力遅延の変更
+		OverflowQueue<SpscQueue<message_server_control::ChangeInputDelay, InputDelayQueueSize>> _inputDelayQueue;
+		// 他のピアが測った、自分に対するアドバンテージ
+		SpscQueue<message_server_control::FrameAdvantageReport, AdvantageReportQueueSize> _advantageReportQueue;
+
+		// DATAGRAMで入力を送るときに使う. _inputSenderと_inputSeqはゲームスレッドだけが触る
+		bool _datagramInputs = false;
+		bool _arbitratedInputs = false;
+		net::RedundantInputSender<SyncWindow, InputHistorySize> _inputSender{ SyncWindowSize };
+		std::uint32_t _inputSeq = 0;
+		// 通信スレッドがACKを書き込み、ゲームスレッドが送るときに読む
+		std::atomic<GameTick::value_type> _inputAckedTick = 0;
+		std::atomic<float> _inputLossRate = 0;
+
+		// ゲームスレッドだけが触る
+		net::FrameAdvantageBalancer<MaxPlayerNum> _frameAdvantage{ { ._tickPeriod = TickPeriod } };
+		std::optional<GameTick> _lastAdvantageReportTick;
 	};
 
 	namespace job_conditions
@@ -122,14 +316,16 @@ namespace tofu::ball
 		class CheckStepable
 		{
 		public:
-			CheckStepable(observer_ptr<CompletelySyncSystem> system)
+			CheckStepable(observer_ptr<SyncSystem> system)
 				: _system(system)
 			{
 			}
 
 			std::optional<condition_tag> operator()() const
 			{
-				if (_system->CanStep())
+				auto can_step = _system->CanStep();
+				_system->RecordStepable(can_step);
+				if (can_step)
 				{
 					return get_condition_tag<job_conditions::IsStepable>();
 				}
@@ -140,13 +336,13 @@ namespace tofu::ball
 			}
 
 		private:
-			observer_ptr<CompletelySyncSystem> _system;
+			observer_ptr<SyncSystem> _system;
 		};
 
 		class ApplySyncBufferToActionQueue
 		{
 		public:
-			ApplySyncBufferToActionQueue(observer_ptr<CompletelySyncSystem> system)
+			ApplySyncBufferToActionQueue(observer_ptr<SyncSystem> system)
 				: _system(system)
 			{
 			}
@@ -157,13 +353,13 @@ namespace tofu::ball
 			}
 
 		private:
-			observer_ptr<CompletelySyncSystem> _system;
+			observer_ptr<SyncSystem> _system;
 		};
 
 		class StepSyncBuffer
 		{
 		public:
-			StepSyncBuffer(observer_ptr<CompletelySyncSystem> system)
+			StepSyncBuffer(observer_ptr<SyncSystem> system)
 				: _system(system)
 			{
 			}
@@ -174,7 +370,41 @@ namespace tofu::ball
 			}
 
 		private:
-			observer_ptr<CompletelySyncSystem> _system;
+			observer_ptr<SyncSystem> _system;
+		};
+
+		class Rollback
+		{
+		public:
+			Rollback(observer_ptr<RollbackSyncSystem> system)
+				: _system(system)
+			{
+			}
+
+			void operator()() const
+			{
+				_system->Rollback();
+			}
+
+		private:
+			observer_ptr<RollbackSyncSystem> _system;
+		};
+
+		class SaveSnapshot
+		{
+		public:
+			SaveSnapshot(observer_ptr<RollbackSyncSystem> system)
+				: _system(system)
+			{
+			}
+
+			void operator()() const
+			{
+				_system->SaveSnapshot();
+			}
+
+		private:
+			observer_ptr<RollbackSyncSystem> _system;
 		};
 
         class ApplySyncObject
@@ -193,5 +423,39 @@ namespace tofu::ball
         private:
             observer_ptr<QuicControllerSystem> _system;
         };
+
+        class CorkSend
+        {
+        public:
+            CorkSend(observer_ptr<QuicControllerSystem> system)
+                : _system(system)
+            {
+            }
+
+            void operator()() const
+            {
+                _system->CorkSend();
+            }
+
+        private:
+            observer_ptr<QuicControllerSystem> _system;
+        };
+
+        class UncorkSend
+        {
+        public:
+            UncorkSend(observer_ptr<QuicControllerSystem> system)
+                : _system(system)
+            {
+            }
+
+            void operator()() const
+            {
+                _system->UncorkSend();
+            }
+
+        private:
+            observer_ptr<QuicControllerSystem> _system;
+        };
     }
 }
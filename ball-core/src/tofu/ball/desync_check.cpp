@@ -0,0 +1,90 @@
+﻿#include "tofu/ball/desync_check.h"
+
+#include <fstream>
+
+#include "tofu/ball/snapshot.h"
+#include "tofu/ball/sync.h"
+
+namespace tofu::ball
+{
+    DesyncCheckSystem::DesyncCheckSystem(observer_ptr<ServiceLocator> service_locator, observer_ptr<entt::registry> registry, std::uint32_t final_delay)
+        : _serviceLocator(service_locator)
+        , _registry(registry)
+        , _finalDelay(final_delay)
+    {
+        assert(final_delay + ChecksumBatchSize < DesyncHistorySize);
+    }
+
+    void DesyncCheckSystem::Record()
+    {
+        auto tick = _serviceLocator->Get<TickCounter>()->GetCurrent();
+        auto& entry = _history[*tick % DesyncHistorySize];
+        entry._tick = tick;
+        entry._hash = compute_world_checksum(_serviceLocator, _registry);
+        // デシンクしたときに書き出せるよう、同じバッファを使い回して保存しておく
+        save_world_snapshot(_serviceLocator, _registry, entry._snapshot);
+
+        if (!_nextSendTick)
+            _nextSendTick = tick;
+    }
+
+    void DesyncCheckSystem::Step()
+    {
+        while (auto message = _desyncQueue.try_pop())
+        {
+            Dump(*message);
+        }
+
+        auto net_system = _serviceLocator->Get<QuicControllerSystem>();
+        auto tick = _serviceLocator->Get<TickCounter>()->GetCurrent();
+        if (!_nextSendTick || tick < GameTick{ _finalDelay })
+            return;
+
+        auto final_tick = tick - GameTick{ _finalDelay };
+        for (; *_nextSendTick <= final_tick; _nextSendTick = *_nextSendTick + GameTick{ 1 })
+        {
+            auto& entry = _history[**_nextSendTick % DesyncHistorySize];
+            assert(entry._tick == _nextSendTick);
+
+            if (_batch._count == 0)
+                _batch._tick = *_nextSendTick;
+            _batch._hashes[_batch._count++] = entry._hash;
+            if (_batch._count < ChecksumBatchSize)
+                continue;
+
+            if (net_system)
+            {
+                _batch._player = net_system->GetMyID();
+                net_system->Send(_batch);
+            }
+            _batch._count = 0;
+        }
+    }
+
+    void DesyncCheckSystem::Receive(const message_server_control::DesyncDetected& message)
+    {
+        _desyncQueue.push(message);
+    }
+
+    void DesyncCheckSystem::Dump(const message_server_control::DesyncDetected& message)
+    {
+        PlayerID id = 0;
+        if (auto net_system = _serviceLocator->Get<QuicControllerSystem>())
+            id = net_system->GetMyID();
+
+        auto& entry = _history[*message._tick % DesyncHistorySize];
+        if (entry._tick != message._tick)
+        {
+            TOFU_FMT::print("Desync detected at tick {} (players {:b}), but the snapshot is already discarded.\n", *message._tick, message._players);
+            return;
+        }
+
+        // 各ピアが自分のスナップショットを書き出すので、食い違った同士のファイルを見比べる
+        auto path = TOFU_FMT::format("desync_{}_player{}.bin", *message._tick, *id);
+        auto data = entry._snapshot.AsSpan();
+        std::ofstream file{ path, std::ios::binary };
+        file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+
+        TOFU_FMT::print("Desync detected at tick {} (players {:b}). hash={:016x} snapshot={}\n", *message._tick, message._players, entry._hash, path);
+    }
+}
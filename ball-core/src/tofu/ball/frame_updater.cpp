@@ -7,13 +7,21 @@ namespace tofu::ball
     UpdateSystem::UpdateSystem(observer_ptr<ServiceLocator> service_locator, observer_ptr<entt::registry> registry)
         : _serviceLocator(service_locator)
         , _registry(registry)
-        , _thread(std::chrono::microseconds{ 16'666 }, [this](ScheduledUpdateThread&) { this->Step(); })
+        , _thread(TickPeriod, [this](ScheduledUpdateThread&) { this->Step(); })
     {
     }
 
-    void UpdateSystem::Start()
+    void UpdateSystem::Start(std::optional<ScheduledUpdateThread::time_point> start_time)
     {
-        _thread.Start();
+        if (start_time)
+            _thread.Start(*start_time);
+        else
+            _thread.Start();
+    }
+
+    void UpdateSystem::SetTickPeriod(std::chrono::microseconds period)
+    {
+        _thread.SetPeriod(period);
     }
 
     void UpdateSystem::StartFrame()
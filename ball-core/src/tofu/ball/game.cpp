@@ -3,6 +3,7 @@
 #include <tofu/utils/job.h>
 #include <tofu/ecs/core.h>
 #include <tofu/ecs/physics.h>
+#include <tofu/net/input_delay.h>
 
 #include "tofu/ball/actions.h"
 #include "tofu/ball/stage.h"
@@ -11,11 +12,39 @@
 
 #include "tofu/ball/network.h"
 #include "tofu/ball/sync.h"
+#include "tofu/ball/snapshot.h"
+#include "tofu/ball/desync_check.h"
+#include "tofu/ball/replay.h"
+
+#undef GetJob
 
 namespace tofu::ball 
 {
     Game::Game()
+        : Game(Config{})
+    {
+    }
+    Game::Game(const Config& config)
+        : _config(config)
+    {
+        assert(0 < config._playerNum && config._playerNum <= MaxPlayerNum);
+    }
+    void Game::setPlayerNum(std::size_t player_num)
+    {
+        assert(0 < player_num && player_num <= MaxPlayerNum);
+        _config._playerNum = player_num;
+    }
+    std::size_t Game::getPlayerNum() const noexcept
+    {
+        return _config._playerNum;
+    }
+    void Game::setSyncMode(SyncMode sync_mode)
     {
+        _config._syncMode = sync_mode;
+    }
+    void Game::setReplayPath(const std::string& path)
+    {
+        _config._replayPath = path;
     }
     void Game::initBaseSystems()
     {
@@ -27,9 +56,9 @@ namespace tofu::ball
         initBall();
         initPlayers();
     }
-    void Game::start()
+    void Game::start(std::optional<std::chrono::system_clock::time_point> start_time)
     {
-        _serviceLocator.Get<UpdateSystem>()->Start();
+        _serviceLocator.Get<UpdateSystem>()->Start(start_time);
     }
     void Game::update()
     {
@@ -43,6 +72,15 @@ namespace tofu::ball
         return &_serviceLocator;
     }
 
+    void Game::saveSnapshot(SnapshotBuffer& buffer)
+    {
+        save_world_snapshot(&_serviceLocator, &_registry, buffer);
+    }
+    Error Game::loadSnapshot(const SnapshotBuffer& buffer)
+    {
+        return load_world_snapshot(&_serviceLocator, &_registry, buffer);
+    }
+
     void Game::initSystems()
     {
         // === Core ===
@@ -58,7 +96,41 @@ namespace tofu::ball
         auto action_system = _serviceLocator.Register(std::make_unique<ActionSystem>(&_serviceLocator, &_registry));
 
         // === Net ===
-        auto sync_system = _serviceLocator.Register(std::make_unique<CompletelySyncSystem>(&_serviceLocator, &_registry, MaxPlayerNum, ActionDelay));
+        _serviceLocator.Register(std::make_unique<net::InputDelaySchedule>(ActionDelay));
+        observer_ptr<SyncSystem> sync_system = nullptr;
+        observer_ptr<RollbackSyncSystem> rollback_system = nullptr;
+        // シミュレーションの結果が確定するまでのTick数. 巻き戻しがあるなら、巻き戻せなくなるまで確定しない
+        std::uint32_t final_delay = 0;
+        switch (_config._syncMode)
+        {
+        case SyncMode::Completely:
+            sync_system = _serviceLocator.Register(std::unique_ptr<SyncSystem>{ std::make_unique<CompletelySyncSystem>(&_serviceLocator, &_registry, _config._playerNum, ActionDelay) });
+            break;
+        case SyncMode::Rollback:
+        {
+            auto system = std::make_unique<RollbackSyncSystem>(&_serviceLocator, &_registry, _config._playerNum, ActionDelay);
+            rollback_system = system.get();
+            sync_system = _serviceLocator.Register(std::unique_ptr<SyncSystem>{ std::move(system) });
+            final_delay = MaxRollbackTick;
+            break;
+        }
+        case SyncMode::ServerAuthoritative:
+            sync_system = _serviceLocator.Register(std::unique_ptr<SyncSystem>{ std::make_unique<AuthoritativeSyncSystem>(&_serviceLocator, &_registry, _config._playerNum) });
+            break;
+        }
+        if (!_config._replayPath.empty())
+        {
+            // 記録できなくても試合は続ける
+            auto recorder = std::make_unique<ReplayRecorder>();
+            if (auto error = recorder->Open(_config._replayPath, _config))
+                error->Dump();
+            else
+                _serviceLocator.Register(std::move(recorder));
+        }
+        // サーバーが状態を決めるなら、クライアント同士の状態は食い違っても合わせ直されるので確かめない
+        observer_ptr<DesyncCheckSystem> desync_check = nullptr;
+        if (_config._syncMode != SyncMode::ServerAuthoritative)
+            desync_check = _serviceLocator.Register(std::make_unique<DesyncCheckSystem>(&_serviceLocator, &_registry, final_delay));
 
         // === Job ===
         auto job_scheduler = _serviceLocator.Register(std::make_unique<JobScheduler>());
@@ -76,7 +148,20 @@ namespace tofu::ball
             job_scheduler->Register(make_job<StepPhysics>({ get_job_tag<StepAction>() }, { get_condition_tag<IsStepable>() }, physics));
 
             job_scheduler->Register(make_job<EndUpdate>({ get_job_tag<StepAction>(), get_job_tag<StepPhysics>() }, {}));
+            if (desync_check)
+            {
+                job_scheduler->Register(make_job<CheckDesync>({ get_job_tag<StepPhysics>() }, { get_condition_tag<IsStepable>() }, desync_check));
+                job_scheduler->GetJob(get_job_tag<EndUpdate>())->AddDependency(get_job_tag<CheckDesync>());
+            }
             job_scheduler->Register(make_job<StepSyncBuffer>({ get_job_tag<EndUpdate>() }, { get_condition_tag<IsStepable>() }, sync_system));
+
+            if (rollback_system)
+            {
+                // 巻き戻しは進められるかどうかに関わらず行い、進める場合はシミュレーション前の状態を保存する
+                job_scheduler->Register(make_job<Rollback>({ get_job_tag<CheckStepable>() }, {}, rollback_system));
+                job_scheduler->Register(make_job<SaveSnapshot>({ get_job_tag<Rollback>() }, { get_condition_tag<IsStepable>() }, rollback_system));
+                job_scheduler->GetJob(get_job_tag<StepTick>())->AddDependency(get_job_tag<SaveSnapshot>());
+            }
         }
     }
     void Game::initStage()
@@ -88,8 +173,15 @@ namespace tofu::ball
         auto physics = _serviceLocator.Get<Physics>();
         {
             // Player 
-            Player::Generate(&_serviceLocator, &_registry, 0, {1.0f, 5.0f});
-            Player::Generate(&_serviceLocator, &_registry, 1, {7.0f, 5.0f});
+            //  左右の壁の間に等間隔で並べる (2人なら x=1, 7)
+            constexpr float left = 1.0f;
+            constexpr float right = 7.0f;
+            auto player_num = _config._playerNum;
+            for (std::size_t i = 0; i < player_num; i++)
+            {
+                float x = player_num == 1 ? left : left + (right - left) * i / (player_num - 1);
+                Player::Generate(&_serviceLocator, &_registry, static_cast<int>(i), { x, 5.0f });
+            }
         }
     }
     void Game::initBall()
@@ -1,7 +1,14 @@
+#include <algorithm>
+#include <chrono>
 #include <random>
+#include <cstring>
+
+#include <tofu/utils/job.h>
 
 #include "tofu/ball/net_client.h"
 #include "tofu/ball/sync.h"
+#include "tofu/ball/desync_check.h"
+#include "tofu/ball/state_sync.h"
 
 namespace tofu::ball
 {
@@ -24,26 +31,38 @@ namespace tofu::ball
         case State::Ready:
             UpdateReady();
             return;
+        case State::CatchUp:
+            // 入力を含むメッセージは、Clientが追いつきながら読む
+            ReceiveDatagrams();
+            return;
         case State::InGame:
             UpdateIngame();
             return;
         }
     }
 
+    void ServerConnection::FinishCatchUp()
+    {
+        assert(_state == State::CatchUp && _catchUp.IsComplete());
+        _state = State::InGame;
+    }
+
     void ServerConnection::UpdateWaitConnect()
     {
-        if (!_quic->IsConnected())
+        // セッションチケットがあれば、参加の申し込みは0-RTTで送る
+        if (!_quic->IsSendable())
             return;
 
         _streamControlSend = _quic->OpenStream(ClientControlStreamId, false);
         _streamControlRecv = _quic->OpenStream(ServerControlStreamId, true);
+        _streamCatchUp = _quic->OpenStream(CatchUpStreamId, true);
 
         message_client_control::RequestJoin msg;
         std::string user_name = "User";
         user_name += std::to_string(std::random_device{}() % 10000);
         strncpy(msg._userName, user_name.c_str(), sizeof(msg._userName));
 
-        _streamControlSend->Send(reinterpret_cast<const std::byte*>(&msg), sizeof(msg));
+        SendMessage(_streamControlSend, msg);
 
         _state = State::WaitJoinApproval;
     }
@@ -61,42 +80,187 @@ namespace tofu::ball
         if (!message)
             return;
 
-        _id = message->_playerId;
+        // 観戦者は-1
+        _id = message->_playerId == message_server_control::SpectatorPlayerId ? PlayerID{ -1 } : PlayerID{ static_cast<PlayerID::value_type>(message->_playerId) };
         _state = State::Ready;
     }
 
     void ServerConnection::UpdateReady()
     {
-        auto [message, error] = ReadMessage<message_server_control::StartGame>(_streamControlRecv);
-
-        if (error)
+        // 人数分のPlayerInfoの後にStartGameが届く
+        while (true)
         {
-            _error = error;
+            auto [header, header_error] = PeekHeader(_streamControlRecv);
+            if (header_error)
+            {
+                _error = header_error;
+                return;
+            }
+            if (!header)
+                return;
+
+            if (header->_type == message_server_control::PlayerInfo::message_type)
+            {
+                auto [message, error] = ReadMessage<message_server_control::PlayerInfo>(_streamControlRecv);
+                if (error)
+                {
+                    _error = error;
+                    return;
+                }
+                if (!message)
+                    return;
+
+                if (_members.size() <= static_cast<std::size_t>(message->_id))
+                    _members.resize(message->_id + 1);
+                _members[message->_id] = std::string{ message->_name, strnlen(message->_name, sizeof(message->_name)) };
+                continue;
+            }
+            if (header->_type == message_server_control::ClockSyncRequest::message_type)
+            {
+                auto [message, error] = ReadMessage<message_server_control::ClockSyncRequest>(_streamControlRecv);
+                if (error)
+                {
+                    _error = error;
+                    return;
+                }
+                if (!message)
+                    return;
+
+                RespondClockSync(*message);
+                continue;
+            }
+
+            auto [message, error] = ReadMessage<message_server_control::StartGame>(_streamControlRecv);
+            if (error)
+            {
+                _error = error;
+                return;
+            }
+            if (!message)
+                return;
+
+            if (_members.size() != message->_playerNum)
+            {
+                _error = TOFU_MAKE_ERROR("Player info mismatch. info={}, start={}", _members.size(), message->_playerNum);
+                return;
+            }
+
+            _datagramInputs = message->_datagramInputs;
+            _arbitratedInputs = message->_arbitratedInputs;
+            _stateSync = message->_stateSync;
+            _startTime = net::ClockSyncEstimator::time_point{ net::ClockSyncEstimator::duration{ message->_startTime } };
+            _firstInputTick = message->_firstInputTick;
+            _catchUp.Begin(message->_catchUpSize);
+            _state = State::CatchUp;
             return;
         }
+    }
 
-        if (!message)
-            return;
+    void ServerConnection::UpdateIngame()
+    {
+        ReceiveDatagrams();
 
-        _state = State::InGame;
+        // 人数が増えると1フレームに届くメッセージも増えるので、届いている分は全て処理する
+        while (ProcessNextMessage())
+        {
+        }
     }
 
-    void ServerConnection::UpdateIngame()
+    bool ServerConnection::ProcessNextMessage()
     {
-        auto header = PeekHeader(_streamControlRecv);
-        if (!header)
-            return;
-        switch (header->_messageType)
+        if (_catchUp.IsComplete())
+            return ProcessMessage(_streamControlRecv);
+
+        // ProcessMessageがSeekする前に大きさを見ておく. ヘッダが壊れていればProcessMessageがエラーにする
+        auto header = std::get<0>(PeekHeader(_streamCatchUp));
+        if (!ProcessMessage(_streamCatchUp) || !header)
+            return false;
+
+        // 読んだ分を返して、続きを送ってもらう
+        if (_catchUp.Consume(header->FrameSize()))
         {
-        case message_server_control::SyncPlayerAction::message_type:
+            message_client_control::CatchUpProgress progress;
+            progress._received = static_cast<std::uint32_t>(_catchUp.GetConsumed());
+            SendMessage(_streamControlSend, progress);
+        }
+        return true;
+    }
+
+    bool ServerConnection::ProcessMessage(const std::shared_ptr<net::QuicStream>& stream)
+    {
+        // 読めないメッセージの後ろは読めない
+        if (_error)
+            return false;
+
+        auto handlers = net::MessageHandlers{
+            [this](const message_server_control::SyncPlayerAction& message) {
+                // サーバーは全員に同じ入力を配るので、自分の入力も返ってくる
+                //  サーバーが入力を決めるときは、返ってきた自分の入力を使う
+                if ((message._player != _id || _arbitratedInputs) && !_client->OnReceiveSyncObject(message))
+                {
+                    _error = TOFU_MAKE_ERROR("Received broken inputs. player=({}), tick=({})", *message._player, *message._tick);
+                    return false;
+                }
+                return true;
+            },
+            [this](const message_server_control::SyncTickActions& message) {
+                // 自分の入力も含まれているが、読み飛ばすのはQuicControllerSystemに任せる
+                if (!_client->OnReceiveSyncObject(message))
+                {
+                    _error = TOFU_MAKE_ERROR("Received broken inputs. tick=({})", *message._tick);
+                    return false;
+                }
+                return true;
+            },
+            [this](const message_server_control::ClockSyncRequest& message) {
+                RespondClockSync(message);
+            },
+            [this, &stream](const message_server_control::DesyncDetected& message) {
+                // 参加する前に見つかったデシンクは、自分の状態とは関係ないので読み飛ばす
+                if (stream != _streamCatchUp)
+                    _client->OnReceiveDesync(message);
+            },
+            [this](const message_server_control::ChangeInputDelay& message) {
+                _client->OnReceiveInputDelay(message);
+            },
+            [this](const message_server_control::FrameAdvantageReport& message) {
+                _client->OnReceiveFrameAdvantage(message);
+            },
+        };
+        auto [dispatched, error] = DispatchMessage<message_server_control::IngameMessages>(stream, handlers);
+        if (error)
+            _error = error;
+        return dispatched;
+    }
+
+    void ServerConnection::RespondClockSync(const message_server_control::ClockSyncRequest& message)
+    {
+        // 受け取ってすぐに返すので、受け取った時刻と送る時刻は同じ
+        auto now = net::ClockSyncEstimator::Now().time_since_epoch().count();
+
+        message_client_control::ClockSyncResponse response;
+        response._requestTime = message._sendTime;
+        response._receiveTime = now;
+        response._sendTime = now;
+        SendMessage(_streamControlSend, response);
+        // ゲームスレッドがCorkしていても、Tickの終わりまで待たせると往復時間がずれる
+        _streamControlSend->Flush();
+    }
+
+    void ServerConnection::ReceiveDatagrams()
+    {
+        std::array<std::byte, 2048> buffer;
+        while (auto size = _quic->ReadUnreliable(buffer.data(), buffer.size()))
         {
-            auto [message, error] = ReadMessage<message_server_control::SyncPlayerAction>(_streamControlRecv);
-            if (message)
+            auto bytes = std::span{ buffer }.first(size);
+            if (auto ack = ParseMessage<message_datagram::InputAck>(bytes))
             {
-                _client->OnReceiveSyncObject(*message);
+                _client->OnReceiveInputAck(*ack);
+            }
+            else if (auto state = ParseMessage<message_datagram::WorldState>(bytes))
+            {
+                _client->OnReceiveWorldState(*state);
             }
-        }
-            break;
         }
     }
 
@@ -110,6 +274,9 @@ namespace tofu::ball
             ._serverName = _config._ip.c_str(),
             ._port = 12345,
             ._alpn = Alpn,
+            // 切れて繋ぎ直したときに、ハンドシェイクを待たずに参加を申し込めるようにする
+            ._ticketFile = "./session_tickets.bin",
+            ._tokenFile = "./retry_tokens.bin",
         };
 
         _quic = std::make_unique<net::QuicClient>(config);
@@ -147,17 +314,85 @@ namespace tofu::ball
         {
             _connection->Update();
         }
-        if (_connection->GetState() == ServerConnection::State::InGame) 
+        if (StopOnConnectionError())
+            return;
+        if (_connection->GetState() != ServerConnection::State::CatchUp)
+            return;
+
+        if (!_gameSetUp)
         {
-            InitGame();
-            if (auto system = _game.getServiceLocator()->Get<QuicControllerSystem>())
-            {
-                system->SetConnection(_connection->GetConnection());
-                system->SetMyID(_connection->GetPlayerID());
-            }
-            _game.start();
-            _state = State::InGame;
+            SetUpGame();
+            _gameSetUp = true;
+        }
+        if (!CatchUp())
+        {
+            StopOnConnectionError();
+            return;
+        }
+
+        // 全員が同じ時刻から数え始めるので、Tickの位相が揃う. 途中から参加したときは、追いついたTickの時刻から数える
+        auto tick = _game.getServiceLocator()->Get<TickCounter>()->GetCurrent();
+        _game.start(_connection->GetStartTime() + std::chrono::duration_cast<std::chrono::system_clock::duration>(TickPeriod * *tick));
+        _connection->FinishCatchUp();
+        _state = State::InGame;
+    }
+
+    void Client::SetUpGame()
+    {
+        _game.setPlayerNum(_connection->GetPlayerNum());
+        if (_connection->UsesStateSync())
+        {
+            // 他のプレイヤーの入力は届かず、状態はサーバーが決めるので、入力を記録しても再現できない
+            _game.setSyncMode(SyncMode::ServerAuthoritative);
+        }
+        else
+        {
+            // 試合ごとに別のファイルにする. 開始時刻は全員同じなので、同じ試合のファイルを見つけやすい
+            auto start_time = std::chrono::duration_cast<std::chrono::seconds>(_connection->GetStartTime().time_since_epoch());
+            _game.setReplayPath(TOFU_FMT::format("replay_{}_player{}.tofureplay", start_time.count(), *_connection->GetPlayerID()));
+        }
+        InitGame();
+        if (auto system = _game.getServiceLocator()->Get<QuicControllerSystem>())
+        {
+            system->SetConnection(_connection->GetConnection());
+            system->SetMyID(_connection->GetPlayerID());
+            system->SetDatagramInputs(_connection->UsesDatagramInputs());
+            system->SetArbitratedInputs(_connection->UsesArbitratedInputs());
+            // 追いつく間に過ぎるTickの入力はサーバーが埋めている
+            system->SetFirstInputTick(_connection->GetFirstInputTick());
+        }
+        if (_connection->UsesStateSync())
+        {
+            StateSyncClientSystem::Attach(_game, _connection->GetConnection(), _connection->GetPlayerID());
+        }
+    }
+
+    bool Client::CatchUp()
+    {
+        auto service_locator = _game.getServiceLocator();
+        auto tick_counter = service_locator->Get<TickCounter>();
+        auto job_scheduler = service_locator->Get<JobScheduler>();
+
+        // 描画や通信を止めないよう、1回に使う時間を区切る. 残りは次のフレームで進める
+        auto deadline = std::chrono::steady_clock::now() + CatchUpFrameBudget;
+        while (std::chrono::steady_clock::now() < deadline)
+        {
+            auto elapsed = net::ClockSyncEstimator::Now() - _connection->GetStartTime();
+            auto live_tick = GameTick{ static_cast<GameTick::value_type>(std::max<std::int64_t>(0, elapsed / TickPeriod)) };
+            auto tick = tick_counter->GetCurrent();
+            if (_connection->IsCatchUpComplete() && live_tick <= tick)
+                return true;
+
+            // 届いた入力で進められる限り進める. 1フレームごとに受信キューも空になる
+            job_scheduler->Run();
+            if (tick < tick_counter->GetCurrent())
+                continue;
+
+            // 進められないので、次の入力を1つ読む. 全て読んでもまだ届いていなければ、あとは普段通りに待つ
+            if (!_connection->ProcessNextMessage())
+                return _connection->IsCatchUpComplete();
         }
+        return false;
     }
 
     void Client::UpdateIngame()
@@ -165,15 +400,66 @@ namespace tofu::ball
         if (!_end && _state == State::InGame)
         {
             _connection->Update();
+            if (StopOnConnectionError())
+                return;
             UpdateGame();
         }
     }
 
-    void Client::OnReceiveSyncObject(const message_server_control::SyncPlayerAction& message)
+    bool Client::StopOnConnectionError()
+    {
+        auto error = _connection->GetError();
+        if (!error)
+            return false;
+
+        // 読めないメッセージの後ろは読めないので、これ以上は進められない
+        if (!_end)
+        {
+            error->Dump();
+            Stop();
+        }
+        return true;
+    }
+
+    bool Client::OnReceiveSyncObject(const message_server_control::SyncPlayerAction& message)
+    {
+        return _game.getServiceLocator()->Get<QuicControllerSystem>()->Receive(message);
+    }
+
+    bool Client::OnReceiveSyncObject(const message_server_control::SyncTickActions& message)
+    {
+        return _game.getServiceLocator()->Get<QuicControllerSystem>()->Receive(message);
+    }
+
+    void Client::OnReceiveInputDelay(const message_server_control::ChangeInputDelay& message)
     {
         _game.getServiceLocator()->Get<QuicControllerSystem>()->Receive(message);
     }
 
+    void Client::OnReceiveFrameAdvantage(const message_server_control::FrameAdvantageReport& message)
+    {
+        _game.getServiceLocator()->Get<QuicControllerSystem>()->Receive(message);
+    }
+
+    void Client::OnReceiveInputAck(const message_datagram::InputAck& message)
+    {
+        _game.getServiceLocator()->Get<QuicControllerSystem>()->Receive(message);
+    }
+
+    void Client::OnReceiveWorldState(const message_datagram::WorldState& message)
+    {
+        // 試合を始める前に届いたものは捨てる
+        if (auto system = _game.getServiceLocator()->Get<StateSyncClientSystem>())
+            system->Receive(message);
+    }
+
+    void Client::OnReceiveDesync(const message_server_control::DesyncDetected& message)
+    {
+        // サーバーが状態を決めるときは、状態を突き合わせないので届かない
+        if (auto system = _game.getServiceLocator()->Get<DesyncCheckSystem>())
+            system->Receive(message);
+    }
+
     void Client::InitGame()
     {
         _game.initBaseSystems();
@@ -1,12 +1,15 @@
-﻿#include "tofu/ball/network.h"
+﻿#include <algorithm>
+
+#include "tofu/ball/network.h"
 #include "tofu/ball/net_server.h"
 
 namespace tofu::ball
 {
-    ClientConnection::ClientConnection(observer_ptr<Server> server, const std::shared_ptr<net::QuicConnection>& quic, PlayerID player_id)
+    ClientConnection::ClientConnection(observer_ptr<Server> server, const std::shared_ptr<net::QuicConnection>& quic, PlayerID player_id, std::size_t peer)
         : _server(server)
         , _quic(quic)
         , _id(player_id)
+        , _peer(peer)
     {
     }
 
@@ -20,30 +23,84 @@ namespace tofu::ball
         case State::WaitJoinRequest:
             UpdateWaitJoinRequest();
             return;
+        case State::Ready:
+            UpdateReady();
+            return;
         case State::Ingame:
             UpdateIngame();
             return;
+        case State::Disconnected:
+            return;
         }
     }
 
-    void ClientConnection::StartGame()
+    void ClientConnection::StartGame(net::ClockSyncEstimator::time_point start_time)
     {
-        message_server_control::StartGame message;
-        message._playerNum = 0;
-        auto connections = _server->GetConnections();
-        for (int i = 0; i < MaxPlayerNum; i++) 
+        auto& connections = _server->GetConnections();
+        for (auto& connection : connections)
         {
-            strncpy(message._members[i]._name, connections[i]->GetName().c_str(), sizeof(message._members[i]._name));
-            message._playerNum++;
+            message_server_control::PlayerInfo info;
+            info._id = *connection->GetID();
+            strncpy(info._name, connection->GetName().c_str(), sizeof(info._name));
+            SendMessage(_streamControlSend, info);
         }
+
+        message_server_control::StartGame message;
+        message._playerNum = static_cast<std::uint8_t>(connections.size());
+        message._datagramInputs = _server->GetConfig()._datagramInputs;
+        message._arbitratedInputs = _server->GetConfig()._arbitrateInputs;
+        message._stateSync = _server->GetConfig()._stateSync;
+        message._startTime = _clock.ToRemote(start_time).time_since_epoch().count();
+        message._firstInputTick = _inputReceiver.GetNextTick();
+        message._catchUpSize = static_cast<std::uint32_t>(_catchUp.GetSize());
+        // 途中から参加したプレイヤーは、サーバーが埋めた自分の入力もサーバーから受け取る
+        if (_lateJoin && !IsSpectator() && !message._stateSync)
+            message._arbitratedInputs = true;
         SendMessage(_streamControlSend, message);
 
+        fmt::print("Clock of {} ({}): offset {}us, drift {:.1f}ppm, RTT {}us\n", _name, *_id, _clock.GetOffset(start_time).count(), _clock.GetDrift() * 1e6, _clock.GetRoundTrip().count());
+
         _state = State::Ingame;
     }
 
+    void ClientConnection::StartLateGame(net::ClockSyncEstimator::time_point start_time, GameTick first_input_tick, std::size_t catch_up_size)
+    {
+        _lateJoin = true;
+        _inputReceiver = decltype(_inputReceiver){ first_input_tick, SyncWindowSize };
+        _catchUp.Begin(catch_up_size);
+        if (catch_up_size != 0)
+            _streamCatchUp = _quic->OpenStream(CatchUpStreamId, false);
+        StartGame(start_time);
+    }
+
+    void ClientConnection::Disconnect()
+    {
+        _state = State::Disconnected;
+    }
+
+    void ClientConnection::CorkControl()
+    {
+        if (_streamControlSend)
+            _streamControlSend->Cork();
+    }
+
+    void ClientConnection::UncorkControl()
+    {
+        if (_streamControlSend)
+            _streamControlSend->Uncork();
+    }
+
+    net::QuicSendMetrics ClientConnection::GetControlSendMetrics() const
+    {
+        if (!_streamControlSend)
+            return {};
+        return _streamControlSend->GetSendMetrics();
+    }
+
 	void ClientConnection::UpdateWaitConnect()
 	{
-        if (!_quic->IsConnected())
+        // 0-RTTで届いた参加の申し込みを読めるよう、ハンドシェイクの確定を待たずにストリームを開く
+        if (!_quic->IsSendable())
             return;
 
         _streamControlSend = _quic->OpenStream(ServerControlStreamId, false);
@@ -53,6 +110,11 @@ namespace tofu::ball
 
     void ClientConnection::UpdateWaitJoinRequest()
     {
+        // 0-RTTのデータは盗み見た第三者が送り直せるので、枠を取る参加の申し込みはハンドシェイクが確定するまで処理しない
+        //  送り直されただけの接続は確定しないので、そのうち切れる
+        if (!_quic->IsConnected())
+            return;
+
         auto [message, error] = ReadMessage<message_client_control::RequestJoin>(_streamControlRecv);
 
         if (error)
@@ -67,35 +129,185 @@ namespace tofu::ball
         _name = message->_userName;
 
         message_server_control::ApproveJoin approve;
-        approve._playerId = *_id;
-        _streamControlSend->Send(reinterpret_cast<std::byte*>(&approve), sizeof(approve));
+        approve._playerId = IsSpectator() ? message_server_control::SpectatorPlayerId : static_cast<std::uint8_t>(*_id);
+        SendMessage(_streamControlSend, approve);
 
-        fmt::print("Joined Client: {} ({})\n", _name, *_id);
+        if (IsSpectator())
+            fmt::print("Joined Spectator: {}\n", _name);
+        else
+            fmt::print("Joined Client: {} ({})\n", _name, *_id);
 
         _state = State::Ready;
     }
 
+    void ClientConnection::UpdateReady()
+    {
+        // 試合を始めるまでに、時計のずれを測っておく
+        while (true)
+        {
+            auto [message, error] = ReadMessage<message_client_control::ClockSyncResponse>(_streamControlRecv);
+            if (error)
+            {
+                _error = error;
+                return;
+            }
+            if (!message)
+                break;
+            OnReceiveClockSync(*message);
+        }
+        RequestClockSync(ClockSyncLobbyInterval);
+    }
+
+    void ClientConnection::RequestClockSync(std::chrono::microseconds interval)
+    {
+        auto now = net::ClockSyncEstimator::Now();
+        if (_lastClockSync && now - *_lastClockSync < interval)
+            return;
+        _lastClockSync = now;
+
+        message_server_control::ClockSyncRequest request;
+        request._sendTime = now.time_since_epoch().count();
+        SendMessage(_streamControlSend, request);
+    }
+
+    void ClientConnection::OnReceiveClockSync(const message_client_control::ClockSyncResponse& message)
+    {
+        using time_point = net::ClockSyncEstimator::time_point;
+        using duration = net::ClockSyncEstimator::duration;
+        _clock.AddSample(
+            time_point{ duration{ message._requestTime } },
+            time_point{ duration{ message._receiveTime } },
+            time_point{ duration{ message._sendTime } },
+            net::ClockSyncEstimator::Now());
+    }
+
     void ClientConnection::UpdateIngame()
     {
-        auto header = PeekHeader(_streamControlRecv);
-        if (!header)
+        // 切断を待っている
+        if (_error)
             return;
-        switch (header->_messageType)
-        {
-        case message_client_control::SyncPlayerAction::message_type:
+
+        ReceiveDatagrams();
+        RequestClockSync(ClockSyncIngameInterval);
+        SendCatchUp();
+
+        // 前の呼び出しから届いた分は全て処理する. 1つずつだと、まとめて届いたときに処理し終えるまで何周もかかる
+        auto handlers = net::MessageHandlers{
+            [this](const message_client_control::SyncPlayerAction& message) {
+                // DATAGRAMを使うときは、DATAGRAMで届かなかった分だけがストリームで届く
+                //  観戦者の入力は使わない
+                if (IsSpectator())
+                    return true;
+                auto obj = message.GetInputs();
+                if (!obj)
+                {
+                    _error = TOFU_MAKE_ERROR("Received broken inputs. player=({}), tick=({})", *_id, *message._tick);
+                    return false;
+                }
+                AcceptInput(message._tick, *obj);
+                return true;
+            },
+            [this](const message_client_control::StateChecksums& message) {
+                // 観戦者の状態は突き合わせない
+                if (IsSpectator())
+                    return;
+                // 他人のIDを名乗っていても、接続ごとのIDで扱う
+                auto checksums = message;
+                checksums._player = _id;
+                _server->OnReceiveChecksums(checksums);
+            },
+            [this](const message_client_control::ClockSyncResponse& message) {
+                OnReceiveClockSync(message);
+            },
+            [this](const message_client_control::FrameAdvantageReport& message) {
+                if (!IsSpectator())
+                    _server->OnReceiveFrameAdvantage(_id, message);
+            },
+            [this](const message_client_control::CatchUpProgress& message) {
+                _catchUp.Ack(message._received);
+                SendCatchUp();
+                if (_catchUp.IsDone())
+                    fmt::print("Sent the backlog to {}: {} bytes\n", _name, _catchUp.GetSize());
+            },
+        };
+        auto [count, error] = DispatchMessages<message_client_control::IngameMessages>(_streamControlRecv, handlers);
+        if (error)
+            _error = error;
+        if (!_error)
+            return;
+
+        // 読めないメッセージの後ろは読めないので、切断する. 試合は続け、このプレイヤーの入力はサーバーが埋める
+        fmt::print("Disconnecting {}: {}\n", _name, _error->_message);
+        _quic->Close();
+    }
+
+    void ClientConnection::SendCatchUp()
+    {
+        if (!_streamCatchUp)
+            return;
+        _catchUp.Collect(_server->GetBacklog(), [this](std::span<const std::byte> chunk) {
+            _streamCatchUp->Send(chunk.data(), chunk.size());
+        });
+    }
+
+    void ClientConnection::ReceiveDatagrams()
+    {
+        bool received = false;
+        std::array<std::byte, 2048> buffer;
+        while (auto size = _quic->ReadUnreliable(buffer.data(), buffer.size()))
         {
-            auto [message, error] = ReadMessage<message_client_control::SyncPlayerAction>(_streamControlRecv);
-            if (message)
+            auto bytes = std::span{ buffer }.first(size);
+            if (auto ack = ParseMessage<message_datagram::WorldStateAck>(bytes))
             {
-                _server->OnReceiveSyncObject(*message);
-                static std::size_t total = 0;
-                total += sizeof(message);
-                auto rtt = picoquic_get_rtt(_quic->GetRaw());
-                fmt::print("recved sync obj[{}]({}): {}, {} <{}> RTT:{} \n", *message->_tick, *message->_player, message->_obj[0]._action.index(), message->_obj[1]._action.index(), total, rtt);
+                _server->OnReceiveStateAck(_peer, ack->_tick);
+                continue;
+            }
+
+            auto message = ParseMessage<message_datagram::PlayerInputs>(bytes);
+            if (!message || message->_player != _id || IsSpectator())
+                continue;
+
+            // 壊れたDATAGRAMは落ちたものとして扱う. 足りない入力はストリームで届く
+            std::array<SyncWindow, message_datagram::MaxInputRedundancy> inputs;
+            if (message_datagram::MaxInputRedundancy < message->_count || !message->GetInputs(inputs))
+                continue;
+
+            received = true;
+            _inputLoss.OnReceive(message->_seq);
+            for (std::size_t i = 0; i < message->_count; i++)
+            {
+                AcceptInput(message->_tick + GameTick{ static_cast<GameTick::value_type>(i * SyncWindowSize) }, inputs[i]);
             }
         }
-            break;
-        }
+        if (!received)
+            return;
+
+        message_datagram::InputAck ack;
+        ack._lossRate = static_cast<std::uint8_t>(_inputLoss.GetLossRate() * 255);
+        ack._nextTick = _inputReceiver.GetNextTick();
+        SendDatagram(_quic, ack);
+    }
+
+    void ClientConnection::AcceptInput(GameTick tick, const SyncWindow& obj)
+    {
+        if (!_inputReceiver.Accept(tick, obj))
+            return;
+        _inputReceiver.Release([this](GameTick tick, const SyncWindow& obj) {
+            OnReceiveInput(tick, obj);
+        });
+    }
+
+    void ClientConnection::OnReceiveInput(GameTick tick, const SyncWindow& obj)
+    {
+        _latency.AddRttSample(_quic->GetRtt());
+        _latency.AddArrival(tick, net::LatencyEstimator::clock::now());
+        _lastInputTick = tick + GameTick{ SyncWindowSize - 1 };
+
+        _server->OnReceiveSyncObject(_id, tick, obj);
+        static std::size_t total = 0;
+        total++;
+        auto rtt = picoquic_get_rtt(_quic->GetRaw());
+        fmt::print("recved sync obj[{}]({}): {}, {} <{}> RTT:{} \n", *tick, *_id, obj[0]._action.index(), obj[1]._action.index(), total, rtt);
     }
 
     void Server::Run()
@@ -110,6 +322,8 @@ namespace tofu::ball
             ._certFile = { "./cert/_wildcard.reanisz.info+3.pem" },
             ._secretFile = { "./cert/_wildcard.reanisz.info+3-key.pem" },
             ._alpn = Alpn,
+            // 再起動しても、前に配ったセッションチケットで再開できるようにする
+            ._ticketKeyFile = { "./cert/session_ticket.key" },
         };
 
         _quic = std::make_unique<net::QuicServer>(config);
@@ -117,43 +331,59 @@ namespace tofu::ball
 
         _state = State::Lobby;
 
-        // 1クライアントでも接続が切れたらすぐ終了する
         _quic->SetCallbackOnClose(
             [this](const std::shared_ptr<net::QuicConnection>& connection)
             {
-                Stop();
+                std::lock_guard lock{ _mutexConnection };
+                // 試合中は試合を続け、抜けたプレイヤーの入力をメインスレッドで埋める
+                if (_state == State::InGame)
+                {
+                    _closedConnections.push_back(connection);
+                    return;
+                }
+                // 始まる前に参加者が抜けたら、人数が揃わないので終了する. 満員で断った接続は関係ない
+                auto joined = std::ranges::any_of(_connections, [&](const std::shared_ptr<ClientConnection>& client) {
+                    return client && client->GetConnection() == connection;
+                });
+                if (joined)
+                    Stop();
             }
         );
 
         _quic->SetCallbackOnConnect(
             [this](const std::shared_ptr<net::QuicConnection>& connection)
             {
-                if (MaxPlayerNum <= _clientNum)
+                std::lock_guard lock{ _mutexConnection };
+                // 試合中に来た接続は、抜けたプレイヤーとして戻すか観戦者にする. メインスレッドで決める
+                if (_state == State::InGame)
                 {
-                    connection->Close();
+                    _lateConnections.push_back(connection);
                     return;
                 }
+                if (GetPlayerNum() <= static_cast<std::size_t>(_clientNum))
                 {
-                    std::lock_guard lock{ _mutexConnection };
-                    int id = _clientNum++;
-                    _connections[id] = std::make_shared<ClientConnection>(this, connection, id);
+                    connection->Close();
+                    return;
                 }
+                int id = _clientNum++;
+                _connections[id] = std::make_shared<ClientConnection>(this, connection, id, static_cast<std::size_t>(id));
             }
         );
 
+        // 時計合わせの応答を読むのが遅れると、その分だけ往復遅延が大きく見えるので、短い間隔で回す
         while (!_end && _state == State::Lobby)
         {
             UpdateAtLobby();
-            std::this_thread::sleep_for(std::chrono::milliseconds{ 100 });
+            std::this_thread::sleep_for(ServerUpdateInterval);
         }
 
         InitGame();
-        _game.start();
+        _game.start(_startTime);
 
         while (!_end && _state == State::InGame)
         {
             UpdateAtIngame();
-            std::this_thread::sleep_for(std::chrono::milliseconds{ 10 });
+            std::this_thread::sleep_for(ServerUpdateInterval);
         }
 
         _quic->Exit();
@@ -162,23 +392,170 @@ namespace tofu::ball
     {
         _end = true;
     }
-    void Server::OnReceiveSyncObject(const message_client_control::SyncPlayerAction& message)
+    void Server::OnReceiveSyncObject(PlayerID player, GameTick tick, const SyncWindow& obj)
     {
-        for (auto& connection : _connections)
+        // サーバーがゲームを進めるときは、入力は他のクライアントに配らず自分のゲームに使う
+        if (_stateSync)
         {
-            if (connection->GetID() != message._player)
-            {
-                message_server_control::SyncPlayerAction send_msg =
-                {
-                    ._player = message._player,
-                    ._tick = message._tick,
-                    ._obj = message._obj,
-                };
+            _stateSync->Receive(player, tick, obj);
+            return;
+        }
+        // 戻ってきたプレイヤーの最初の入力. 抜けていた間をこのTickの手前まで埋め切ってから使う
+        auto& absent = _absent[static_cast<std::size_t>(*player)];
+        if (absent)
+        {
+            FillAbsentInputs(player, tick);
+            absent.reset();
+        }
+        if (_config._arbitrateInputs && !_arbiter.Add(static_cast<std::size_t>(*player), tick, obj, decltype(_arbiter)::clock::now()))
+        {
+            fmt::print("Discarded late input of player {} for tick {}\n", *player, *tick);
+            return;
+        }
+        CommitInput(player, tick, obj);
+    }
+    void Server::CommitInput(PlayerID player, GameTick tick, const SyncWindow& obj)
+    {
+        if (_config._aggregateInputs)
+        {
+            _aggregator.Add(static_cast<std::size_t>(*player), tick, obj, decltype(_aggregator)::clock::now());
+            return;
+        }
 
-                connection->SendAsControl(send_msg);
-            }
+        // 送り主にも同じバイト列が届くが、クライアント側で自分の入力は読み飛ばす
+        message_server_control::SyncPlayerAction message;
+        message._player = player;
+        message._tick = tick;
+        message.SetInputs(obj);
+        AppendMessage(_fanOut, message);
+    }
+    void Server::OnReceiveChecksums(const message_client_control::StateChecksums& message)
+    {
+        for (std::size_t i = 0; i < message._count && i < ChecksumBatchSize; i++)
+        {
+            auto tick = message._tick + GameTick{ static_cast<GameTick::value_type>(i) };
+            if (auto desync = _desync.Add(static_cast<std::size_t>(*message._player), tick, message._hashes[i]))
+                NotifyDesync(*desync);
+        }
+    }
+    void Server::NotifyDesync(const net::DesyncDetector<MaxPlayerNum>::Desync& desync)
+    {
+        fmt::print("Desync detected at tick {}. players: {:b}\n", *desync._tick, desync._players);
+
+        message_server_control::DesyncDetected notification;
+        notification._tick = desync._tick;
+        notification._players = desync._players;
+        AppendMessage(_fanOut, notification);
+    }
+    void Server::OnReceiveFrameAdvantage(PlayerID player, const message_client_control::FrameAdvantageReport& message)
+    {
+        for (auto& client : _connections)
+        {
+            if (client->GetState() != ClientConnection::State::Ingame || client->GetID() == player)
+                continue;
+            auto id = static_cast<std::size_t>(*client->GetID());
+            if (message._count <= id || (message._measured & (PlayerMask{ 1 } << id)) == 0)
+                continue;
+
+            message_server_control::FrameAdvantageReport relay;
+            relay._player = player;
+            relay._advantage = message._advantages[id];
+            client->SendAsControl(relay);
+        }
+    }
+    void Server::OnReceiveStateAck(std::size_t peer, GameTick tick)
+    {
+        if (_stateSync)
+            _stateSync->Ack(peer, tick);
+    }
+    void Server::ArbitrateInputs()
+    {
+        auto fill = [this](std::size_t, GameTick, const std::optional<SyncWindow>& last) {
+            SyncWindow obj{};
+            if (_config._inputFill == Config::InputFill::RepeatMove && last && std::holds_alternative<actions::Move>(last->back()._action))
+                obj.fill(last->back());
+            return obj;
+        };
+        _arbiter.Collect(decltype(_arbiter)::clock::now(), fill, [this](std::size_t player_id, GameTick tick, const SyncWindow& obj) {
+            fmt::print("Player {} missed the input deadline for tick {}. Filled in by the server\n", player_id, *tick);
+            CommitInput(static_cast<PlayerID::value_type>(player_id), tick, obj);
+        });
+    }
+    void Server::CollectAggregatedInputs()
+    {
+        using message_type = message_server_control::SyncTickActions;
+
+        _aggregator.Collect(decltype(_aggregator)::clock::now(), [this](GameTick tick, PlayerMask players, std::span<const SyncWindow> inputs) {
+            message_type message;
+            message._tick = tick;
+            message.SetInputs(players, inputs);
+            AppendMessage(_fanOut, message);
+        });
+    }
+    void Server::FillAbsentInputs()
+    {
+        // 他のプレイヤーの入力が届いているTickまでにする. それより先まで埋めると、クライアントのSyncBufferに入らない
+        std::optional<GameTick> frontier;
+        for (auto& client : _connections)
+        {
+            if (client->GetState() != ClientConnection::State::Ingame)
+                continue;
+            if (auto tick = client->GetLastInputTick(); tick && (!frontier || *frontier < *tick))
+                frontier = tick;
+        }
+        if (!frontier)
+            return;
+
+        for (std::size_t p = 0; p < _absent.size(); p++)
+        {
+            auto& absent = _absent[p];
+            if (!absent)
+                continue;
+            auto until = *frontier + GameTick{ 1 };
+            if (absent->_until && *absent->_until < until)
+                until = *absent->_until;
+            FillAbsentInputs(static_cast<PlayerID::value_type>(p), until);
         }
     }
+    void Server::FillAbsentInputs(PlayerID player, GameTick until)
+    {
+        auto& absent = _absent[static_cast<std::size_t>(*player)];
+        assert(absent);
+        for (; absent->_next < until; absent->_next = absent->_next + GameTick{ SyncWindowSize })
+        {
+            // 締め切りを過ぎてサーバーが既に決めたウィンドウは、その入力のままにする
+            SyncWindow obj{};
+            if (_config._arbitrateInputs && !_arbiter.Add(static_cast<std::size_t>(*player), absent->_next, obj, decltype(_arbiter)::clock::now()))
+                continue;
+            CommitInput(player, absent->_next, obj);
+        }
+    }
+    void Server::FlushFanOut()
+    {
+        if (_fanOut.Empty())
+            return;
+        // 途中から参加したクライアントに送り直せるよう、配ったものは全て残しておく
+        //  送り直している途中のクライアントがいるかもしれないので、上限に達しても捨てずに、それ以上足さない
+        auto data = _fanOut.Data();
+        if (!_backlogFull && MaxBacklogSize < _backlog.size() + data.size())
+        {
+            _backlogFull = true;
+            fmt::print("The backlog reached {} bytes. No more late joins are accepted\n", _backlog.size());
+        }
+        if (!_backlogFull)
+            _backlog.insert(_backlog.end(), data.begin(), data.end());
+
+        // 抜けたクライアントや、まだ試合に加わっていないクライアントには送らない
+        auto send = [](const std::shared_ptr<ClientConnection>& connection, std::span<const std::byte> messages) {
+            if (connection && connection->GetState() == ClientConnection::State::Ingame)
+                connection->SendAsControl(messages);
+        };
+        for (auto& spectator : _spectators)
+        {
+            send(spectator, data);
+        }
+        _fanOut.Flush(_connections, send);
+    }
     void Server::UpdateAtLobby()
     {
         std::lock_guard lock{ _mutexConnection };
@@ -188,17 +565,25 @@ namespace tofu::ball
             if (!client)
                 continue;
             client->Update();
-            if (client->GetState() != ClientConnection::State::Ready)
+            if (client->GetState() != ClientConnection::State::Ready || !client->IsClockSynced())
                 ready = false;
         }
-        if (_clientNum < MaxPlayerNum || !ready)
+        if (static_cast<std::size_t>(_clientNum) < GetPlayerNum() || !ready)
             return;
 
+        // 最も遠いクライアントにもStartGameが届いてから始まるようにする
+        net::ClockSyncEstimator::duration lead{ 0 };
+        for (auto& client : _connections)
+        {
+            lead = std::max(lead, client->GetClock().GetRoundTrip());
+        }
+        _startTime = net::ClockSyncEstimator::Now() + lead + StartTimeMargin;
+
         for (auto& client : _connections)
         {
             if (!client)
                 continue;
-            client->StartGame();
+            client->StartGame(*_startTime);
         }
 
         _state = State::InGame;
@@ -206,20 +591,307 @@ namespace tofu::ball
 
     void Server::UpdateAtIngame()
     {
+        AcceptConnectionChanges();
+        // このTickに各クライアントへ送るメッセージは、最後にまとめて送る
+        auto cork = [](const std::shared_ptr<ClientConnection>& connection, bool corked) {
+            if (!connection)
+                return;
+            if (corked)
+                connection->CorkControl();
+            else
+                connection->UncorkControl();
+        };
+        for (auto& client : _connections)
+        {
+            cork(client, true);
+        }
+        for (auto& spectator : _spectators)
+        {
+            cork(spectator, true);
+        }
+
         for (auto& client : _connections)
         {
-            if (!client)
-                continue;
             client->Update();
         }
+        for (auto& spectator : _spectators)
+        {
+            if (spectator)
+                spectator->Update();
+        }
+        StartLateJoins();
+
+        // 抜けたプレイヤーの分は、締め切りを待たずに空の入力で決める
+        FillAbsentInputs();
+        if (_config._arbitrateInputs)
+        {
+            ArbitrateInputs();
+        }
+        UpdateInputDelay();
+        if (_config._aggregateInputs)
+        {
+            CollectAggregatedInputs();
+        }
+        FlushFanOut();
+        for (auto& client : _connections)
+        {
+            cork(client, false);
+        }
+        for (auto& spectator : _spectators)
+        {
+            cork(spectator, false);
+        }
         
         _game.update();
     }
 
+    void Server::UpdateInputDelay()
+    {
+        // 入力はサーバーを経由して他のクライアントに届くので、片道の時間は送り手と受け手のRTTの半分ずつの和になる
+        //  どの2人の組でも足りるよう、最大のRTTとジッタで見積もる
+        std::chrono::microseconds rtt{ 0 };
+        std::chrono::microseconds jitter{ 0 };
+        GameTick last_input_tick = 0;
+        for (auto& client : _connections)
+        {
+            // 抜けているプレイヤーの入力はサーバーが埋めるので、遅延を見積もらない
+            if (client->GetState() == ClientConnection::State::Disconnected)
+                continue;
+            auto& latency = client->GetLatency();
+            auto input_tick = client->GetLastInputTick();
+            if (!latency.HasRtt() || !input_tick)
+                return;
+
+            rtt = std::max(rtt, latency.GetRtt());
+            jitter = std::max(jitter, latency.GetJitter());
+            last_input_tick = std::max(last_input_tick, *input_tick);
+        }
+
+        auto delay = _inputDelay.Update(rtt, jitter, net::InputDelayController::clock::now());
+        if (!delay)
+            return;
+
+        // どのクライアントも、他のクライアントの入力が揃っているTickまでしか進めない
+        //  他のクライアントの入力はこの通知と同じストリームで後から届くので、サーバーがまだ受け取っていないTickで切り替えれば、
+        //  全クライアントが切り替えより前に通知を受け取れる
+        GameTick tick = last_input_tick + GameTick{ SyncWindowSize + 1 };
+        if (_lastInputDelayTick && tick <= *_lastInputDelayTick)
+            tick = *_lastInputDelayTick + GameTick{ 1 };
+        _lastInputDelayTick = tick;
+
+        message_server_control::ChangeInputDelay message;
+        message._tick = tick;
+        message._delay = static_cast<std::uint8_t>(*delay);
+        // このフレームに受け取った入力より後ろに積むので、変更より後の入力は必ず変更の後に届く
+        AppendMessage(_fanOut, message);
+
+        fmt::print("Change input delay: {} (from tick {}) RTT:{}us jitter:{}us\n", *delay, *tick, rtt.count(), jitter.count());
+    }
+
+    void Server::AcceptConnectionChanges()
+    {
+        std::vector<std::shared_ptr<net::QuicConnection>> late_connections;
+        std::vector<std::shared_ptr<net::QuicConnection>> closed_connections;
+        {
+            std::lock_guard lock{ _mutexConnection };
+            late_connections.swap(_lateConnections);
+            closed_connections.swap(_closedConnections);
+        }
+
+        // 繋いですぐ切れた接続も、加えてから外す
+        for (auto& connection : late_connections)
+        {
+            OnLateConnect(connection);
+        }
+        for (auto& connection : closed_connections)
+        {
+            OnDisconnect(connection);
+        }
+    }
+
+    void Server::OnLateConnect(const std::shared_ptr<net::QuicConnection>& quic)
+    {
+        // 配ったメッセージ列が途中で切れているので、今の状態を作り直させられない
+        if (_backlogFull)
+        {
+            quic->Close();
+            return;
+        }
+
+        for (std::size_t p = 0; p < _connections.size(); p++)
+        {
+            if (_connections[p]->GetState() != ClientConnection::State::Disconnected)
+                continue;
+            // 抜けたプレイヤーの枠に入れる. 試合に加わるまでは、引き続きサーバーが入力を埋める
+            _connections[p] = std::make_shared<ClientConnection>(this, quic, static_cast<PlayerID::value_type>(p), p);
+            fmt::print("Reconnecting as player {}\n", p);
+            return;
+        }
+
+        for (std::size_t i = 0; i < _spectators.size(); i++)
+        {
+            if (_spectators[i])
+                continue;
+            _spectators[i] = std::make_shared<ClientConnection>(this, quic, -1, MaxPlayerNum + i);
+            fmt::print("Connecting as spectator {}\n", i);
+            return;
+        }
+
+        quic->Close();
+    }
+
+    void Server::OnDisconnect(const std::shared_ptr<net::QuicConnection>& quic)
+    {
+        for (auto& spectator : _spectators)
+        {
+            if (!spectator || spectator->GetConnection() != quic)
+                continue;
+            fmt::print("Spectator left: {}\n", spectator->GetName());
+            if (_stateSync)
+                _stateSync->RemovePeer(spectator->GetPeer());
+            spectator = nullptr;
+            return;
+        }
+
+        for (auto& client : _connections)
+        {
+            if (client->GetConnection() != quic || client->GetState() == ClientConnection::State::Disconnected)
+                continue;
+
+            auto player = client->GetID();
+            fmt::print("Player left: {} ({})\n", client->GetName(), *player);
+            auto metrics = client->GetControlSendMetrics();
+            fmt::print("Sent to {}: {:.2f} packets/tick, {:.1f} bytes/packet\n", client->GetName(), metrics.PacketsPerTick(), metrics.AveragePayload());
+            client->Disconnect();
+            // 抜けたプレイヤーのハッシュは届かないので、残りのプレイヤーだけで突き合わせる
+            if (auto desync = _desync.RemovePlayer(static_cast<std::size_t>(*player)))
+                NotifyDesync(*desync);
+
+            auto& absent = _absent[static_cast<std::size_t>(*player)];
+            if (_stateSync)
+            {
+                _stateSync->RemovePeer(client->GetPeer());
+                // 最後の入力から予測し続けないよう、何もしない入力を今Tickの入力として渡す
+                _stateSync->Receive(player, GameTick{ 0 }, SyncWindow{});
+            }
+            else if (absent)
+            {
+                // 戻ってくる途中でまた抜けた. 埋めている続きから、戻ってくるまで埋め続ける
+                absent->_until.reset();
+            }
+            else
+            {
+                absent = AbsentInputs{ ._next = client->GetNextInputTick() };
+            }
+            break;
+        }
+
+        auto connected = std::ranges::any_of(_connections, [](const std::shared_ptr<ClientConnection>& client) {
+            return client->GetState() != ClientConnection::State::Disconnected;
+        });
+        if (!connected)
+        {
+            fmt::print("All players left. Closing the server\n");
+            Stop();
+        }
+    }
+
+    void Server::StartLateJoins()
+    {
+        for (auto& client : _connections)
+        {
+            if (client->GetState() == ClientConnection::State::Ready && client->IsClockSynced())
+                StartLateJoin(*client);
+        }
+        for (auto& spectator : _spectators)
+        {
+            if (spectator && spectator->GetState() == ClientConnection::State::Ready && spectator->IsClockSynced())
+                StartLateJoin(*spectator);
+        }
+    }
+
+    void Server::StartLateJoin(ClientConnection& client)
+    {
+        // 接続した後に_backlogが上限に達した
+        if (_backlogFull)
+        {
+            fmt::print("Rejecting late join of {}: the backlog is full\n", client.GetName());
+            client.Disconnect();
+            client.GetConnection()->Close();
+            return;
+        }
+
+        // 追いつくのにかかる時間の分だけ先のTickから、入力を送ってもらう. それまではサーバーが空の入力で埋める
+        auto live_tick = *EstimateLiveTick();
+        GameTick first_input_tick = ActionDelay;
+        if (!client.IsSpectator())
+        {
+            auto& absent = _absent[static_cast<std::size_t>(*client.GetID())];
+            if (absent)
+                first_input_tick = absent->_next;
+            auto lead = live_tick / CatchUpSpeedup + static_cast<GameTick::value_type>(LateJoinMargin / TickPeriod);
+            auto target = GameTick{ live_tick + lead };
+            // ウィンドウの区切りを、抜ける前の入力と揃える
+            if (first_input_tick < target)
+                first_input_tick = first_input_tick + GameTick{ (*target - *first_input_tick + SyncWindowSize - 1) / SyncWindowSize * SyncWindowSize };
+            if (absent)
+                absent->_until = first_input_tick;
+            // 自分の入力を使い始めるまでの状態は、他のプレイヤーの分で比べ終わっている
+            _desync.AddPlayer(static_cast<std::size_t>(*client.GetID()), first_input_tick);
+        }
+
+        client.StartLateGame(*_startTime, first_input_tick, _backlog.size());
+        if (_stateSync)
+            _stateSync->AddPeer(client.GetPeer(), client.GetConnection());
+
+        fmt::print("Late join: {} at tick {}. inputs from tick {}, backlog {} bytes\n", client.GetName(), live_tick, *first_input_tick, _backlog.size());
+    }
+
+    GameTick Server::EstimateLiveTick() const
+    {
+        // クライアントはお互いの差を縮めるために1Tickを伸ばすので、開始からの時間をTickPeriodで割ると進みすぎる
+        //  届いている入力から数える. 窓の最後の入力は、入力遅延の分だけ前のTickに送られている
+        std::optional<GameTick> frontier;
+        for (auto& client : _connections)
+        {
+            if (client->GetState() != ClientConnection::State::Ingame)
+                continue;
+            if (auto tick = client->GetLastInputTick(); tick && (!frontier || *frontier < *tick))
+                frontier = tick;
+        }
+        auto delay = static_cast<std::int64_t>(_inputDelay.GetDelay());
+        if (frontier)
+            return GameTick{ static_cast<GameTick::value_type>(std::max<std::int64_t>(0, static_cast<std::int64_t>(**frontier) - delay)) };
+
+        // まだ誰からも入力が届いていなければ、時間から求める
+        auto elapsed = net::ClockSyncEstimator::Now() - *_startTime;
+        return GameTick{ static_cast<GameTick::value_type>(std::max<std::int64_t>(0, elapsed / TickPeriod)) };
+    }
+
     void Server::InitGame()
     {
+        if (_config._stateSync)
+        {
+            _game.setSyncMode(SyncMode::ServerAuthoritative);
+            // 状態を決めるのはサーバーなので、サーバーが使った入力を記録すれば試合を再現できる
+            if (_startTime)
+            {
+                auto start_time = std::chrono::duration_cast<std::chrono::seconds>(_startTime->time_since_epoch());
+                _game.setReplayPath(fmt::format("replay_{}_server.tofureplay", start_time.count()));
+            }
+        }
         _game.initBaseSystems();
         _game.initEnitites();
+
+        if (_config._stateSync)
+        {
+            _stateSync = StateSyncServerSystem::Attach(_game);
+            for (auto& client : _connections)
+            {
+                if (client)
+                    _stateSync->AddPeer(client->GetPeer(), client->GetConnection());
+            }
+        }
     }
 }
 
@@ -2,13 +2,129 @@
 
 namespace tofu::ball
 {
-    std::optional<MessageHeader> PeekHeader(const std::shared_ptr<net::QuicStream>& stream)
+    std::tuple<std::optional<MessageHeader>, tofu::Error> PeekHeader(const std::shared_ptr<net::QuicStream>& stream)
     {
+        // ヘッダの大きさは届くまで分からないので、最大の大きさまで届いている分を見る
+        std::array<std::byte, net::MaxFrameHeaderSize> bytes;
+        auto size = std::min(stream->ReceivedSize(), bytes.size());
+        if (size == 0)
+            return { std::nullopt, std::nullopt };
+
+        stream->Peek(bytes.data(), size);
         MessageHeader header;
-        if (stream->ReceivedSize() < sizeof(header))
-            return std::nullopt;
+        switch (net::ParseFrameHeader(std::span{ bytes }.first(size), header))
+        {
+        case net::FrameStatus::Complete:
+            return { header, std::nullopt };
+        case net::FrameStatus::Incomplete:
+            return { std::nullopt, std::nullopt };
+        default:
+            return { std::nullopt, TOFU_MAKE_ERROR("Received broken message header.") };
+        }
+    }
+
+    namespace
+    {
+        using CodecInput = SyncObjectCodec::Input;
+
+        CodecInput to_codec_input(const SyncObject& obj) noexcept
+        {
+            CodecInput input;
+            input._kind = static_cast<std::uint8_t>(obj._action.index());
+            std::visit([&](const auto& action) {
+                if constexpr (requires { action._target; })
+                {
+                    input._x = SyncObjectCodec::Quantize(action._target._x);
+                    input._y = SyncObjectCodec::Quantize(action._target._y);
+                }
+            }, obj._action);
+            return input;
+        }
+
+        std::optional<SyncObject> from_codec_input(const CodecInput& input) noexcept
+        {
+            tVec2 target{ SyncObjectCodec::Dequantize(input._x), SyncObjectCodec::Dequantize(input._y) };
+            switch (input._kind)
+            {
+            case 0:
+                return SyncObject{ actions::Null{} };
+            case 1:
+                return SyncObject{ actions::Move{ target } };
+            case 2:
+                return SyncObject{ actions::Dash{ target } };
+            default:
+                return std::nullopt;
+            }
+        }
+        static_assert(std::variant_size_v<actions::Variant> == 3, "from_codec_input に新しいアクションを追加すること");
+    }
+
+    SyncObject quantize(const SyncObject& obj) noexcept
+    {
+        return *from_codec_input(to_codec_input(obj));
+    }
 
-        stream->Peek(reinterpret_cast<std::byte*>(&header), sizeof(header));
-        return header;
+    std::size_t encode_sync_windows(std::span<const SyncWindow> windows, std::span<std::byte> out) noexcept
+    {
+        BitWriter writer{ out };
+        SyncObjectCodec::Encoder encoder{ writer };
+        for (auto& window : windows)
+        {
+            for (auto& obj : window)
+            {
+                [[maybe_unused]] auto written = encoder.Add(to_codec_input(obj));
+                assert(written);
+            }
+        }
+        return writer.Finish();
+    }
+
+    bool decode_sync_windows(std::span<const std::byte> in, std::span<SyncWindow> windows) noexcept
+    {
+        BitReader reader{ in };
+        SyncObjectCodec::Decoder decoder{ reader };
+        for (auto& window : windows)
+        {
+            for (auto& obj : window)
+            {
+                auto input = decoder.Next();
+                if (!input)
+                    return false;
+                auto decoded = from_codec_input(*input);
+                if (!decoded)
+                    return false;
+                obj = *decoded;
+            }
+        }
+        return true;
+    }
+
+    std::size_t encode_sync_objects(std::span<const SyncObject> objs, std::span<std::byte> out) noexcept
+    {
+        BitWriter writer{ out };
+        SyncObjectCodec::Encoder encoder{ writer };
+        for (auto& obj : objs)
+        {
+            [[maybe_unused]] auto written = encoder.Add(to_codec_input(obj));
+            assert(written);
+        }
+        return writer.Finish();
+    }
+
+    bool decode_sync_objects(std::span<const std::byte> in, std::span<SyncObject> objs) noexcept
+    {
+        BitReader reader{ in };
+        SyncObjectCodec::Decoder decoder{ reader };
+        for (auto& obj : objs)
+        {
+            auto input = decoder.Next();
+            if (!input)
+                return false;
+            auto decoded = from_codec_input(*input);
+            if (!decoded)
+                return false;
+            obj = *decoded;
+        }
+        return true;
     }
 }
\ No newline at end of file
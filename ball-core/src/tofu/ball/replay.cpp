@@ -0,0 +1,114 @@
+﻿#include "tofu/ball/replay.h"
+
+#include <cstring>
+
+#include <tofu/utils/job.h>
+#include <tofu/ecs/physics.h>
+
+#include "tofu/ball/sync.h"
+#include "tofu/ball/snapshot.h"
+
+namespace tofu::ball
+{
+    Error ReplayRecorder::Open(const std::string& path, const Game::Config& config)
+    {
+        if (auto error = _writer.Open(path))
+            return error;
+
+        ReplayHeader header;
+        header._syncMode = static_cast<std::uint8_t>(config._syncMode);
+        header._playerNum = static_cast<std::uint8_t>(config._playerNum);
+        header._tickPeriod = static_cast<std::uint32_t>(TickPeriod.count());
+        _writer.WriteValue(header);
+        _nextTick = 1;
+        return std::nullopt;
+    }
+
+    void ReplayRecorder::Record(GameTick tick, std::span<const SyncObject> inputs)
+    {
+        assert(tick == _nextTick);
+        assert(inputs.size() <= MaxPlayerNum);
+        _nextTick = tick + GameTick{ 1 };
+
+        std::array<std::byte, 1 + ReplayRecordCapacity> record;
+        auto size = encode_sync_objects(inputs, std::span{ record }.subspan(1));
+        record[0] = static_cast<std::byte>(size);
+        _writer.Write(std::span{ record }.first(1 + size));
+    }
+
+    Error ReplayPlayer::Open(const std::string& path)
+    {
+        if (auto error = _file.Open(path))
+            return error;
+
+        auto bytes = _file.Bytes();
+        if (bytes.size() < sizeof(ReplayHeader))
+            return TOFU_MAKE_ERROR("Replay is too short. path=({}), size=({})", path, bytes.size());
+        std::memcpy(&_header, bytes.data(), sizeof(ReplayHeader));
+
+        if (_header._magic != ReplayMagic)
+            return TOFU_MAKE_ERROR("Not a replay file. path=({})", path);
+        if (_header._version != ReplayVersion)
+            return TOFU_MAKE_ERROR("Unsupported replay version. path=({}), version=({})", path, _header._version);
+        if (_header._playerNum < 1 || MaxPlayerNum < _header._playerNum)
+            return TOFU_MAKE_ERROR("Invalid player num in replay. path=({}), player_num=({})", path, _header._playerNum);
+        if (static_cast<std::uint8_t>(SyncMode::ServerAuthoritative) < _header._syncMode)
+            return TOFU_MAKE_ERROR("Invalid sync mode in replay. path=({}), sync_mode=({})", path, _header._syncMode);
+
+        // 記録されているのは確定した入力なので、予測も巻き戻しもせず完全同期で進める
+        //  ロールバック方式の試合のワールドの扱いはRunで合わせる
+        _game = std::make_unique<Game>(Game::Config{
+            ._syncMode = SyncMode::Completely,
+            ._playerNum = _header._playerNum,
+            });
+        _game->initBaseSystems();
+        _game->initEnitites();
+
+        _tickCount = 0;
+        _truncated = false;
+        return std::nullopt;
+    }
+
+    Error ReplayPlayer::Run()
+    {
+        assert(_game);
+        auto service_locator = _game->getServiceLocator();
+        auto sync = service_locator->Get<SyncSystem>();
+        auto job_scheduler = service_locator->Get<JobScheduler>();
+        // ロールバック方式では、毎Tick保存する前にワールドを作り直している (RollbackSyncSystem::SaveSnapshot)
+        //  作り直すとwarm startingもTickをまたいだスリープも効かず結果が変わるので、再生でも毎Tick作り直す
+        auto physics = _header._syncMode == static_cast<std::uint8_t>(SyncMode::Rollback) ? service_locator->Get<Physics>() : nullptr;
+
+        std::array<SyncObject, MaxPlayerNum> inputs;
+        auto players = std::span{ inputs }.first(_header._playerNum);
+
+        auto begin = std::chrono::steady_clock::now();
+        auto rest = _file.Bytes().subspan(sizeof(ReplayHeader));
+        while (!rest.empty())
+        {
+            auto size = std::to_integer<std::size_t>(rest[0]);
+            if (ReplayRecordCapacity < size)
+                return TOFU_MAKE_ERROR("Broken replay record. tick=({}), size=({})", _tickCount + 1, size);
+            if (rest.size() < 1 + size)
+            {
+                _truncated = true;
+                break;
+            }
+            if (!decode_sync_objects(rest.subspan(1, size), players))
+                return TOFU_MAKE_ERROR("Broken replay record. tick=({})", _tickCount + 1);
+            rest = rest.subspan(1 + size);
+
+            // 入力遅延分のTickには既定の入力が入っているが、記録した入力で上書きしてよい
+            for (std::size_t p = 0; p < players.size(); p++)
+                sync->SetData(p, GameTick{ 0 }, players[p]);
+            assert(sync->CanStep());
+            if (physics)
+                physics->DiscardTransientState();
+            job_scheduler->Run();
+            _tickCount++;
+        }
+        _elapsed = std::chrono::steady_clock::now() - begin;
+        _checksum = compute_world_checksum(service_locator, _game->getRegistry());
+        return std::nullopt;
+    }
+}
@@ -0,0 +1,109 @@
+﻿#include "tofu/ball/snapshot.h"
+
+#include <tofu/ecs/core.h>
+#include <tofu/ecs/physics.h>
+#include <tofu/utils/state_hasher.h>
+
+#include "tofu/ball/actions.h"
+#include "tofu/ball/player.h"
+#include "tofu/ball/stage.h"
+
+namespace
+{
+    using namespace tofu;
+
+    template<class TComponent>
+    void save_components(observer_ptr<entt::registry> registry, SnapshotBuffer& buffer)
+    {
+        auto view = registry->view<TComponent>();
+        buffer.Write(static_cast<std::uint32_t>(view.size()));
+        for (auto entity : view)
+        {
+            buffer.Write(entity);
+            buffer.Write(view.template get<TComponent>(entity));
+        }
+    }
+
+    template<class TComponent>
+    Error load_components(observer_ptr<entt::registry> registry, SnapshotReader& reader)
+    {
+        std::uint32_t count;
+        if (!reader.Read(count))
+            return TOFU_MAKE_ERROR("World snapshot is truncated.");
+
+        for (std::uint32_t i = 0; i < count; i++)
+        {
+            entt::entity entity;
+            TComponent component;
+            if (!reader.Read(entity) || !reader.Read(component))
+                return TOFU_MAKE_ERROR("World snapshot is truncated.");
+
+            auto current = registry->valid(entity) ? registry->try_get<TComponent>(entity) : nullptr;
+            if (!current)
+                return TOFU_MAKE_ERROR("World snapshot refers to a missing component. entity={}", static_cast<std::uint32_t>(entity));
+            *current = component;
+        }
+        return std::nullopt;
+    }
+}
+
+namespace tofu::ball
+{
+    void save_world_snapshot(observer_ptr<ServiceLocator> service_locator, observer_ptr<entt::registry> registry, SnapshotBuffer& buffer)
+    {
+        buffer.Clear();
+        buffer.Write(service_locator->Get<TickCounter>()->GetCurrent());
+
+        save_components<Transform>(registry, buffer);
+        save_components<Player>(registry, buffer);
+        save_components<Ball>(registry, buffer);
+        save_components<Goal>(registry, buffer);
+
+        service_locator->Get<Physics>()->SaveSnapshot(buffer);
+    }
+
+    Error load_world_snapshot(observer_ptr<ServiceLocator> service_locator, observer_ptr<entt::registry> registry, const SnapshotBuffer& buffer)
+    {
+        SnapshotReader reader{ buffer };
+
+        GameTick tick;
+        if (!reader.Read(tick))
+            return TOFU_MAKE_ERROR("World snapshot is truncated.");
+
+        if (auto error = load_components<Transform>(registry, reader))
+            return error;
+        if (auto error = load_components<Player>(registry, reader))
+            return error;
+        if (auto error = load_components<Ball>(registry, reader))
+            return error;
+        if (auto error = load_components<Goal>(registry, reader))
+            return error;
+
+        if (auto error = service_locator->Get<Physics>()->LoadSnapshot(reader))
+            return error;
+        if (!reader.IsEnd())
+            return TOFU_MAKE_ERROR("World snapshot has {} trailing bytes.", reader.Remaining());
+
+        service_locator->Get<TickCounter>()->Set(tick);
+        service_locator->Get<ActionQueue>()->SetCurrentTick(tick);
+
+        return std::nullopt;
+    }
+
+    std::uint64_t compute_world_checksum(observer_ptr<ServiceLocator> service_locator, observer_ptr<entt::registry> registry)
+    {
+        StateHasher hasher;
+        hasher.Add(*service_locator->Get<TickCounter>()->GetCurrent());
+
+        for (auto&& [entity, transform] : registry->view<Transform>().proxy())
+        {
+            hasher.Add(static_cast<std::uint32_t>(entity));
+            hasher.Add(transform._pos._x);
+            hasher.Add(transform._pos._y);
+            hasher.Add(transform._angle);
+        }
+
+        service_locator->Get<Physics>()->HashState(hasher);
+        return hasher.Get();
+    }
+}
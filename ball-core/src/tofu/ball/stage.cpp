@@ -47,7 +47,7 @@ namespace tofu::ball
 
         for (int i = 0; i < 2; i++) {
             b2PolygonShape shape;
-            stack_vector<b2Vec2, 8> v =
+            small_vector<b2Vec2, b2_maxPolygonVertices> v =
             {
                 {-w, -h},
                 {+w, -h},
@@ -0,0 +1,300 @@
+﻿#include "tofu/ball/state_sync.h"
+
+#include <cstdlib>
+
+#include <tofu/utils/job.h>
+#include <tofu/ecs/physics.h>
+
+#include "tofu/ball/actions.h"
+#include "tofu/ball/player.h"
+#include "tofu/ball/stage.h"
+#include "tofu/ball/frame_updater.h"
+
+#undef GetJob
+
+namespace tofu::ball
+{
+    std::size_t collect_state_entities(observer_ptr<entt::registry> registry, std::span<entt::entity, MaxStateEntities> entities)
+    {
+        std::size_t count = 0;
+        auto player_num = registry->view<Player>().size();
+        for (PlayerID::value_type i = 0; i < static_cast<PlayerID::value_type>(player_num); i++)
+        {
+            auto res_find = Player::Find(registry, i);
+            assert(res_find);
+            entities[count++] = std::get<0>(*res_find);
+        }
+        for (auto entity : registry->view<Ball>())
+        {
+            entities[count++] = entity;
+            break;
+        }
+        return count;
+    }
+
+    StateFrame::Fields capture_state(observer_ptr<entt::registry> registry, entt::entity entity)
+    {
+        auto& transform = registry->get<Transform>(entity);
+        auto body = registry->get<RigidBody>(entity)._body;
+        auto& velocity = body->GetLinearVelocity();
+        return {
+            StateCodec::Quantize(transform._pos._x, StateScale),
+            StateCodec::Quantize(transform._pos._y, StateScale),
+            StateCodec::Quantize(transform._angle, StateScale),
+            StateCodec::Quantize(velocity.x, StateScale),
+            StateCodec::Quantize(velocity.y, StateScale),
+            StateCodec::Quantize(body->GetAngularVelocity(), StateScale),
+        };
+    }
+
+    void capture_state(observer_ptr<entt::registry> registry, StateFrame& frame)
+    {
+        std::array<entt::entity, MaxStateEntities> entities;
+        auto count = collect_state_entities(registry, entities);
+        for (std::size_t i = 0; i < count; i++)
+        {
+            frame._entities[i] = capture_state(registry, entities[i]);
+        }
+        frame._count = static_cast<std::uint32_t>(count);
+    }
+
+    void apply_state(observer_ptr<entt::registry> registry, entt::entity entity, const StateFrame::Fields& fields)
+    {
+        auto& transform = registry->get<Transform>(entity);
+        transform._pos._x = StateCodec::Dequantize(fields[0], StateScale);
+        transform._pos._y = StateCodec::Dequantize(fields[1], StateScale);
+        transform._angle = StateCodec::Dequantize(fields[2], StateScale);
+
+        // 次のTickのFollowTransformを待たずに、速度もbox2d世界に書き込む
+        auto body = registry->get<RigidBody>(entity)._body;
+        body->SetTransform(b2Vec2{ transform._pos._x, transform._pos._y }, transform._angle);
+        body->SetLinearVelocity(b2Vec2{ StateCodec::Dequantize(fields[3], StateScale), StateCodec::Dequantize(fields[4], StateScale) });
+        body->SetAngularVelocity(StateCodec::Dequantize(fields[5], StateScale));
+        body->SetAwake(true);
+    }
+
+    StateSyncServerSystem::StateSyncServerSystem(observer_ptr<ServiceLocator> service_locator, observer_ptr<entt::registry> registry)
+        : _serviceLocator(service_locator)
+        , _registry(registry)
+    {
+    }
+
+    observer_ptr<StateSyncServerSystem> StateSyncServerSystem::Attach(Game& game)
+    {
+        auto service_locator = game.getServiceLocator();
+        auto system = service_locator->Register(std::make_unique<StateSyncServerSystem>(service_locator, game.getRegistry()));
+
+        using namespace tofu::jobs;
+        using namespace tofu::ball::jobs;
+        auto job_scheduler = service_locator->Get<JobScheduler>();
+        // 届いた入力を詰めてから進める
+        job_scheduler->Register(make_job<ApplyStateSyncInputs>({ get_job_tag<StartFrame>() }, {}, system));
+        job_scheduler->GetJob(get_job_tag<CheckStepable>())->AddDependency(get_job_tag<ApplyStateSyncInputs>());
+        // シミュレーションし終えた状態を配る
+        job_scheduler->Register(make_job<BroadcastState>({ get_job_tag<StepPhysics>() }, { get_condition_tag<job_conditions::IsStepable>() }, system));
+        job_scheduler->GetJob(get_job_tag<EndUpdate>())->AddDependency(get_job_tag<BroadcastState>());
+
+        return system;
+    }
+
+    void StateSyncServerSystem::AddPeer(std::size_t peer, const std::shared_ptr<net::QuicConnection>& quic)
+    {
+        assert(peer < MaxStatePeers);
+        std::lock_guard lock{ _mutexPeers };
+        _peers[peer] = quic;
+        _baselines.Reset(peer);
+    }
+
+    void StateSyncServerSystem::RemovePeer(std::size_t peer)
+    {
+        assert(peer < MaxStatePeers);
+        std::lock_guard lock{ _mutexPeers };
+        _peers[peer] = nullptr;
+    }
+
+    void StateSyncServerSystem::Receive(PlayerID player, GameTick tick, const SyncWindow& obj)
+    {
+        _inputQueue.push(InputMessage{ player, tick, obj });
+    }
+
+    void StateSyncServerSystem::Ack(std::size_t peer, GameTick tick)
+    {
+        _baselines.Ack(peer, tick);
+    }
+
+    void StateSyncServerSystem::ApplyInputs()
+    {
+        auto sync = _serviceLocator->Get<SyncSystem>();
+        auto current_tick = _serviceLocator->Get<TickCounter>()->GetCurrent();
+
+        auto count = _inputQueue.size_approx();
+        _inputQueue.pop_n(count, [&](InputMessage&& message) {
+            for (std::uint32_t i = 0; i < SyncWindowSize; i++)
+            {
+                // 遅れて届いた入力も捨てずに、今Tickの入力として使う. 先すぎてバッファに入らない入力は捨てる
+                auto tick = message._tick + GameTick{ i };
+                auto tick_after = tick < current_tick ? GameTick{ 0 } : tick - current_tick;
+                if (SyncBufferSize <= *tick_after)
+                    continue;
+                sync->SetData(static_cast<std::size_t>(*message._player), tick_after, message._obj[i]);
+            }
+        });
+    }
+
+    void StateSyncServerSystem::Broadcast()
+    {
+        StateFrame frame;
+        frame._tick = _serviceLocator->Get<TickCounter>()->GetCurrent();
+        capture_state(_registry, frame);
+        _baselines.Push(frame);
+
+        // 相手が加わったり外れたりするのは稀なので、配り終えるまで待たせる
+        std::lock_guard lock{ _mutexPeers };
+        for (std::size_t p = 0; p < _peers.size(); p++)
+        {
+            if (!_peers[p])
+                continue;
+
+            auto base = _baselines.GetBaseline(p);
+            message_datagram::WorldState message;
+            message._tick = frame._tick;
+            message._hasBase = base != nullptr;
+            message._baseTick = base ? base->_tick : frame._tick;
+            message._entityCount = static_cast<std::uint8_t>(frame._count);
+
+            // 1つのDATAGRAMに収まるだけ詰めて、残りは次のDATAGRAMで送る
+            for (std::size_t first = 0; first < frame._count;)
+            {
+                auto result = StateCodec::Encode(base, frame, first, message._data);
+                // 1エンティティは必ず収まる
+                assert(0 < result._count);
+                message.SetData(first, result._count, result._size);
+                SendDatagram(_peers[p], message);
+                first += result._count;
+            }
+        }
+    }
+
+    StateSyncClientSystem::StateSyncClientSystem(observer_ptr<ServiceLocator> service_locator, observer_ptr<entt::registry> registry, const std::shared_ptr<net::QuicConnection>& quic, PlayerID my_id)
+        : _serviceLocator(service_locator)
+        , _registry(registry)
+        , _quic(quic)
+        , _myId(my_id)
+    {
+    }
+
+    observer_ptr<StateSyncClientSystem> StateSyncClientSystem::Attach(Game& game, const std::shared_ptr<net::QuicConnection>& quic, PlayerID my_id)
+    {
+        auto service_locator = game.getServiceLocator();
+        auto system = service_locator->Register(std::make_unique<StateSyncClientSystem>(service_locator, game.getRegistry(), quic, my_id));
+
+        using namespace tofu::jobs;
+        using namespace tofu::ball::jobs;
+        // 自分の入力でシミュレーションした後に、届いた状態で上書きする
+        auto job_scheduler = service_locator->Get<JobScheduler>();
+        job_scheduler->Register(make_job<ApplyState>({ get_job_tag<StepPhysics>() }, { get_condition_tag<job_conditions::IsStepable>() }, system));
+        job_scheduler->GetJob(get_job_tag<EndUpdate>())->AddDependency(get_job_tag<ApplyState>());
+
+        return system;
+    }
+
+    void StateSyncClientSystem::Receive(const message_datagram::WorldState& message)
+    {
+        // DATAGRAMなので、溢れたら落ちたものとして捨てる. 次のTickの状態で追いつく
+        _stateQueue.try_push(message);
+    }
+
+    void StateSyncClientSystem::Apply()
+    {
+        ReceiveStates();
+
+        std::array<entt::entity, MaxStateEntities> entities;
+        auto count = collect_state_entities(_registry, entities);
+        auto own_index = static_cast<std::size_t>(*_myId);
+        if (own_index < count)
+        {
+            Reconcile(entities[own_index], own_index);
+        }
+        Interpolate(std::span{ entities }.first(count), own_index);
+    }
+
+    void StateSyncClientSystem::ReceiveStates()
+    {
+        bool received = false;
+        auto count = _stateQueue.size_approx();
+        _stateQueue.pop_n(count, [&](message_datagram::WorldState&& message) {
+            std::optional<GameTick> base_tick;
+            if (message._hasBase)
+                base_tick = message._baseTick;
+            if (_receiver.Receive(message._tick, base_tick, message._entityCount, message._first, message._count, message.GetData()))
+                received = true;
+        });
+
+        // ACKも落ちることがあるので、届くたびに最新を返す
+        auto latest = _receiver.GetLatestTick();
+        if (!received || !latest)
+            return;
+        message_datagram::WorldStateAck ack;
+        ack._tick = *latest;
+        SendDatagram(_quic, ack);
+    }
+
+    void StateSyncClientSystem::Reconcile(entt::entity entity, std::size_t index)
+    {
+        auto current_tick = _serviceLocator->Get<TickCounter>()->GetCurrent();
+        _predictions.Push(Prediction{ current_tick, capture_state(_registry, entity) });
+
+        // 新しく揃ったサーバーの状態ごとに1度だけ比べる
+        auto latest = _receiver.GetLatestTick();
+        if (!latest || (_reconciledTick && *latest <= *_reconciledTick))
+            return;
+        _reconciledTick = latest;
+
+        auto server = _receiver.Find(*latest);
+        auto predicted = _predictions.Find(*latest);
+        if (!server || !predicted || server->_count <= index || current_tick < *latest)
+            return;
+
+        StateFrame::Fields error;
+        bool exceeded = false;
+        for (std::size_t f = 0; f < StateFieldCount; f++)
+        {
+            error[f] = server->_entities[index][f] - predicted->_fields[f];
+            if (StateCorrectionThreshold < std::abs(error[f]))
+                exceeded = true;
+        }
+        if (!exceeded)
+            return;
+
+        // そのTickの後に自分の入力で進めた分は残し、ずれだけを今の状態と残りの予測に足す
+        //  足した予測と比べるので、同じずれを何度も直さない
+        for (auto tick = *latest + GameTick{ 1 }; tick <= current_tick; tick = tick + GameTick{ 1 })
+        {
+            auto later = _predictions.Find(tick);
+            if (!later)
+                continue;
+            for (std::size_t f = 0; f < StateFieldCount; f++)
+                later->_fields[f] += error[f];
+        }
+        predicted->_fields = server->_entities[index];
+        apply_state(_registry, entity, _predictions.Find(current_tick)->_fields);
+    }
+
+    void StateSyncClientSystem::Interpolate(std::span<const entt::entity> entities, std::size_t own_index)
+    {
+        // 最新の状態はサーバーから片道分遅れて届く. さらに少し遅らせて、前後の状態が揃っているTickを表示する
+        auto current_tick = _serviceLocator->Get<TickCounter>()->GetCurrent();
+        auto one_way = std::chrono::duration<double, std::micro>(_quic->GetRtt() / 2);
+        auto tick = static_cast<double>(*current_tick) - one_way / TickPeriod - StateInterpolationTicks;
+
+        StateFrame sampled;
+        if (!_receiver.Sample(tick, sampled))
+            return;
+        for (std::size_t i = 0; i < entities.size() && i < sampled._count; i++)
+        {
+            if (i == own_index)
+                continue;
+            apply_state(_registry, entities[i], sampled._entities[i]);
+        }
+    }
+}
@@ -1,7 +1,202 @@
 ﻿#include "tofu/ball/sync.h"
 
+#include <algorithm>
+
+#include <tofu/ecs/physics.h>
+
+#include "tofu/ball/frame_updater.h"
+#include "tofu/ball/desync_check.h"
+#include "tofu/ball/replay.h"
+
+namespace
+{
+    using namespace tofu;
+    using namespace tofu::ball;
+
+    const SyncObject& get_sync_object(const SyncObject& obj)
+    {
+        return obj;
+    }
+    const SyncObject& get_sync_object(const std::optional<SyncObject>& obj)
+    {
+        return *obj;
+    }
+
+    // 1Tick分の入力を、各プレイヤーのActionとしてActionQueueに積む
+    //  data[i]はSyncObjectかstd::optional<SyncObject>
+    template<class TInputs>
+    void enqueue_actions(observer_ptr<ServiceLocator> service_locator, observer_ptr<entt::registry> registry, const TInputs& data)
+    {
+        auto tick = service_locator->Get<TickCounter>()->GetCurrent();
+        auto action_queue = service_locator->Get<ActionQueue>();
+        for (PlayerID::value_type i = 0; i < static_cast<PlayerID::value_type>(std::size(data)); i++)
+        {
+            auto res_find = Player::Find(registry, i);
+            assert(res_find);
+
+            action_queue->Enqueue(tofu::ball::ActionCommand{
+                ._entity = std::get<0>(*res_find),
+                ._action = get_sync_object(data[i])._action,
+                ._tick = tick,
+                });
+        }
+    }
+
+    // 届いていない入力の予測
+    //  Dashは押した瞬間だけのActionなので繰り返さない. Moveは押している間続くので繰り返す
+    SyncObject predict_sync_object(const SyncObject& last)
+    {
+        if (std::holds_alternative<actions::Dash>(last._action))
+            return SyncObject{ ._action = actions::Null{} };
+        return last;
+    }
+}
+
 namespace tofu::ball
 {
+    void SyncSystem::RecordStepable(bool can_step)
+    {
+        if (can_step)
+        {
+            if (StallReportFrames <= _stallFrames)
+            {
+                TOFU_FMT::print("Sync resumed after {} frames.\n", _stallFrames);
+            }
+            _stallFrames = 0;
+            return;
+        }
+
+        _stallFrames++;
+        if (_stallFrames % StallReportFrames != 0)
+            return;
+
+        std::string players;
+        auto waiting = GetWaitingPlayers();
+        for (std::size_t p = 0; p < 64; p++)
+        {
+            if (waiting & (std::uint64_t{ 1 } << p))
+            {
+                if (!players.empty())
+                    players += ", ";
+                players += std::to_string(p);
+            }
+        }
+        TOFU_FMT::print("Sync stalled for {} frames. Waiting for players: [{}]\n", _stallFrames, players);
+    }
+
+    void CompletelySyncSystem::ApplyToActionQueue()
+    {
+        assert(CanStep());
+        enqueue_actions(_serviceLocator, _registry, _sync.Top());
+
+        if (auto recorder = _serviceLocator->Get<ReplayRecorder>())
+            recorder->Record(_serviceLocator->Get<TickCounter>()->GetCurrent(), _sync.Top());
+    }
+
+    RollbackSyncSystem::RollbackSyncSystem(observer_ptr<ServiceLocator> service_locator, observer_ptr<entt::registry> registry, std::size_t player_num, std::uint32_t default_delay)
+        : _serviceLocator(service_locator)
+        , _registry(registry)
+        , _sync(player_num, default_delay, MaxRollbackTick, predict_sync_object)
+    {
+    }
+
+    void RollbackSyncSystem::ApplyToActionQueue()
+    {
+        assert(CanStep());
+        enqueue_actions(_serviceLocator, _registry, _sync.Top());
+
+        // 予測した入力は外れるかもしれないので、巻き戻せなくなったTickの確定した入力を記録する
+        //  最後のMaxRollbackTick Tick分は記録されない
+        auto recorder = _serviceLocator->Get<ReplayRecorder>();
+        auto finalized = _sync.Finalized();
+        if (recorder && finalized)
+        {
+            std::array<SyncObject, MaxPlayerNum> inputs;
+            for (std::size_t p = 0; p < finalized->size(); p++)
+                inputs[p] = *(*finalized)[p];
+            auto tick = _serviceLocator->Get<TickCounter>()->GetCurrent() - GameTick{ MaxRollbackTick };
+            recorder->Record(tick, std::span{ inputs }.first(finalized->size()));
+        }
+    }
+
+    void RollbackSyncSystem::SaveSnapshot()
+    {
+        SaveSnapshot(_sync.CurrentSnapshot());
+    }
+    void RollbackSyncSystem::SaveSnapshot(SnapshotBuffer& snapshot)
+    {
+        // box2dの接触やスリープまでの時間はスナップショットに入らないので、保存する前に捨てて、復元した後と同じワールドにしておく
+        _serviceLocator->Get<Physics>()->DiscardTransientState();
+        save_world_snapshot(_serviceLocator, _registry, snapshot);
+    }
+
+    void RollbackSyncSystem::Rollback()
+    {
+        _sync.Rollback(
+            [this](const SnapshotBuffer& snapshot) {
+                // 同じワールドで保存したものなので、失敗するのはバグ
+                auto error = load_world_snapshot(_serviceLocator, _registry, snapshot);
+                if (error)
+                    error->Dump();
+                assert(!error);
+                _serviceLocator->Get<Physics>()->DiscardTransientState();
+            },
+            [this](SnapshotBuffer& snapshot) { SaveSnapshot(snapshot); },
+            [this]() { Resimulate(); });
+    }
+
+    void RollbackSyncSystem::Resimulate()
+    {
+        // Game::initSystems で登録しているStepTick ~ StepPhysicsと同じ順に処理する
+        _serviceLocator->Get<UpdateSystem>()->StepTick();
+        enqueue_actions(_serviceLocator, _registry, _sync.Top());
+        _serviceLocator->Get<ActionSystem>()->Step();
+        tofu::jobs::StepPhysics{ _serviceLocator->Get<Physics>() }();
+
+        // 予測で進めたときに記録した状態を、再シミュレーションした結果で上書きする
+        if (auto desync_check = _serviceLocator->Get<DesyncCheckSystem>())
+            desync_check->Record();
+    }
+
+    AuthoritativeSyncSystem::AuthoritativeSyncSystem(observer_ptr<ServiceLocator> service_locator, observer_ptr<entt::registry> registry, std::size_t player_num)
+        : _serviceLocator(service_locator)
+        , _registry(registry)
+        , _playerNum(player_num)
+    {
+        assert(0 < player_num && player_num <= MaxPlayerNum);
+        for (std::uint32_t i = 0; i < SyncBufferSize; i++)
+        {
+            _buffer.emplace_back();
+        }
+    }
+
+    void AuthoritativeSyncSystem::SetData(std::size_t player_id, GameTick tick_after, const SyncObject& data)
+    {
+        assert(tick_after < SyncBufferSize);
+        assert(player_id < _playerNum);
+        auto& frame = _buffer[*tick_after];
+        frame._data[player_id] = data;
+        frame._received |= static_cast<PlayerMask>(PlayerMask{ 1 } << player_id);
+    }
+
+    void AuthoritativeSyncSystem::ApplyToActionQueue()
+    {
+        auto& frame = _buffer[0];
+        for (std::size_t p = 0; p < _playerNum; p++)
+        {
+            if (frame._received & (PlayerMask{ 1 } << p))
+                _last[p] = frame._data[p];
+            else
+                _last[p] = predict_sync_object(_last[p]);
+        }
+        auto inputs = std::span{ _last }.first(_playerNum);
+        enqueue_actions(_serviceLocator, _registry, inputs);
+
+        // サーバーでは、予測した分も含めて実際に使った入力が正になる
+        if (auto recorder = _serviceLocator->Get<ReplayRecorder>())
+            recorder->Record(_serviceLocator->Get<TickCounter>()->GetCurrent(), inputs);
+    }
+
     QuicControllerSystem::QuicControllerSystem(observer_ptr<ServiceLocator> service_locator, observer_ptr<entt::registry> registry)
         : _serviceLocator(service_locator)
         , _registry(registry)
@@ -12,30 +207,179 @@ namespace tofu::ball
         _quic = quic;
         _sendStream = quic->GetStream(ClientControlStreamId);
     }
-    void QuicControllerSystem::Receive(const message_server_control::SyncPlayerAction& message)
+    void QuicControllerSystem::CorkSend()
     {
-        std::lock_guard lock{_syncObjectMutex};
-        _syncObjectBuffer.push_back(message);
+        if (_sendStream)
+            _sendStream->Cork();
     }
-    void QuicControllerSystem::Receive(const message_client_control::SyncPlayerAction& message)
+    void QuicControllerSystem::UncorkSend()
     {
-        std::lock_guard lock{_syncObjectMutex};
-        _syncObjectBuffer.push_back(message);
+        if (_sendStream)
+            _sendStream->Uncork();
     }
-    void QuicControllerSystem::ApplySyncObject()
+    void QuicControllerSystem::SendInput(GameTick tick, const SyncWindow& obj)
     {
-        std::lock_guard lock{_syncObjectMutex};
+        auto send = [this](GameTick input_tick, const SyncWindow& input) {
+            message_client_control::SyncPlayerAction message;
+            message._player = _playerId;
+            message._tick = input_tick;
+            message.SetInputs(input);
+            Send(message);
+        };
+        if (!_datagramInputs)
+        {
+            send(tick, obj);
+            return;
+        }
+
+        auto now = decltype(_inputSender)::clock::now();
+        _inputSender.Ack(GameTick{ _inputAckedTick.load(std::memory_order_acquire) });
+        _inputSender.Push(tick, obj, now);
 
-        auto sync = _serviceLocator->Get<CompletelySyncSystem>();
+        // DATAGRAMでいつまでも届かない入力は、確実に届くストリームで送り直す
+        //  サーバーはどちらで届いても、同じTickの入力は1度しか使わない
+        auto timeout = std::max<std::chrono::microseconds>(MinInputFallbackTimeout, 2 * _quic->GetRtt());
+        _inputSender.CollectFallback(now, timeout, send);
+
+        // 損失が多いほど、ACKされていない入力を多く載せる
+        auto redundancy = net::choose_redundancy(_inputLossRate.load(std::memory_order_relaxed), message_datagram::MinInputRedundancy, message_datagram::MaxInputRedundancy);
+
+        std::array<SyncWindow, message_datagram::MaxInputRedundancy> latest;
+        auto [latest_tick, count] = _inputSender.CopyLatest(std::span{ latest }.first(redundancy));
+
+        message_datagram::PlayerInputs datagram;
+        datagram._player = _playerId;
+        datagram._seq = _inputSeq++;
+        datagram._tick = latest_tick;
+        datagram.SetInputs(std::span{ latest }.first(count));
+        SendDatagram(_quic, datagram);
+    }
+    bool QuicControllerSystem::Receive(const message_server_control::SyncPlayerAction& message)
+    {
+        auto obj = message.GetInputs();
+        if (!obj)
+            return false;
+        Enqueue(SyncMessage{ message._player, message._tick, *obj });
+        return true;
+    }
+    bool QuicControllerSystem::Receive(const message_client_control::SyncPlayerAction& message)
+    {
+        auto obj = message.GetInputs();
+        if (!obj)
+            return false;
+        Enqueue(SyncMessage{ message._player, message._tick, *obj });
+        return true;
+    }
+    bool QuicControllerSystem::Receive(const message_server_control::SyncTickActions& message)
+    {
+        std::array<SyncWindow, MaxPlayerNum> inputs;
+        if (!message.GetInputs(std::span{ inputs }.first(message.Count())))
+            return false;
+
+        std::size_t index = 0;
+        for (PlayerMask rest = message._players; rest; rest &= rest - 1)
+        {
+            PlayerID player = static_cast<PlayerID::value_type>(std::countr_zero(rest));
+            const auto& obj = inputs[index++];
+            if (player == _playerId && !_arbitratedInputs)
+                continue;
+            Enqueue(SyncMessage{ player, message._tick, obj });
+        }
+        return true;
+    }
+    void QuicControllerSystem::Receive(const message_server_control::ChangeInputDelay& message)
+    {
+        _inputDelayQueue.push(message);
+    }
+    void QuicControllerSystem::Receive(const message_server_control::FrameAdvantageReport& message)
+    {
+        // 報告は定期的に届き、新しいもので上書きされるので、ゲームスレッドが詰まっていたら捨てる
+        _advantageReportQueue.try_push(message);
+    }
+    void QuicControllerSystem::Receive(const message_datagram::InputAck& message)
+    {
+        // DATAGRAMは順番が入れ替わるので、古いACKで戻さない. 書き込むのは通信スレッドだけ
+        if (_inputAckedTick.load(std::memory_order_relaxed) < *message._nextTick)
+        {
+            _inputAckedTick.store(*message._nextTick, std::memory_order_release);
+        }
+        _inputLossRate.store(message._lossRate / 255.0f, std::memory_order_relaxed);
+    }
+    void QuicControllerSystem::Enqueue(const SyncMessage& message)
+    {
+        // ゲームスレッドは毎フレームキューを空にするので、満杯になるのはゲームスレッドが詰まっているときだけ
+        //  同期データは落とせないが、通信スレッドを止めると全ての接続の送受信が止まるので、溢れさせて待たない
+        _syncObjectQueue.push(message);
+    }
+    void QuicControllerSystem::ApplySyncObject()
+    {
+        auto sync = _serviceLocator->Get<SyncSystem>();
         auto current_tick = _serviceLocator->Get<TickCounter>()->GetCurrent();
-        for (auto& obj : _syncObjectBuffer) 
+
+        // 呼び出し時点で溜まっている分だけを処理し、通信スレッドを待たない
+        auto count = _syncObjectQueue.size_approx();
+
+        // 入力遅延の変更は、それより後に送られた入力より先に予約されていなければならない
+        //  入力の数を数えた後に取り出すことで、数えた入力より前に届いた変更は全て取り出せる
+        std::uint32_t delay = ActionDelay;
+        if (auto input_delay = _serviceLocator->Get<net::InputDelaySchedule>())
+        {
+            while (auto change = _inputDelayQueue.try_pop())
+            {
+                input_delay->Schedule(change->_tick, change->_delay);
+            }
+            delay = input_delay->GetDelay(current_tick);
+        }
+
+        while (auto report = _advantageReportQueue.try_pop())
         {
+            _frameAdvantage.SetRemoteAdvantage(static_cast<std::size_t>(*report->_player), report->_advantage / AdvantageScale);
+        }
+
+        // 入力は送り主からサーバー、サーバーから自分と中継されるので、片道は送り主と自分のRTTの半分ずつの和
+        //  送り主のRTTは分からないので自分と同じとみなし、RTT1回分にサーバーが配るまで待たされる時間を足す
+        //  見積もりの誤差は送り主の側にも同じだけ乗るので、報告されたアドバンテージと差し引いて打ち消す
+        auto one_way = _quic ? _quic->GetRtt() + std::chrono::duration_cast<std::chrono::microseconds>(ServerUpdateInterval) / 2 : std::chrono::microseconds{ 0 };
+
+        _syncObjectQueue.pop_n(count, [&](SyncMessage&& obj) {
             auto tick_after = obj._tick - current_tick;
             for (std::uint32_t i = 0; i < SyncWindowSize; i++)
             {
                 sync->SetData(*(obj._player), tick_after + GameTick{ i }, obj._obj[i]);
             }
+
+            // 送り主は、窓の最後の入力をdelay Tick前に送っている (PlayerController::Stepと同じ数え方)
+            //  引き算で負にならないよう、どちらにもdelayを足して比べる
+            _frameAdvantage.AddSample(*obj._player, obj._tick + GameTick{ SyncWindowSize }, current_tick + GameTick{ delay }, one_way);
+        });
+
+        _serviceLocator->Get<UpdateSystem>()->SetTickPeriod(_frameAdvantage.GetTickPeriod());
+        ReportFrameAdvantage(current_tick);
+    }
+    void QuicControllerSystem::ReportFrameAdvantage(GameTick current_tick)
+    {
+        // 観戦者の進み具合は誰も待たないので、報告しない
+        if (!_quic || IsSpectator())
+            return;
+        // 止まっている間は同じTickで何度も呼ばれるので、Tickで数える
+        if (_lastAdvantageReportTick && current_tick < *_lastAdvantageReportTick + GameTick{ AdvantageReportInterval })
+            return;
+        _lastAdvantageReportTick = current_tick;
+
+        message_client_control::FrameAdvantageReport report;
+        for (std::size_t i = 0; i < MaxPlayerNum; i++)
+        {
+            auto advantage = _frameAdvantage.GetMeasuredAdvantage(i);
+            if (!advantage)
+                continue;
+            constexpr float limit = std::numeric_limits<std::int16_t>::max();
+            report._measured |= PlayerMask{ 1 } << i;
+            report._advantages[i] = static_cast<std::int16_t>(std::clamp(*advantage * AdvantageScale, -limit, limit));
         }
-        _syncObjectBuffer.clear();
+        if (report._measured == 0)
+            return;
+        // 測れているプレイヤーまでを送る
+        report._count = static_cast<std::uint8_t>(std::bit_width(report._measured));
+        Send(report);
     }
 }
\ No newline at end of file
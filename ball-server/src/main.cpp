@@ -1,19 +1,104 @@
 ﻿#include <fmt/core.h>
 
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
 #include <tofu/ball/network.h>
 #include <tofu/ball/net_server.h>
+#include <tofu/ball/replay.h>
 
 namespace tofu::ball
 {
-    void run_server()
+    void run_server(const Server::Config& config)
     {
-        Server server;
+        fmt::print("Players: {}\n", config._game._playerNum);
+        if (config._aggregateInputs)
+            fmt::print("Aggregate inputs: max wait {}us\n", config._aggregateMaxWait.count());
+        if (config._datagramInputs)
+            fmt::print("Datagram inputs\n");
+        if (config._arbitrateInputs)
+            fmt::print("Arbitrate inputs: deadline {}us\n", config._inputDeadline.count());
+
+        Server server{ config };
         server.Run();
     }
+
+    // 記録した試合を通信なしで再シミュレーションし、かかった時間と最後の状態のハッシュを出力する
+    int run_replay(const std::string& path)
+    {
+        ReplayPlayer player;
+        if (auto error = player.Open(path))
+        {
+            error->Dump();
+            return 1;
+        }
+        auto& header = player.GetHeader();
+        fmt::print("Replay: {} players, sync mode {}\n", header._playerNum, header._syncMode);
+
+        if (auto error = player.Run())
+        {
+            error->Dump();
+            return 1;
+        }
+        if (player.IsTruncated())
+            fmt::print("The last tick is truncated.\n");
+
+        auto elapsed = std::chrono::duration<double>(player.GetElapsed()).count();
+        fmt::print("Ticks: {} ({:.3f}s, {:.0f} ticks/s)\n", player.GetTickCount(), elapsed, elapsed == 0 ? 0.0 : player.GetTickCount() / elapsed);
+        fmt::print("Checksum: {:016x}\n", player.GetChecksum());
+        return 0;
+    }
 }
 
+// 使い方: ball_server [--players N] [--aggregate] [--datagram] [--deadline MS] [--state-sync]
+//         ball_server --replay FILE
 int main(int argc, char** argv)
 {
-    tofu::ball::run_server();
+    tofu::ball::Server::Config config;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string_view arg = argv[i];
+        if (arg == "--players" && i + 1 < argc)
+        {
+            auto player_num = std::atoi(argv[++i]);
+            if (player_num < 1 || tofu::ball::MaxPlayerNum < player_num)
+            {
+                fmt::print("--players must be in [1, {}].\n", tofu::ball::MaxPlayerNum);
+                return 1;
+            }
+            config._game._playerNum = static_cast<std::size_t>(player_num);
+        }
+        else if (arg == "--aggregate")
+        {
+            config._aggregateInputs = true;
+        }
+        else if (arg == "--datagram")
+        {
+            config._datagramInputs = true;
+        }
+        else if (arg == "--deadline" && i + 1 < argc)
+        {
+            auto deadline = std::atoi(argv[++i]);
+            if (deadline < 1)
+            {
+                fmt::print("--deadline must be a positive number of milliseconds.\n");
+                return 1;
+            }
+            config._arbitrateInputs = true;
+            config._inputDeadline = std::chrono::milliseconds{ deadline };
+        }
+        else if (arg == "--state-sync")
+        {
+            config._stateSync = true;
+        }
+        else if (arg == "--replay" && i + 1 < argc)
+        {
+            return tofu::ball::run_replay(argv[++i]);
+        }
+    }
+
+    tofu::ball::run_server(config);
 }
 
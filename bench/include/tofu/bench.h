@@ -0,0 +1,74 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/core.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// 外部ライブラリに依存しない、超簡易なベンチマークヘルパ
+namespace tofu::bench
+{
+    struct Case
+    {
+        std::string _name;
+        std::function<void()> _func;
+    };
+
+    inline std::vector<Case>& GetCases()
+    {
+        static std::vector<Case> cases;
+        return cases;
+    }
+
+    struct Registerer
+    {
+        Registerer(const char* name, std::function<void()> func)
+        {
+            GetCases().push_back(Case{ name, std::move(func) });
+        }
+    };
+
+    // 最適化で計算結果が捨てられないようにする
+    template<class T>
+    inline void DoNotOptimize(const T& value)
+    {
+#if defined(_MSC_VER)
+        _ReadWriteBarrier();
+        (void)reinterpret_cast<const volatile char&>(value);
+#else
+        asm volatile("" : : "r,m"(value) : "memory");
+#endif
+    }
+
+    inline void Report(std::string_view label, std::chrono::nanoseconds elapsed, std::size_t operations)
+    {
+        auto per_op = static_cast<double>(elapsed.count()) / static_cast<double>(operations);
+        fmt::print("  {:<48} {:>12.2f} ns/op  ({} ops, {:.2f} ms)\n", label, per_op, operations, elapsed.count() / 1e6);
+    }
+
+    // funcをiterations回呼び出し、1回あたりの時間を表示する
+    template<class TFunc>
+    inline void Measure(std::string_view label, std::size_t iterations, TFunc&& func)
+    {
+        using namespace std::chrono;
+        auto start = steady_clock::now();
+        for (std::size_t i = 0; i < iterations; i++)
+        {
+            func(i);
+        }
+        Report(label, duration_cast<nanoseconds>(steady_clock::now() - start), iterations);
+    }
+}
+
+#define TOFU_BENCH(name) \
+    static void tofu_bench_##name(); \
+    static ::tofu::bench::Registerer tofu_bench_registerer_##name{ #name, &tofu_bench_##name }; \
+    static void tofu_bench_##name()
@@ -0,0 +1,62 @@
+﻿#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <tofu/containers/flat_hash_map.h>
+
+#include "tofu/bench.h"
+
+namespace
+{
+    template<class TMap>
+    void RunMapBench(std::string_view name, std::size_t element_num)
+    {
+        // QUICのストリームIDのように、とびとびの整数キーを使う
+        std::vector<std::uint64_t> keys(element_num);
+        for (std::size_t i = 0; i < element_num; i++)
+        {
+            keys[i] = i * 4 + 2;
+        }
+        std::vector<std::uint64_t> lookup_order = keys;
+        std::shuffle(lookup_order.begin(), lookup_order.end(), std::mt19937_64{ 42 });
+
+        constexpr std::size_t LookupCount = 2'000'000;
+        TMap map;
+
+        tofu::bench::Measure(fmt::format("{} insert (n={})", name, element_num), element_num, [&](std::size_t i) {
+            map.insert({ keys[i], i });
+        });
+
+        std::uint64_t sum = 0;
+        tofu::bench::Measure(fmt::format("{} find hit (n={})", name, element_num), LookupCount, [&](std::size_t i) {
+            auto it = map.find(lookup_order[i % element_num]);
+            sum += it->second;
+        });
+        tofu::bench::Measure(fmt::format("{} find miss (n={})", name, element_num), LookupCount, [&](std::size_t i) {
+            sum += map.find(lookup_order[i % element_num] + 1) == map.end();
+        });
+        tofu::bench::Measure(fmt::format("{} iterate (n={})", name, element_num), 1000, [&](std::size_t) {
+            for (auto& [key, value] : map)
+            {
+                sum += value;
+            }
+        });
+        tofu::bench::Measure(fmt::format("{} erase (n={})", name, element_num), element_num, [&](std::size_t i) {
+            map.erase(lookup_order[i]);
+        });
+        tofu::bench::DoNotOptimize(sum);
+    }
+}
+
+TOFU_BENCH(FlatHashMap)
+{
+    for (std::size_t element_num : { 8, 64, 4096, 262144 })
+    {
+        RunMapBench<tofu::flat_hash_map<std::uint64_t, std::uint64_t>>("flat_hash_map", element_num);
+        RunMapBench<std::unordered_map<std::uint64_t, std::uint64_t>>("std::unordered_map", element_num);
+    }
+}
@@ -0,0 +1,107 @@
+﻿#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include <tofu/containers/triple_buffer.h>
+
+#include "tofu/bench.h"
+
+namespace
+{
+    // 比較用: mutexで最新データを受け渡す素朴な実装
+    template<class T>
+    class LockedHandoff
+    {
+    public:
+        void Write(const T& value)
+        {
+            std::lock_guard lock{ _mutex };
+            _data = value;
+            _fresh = true;
+        }
+        bool Read(T& out)
+        {
+            std::lock_guard lock{ _mutex };
+            out = _data;
+            return std::exchange(_fresh, false);
+        }
+
+    private:
+        std::mutex _mutex;
+        T _data{};
+        bool _fresh = false;
+    };
+
+    struct Payload
+    {
+        std::uint64_t _values[32];
+    };
+
+    constexpr std::size_t WriteCount = 1'000'000;
+}
+
+// 書き込みスレッドと読み込みスレッドが同時に回り続けたときの1操作あたりの時間
+TOFU_BENCH(TripleBuffer_Contention)
+{
+    using namespace std::chrono;
+
+    {
+        tofu::TripleBuffer<Payload> tb;
+        std::atomic<bool> end = false;
+        std::size_t reads = 0;
+
+        std::thread reader_thread{ [&]() {
+            while (!end)
+            {
+                if (!tb.CanRead() && !tb.CanReadUsed())
+                    continue;
+                auto reader = tb.ownAsReaderAllowUsed();
+                tofu::bench::DoNotOptimize(reader->_values[0]);
+                reads++;
+            }
+        } };
+
+        auto start = steady_clock::now();
+        for (std::size_t i = 0; i < WriteCount; i++)
+        {
+            auto writer = tb.ownAsWriter();
+            writer->_values[0] = i;
+        }
+        auto elapsed = duration_cast<nanoseconds>(steady_clock::now() - start);
+        end = true;
+        reader_thread.join();
+
+        tofu::bench::Report("TripleBuffer write (reader spinning)", elapsed, WriteCount);
+        tofu::bench::Report("TripleBuffer read (writer spinning)", elapsed, reads);
+    }
+
+    {
+        LockedHandoff<Payload> handoff;
+        std::atomic<bool> end = false;
+        std::size_t reads = 0;
+
+        std::thread reader_thread{ [&]() {
+            Payload payload;
+            while (!end)
+            {
+                handoff.Read(payload);
+                tofu::bench::DoNotOptimize(payload._values[0]);
+                reads++;
+            }
+        } };
+
+        auto start = steady_clock::now();
+        Payload payload{};
+        for (std::size_t i = 0; i < WriteCount; i++)
+        {
+            payload._values[0] = i;
+            handoff.Write(payload);
+        }
+        auto elapsed = duration_cast<nanoseconds>(steady_clock::now() - start);
+        end = true;
+        reader_thread.join();
+
+        tofu::bench::Report("std::mutex handoff write (reader spinning)", elapsed, WriteCount);
+        tofu::bench::Report("std::mutex handoff read (writer spinning)", elapsed, reads);
+    }
+}
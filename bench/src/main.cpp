@@ -0,0 +1,19 @@
+﻿#include <string_view>
+
+#include <fmt/core.h>
+
+#include "tofu/bench.h"
+
+int main(int argc, char** argv)
+{
+    std::string_view filter = 1 < argc ? argv[1] : "";
+
+    for (auto& bench_case : tofu::bench::GetCases())
+    {
+        if (!filter.empty() && bench_case._name.find(filter) == std::string::npos)
+            continue;
+
+        fmt::print("[{}]\n", bench_case._name);
+        bench_case._func();
+    }
+}
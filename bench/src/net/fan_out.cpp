@@ -0,0 +1,94 @@
+﻿#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <tofu/net/fan_out.h>
+#include <tofu/utils/circular_queue_allocator.h>
+#include <tofu/ball/network.h>
+
+#include "tofu/bench.h"
+
+namespace
+{
+    using namespace tofu::ball;
+
+    // サーバーが中継する、fromのtickの入力
+    //  入力を詰める手間も含めて測るため、プレイヤーとTickごとに違う座標へ移動させる
+    message_server_control::SyncPlayerAction make_message(std::size_t from, std::size_t tick)
+    {
+        auto x = static_cast<float>((from * 7 + tick) % 160) * 0.05f;
+        SyncWindow obj{
+            SyncObject{ actions::Move{ tofu::tVec2{ x, 1.f } } },
+            SyncObject{ actions::Move{ tofu::tVec2{ x + 0.05f, 1.f } } },
+        };
+
+        message_server_control::SyncPlayerAction message;
+        message._player = static_cast<PlayerID::value_type>(from);
+        message._tick = static_cast<tofu::GameTick::value_type>(tick);
+        message.SetInputs(obj);
+        return message;
+    }
+
+    // QuicStream::Send と同じく、送信のたびにロックしてリングバッファへ書き込む
+    class Stream
+    {
+    public:
+        Stream()
+            : _buffer(64 * 1024)
+        {
+        }
+        void Send(const std::byte* data, std::size_t length)
+        {
+            std::lock_guard lock{ _mutex };
+            if (!_buffer.CanWrite(length))
+                _buffer.Seek(_buffer.Size());
+            _buffer.Write(data, length);
+        }
+
+    private:
+        std::mutex _mutex;
+        tofu::CircularContinuousBuffer _buffer;
+    };
+
+    constexpr std::size_t TickCount = 20'000;
+}
+
+// 全員の入力が届いた1Tick分を、全クライアントに配るのにかかる時間
+//  per-message: 受け取ったメッセージごとに、送り主以外の全員へ個別に組み立てて送る (従来の Server::OnReceiveSyncObject)
+//  fan-out: 受け取ったメッセージを一度だけバッファに積み、Tickの終わりに全員へ同じバイト列を送る
+TOFU_BENCH(Net_FanOut)
+{
+    for (std::size_t player_num : { 2, 4, 8, 16 })
+    {
+        std::vector<std::unique_ptr<Stream>> streams;
+        for (std::size_t i = 0; i < player_num; i++)
+            streams.push_back(std::make_unique<Stream>());
+
+        tofu::bench::Measure(fmt::format("per-message  players={:>2}", player_num), TickCount, [&](std::size_t tick) {
+            for (std::size_t from = 0; from < player_num; from++)
+            {
+                for (std::size_t to = 0; to < player_num; to++)
+                {
+                    if (to == from)
+                        continue;
+                    PacketBuffer buffer;
+                    auto size = EncodeMessage(make_message(from, tick), buffer);
+                    streams[to]->Send(buffer.data(), size);
+                }
+            }
+        });
+
+        tofu::net::FanOutBuffer fan_out;
+        tofu::bench::Measure(fmt::format("fan-out      players={:>2}", player_num), TickCount, [&](std::size_t tick) {
+            for (std::size_t from = 0; from < player_num; from++)
+            {
+                AppendMessage(fan_out, make_message(from, tick));
+            }
+            fan_out.Flush(streams, [](const std::unique_ptr<Stream>& stream, std::span<const std::byte> data) {
+                stream->Send(data.data(), data.size());
+            });
+        });
+    }
+}
@@ -0,0 +1,76 @@
+﻿#include <array>
+#include <string_view>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <tofu/net/input_codec.h>
+
+#include "tofu/bench.h"
+
+namespace
+{
+    // ball の actions::Variant と同じく Null / Move / Dash の3種類
+    using Codec = tofu::net::InputCodec<3>;
+    using Input = Codec::Input;
+
+    // ball の SyncObject 1つ分 (std::variant<Null, Move, Dash>) の大きさ
+    constexpr std::size_t RawInputSize = 12;
+    // SyncPlayerAction 1つで送る Tick 数
+    constexpr std::size_t WindowSize = 2;
+    constexpr std::size_t TickCount = 60 * 60;
+
+    std::vector<Input> make_inputs(std::string_view pattern)
+    {
+        std::vector<Input> inputs(TickCount);
+        for (std::size_t i = 0; i < TickCount; i++)
+        {
+            auto t = static_cast<std::int16_t>(i);
+            if (pattern == "idle")
+                inputs[i] = Input{};
+            else if (pattern == "hold")
+                // 同じ目標を1秒ずつ押し続ける
+                inputs[i] = Input{ 1, static_cast<std::int16_t>(i / 60 * 50), 300 };
+            else
+                // マウスを動かしながら、時々ダッシュする
+                inputs[i] = i % 7 == 0 ? Input{} : Input{ static_cast<std::uint8_t>(i % 23 == 0 ? 2 : 1), static_cast<std::int16_t>(t * 3), static_cast<std::int16_t>(500 - t) };
+        }
+        return inputs;
+    }
+}
+
+// SyncPlayerAction 1つ分 (2Tick) の入力を詰める・読むのにかかる時間と、詰めた後の大きさ
+TOFU_BENCH(Net_InputCodec)
+{
+    for (auto pattern : { "idle", "hold", "mixed" })
+    {
+        auto inputs = make_inputs(pattern);
+        std::array<std::byte, (Codec::MaxBits(WindowSize) + 7) / 8> buffer;
+
+        std::size_t encoded_size = 0;
+        tofu::bench::Measure(fmt::format("encode {:<5}", pattern), TickCount / WindowSize, [&](std::size_t i) {
+            tofu::BitWriter writer{ buffer };
+            Codec::Encoder encoder{ writer };
+            for (std::size_t k = 0; k < WindowSize; k++)
+                encoder.Add(inputs[i * WindowSize + k]);
+            auto size = writer.Finish();
+            encoded_size += size;
+            tofu::bench::DoNotOptimize(size);
+        });
+
+        tofu::bench::Measure(fmt::format("decode {:<5}", pattern), TickCount / WindowSize, [&](std::size_t i) {
+            tofu::BitWriter writer{ buffer };
+            Codec::Encoder encoder{ writer };
+            for (std::size_t k = 0; k < WindowSize; k++)
+                encoder.Add(inputs[i * WindowSize + k]);
+            auto size = writer.Finish();
+
+            tofu::BitReader reader{ std::span{ buffer }.first(size) };
+            Codec::Decoder decoder{ reader };
+            for (std::size_t k = 0; k < WindowSize; k++)
+                tofu::bench::DoNotOptimize(decoder.Next());
+        });
+
+        fmt::print("    {:<5}: raw {} bytes -> encoded {:.1f} bytes per message\n", pattern, RawInputSize * WindowSize, static_cast<double>(encoded_size) / (TickCount / WindowSize));
+    }
+}
@@ -0,0 +1,51 @@
+﻿#include <array>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <tofu/utils/state_hasher.h>
+
+#include "tofu/bench.h"
+
+namespace
+{
+    // Physics::HashState で1剛体ごとに加える値
+    struct Body
+    {
+        float _x, _y, _angle;
+        float _vx, _vy, _angularVelocity;
+        bool _awake;
+    };
+
+    constexpr std::size_t TickCount = 100'000;
+}
+
+// 1Tick分の状態のハッシュを求めるのにかかる時間. 1Tickあたり10us以内に収まること
+TOFU_BENCH(Net_StateHash)
+{
+    for (std::size_t body_num : { 8, 32, 128, 512 })
+    {
+        std::vector<Body> bodies(body_num);
+        for (std::size_t i = 0; i < body_num; i++)
+        {
+            auto v = static_cast<float>(i);
+            bodies[i] = Body{ v, v * 2, v * 0.1f, -v, v * 0.5f, 0.01f, true };
+        }
+
+        tofu::bench::Measure(fmt::format("bodies={:>3}", body_num), TickCount, [&](std::size_t tick) {
+            tofu::StateHasher hasher;
+            hasher.Add(static_cast<std::uint32_t>(tick));
+            for (auto& body : bodies)
+            {
+                hasher.Add(body._x);
+                hasher.Add(body._y);
+                hasher.Add(body._angle);
+                hasher.Add(body._vx);
+                hasher.Add(body._vy);
+                hasher.Add(body._angularVelocity);
+                hasher.Add(body._awake);
+            }
+            tofu::bench::DoNotOptimize(hasher.Get());
+        });
+    }
+}
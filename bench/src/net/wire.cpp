@@ -0,0 +1,122 @@
+﻿#include <array>
+#include <cstring>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <tofu/net/wire.h>
+#include <tofu/utils/strong_numeric.h>
+
+#include "tofu/bench.h"
+
+namespace
+{
+    using GameTick = tofu::StrongNumeric<class Tag_GameTick, std::uint32_t>;
+    using PlayerID = tofu::StrongNumeric<class Tag_PlayerID, std::int8_t>;
+
+    // ball の StateChecksums と同じ並び
+    struct Checksums
+    {
+        PlayerID _player;
+        std::uint8_t _count = 0;
+        GameTick _tick;
+        std::array<std::uint64_t, 4> _hashes{};
+
+        using wire_schema = tofu::net::WireSchema<
+            tofu::net::wire::Fixed<&Checksums::_player>,
+            tofu::net::wire::Fixed<&Checksums::_count>,
+            tofu::net::wire::Var<&Checksums::_tick>,
+            tofu::net::wire::Array<&Checksums::_hashes, &Checksums::_count>>;
+    };
+
+    // ball の PlayerInputs と同じ並び. 入力は InputCodec で詰めた後のバイト列
+    struct Inputs
+    {
+        PlayerID _player;
+        std::uint8_t _count = 0;
+        std::uint32_t _seq = 0;
+        GameTick _tick;
+        std::uint8_t _size = 0;
+        std::array<std::byte, 48> _data{};
+
+        using wire_schema = tofu::net::WireSchema<
+            tofu::net::wire::Fixed<&Inputs::_player>,
+            tofu::net::wire::Fixed<&Inputs::_count>,
+            tofu::net::wire::Var<&Inputs::_seq>,
+            tofu::net::wire::Var<&Inputs::_tick>,
+            tofu::net::wire::Bytes<&Inputs::_data, &Inputs::_size>>;
+    };
+
+    constexpr std::size_t MessageCount = 60 * 60;
+
+    std::vector<Checksums> make_checksums()
+    {
+        std::vector<Checksums> messages(MessageCount);
+        for (std::size_t i = 0; i < MessageCount; i++)
+        {
+            auto& message = messages[i];
+            message._player = static_cast<std::int8_t>(i % 4);
+            message._count = 1 + i % 4;
+            message._tick = static_cast<std::uint32_t>(i);
+            for (std::size_t k = 0; k < message._count; k++)
+                message._hashes[k] = 0x9e3779b97f4a7c15ull * (i + k);
+        }
+        return messages;
+    }
+
+    std::vector<Inputs> make_inputs()
+    {
+        std::vector<Inputs> messages(MessageCount);
+        for (std::size_t i = 0; i < MessageCount; i++)
+        {
+            auto& message = messages[i];
+            message._player = static_cast<std::int8_t>(i % 4);
+            message._count = 4;
+            message._seq = static_cast<std::uint32_t>(i);
+            message._tick = static_cast<std::uint32_t>(i + 3);
+            // 動いている入力を4Tick分詰めると、だいたいこのくらい
+            message._size = static_cast<std::uint8_t>(6 + i % 7);
+            for (std::size_t k = 0; k < message._size; k++)
+                message._data[k] = static_cast<std::byte>(i * 31 + k);
+        }
+        return messages;
+    }
+
+    template<class T>
+    void measure(const char* name, const std::vector<T>& messages)
+    {
+        std::array<std::byte, T::wire_schema::MaxSize> buffer;
+
+        std::size_t encoded_size = 0;
+        tofu::bench::Measure(fmt::format("encode {:<9}", name), messages.size(), [&](std::size_t i) {
+            auto size = tofu::net::wire_encode(messages[i], buffer);
+            encoded_size += size;
+            tofu::bench::DoNotOptimize(size);
+        });
+
+        tofu::bench::Measure(fmt::format("decode {:<9}", name), messages.size(), [&](std::size_t i) {
+            auto size = tofu::net::wire_encode(messages[i], buffer);
+            T decoded;
+            tofu::bench::DoNotOptimize(tofu::net::wire_decode(std::span<const std::byte>{ buffer }.first(size), decoded));
+            tofu::bench::DoNotOptimize(decoded);
+        });
+
+        // 比べるために、構造体をそのままコピーする (これまでの送り方)
+        std::array<std::byte, sizeof(T)> raw;
+        tofu::bench::Measure(fmt::format("memcpy {:<9}", name), messages.size(), [&](std::size_t i) {
+            std::memcpy(raw.data(), &messages[i], sizeof(T));
+            T decoded;
+            std::memcpy(&decoded, raw.data(), sizeof(T));
+            tofu::bench::DoNotOptimize(decoded);
+        });
+
+        fmt::print("    {:<9}: memcpy {} bytes -> wire {:.1f} bytes per message\n", name, sizeof(T), static_cast<double>(encoded_size) / messages.size());
+    }
+}
+
+// メッセージをスキーマに沿って書く・読むのにかかる時間と、構造体をそのまま送るのと比べた大きさ
+TOFU_BENCH(Net_Wire)
+{
+    measure("checksums", make_checksums());
+    measure("inputs", make_inputs());
+}
@@ -0,0 +1,242 @@
+﻿#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include "tofu/containers/concurrent_queue.h"
+
+TEST(Container_SpscQueue, 入れた順に取り出せる)
+{
+    tofu::SpscQueue<int, 4> queue;
+    EXPECT_TRUE(queue.empty_approx());
+    EXPECT_FALSE(queue.try_pop());
+
+    EXPECT_TRUE(queue.try_push(1));
+    EXPECT_TRUE(queue.try_push(2));
+    EXPECT_EQ(2, queue.size_approx());
+
+    EXPECT_EQ(1, queue.try_pop());
+    EXPECT_EQ(2, queue.try_pop());
+    EXPECT_FALSE(queue.try_pop());
+}
+
+TEST(Container_SpscQueue, 満杯なら失敗する)
+{
+    tofu::SpscQueue<int, 4> queue;
+    for (int i = 0; i < 4; i++)
+    {
+        EXPECT_TRUE(queue.try_push(i));
+    }
+    EXPECT_FALSE(queue.try_push(4));
+
+    EXPECT_EQ(0, queue.try_pop());
+    EXPECT_TRUE(queue.try_push(4));
+    for (int i = 1; i <= 4; i++)
+    {
+        EXPECT_EQ(i, queue.try_pop());
+    }
+}
+
+TEST(Container_SpscQueue, まとめて取り出せる)
+{
+    tofu::SpscQueue<int, 8> queue;
+    // 何周かしても壊れない
+    for (int round = 0; round < 5; round++)
+    {
+        for (int i = 0; i < 6; i++)
+        {
+            EXPECT_TRUE(queue.try_push(round * 10 + i));
+        }
+
+        std::vector<int> out;
+        EXPECT_EQ(4, queue.pop_n(4, std::back_inserter(out)));
+        EXPECT_EQ(2, queue.pop_n(4, std::back_inserter(out)));
+        EXPECT_EQ(0, queue.pop_n(4, std::back_inserter(out)));
+
+        std::vector<int> expected(6);
+        std::iota(expected.begin(), expected.end(), round * 10);
+        EXPECT_EQ(expected, out);
+    }
+}
+
+TEST(Container_SpscQueue, 残った要素は破棄される)
+{
+    auto counter = std::make_shared<int>(0);
+    {
+        tofu::SpscQueue<std::shared_ptr<int>, 4> queue;
+        queue.try_push(counter);
+        queue.try_push(counter);
+        queue.try_pop();
+        EXPECT_EQ(2, counter.use_count());
+    }
+    EXPECT_EQ(1, counter.use_count());
+}
+
+TEST(Container_SpscQueue, 別スレッド間で順序を保って受け渡せる)
+{
+    constexpr int Count = 100000;
+    tofu::SpscQueue<int, 64> queue;
+
+    std::thread producer{ [&]() {
+        for (int i = 0; i < Count; i++)
+        {
+            while (!queue.try_push(i))
+                std::this_thread::yield();
+        }
+    } };
+
+    int expected = 0;
+    while (expected < Count)
+    {
+        queue.pop_n(16, [&](int&& value) {
+            EXPECT_EQ(expected, value);
+            expected++;
+        });
+    }
+    producer.join();
+    EXPECT_TRUE(queue.empty_approx());
+}
+
+TEST(Container_MpscQueue, 入れた順に取り出せる)
+{
+    tofu::MpscQueue<int, 4> queue;
+    EXPECT_FALSE(queue.try_pop());
+
+    for (int round = 0; round < 3; round++)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            EXPECT_TRUE(queue.try_push(i));
+        }
+        EXPECT_FALSE(queue.try_push(4));
+
+        std::vector<int> out;
+        EXPECT_EQ(4, queue.pop_n(8, std::back_inserter(out)));
+        EXPECT_EQ((std::vector<int>{0, 1, 2, 3}), out);
+    }
+}
+
+TEST(Container_MpscQueue, 残った要素は破棄される)
+{
+    auto counter = std::make_shared<int>(0);
+    {
+        tofu::MpscQueue<std::shared_ptr<int>, 4> queue;
+        queue.try_push(counter);
+        queue.try_push(counter);
+        queue.try_pop();
+        EXPECT_EQ(2, counter.use_count());
+    }
+    EXPECT_EQ(1, counter.use_count());
+}
+
+TEST(Container_MpscQueue, 複数スレッドから書き込める)
+{
+    constexpr int ProducerNum = 4;
+    constexpr int CountPerProducer = 20000;
+
+    struct Item
+    {
+        int _producer;
+        int _value;
+    };
+    tofu::MpscQueue<Item, 64> queue;
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < ProducerNum; p++)
+    {
+        producers.emplace_back([&queue, p]() {
+            for (int i = 0; i < CountPerProducer; i++)
+            {
+                while (!queue.try_push(Item{ p, i }))
+                    std::this_thread::yield();
+            }
+        });
+    }
+
+    // 書き込み者ごとの順序は保たれる
+    std::vector<int> next(ProducerNum, 0);
+    int total = 0;
+    while (total < ProducerNum * CountPerProducer)
+    {
+        total += static_cast<int>(queue.pop_n(16, [&](Item&& item) {
+            EXPECT_EQ(next[item._producer], item._value);
+            next[item._producer]++;
+        }));
+    }
+    for (auto& producer : producers)
+    {
+        producer.join();
+    }
+    EXPECT_TRUE(queue.empty_approx());
+    for (auto n : next)
+    {
+        EXPECT_EQ(CountPerProducer, n);
+    }
+}
+
+TEST(Container_OverflowQueue, 満杯でも待たずに入れて順番通りに取り出せる)
+{
+    tofu::OverflowQueue<tofu::SpscQueue<int, 4>> queue;
+    for (int i = 0; i < 10; i++)
+    {
+        queue.push(i);
+    }
+    EXPECT_EQ(10, queue.size_approx());
+    EXPECT_EQ(6, queue.overflow_count());
+
+    // 溢れている間は、空きができても溢れた側の後ろに積む
+    EXPECT_EQ(0, queue.try_pop());
+    queue.push(10);
+
+    std::vector<int> popped;
+    EXPECT_EQ(5, queue.pop_n(5, [&](int&& value) { popped.push_back(value); }));
+    EXPECT_EQ(5, queue.pop_n(100, [&](int&& value) { popped.push_back(value); }));
+    EXPECT_EQ(popped, (std::vector<int>{ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 }));
+    EXPECT_TRUE(queue.empty_approx());
+
+    // 溢れたものを読み終えたら、またロックを取らずに入れる
+    queue.push(11);
+    EXPECT_EQ(7, queue.overflow_count());
+    EXPECT_EQ(11, queue.try_pop());
+}
+
+TEST(Container_OverflowQueue, 読み込み側が止まっていても書き込み側は待たない)
+{
+    constexpr int ProducerNum = 4;
+    constexpr int CountPerProducer = 1000;
+
+    struct Item
+    {
+        int _producer;
+        int _value;
+    };
+    tofu::OverflowQueue<tofu::MpscQueue<Item, 16>> queue;
+
+    // 読み込み側が何も読まなくても、書き込みは全て終わる
+    std::vector<std::thread> producers;
+    for (int p = 0; p < ProducerNum; p++)
+    {
+        producers.emplace_back([&queue, p]() {
+            for (int i = 0; i < CountPerProducer; i++)
+            {
+                queue.push(Item{ p, i });
+            }
+        });
+    }
+    for (auto& producer : producers)
+    {
+        producer.join();
+    }
+    EXPECT_EQ(ProducerNum * CountPerProducer, queue.size_approx());
+
+    std::vector<int> next(ProducerNum, 0);
+    auto total = queue.pop_n(ProducerNum * CountPerProducer, [&](Item&& item) {
+        EXPECT_EQ(next[item._producer], item._value);
+        next[item._producer]++;
+    });
+    EXPECT_EQ(ProducerNum * CountPerProducer, total);
+    EXPECT_TRUE(queue.empty_approx());
+}
@@ -0,0 +1,182 @@
+﻿#include <gtest/gtest.h>
+
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+
+#include "tofu/containers/flat_hash_map.h"
+
+TEST(Container_FlatHashMap, 挿入と検索ができる)
+{
+    tofu::flat_hash_map<int, std::string> map;
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(map.end(), map.find(1));
+
+    auto [it, inserted] = map.insert({ 1, "one" });
+    EXPECT_TRUE(inserted);
+    EXPECT_EQ(1, it->first);
+    EXPECT_EQ("one", it->second);
+
+    // 既にあるキーは上書きしない
+    auto [it2, inserted2] = map.try_emplace(1, "uno");
+    EXPECT_FALSE(inserted2);
+    EXPECT_EQ("one", it2->second);
+
+    map[2] = "two";
+    EXPECT_EQ(2, map.size());
+    EXPECT_TRUE(map.contains(2));
+    EXPECT_FALSE(map.contains(3));
+    EXPECT_EQ("two", map.at(2));
+    EXPECT_THROW(map.at(3), std::out_of_range);
+
+    map.insert_or_assign(1, "uno");
+    EXPECT_EQ("uno", map.at(1));
+}
+
+TEST(Container_FlatHashMap, 削除できる)
+{
+    tofu::flat_hash_map<int, int> map;
+    for (int i = 0; i < 100; i++)
+    {
+        map[i] = i * 10;
+    }
+    for (int i = 0; i < 100; i += 2)
+    {
+        EXPECT_EQ(1, map.erase(i));
+    }
+    EXPECT_EQ(0, map.erase(0));
+    EXPECT_EQ(50, map.size());
+
+    for (int i = 0; i < 100; i++)
+    {
+        if (i % 2 == 0)
+        {
+            EXPECT_FALSE(map.contains(i));
+        }
+        else
+        {
+            EXPECT_EQ(i * 10, map.at(i));
+        }
+    }
+
+    map.erase(map.find(1));
+    EXPECT_FALSE(map.contains(1));
+    EXPECT_EQ(49, map.size());
+}
+
+TEST(Container_FlatHashMap, 全要素を列挙できる)
+{
+    tofu::flat_hash_map<int, int> map;
+    int sum = 0;
+    for (int i = 0; i < 1000; i++)
+    {
+        map.try_emplace(i * 4, i);
+        sum += i;
+    }
+
+    int count = 0;
+    int actual = 0;
+    for (auto [key, value] : map)
+    {
+        EXPECT_EQ(key, value * 4);
+        actual += value;
+        count++;
+    }
+    EXPECT_EQ(1000, count);
+    EXPECT_EQ(sum, actual);
+}
+
+TEST(Container_FlatHashMap, std_mapと同じ結果になる)
+{
+    tofu::flat_hash_map<std::uint32_t, std::uint32_t> map;
+    std::map<std::uint32_t, std::uint32_t> expected;
+
+    std::mt19937 rng{ 12345 };
+    for (int i = 0; i < 100000; i++)
+    {
+        auto key = rng() % 2000;
+        switch (rng() % 3)
+        {
+        case 0:
+        case 1:
+            map.insert_or_assign(key, i);
+            expected.insert_or_assign(key, i);
+            break;
+        case 2:
+            EXPECT_EQ(expected.erase(key), map.erase(key));
+            break;
+        }
+    }
+
+    EXPECT_EQ(expected.size(), map.size());
+    for (auto& [key, value] : expected)
+    {
+        EXPECT_EQ(value, map.at(key));
+    }
+    for (auto& [key, value] : map)
+    {
+        EXPECT_EQ(expected.at(key), value);
+    }
+}
+
+TEST(Container_FlatHashMap, 偏ったハッシュでも動く)
+{
+    struct BadHash
+    {
+        std::size_t operator()(int) const noexcept
+        {
+            return 0;
+        }
+    };
+
+    // 全て同じ位置に衝突させても正しく引ける
+    tofu::flat_hash_map<int, int, BadHash> map;
+    for (int i = 0; i < 600; i++)
+    {
+        auto [it, inserted] = map.try_emplace(i, i);
+        EXPECT_TRUE(inserted);
+        EXPECT_EQ(i, it->first);
+    }
+    for (int i = 0; i < 600; i++)
+    {
+        EXPECT_EQ(i, map.at(i));
+    }
+}
+
+TEST(Container_FlatHashMap, コピーとムーブ)
+{
+    tofu::flat_hash_map<int, std::unique_ptr<int>> map;
+    map.try_emplace(1, std::make_unique<int>(10));
+    map.try_emplace(2, std::make_unique<int>(20));
+
+    auto moved = std::move(map);
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(10, *moved.at(1));
+
+    tofu::flat_hash_map<int, std::string> a{ {1, "one"}, {2, "two"} };
+    auto b = a;
+    b[3] = "three";
+    EXPECT_EQ(2, a.size());
+    EXPECT_EQ(3, b.size());
+    EXPECT_EQ("two", b.at(2));
+}
+
+TEST(Container_FlatHashMap, 要素が正しく破棄される)
+{
+    auto counter = std::make_shared<int>(0);
+    {
+        tofu::flat_hash_map<int, std::shared_ptr<int>> map;
+        for (int i = 0; i < 100; i++)
+        {
+            map[i] = counter;
+        }
+        EXPECT_EQ(101, counter.use_count());
+        for (int i = 0; i < 50; i++)
+        {
+            map.erase(i);
+        }
+        EXPECT_EQ(51, counter.use_count());
+    }
+    EXPECT_EQ(1, counter.use_count());
+}
@@ -1,5 +1,8 @@
 ﻿#include <gtest/gtest.h>
 
+#include <algorithm>
+#include <numeric>
+
 #include "tofu/containers/ring_buffer.h"
 
 TEST(Container_RingBuffer, pushとpopの基本的な動作)
@@ -75,3 +78,138 @@ TEST(Container_RingBuffer, TailOriginでアクセスできる)
     EXPECT_EQ(1, rb[-2]);
 }
 
+TEST(Container_RingBuffer, 2の累乗でない容量でも折り返せる)
+{
+    tofu::RingBuffer<int, 3> rb;
+    for (int i = 0; i < 10; i++)
+    {
+        rb.push_back(i);
+        if (rb.full())
+            rb.pop_front();
+    }
+
+    EXPECT_EQ(2, rb.size());
+    EXPECT_EQ(8, rb[0]);
+    EXPECT_EQ(9, rb[1]);
+}
+
+TEST(Container_RingBuffer, push_frontで先頭に追加できる)
+{
+    tofu::RingBuffer<int, 4> rb;
+    rb.push_back(2);
+    rb.push_front(1);
+    rb.push_front(0);
+
+    EXPECT_EQ(3, rb.size());
+    EXPECT_EQ(0, rb.front());
+    EXPECT_EQ(1, rb[1]);
+    EXPECT_EQ(2, rb.back());
+}
+
+TEST(Container_RingBuffer, push_back_nとpop_front_nでまとめて操作できる)
+{
+    tofu::RingBuffer<int, 8> rb;
+    const int values[] = { 1, 2, 3, 4, 5, 6 };
+
+    rb.push_back_n(values, 6);
+    rb.pop_front_n(4);
+    rb.push_back_n(values, 5); // 折り返す
+
+    EXPECT_EQ(7, rb.size());
+    EXPECT_EQ(5, rb[0]);
+    EXPECT_EQ(6, rb[1]);
+    EXPECT_EQ(1, rb[2]);
+    EXPECT_EQ(5, rb[6]);
+
+    int out[3] = {};
+    rb.pop_front_n(3, out);
+    EXPECT_EQ(5, out[0]);
+    EXPECT_EQ(6, out[1]);
+    EXPECT_EQ(1, out[2]);
+    EXPECT_EQ(4, rb.size());
+    EXPECT_EQ(2, rb[0]);
+}
+
+TEST(Container_RingBuffer, as_spansで連続領域を取得できる)
+{
+    tofu::RingBuffer<int, 4> rb;
+    rb.push_back(1);
+    rb.push_back(2);
+    rb.push_back(3);
+    rb.pop_front();
+    rb.pop_front();
+    rb.push_back(4);
+    rb.push_back(5);
+
+    auto [first, second] = rb.as_spans();
+    EXPECT_EQ(2, first.size());
+    EXPECT_EQ(3, first[0]);
+    EXPECT_EQ(4, first[1]);
+    EXPECT_EQ(1, second.size());
+    EXPECT_EQ(5, second[0]);
+}
+
+TEST(Container_RingBuffer, イテレータとrangesで走査できる)
+{
+    static_assert(std::ranges::random_access_range<tofu::RingBuffer<int, 4>>);
+    static_assert(std::ranges::sized_range<const tofu::RingBuffer<int, 4>>);
+
+    tofu::RingBuffer<int, 4> rb;
+    rb.push_back(1);
+    rb.push_back(2);
+    rb.pop_front();
+    rb.push_back(3);
+    rb.push_back(4);
+    rb.push_back(5);
+
+    int expected = 2;
+    for (int v : rb)
+    {
+        EXPECT_EQ(expected, v);
+        expected++;
+    }
+
+    auto it = std::ranges::find(rb, 4);
+    EXPECT_EQ(2, it - rb.begin());
+    EXPECT_EQ(5, *rb.rbegin());
+
+    const auto& crb = rb;
+    EXPECT_EQ(14, std::accumulate(crb.begin(), crb.end(), 0));
+}
+
+namespace {
+    namespace ring_buffer_test {
+        static int ctor = 0;
+        static int dtor = 0;
+
+        struct Sample {
+            Sample() { ctor++; }
+            Sample(const Sample&) { ctor++; }
+            Sample(Sample&&) noexcept { ctor++; }
+            Sample& operator=(const Sample&) = default;
+            ~Sample() { dtor++; }
+        };
+    }
+}
+TEST(Container_RingBuffer, ctorとdtorの呼ばれる回数)
+{
+    using namespace ring_buffer_test;
+    ctor = dtor = 0;
+
+    {
+        tofu::RingBuffer<Sample, 4> rb;
+        rb.emplace_back();
+        rb.emplace_back();
+        rb.emplace_back();
+        rb.pop_front();
+        rb.emplace_back();
+        rb.emplace_back();
+
+        auto rb2 = rb;
+        rb2.pop_front_n(2);
+        rb.clear();
+        rb.emplace_front();
+    }
+
+    EXPECT_EQ(ctor, dtor);
+}
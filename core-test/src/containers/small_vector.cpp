@@ -0,0 +1,181 @@
+﻿#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "tofu/containers/small_vector.h"
+
+TEST(Container_SmallVector, デフォルト初期化)
+{
+    tofu::small_vector<int, 4> vec;
+    EXPECT_EQ(0, vec.size());
+    EXPECT_EQ(4, vec.capacity());
+    EXPECT_TRUE(vec.is_inline());
+}
+
+TEST(Container_SmallVector, 初期化リストによる初期化)
+{
+    tofu::small_vector<int, 4> vec = { 1, 2, 3 };
+    EXPECT_EQ(3, vec.size());
+    EXPECT_EQ(1, vec[0]);
+    EXPECT_EQ(2, vec[1]);
+    EXPECT_EQ(3, vec[2]);
+}
+
+TEST(Container_SmallVector, 容量を超えるとヒープに移る)
+{
+    tofu::small_vector<int, 4> vec;
+    for (int i = 0; i < 10; i++)
+        vec.push_back(i);
+
+    EXPECT_EQ(10, vec.size());
+    EXPECT_FALSE(vec.is_inline());
+    for (int i = 0; i < 10; i++)
+        EXPECT_EQ(i, vec[i]);
+
+    vec.resize(3);
+    vec.shrink_to_fit();
+    EXPECT_TRUE(vec.is_inline());
+    EXPECT_EQ(3, vec.size());
+    EXPECT_EQ(2, vec[2]);
+}
+
+TEST(Container_SmallVector, コピーとムーブ)
+{
+    tofu::small_vector<std::string, 2> inline_vec = { "a", "b" };
+    tofu::small_vector<std::string, 2> heap_vec = { "a", "b", "c" };
+
+    auto copied = heap_vec;
+    EXPECT_EQ(heap_vec, copied);
+
+    auto moved_inline = std::move(inline_vec);
+    auto moved_heap = std::move(heap_vec);
+    EXPECT_EQ(0, inline_vec.size());
+    EXPECT_EQ(0, heap_vec.size());
+    EXPECT_EQ(2, moved_inline.size());
+    EXPECT_EQ("b", moved_inline[1]);
+    EXPECT_EQ(3, moved_heap.size());
+    EXPECT_EQ("c", moved_heap[2]);
+
+    moved_inline = moved_heap;
+    EXPECT_EQ(moved_heap, moved_inline);
+
+    swap(moved_inline, copied);
+    EXPECT_EQ("c", copied[2]);
+}
+
+TEST(Container_SmallVector, emplace_backはその場で構築する)
+{
+    struct Sample {
+        Sample(int x, int y) : _value(x * y) {}
+        Sample(const Sample&) = delete;
+        Sample(Sample&& other) noexcept : _value(other._value) {}
+        int _value;
+    };
+    tofu::small_vector<Sample, 2> vec;
+    vec.emplace_back(2, 3);
+    vec.emplace_back(3, 4);
+    vec.emplace_back(4, 5);
+
+    EXPECT_EQ(3, vec.size());
+    EXPECT_EQ(6, vec[0]._value);
+    EXPECT_EQ(12, vec[1]._value);
+    EXPECT_EQ(20, vec[2]._value);
+}
+
+TEST(Container_SmallVector, 自身の要素をpush_backできる)
+{
+    tofu::small_vector<std::string, 2> vec = { "hoge", "fuga" };
+    vec.push_back(vec[0]);
+    vec.insert(vec.begin(), vec[2]);
+
+    EXPECT_EQ(4, vec.size());
+    EXPECT_EQ("hoge", vec[0]);
+    EXPECT_EQ("hoge", vec[3]);
+}
+
+TEST(Container_SmallVector, insert)
+{
+    tofu::small_vector<int, 4> vec = { 1, 2, 3 };
+    vec.insert(vec.begin(), 9);
+    vec.insert(vec.begin() + 2, 2, 7);
+    vec.insert(vec.end(), { 5, 6 });
+
+    std::vector<int> expected = { 9, 1, 7, 7, 2, 3, 5, 6 };
+    EXPECT_TRUE(std::equal(vec.begin(), vec.end(), expected.begin(), expected.end()));
+}
+
+TEST(Container_SmallVector, 非トリビアルな型のinsert)
+{
+    tofu::small_vector<std::string, 4> vec = { "a", "b", "c" };
+    vec.insert(vec.begin() + 1, "x");
+    std::vector<std::string> src = { "y", "z" };
+    vec.insert(vec.begin() + 1, src.begin(), src.end());
+
+    std::vector<std::string> expected = { "a", "y", "z", "x", "b", "c" };
+    EXPECT_TRUE(std::equal(vec.begin(), vec.end(), expected.begin(), expected.end()));
+}
+
+TEST(Container_SmallVector, erase)
+{
+    tofu::small_vector<int, 8> vec = { 1, 2, 3, 4, 5 };
+
+    vec.erase(vec.begin() + 1);
+    EXPECT_EQ(4, vec.size());
+    EXPECT_EQ(3, vec[1]);
+
+    vec.erase(vec.begin() + 1, vec.begin() + 3);
+    EXPECT_EQ(2, vec.size());
+    EXPECT_EQ(1, vec[0]);
+    EXPECT_EQ(5, vec[1]);
+}
+
+TEST(Container_SmallVector, assign)
+{
+    tofu::small_vector<int, 2> vec;
+    vec.assign(5, 3);
+    EXPECT_EQ(5, vec.size());
+    EXPECT_EQ(3, vec[4]);
+
+    std::vector<int> src = { 1, 2 };
+    vec.assign(src.begin(), src.end());
+    EXPECT_EQ(2, vec.size());
+    EXPECT_EQ(2, vec[1]);
+}
+
+namespace {
+    namespace small_vector_test {
+        static int ctor = 0;
+        static int dtor = 0;
+
+        struct Sample {
+            Sample() { ctor++; }
+            Sample(const Sample&) { ctor++; }
+            Sample(Sample&&) noexcept { ctor++; }
+            Sample& operator=(const Sample&) = default;
+            Sample& operator=(Sample&&) = default;
+            ~Sample() { dtor++; }
+        };
+    }
+}
+TEST(Container_SmallVector, ctorとdtorの呼ばれる回数)
+{
+    using namespace small_vector_test;
+    ctor = dtor = 0;
+
+    {
+        tofu::small_vector<Sample, 2> vec;
+        vec.emplace_back();
+        vec.emplace_back();
+        vec.emplace_back();
+        vec.insert(vec.begin() + 1, Sample{});
+        vec.erase(vec.begin(), vec.begin() + 2);
+
+        auto vec2 = vec;
+        vec2.clear();
+        vec2.resize(5);
+        vec = std::move(vec2);
+    }
+
+    EXPECT_EQ(ctor, dtor);
+}
@@ -0,0 +1,151 @@
+﻿#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+
+#include "tofu/containers/triple_buffer.h"
+
+TEST(Container_TripleBuffer, 書き込む前は読めない)
+{
+    tofu::TripleBuffer<int> tb;
+    EXPECT_FALSE(tb.CanRead());
+    EXPECT_FALSE(tb.CanReadUsed());
+}
+
+TEST(Container_TripleBuffer, 書き込んだデータを読める)
+{
+    tofu::TripleBuffer<int> tb;
+    {
+        auto writer = tb.ownAsWriter();
+        *writer = 10;
+        EXPECT_FALSE(tb.CanRead()); // Disownするまでは公開されない
+    }
+    EXPECT_TRUE(tb.CanRead());
+
+    {
+        auto reader = tb.ownAsReader();
+        EXPECT_EQ(10, *reader);
+    }
+    EXPECT_FALSE(tb.CanRead());
+    EXPECT_TRUE(tb.CanReadUsed());
+}
+
+TEST(Container_TripleBuffer, 最新のデータだけが読める)
+{
+    tofu::TripleBuffer<int> tb;
+    for (int i = 0; i < 5; i++)
+    {
+        auto writer = tb.ownAsWriter();
+        *writer = i;
+    }
+
+    auto reader = tb.ownAsReader();
+    EXPECT_EQ(4, *reader);
+}
+
+TEST(Container_TripleBuffer, AllowUsedなら前回と同じデータを読める)
+{
+    tofu::TripleBuffer<int> tb;
+    {
+        auto writer = tb.ownAsWriter();
+        *writer = 1;
+    }
+    {
+        auto reader = tb.ownAsReaderAllowUsed();
+        EXPECT_EQ(1, *reader);
+    }
+    {
+        auto reader = tb.ownAsReaderAllowUsed();
+        EXPECT_EQ(1, *reader);
+    }
+    {
+        auto writer = tb.ownAsWriter();
+        *writer = 2;
+    }
+    {
+        auto reader = tb.ownAsReaderAllowUsed();
+        EXPECT_EQ(2, *reader);
+    }
+}
+
+TEST(Container_TripleBuffer, 読み込み中のバッファは書き換えられない)
+{
+    tofu::TripleBuffer<int> tb;
+    {
+        auto writer = tb.ownAsWriter();
+        *writer = 1;
+    }
+
+    auto reader = tb.ownAsReader();
+    for (int i = 2; i < 10; i++)
+    {
+        auto writer = tb.ownAsWriter();
+        *writer = i;
+    }
+    EXPECT_EQ(1, *reader);
+    reader.Disown();
+
+    auto latest = tb.ownAsReader();
+    EXPECT_EQ(9, *latest);
+}
+
+TEST(Container_TripleBuffer, Ownershipをムーブできる)
+{
+    tofu::TripleBuffer<int> tb;
+    tofu::TripleBuffer<int>::Ownership ownership;
+    {
+        auto writer = tb.ownAsWriter();
+        *writer = 3;
+        ownership = std::move(writer);
+    }
+    EXPECT_FALSE(tb.CanRead());
+    ownership.Disown();
+    EXPECT_TRUE(tb.CanRead());
+
+    auto reader = tb.ownAsReader();
+    auto moved = std::move(reader);
+    EXPECT_EQ(3, *moved);
+}
+
+TEST(Container_TripleBuffer, 別スレッドから書き込んでも壊れたデータを読まない)
+{
+    struct Data
+    {
+        int _value = 0;
+        int _doubled = 0;
+    };
+    constexpr int WriteCount = 100000;
+
+    tofu::TripleBuffer<Data> tb;
+    std::atomic<bool> end = false;
+
+    std::thread writer_thread{ [&]() {
+        for (int i = 1; i <= WriteCount; i++)
+        {
+            auto writer = tb.ownAsWriter();
+            writer->_value = i;
+            writer->_doubled = i * 2;
+        }
+        end = true;
+    } };
+
+    int last = 0;
+    while (last != WriteCount)
+    {
+        if (!tb.CanRead())
+        {
+            if (end && !tb.CanRead())
+                break;
+            continue;
+        }
+        auto reader = tb.ownAsReader();
+        EXPECT_EQ(reader->_value * 2, reader->_doubled);
+        EXPECT_LT(last, reader->_value);
+        last = reader->_value;
+    }
+    writer_thread.join();
+
+    if (tb.CanRead())
+        last = tb.ownAsReader()->_value;
+    EXPECT_EQ(WriteCount, last);
+}
@@ -0,0 +1,249 @@
+﻿#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <entt/entt.hpp>
+#include <box2d/box2d.h>
+
+#include "tofu/ecs/physics.h"
+
+namespace
+{
+    void add_ball(tofu::Physics& physics, entt::registry& registry, float x, float y)
+    {
+        auto entity = registry.create();
+        b2BodyDef body_def;
+        body_def.type = b2_dynamicBody;
+        body_def.position.Set(x, y);
+        auto& rigidbody = physics.GenerateBody(entity, body_def);
+
+        b2CircleShape shape;
+        shape.m_radius = 0.5f;
+        b2FixtureDef fixture_def;
+        fixture_def.shape = &shape;
+        fixture_def.density = 1.f;
+        fixture_def.restitution = 0.5f;
+        rigidbody._body->CreateFixture(&fixture_def);
+    }
+
+    void add_ground(tofu::Physics& physics, entt::registry& registry)
+    {
+        auto entity = registry.create();
+        b2BodyDef body_def;
+        body_def.position.Set(0.f, 10.f);
+        auto& rigidbody = physics.GenerateBody(entity, body_def);
+
+        b2PolygonShape shape;
+        shape.SetAsBox(20.f, 0.5f);
+        rigidbody._body->CreateFixture(&shape, 0.f);
+    }
+
+    tofu::SnapshotBuffer save(const tofu::Physics& physics)
+    {
+        tofu::SnapshotBuffer buffer;
+        physics.SaveSnapshot(buffer);
+        return buffer;
+    }
+
+    std::uint64_t hash(const tofu::Physics& physics)
+    {
+        tofu::StateHasher hasher;
+        physics.HashState(hasher);
+        return hasher.Get();
+    }
+
+    // 動くボディ全てに、Tickごとの入力として力を加える
+    void push(entt::registry& registry, const b2Vec2& force)
+    {
+        for (auto&& [entity, rigidbody] : registry.view<tofu::RigidBody>().proxy())
+        {
+            if (rigidbody._body->GetType() == b2_dynamicBody)
+                rigidbody._body->ApplyForceToCenter(force, true);
+        }
+    }
+}
+
+TEST(Ecs_Physics, 保存して復元すると同じ状態になる)
+{
+    entt::registry registry;
+    tofu::Physics physics{ &registry };
+    add_ground(physics, registry);
+    for (int i = 0; i < 5; i++)
+        add_ball(physics, registry, i * 1.5f, 0.f);
+
+    // 地面に接触させておく
+    for (int i = 0; i < 120; i++)
+        physics.Step(1.f / 60);
+
+    auto saved = save(physics);
+
+    tofu::SnapshotReader reader{ saved };
+    EXPECT_FALSE(physics.LoadSnapshot(reader));
+    EXPECT_TRUE(reader.IsEnd());
+
+    EXPECT_EQ(saved, save(physics));
+}
+
+TEST(Ecs_Physics, 復元してから進めると同じ結果になる)
+{
+    entt::registry registry;
+    tofu::Physics physics{ &registry };
+    // 接触が起きない自由落下の間であれば、box2dの内部状態も含めて完全に復元できる
+    for (int i = 0; i < 5; i++)
+        add_ball(physics, registry, i * 1.5f, -100.f);
+
+    for (int i = 0; i < 10; i++)
+        physics.Step(1.f / 60);
+    auto saved = save(physics);
+
+    for (int i = 0; i < 30; i++)
+        physics.Step(1.f / 60);
+    auto expected = save(physics);
+    EXPECT_NE(saved, expected);
+
+    tofu::SnapshotReader reader{ saved };
+    EXPECT_FALSE(physics.LoadSnapshot(reader));
+    for (int i = 0; i < 30; i++)
+        physics.Step(1.f / 60);
+
+    EXPECT_EQ(expected, save(physics));
+}
+
+TEST(Ecs_Physics, ボディの構成が違うと復元に失敗する)
+{
+    entt::registry registry;
+    tofu::Physics physics{ &registry };
+    add_ball(physics, registry, 0.f, 0.f);
+    auto saved = save(physics);
+
+    add_ball(physics, registry, 2.f, 0.f);
+    tofu::SnapshotReader reader{ saved };
+    EXPECT_TRUE(physics.LoadSnapshot(reader));
+
+    tofu::SnapshotBuffer truncated;
+    truncated.WriteBytes(saved.Data(), saved.Size() - 1);
+    tofu::SnapshotReader truncated_reader{ truncated };
+    EXPECT_TRUE(physics.LoadSnapshot(truncated_reader));
+}
+
+TEST(Ecs_Physics, 同じ状態なら同じハッシュになる)
+{
+    auto simulate = [](int steps) {
+        entt::registry registry;
+        tofu::Physics physics{ &registry };
+        add_ground(physics, registry);
+        for (int i = 0; i < 5; i++)
+            add_ball(physics, registry, i * 1.5f, 0.f);
+        for (int i = 0; i < steps; i++)
+            physics.Step(1.f / 60);
+        return hash(physics);
+    };
+
+    // 別々のワールドでも、同じ手順で進めれば一致する
+    EXPECT_EQ(simulate(60), simulate(60));
+    EXPECT_NE(simulate(60), simulate(61));
+}
+
+TEST(Ecs_Physics, 作り直してから保存すれば接触があっても巻き戻して同じ結果になる)
+{
+    entt::registry registry;
+    tofu::Physics physics{ &registry };
+    add_ground(physics, registry);
+    // 隣り合うボール同士と、ボールと地面がぶつかり続ける
+    for (int i = 0; i < 5; i++)
+        add_ball(physics, registry, i * 1.f, 0.f);
+
+    constexpr int TickNum = 240;
+    // 巻き戻すときと同じく、毎Tick保存する前に作り直しながら進める
+    std::vector<tofu::SnapshotBuffer> snapshots;
+    std::vector<std::uint64_t> checksums;
+    for (int i = 0; i < TickNum; i++)
+    {
+        physics.DiscardTransientState();
+        snapshots.push_back(save(physics));
+        physics.Step(1.f / 60);
+        checksums.push_back(hash(physics));
+    }
+
+    // 地面に着いてボール同士が押し合っている150 Tickまで巻き戻して、同じ入力で進め直す
+    constexpr int RollbackTick = 150;
+    tofu::SnapshotReader reader{ snapshots[RollbackTick] };
+    EXPECT_FALSE(physics.LoadSnapshot(reader));
+    physics.DiscardTransientState();
+    EXPECT_EQ(snapshots[RollbackTick], save(physics));
+    physics.Step(1.f / 60);
+    EXPECT_EQ(checksums[RollbackTick], hash(physics));
+
+    for (int i = RollbackTick + 1; i < TickNum; i++)
+    {
+        physics.DiscardTransientState();
+        EXPECT_EQ(snapshots[i], save(physics));
+        physics.Step(1.f / 60);
+        EXPECT_EQ(checksums[i], hash(physics));
+    }
+
+    // RigidBodyは作り直したボディを指している
+    for (auto&& [entity, rigidbody] : registry.view<tofu::RigidBody>().proxy())
+        EXPECT_EQ(static_cast<std::uintptr_t>(entity), rigidbody._body->GetUserData().pointer);
+}
+
+TEST(Ecs_Physics, 巻き戻しながら進めた結果は作り直しながら進めるだけで再現できる)
+{
+    constexpr int TickNum = 240;
+    // 入力がこのTick数遅れて届く
+    constexpr int Latency = 4;
+    // 20 Tickごとに左右に押す向きを変える
+    auto input = [](int tick) { return b2Vec2{ tick / 20 % 2 == 0 ? 30.f : -30.f, 0.f }; };
+    auto setup = [](tofu::Physics& physics, entt::registry& registry) {
+        add_ground(physics, registry);
+        for (int i = 0; i < 5; i++)
+            add_ball(physics, registry, i * 1.f, 0.f);
+    };
+
+    // 試合: 届いた入力のTickまで毎Tick巻き戻し、まだ届いていない入力は最後に届いたもので予測して進め直す
+    std::uint64_t expected;
+    {
+        entt::registry registry;
+        tofu::Physics physics{ &registry };
+        setup(physics, registry);
+
+        std::vector<tofu::SnapshotBuffer> snapshots(TickNum);
+        auto step = [&](int tick, const b2Vec2& force) {
+            physics.DiscardTransientState();
+            snapshots[tick] = save(physics);
+            push(registry, force);
+            physics.Step(1.f / 60);
+        };
+        auto resimulate = [&](int arrived, int end) {
+            tofu::SnapshotReader reader{ snapshots[arrived] };
+            EXPECT_FALSE(physics.LoadSnapshot(reader));
+            physics.DiscardTransientState();
+            for (int i = arrived; i < end; i++)
+                step(i, input(arrived));
+        };
+
+        for (int tick = 0; tick < TickNum; tick++)
+        {
+            auto arrived = tick - Latency;
+            if (0 <= arrived)
+                resimulate(arrived, tick);
+            step(tick, input(std::max(arrived, 0)));
+        }
+        // 最後に届いた入力で進め直し、全Tickを確定した入力で進めた状態にする
+        for (int arrived = TickNum - Latency; arrived < TickNum; arrived++)
+            resimulate(arrived, TickNum);
+        expected = hash(physics);
+    }
+
+    // 再生: 確定した入力だけで、巻き戻しも保存もせず毎Tick作り直しながら進める
+    entt::registry registry;
+    tofu::Physics physics{ &registry };
+    setup(physics, registry);
+    for (int tick = 0; tick < TickNum; tick++)
+    {
+        physics.DiscardTransientState();
+        push(registry, input(tick));
+        physics.Step(1.f / 60);
+    }
+    EXPECT_EQ(expected, hash(physics));
+}
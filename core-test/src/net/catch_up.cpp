@@ -0,0 +1,135 @@
+﻿#include <gtest/gtest.h>
+
+#include <numeric>
+#include <vector>
+
+#include "tofu/net/catch_up.h"
+
+namespace
+{
+    std::vector<std::byte> make_data(std::size_t size)
+    {
+        std::vector<std::byte> data(size);
+        for (std::size_t i = 0; i < size; i++)
+            data[i] = static_cast<std::byte>(i);
+        return data;
+    }
+
+    // 送られたものの大きさを順に返す. 送られたバイト列はoutに足す
+    std::vector<std::size_t> collect(tofu::net::CatchUpSender& sender, std::span<const std::byte> data, std::vector<std::byte>& out)
+    {
+        std::vector<std::size_t> sizes;
+        sender.Collect(data, [&](std::span<const std::byte> chunk) {
+            sizes.push_back(chunk.size());
+            out.insert(out.end(), chunk.begin(), chunk.end());
+        });
+        return sizes;
+    }
+}
+
+TEST(Net_CatchUp, 窓の分だけ区切って送り受け取りを待つ)
+{
+    auto data = make_data(100);
+    tofu::net::CatchUpSender sender{ 16, 40 };
+    sender.Begin(data.size());
+
+    std::vector<std::byte> received;
+    EXPECT_EQ(collect(sender, data, received), (std::vector<std::size_t>{ 16, 16, 8 }));
+    // 受け取りが返ってくるまでは送らない
+    EXPECT_TRUE(collect(sender, data, received).empty());
+    EXPECT_FALSE(sender.IsDone());
+
+    sender.Ack(32);
+    EXPECT_EQ(collect(sender, data, received), (std::vector<std::size_t>{ 16, 16 }));
+    sender.Ack(72);
+    EXPECT_EQ(collect(sender, data, received), (std::vector<std::size_t>{ 16, 12 }));
+    EXPECT_EQ(sender.GetSent(), 100);
+    EXPECT_FALSE(sender.IsDone());
+
+    sender.Ack(100);
+    EXPECT_TRUE(sender.IsDone());
+    EXPECT_EQ(received, data);
+}
+
+TEST(Net_CatchUp, 古い受け取りや送っていない分の受け取りでは進まない)
+{
+    auto data = make_data(64);
+    tofu::net::CatchUpSender sender{ 16, 32 };
+    sender.Begin(data.size());
+
+    std::vector<std::byte> received;
+    collect(sender, data, received);
+    sender.Ack(16);
+    sender.Ack(8);
+    EXPECT_EQ(sender.GetAcked(), 16);
+
+    // まだ送っていない分まで受け取ったことにはしない
+    sender.Ack(1000);
+    EXPECT_EQ(sender.GetAcked(), 32);
+    EXPECT_FALSE(sender.IsDone());
+}
+
+TEST(Net_CatchUp, 送る間に後ろへ書き足されても始めの大きさだけ送る)
+{
+    auto data = make_data(20);
+    tofu::net::CatchUpSender sender{ 16, 64 };
+    sender.Begin(data.size());
+
+    std::vector<std::byte> received;
+    collect(sender, std::span{ data }.first(20), received);
+    auto more = make_data(50);
+    collect(sender, more, received);
+    EXPECT_EQ(received.size(), 20);
+    sender.Ack(20);
+    EXPECT_TRUE(sender.IsDone());
+}
+
+TEST(Net_CatchUp, 何も送らなければ始めから終わっている)
+{
+    tofu::net::CatchUpSender sender{ 16, 64 };
+    sender.Begin(0);
+    EXPECT_TRUE(sender.IsDone());
+
+    tofu::net::CatchUpReceiver receiver{ 16 };
+    receiver.Begin(0);
+    EXPECT_TRUE(receiver.IsComplete());
+}
+
+TEST(Net_CatchUp, 間隔ごとと最後に受け取りを返す)
+{
+    tofu::net::CatchUpReceiver receiver{ 16 };
+    receiver.Begin(40);
+
+    EXPECT_FALSE(receiver.Consume(10));
+    EXPECT_TRUE(receiver.Consume(10));
+    EXPECT_FALSE(receiver.Consume(15));
+    EXPECT_FALSE(receiver.IsComplete());
+    // 間隔に満たなくても、全て読んだら返す
+    EXPECT_TRUE(receiver.Consume(5));
+    EXPECT_TRUE(receiver.IsComplete());
+    EXPECT_EQ(receiver.GetConsumed(), 40);
+}
+
+TEST(Net_CatchUp, 受け取りを返しながら最後まで送れる)
+{
+    auto data = make_data(1000);
+    tofu::net::CatchUpSender sender{ 64, 256 };
+    tofu::net::CatchUpReceiver receiver{ 64 };
+    sender.Begin(data.size());
+    receiver.Begin(data.size());
+
+    // 受け取った分を7バイトずつ読み、返すべきときだけ送り手に返す
+    std::vector<std::byte> stream;
+    std::size_t read = 0;
+    for (int i = 0; i < 1000 && !sender.IsDone(); i++)
+    {
+        collect(sender, data, stream);
+        auto size = std::min<std::size_t>(7, stream.size() - read);
+        read += size;
+        if (size != 0 && receiver.Consume(size))
+            sender.Ack(receiver.GetConsumed());
+    }
+    EXPECT_TRUE(sender.IsDone());
+    EXPECT_TRUE(receiver.IsComplete());
+    EXPECT_EQ(stream, data);
+}
@@ -0,0 +1,79 @@
+﻿#include <gtest/gtest.h>
+
+#include "tofu/net/clock_sync.h"
+
+using namespace std::chrono_literals;
+
+namespace
+{
+    using Estimator = tofu::net::ClockSyncEstimator;
+
+    // こちらの時計でlocalに要求を送り、片道 forward / backward で届くときのサンプルを加える
+    //  ピアの時計は こちらの時計 + offset + drift * 経過時間
+    void add_sample(Estimator& estimator, Estimator::time_point local, std::chrono::microseconds offset, double drift, std::chrono::microseconds forward, std::chrono::microseconds backward)
+    {
+        auto remote = [&](Estimator::time_point t) {
+            auto elapsed = static_cast<double>(t.time_since_epoch().count());
+            return t + offset + std::chrono::microseconds{ std::llround(drift * elapsed) };
+        };
+        auto t0 = local;
+        auto t1 = remote(t0 + forward);
+        auto t2 = t1 + 100us;
+        auto t3 = t0 + forward + 100us + backward;
+        estimator.AddSample(t0, t1, t2, t3);
+    }
+}
+
+TEST(Net_ClockSync, 対称な遅延ならオフセットが正確に求まる)
+{
+    Estimator estimator;
+    EXPECT_EQ(0u, estimator.GetSampleCount());
+
+    Estimator::time_point base{ 1'000'000s };
+    add_sample(estimator, base, 250'000us, 0, 20'000us, 20'000us);
+
+    EXPECT_EQ(1u, estimator.GetSampleCount());
+    EXPECT_EQ(250'000us, estimator.GetOffset(base));
+    EXPECT_EQ(40'000us, estimator.GetRoundTrip());
+    EXPECT_EQ(base + 250'000us, estimator.ToRemote(base));
+}
+
+TEST(Net_ClockSync, 待たされたサンプルより往復遅延の小さいサンプルを信じる)
+{
+    Estimator estimator;
+    Estimator::time_point base{ 1'000'000s };
+    for (int i = 0; i < 16; i++)
+    {
+        auto local = base + 100ms * i;
+        // 半分は帰りにだけ30ms待たされる. そのまま平均すると15msずれる
+        auto backward = i % 2 ? 50'000us : 20'000us;
+        add_sample(estimator, local, -80'000us, 0, 20'000us, backward);
+    }
+    EXPECT_NEAR(-80'000, estimator.GetOffset(base + 1s).count(), 10);
+    EXPECT_EQ(40'000us, estimator.GetRoundTrip());
+}
+
+TEST(Net_ClockSync, ドリフトを推定して先の時刻のオフセットを予測する)
+{
+    Estimator estimator;
+    Estimator::time_point base{ 0s };
+    // ピアの時計が 100ppm 速い
+    constexpr double drift = 100e-6;
+    for (int i = 0; i < 32; i++)
+    {
+        add_sample(estimator, base + 1s * i, 5'000us, drift, 10'000us, 10'000us);
+    }
+    EXPECT_NEAR(drift, estimator.GetDrift(), 1e-6);
+
+    // 60秒後には6msずれている
+    auto later = base + 60s;
+    EXPECT_NEAR(5'000 + 6'000, estimator.GetOffset(later).count(), 50);
+}
+
+TEST(Net_ClockSync, 往復遅延が負のサンプルは捨てる)
+{
+    Estimator estimator;
+    Estimator::time_point base{ 1'000'000s };
+    estimator.AddSample(base, base, base + 10ms, base + 5ms);
+    EXPECT_EQ(0u, estimator.GetSampleCount());
+}
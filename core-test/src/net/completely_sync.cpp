@@ -0,0 +1,119 @@
+﻿#include <gtest/gtest.h>
+
+#include "tofu/net/completely_sync.h"
+
+namespace
+{
+    constexpr std::uint32_t BufferSize = 8;
+    constexpr std::size_t MaxPlayers = 16;
+
+    using System = tofu::net::CompletelySyncSystem<int, BufferSize, MaxPlayers>;
+}
+
+TEST(Net_CompletelySync, 遅延分は空の入力で埋まっている)
+{
+    System system{ 3, 2 };
+
+    for (int i = 0; i < 2; i++)
+    {
+        EXPECT_TRUE(system.CanStep());
+        auto top = system.Top();
+        ASSERT_EQ(3u, top.size());
+        EXPECT_EQ(0, top[0]);
+        system.Step();
+    }
+    EXPECT_FALSE(system.CanStep());
+}
+
+TEST(Net_CompletelySync, 全員分揃うまで進めない)
+{
+    System system{ 3, 0 };
+
+    system.SetData(0, tofu::GameTick{ 0 }, 10);
+    system.SetData(2, tofu::GameTick{ 0 }, 30);
+    EXPECT_FALSE(system.CanStep());
+    EXPECT_EQ(0b010, system.GetWaitingPlayers());
+
+    system.SetData(1, tofu::GameTick{ 0 }, 20);
+    EXPECT_TRUE(system.CanStep());
+    EXPECT_EQ(0, system.GetWaitingPlayers());
+
+    auto top = system.Top();
+    EXPECT_EQ(10, top[0]);
+    EXPECT_EQ(20, top[1]);
+    EXPECT_EQ(30, top[2]);
+}
+
+TEST(Net_CompletelySync, 先のTickの入力はStepで前に詰められる)
+{
+    System system{ 2, 0 };
+
+    system.SetData(0, tofu::GameTick{ 1 }, 1);
+    system.SetData(1, tofu::GameTick{ 1 }, 2);
+    EXPECT_TRUE(system.HasData(tofu::GameTick{ 1 }, 0));
+    EXPECT_FALSE(system.HasData(tofu::GameTick{ 0 }, 0));
+
+    system.SetData(0, tofu::GameTick{ 0 }, 0);
+    system.SetData(1, tofu::GameTick{ 0 }, 0);
+    system.Step();
+
+    EXPECT_TRUE(system.CanStep());
+    EXPECT_EQ(1, system.Top()[0]);
+    EXPECT_EQ(2, system.Top()[1]);
+
+    // 一周しても前の入力が残っていない
+    system.Step();
+    for (std::uint32_t i = 0; i < BufferSize; i++)
+    {
+        EXPECT_FALSE(system.HasData(tofu::GameTick{ i }, 0));
+        EXPECT_FALSE(system.HasData(tofu::GameTick{ i }, 1));
+    }
+    EXPECT_EQ(0b11, system.GetWaitingPlayers());
+}
+
+TEST(Net_CompletelySync, 最大人数で動く)
+{
+    tofu::net::CompletelySyncSystem<int, BufferSize, 64> system{ 64, 0 };
+    static_assert(std::is_same_v<decltype(system)::mask_type, std::uint64_t>);
+
+    for (std::size_t p = 0; p < 63; p++)
+        system.SetData(p, tofu::GameTick{ 0 }, static_cast<int>(p));
+    EXPECT_FALSE(system.CanStep());
+    EXPECT_EQ(std::uint64_t{ 1 } << 63, system.GetWaitingPlayers());
+
+    system.SetData(63, tofu::GameTick{ 0 }, 63);
+    EXPECT_TRUE(system.CanStep());
+    EXPECT_EQ(63, system.Top()[63]);
+}
+
+namespace
+{
+    template<std::size_t Players>
+    void expect_steps_with_all_players()
+    {
+        tofu::net::CompletelySyncSystem<int, BufferSize, Players> system{ Players, 0 };
+        using mask_type = typename decltype(system)::mask_type;
+        static_assert(std::numeric_limits<mask_type>::digits == Players);
+
+        for (std::size_t p = 0; p + 1 < Players; p++)
+            system.SetData(p, tofu::GameTick{ 0 }, static_cast<int>(p));
+        EXPECT_FALSE(system.CanStep());
+        EXPECT_EQ(static_cast<mask_type>(mask_type{ 1 } << (Players - 1)), system.GetWaitingPlayers());
+
+        system.SetData(Players - 1, tofu::GameTick{ 0 }, 0);
+        EXPECT_TRUE(system.CanStep());
+        EXPECT_EQ(0, system.GetWaitingPlayers());
+    }
+}
+
+TEST(Net_CompletelySync, マスクの幅と同じ人数でも揃えば進める)
+{
+    expect_steps_with_all_players<8>();
+    expect_steps_with_all_players<16>();
+    expect_steps_with_all_players<32>();
+
+    EXPECT_EQ(0xffu, tofu::net::completely_sync::all_players<std::uint8_t>(8));
+    EXPECT_EQ(0x7fffu, tofu::net::completely_sync::all_players<std::uint16_t>(15));
+    EXPECT_EQ(0xffff'ffffu, tofu::net::completely_sync::all_players<std::uint32_t>(32));
+    EXPECT_EQ(0u, tofu::net::completely_sync::all_players<std::uint32_t>(0));
+}
@@ -0,0 +1,137 @@
+﻿#include <gtest/gtest.h>
+
+#include "tofu/net/desync.h"
+
+TEST(Net_Desync, 全員のハッシュが一致していれば何も報告しない)
+{
+    tofu::net::DesyncDetector<16> detector{ 3 };
+
+    for (std::uint32_t tick = 0; tick < 10; tick++)
+    {
+        for (std::size_t player = 0; player < 3; player++)
+        {
+            EXPECT_FALSE(detector.Add(player, tick, tick * 100));
+        }
+    }
+    EXPECT_FALSE(detector.GetFirstDesync());
+    EXPECT_EQ(0u, detector.PendingCount());
+}
+
+TEST(Net_Desync, 食い違ったプレイヤーとTickを報告する)
+{
+    tofu::net::DesyncDetector<16> detector{ 3 };
+
+    EXPECT_FALSE(detector.Add(0, 5, 1));
+    EXPECT_FALSE(detector.Add(2, 5, 2));
+    auto desync = detector.Add(1, 5, 1);
+    ASSERT_TRUE(desync);
+    EXPECT_EQ(tofu::GameTick{ 5 }, desync->_tick);
+    EXPECT_EQ(0b100, desync->_players);
+
+    // 食い違いは続くが、報告は最初の1回だけ
+    EXPECT_FALSE(detector.Add(0, 6, 1));
+    EXPECT_FALSE(detector.Add(1, 6, 2));
+    EXPECT_FALSE(detector.Add(2, 6, 3));
+    EXPECT_EQ(tofu::GameTick{ 5 }, detector.GetFirstDesync()->_tick);
+}
+
+TEST(Net_Desync, 後から揃ったより前のTickの食い違いを報告する)
+{
+    tofu::net::DesyncDetector<16> detector{ 2 };
+
+    // 8 Tickは食い違っているが、7 Tickが揃うのは後
+    EXPECT_FALSE(detector.Add(0, 7, 1));
+    EXPECT_FALSE(detector.Add(0, 8, 1));
+    EXPECT_TRUE(detector.Add(1, 8, 2));
+    auto desync = detector.Add(1, 7, 2);
+    ASSERT_TRUE(desync);
+    EXPECT_EQ(tofu::GameTick{ 7 }, desync->_tick);
+    EXPECT_EQ(tofu::GameTick{ 7 }, detector.GetFirstDesync()->_tick);
+}
+
+TEST(Net_Desync, 揃わないTickは上限を超えたら古いものから捨てる)
+{
+    tofu::net::DesyncDetector<16> detector{ 2, 4 };
+
+    for (std::uint32_t tick = 0; tick < 10; tick++)
+    {
+        detector.Add(0, tick, 0);
+    }
+    EXPECT_EQ(4u, detector.PendingCount());
+    // 捨てたTickは新しく待ち始める
+    EXPECT_FALSE(detector.Add(1, 0, 1));
+    EXPECT_EQ(4u, detector.PendingCount());
+}
+
+TEST(Net_Desync, 試合の途中で抜けたプレイヤーは待たない)
+{
+    tofu::net::DesyncDetector<16> detector{ 3 };
+
+    for (std::uint32_t tick = 0; tick < 5; tick++)
+    {
+        for (std::size_t player = 0; player < 3; player++)
+            EXPECT_FALSE(detector.Add(player, tick, tick));
+    }
+
+    // 2が抜ける前に、5 Tickは0と1の分だけ届いていた. 1は食い違っている
+    EXPECT_FALSE(detector.Add(0, 5, 5));
+    EXPECT_FALSE(detector.Add(1, 5, 99));
+    EXPECT_EQ(1u, detector.PendingCount());
+
+    // 2を待たなくてよくなれば、その場で比べる
+    auto desync = detector.RemovePlayer(2);
+    ASSERT_TRUE(desync);
+    EXPECT_EQ(tofu::GameTick{ 5 }, desync->_tick);
+    EXPECT_EQ(0b010, desync->_players);
+    EXPECT_EQ(0b011, detector.GetActivePlayers());
+    EXPECT_EQ(0u, detector.PendingCount());
+}
+
+TEST(Net_Desync, 抜けた後も残りのプレイヤーで比べ続ける)
+{
+    tofu::net::DesyncDetector<16> detector{ 3 };
+
+    EXPECT_FALSE(detector.RemovePlayer(1));
+    for (std::uint32_t tick = 0; tick < 5; tick++)
+    {
+        EXPECT_FALSE(detector.Add(0, tick, tick));
+        EXPECT_FALSE(detector.Add(2, tick, tick));
+    }
+    EXPECT_EQ(0u, detector.PendingCount());
+
+    // 抜けたプレイヤーから遅れて届いたハッシュは使わない
+    EXPECT_FALSE(detector.Add(1, 5, 99));
+    EXPECT_EQ(0u, detector.PendingCount());
+
+    EXPECT_FALSE(detector.Add(0, 6, 1));
+    auto desync = detector.Add(2, 6, 2);
+    ASSERT_TRUE(desync);
+    EXPECT_EQ(0b100, desync->_players);
+}
+
+TEST(Net_Desync, 戻ってきたプレイヤーは指定したTickから比べる)
+{
+    tofu::net::DesyncDetector<16> detector{ 2 };
+
+    EXPECT_FALSE(detector.RemovePlayer(1));
+    for (std::uint32_t tick = 0; tick < 6; tick++)
+        EXPECT_FALSE(detector.Add(0, tick, tick));
+
+    // 戻ってきたプレイヤーの入力を使い始めるのは、他のプレイヤーがまだ進めていない8 Tickから
+    detector.AddPlayer(1, 8);
+    for (std::uint32_t tick = 6; tick < 10; tick++)
+        EXPECT_FALSE(detector.Add(0, tick, tick));
+    EXPECT_EQ(2u, detector.PendingCount());
+
+    // 追いつくまでに進めたTickのハッシュは、比べ終わっているので使わない
+    for (std::uint32_t tick = 0; tick < 8; tick++)
+        EXPECT_FALSE(detector.Add(1, tick, 99));
+    EXPECT_EQ(2u, detector.PendingCount());
+
+    EXPECT_FALSE(detector.Add(1, 8, 8));
+    EXPECT_EQ(1u, detector.PendingCount());
+    auto desync = detector.Add(1, 9, 99);
+    ASSERT_TRUE(desync);
+    EXPECT_EQ(tofu::GameTick{ 9 }, desync->_tick);
+    EXPECT_EQ(0b10, desync->_players);
+}
@@ -0,0 +1,65 @@
+﻿#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "tofu/net/fan_out.h"
+#include "tofu/net/framing.h"
+
+namespace
+{
+    // ヘッダ付きでエンコードしたメッセージ. 中身の大きさはメッセージごとに違う
+    std::vector<std::byte> make_message(std::uint8_t type, std::size_t payload_size)
+    {
+        std::vector<std::byte> message(tofu::net::FrameHeaderSize(payload_size) + payload_size, std::byte{ type });
+        tofu::net::WriteFrameHeader(message, type, payload_size);
+        return message;
+    }
+
+    struct Target
+    {
+        std::vector<std::byte> _received;
+        int _sendCount = 0;
+    };
+}
+
+TEST(Net_FanOutBuffer, 全宛先に同じバイト列を一度ずつ渡す)
+{
+    tofu::net::FanOutBuffer buffer;
+    auto first = make_message(1, 4);
+    auto second = make_message(2, 9);
+    buffer.AppendBytes(first);
+    buffer.AppendBytes(second);
+    EXPECT_EQ(2u, buffer.MessageCount());
+    EXPECT_EQ(first.size() + second.size(), buffer.Size());
+
+    std::vector<Target> targets(3);
+    const std::byte* data = nullptr;
+    buffer.Flush(targets, [&](Target& target, std::span<const std::byte> bytes) {
+        // エンコードし直さず、同じ領域を渡している
+        if (!data)
+            data = bytes.data();
+        EXPECT_EQ(data, bytes.data());
+
+        target._received.insert(target._received.end(), bytes.begin(), bytes.end());
+        target._sendCount++;
+    });
+
+    EXPECT_TRUE(buffer.Empty());
+    for (auto& target : targets)
+    {
+        EXPECT_EQ(1, target._sendCount);
+        // 積んだ順にそのまま並んでいる
+        std::vector<std::byte> expected{ first.begin(), first.end() };
+        expected.insert(expected.end(), second.begin(), second.end());
+        EXPECT_EQ(expected, target._received);
+    }
+}
+
+TEST(Net_FanOutBuffer, 空なら送らない)
+{
+    tofu::net::FanOutBuffer buffer;
+    std::vector<Target> targets(2);
+    buffer.Flush(targets, [](Target& target, std::span<const std::byte>) { target._sendCount++; });
+    EXPECT_EQ(0, targets[0]._sendCount);
+    EXPECT_EQ(0, targets[1]._sendCount);
+}
@@ -0,0 +1,110 @@
+﻿#include <gtest/gtest.h>
+
+#include "tofu/net/frame_advantage.h"
+
+using namespace std::chrono_literals;
+
+namespace
+{
+    using Balancer = tofu::net::FrameAdvantageBalancer<4>;
+
+    constexpr std::chrono::microseconds TickPeriod = 16'666us;
+
+    Balancer make_balancer()
+    {
+        return Balancer{ Balancer::Config{ ._tickPeriod = TickPeriod } };
+    }
+}
+
+TEST(Net_FrameAdvantage, 片道の時間の分を差し引いて比べる)
+{
+    auto balancer = make_balancer();
+    EXPECT_FALSE(balancer.GetAdvantage(1));
+
+    // 相手がTick100で送ったものが、2Tick分かけてTick102の自分に届いた. 相手も今Tick102なので差はない
+    balancer.AddSample(1, 100, 102, TickPeriod * 2);
+    ASSERT_TRUE(balancer.GetAdvantage(1));
+    EXPECT_NEAR(0.f, *balancer.GetAdvantage(1), 0.01f);
+    EXPECT_EQ(0.f, balancer.GetDilation());
+    EXPECT_EQ(TickPeriod, balancer.GetTickPeriod());
+}
+
+TEST(Net_FrameAdvantage, 先行しているときだけ1Tickを伸ばす)
+{
+    auto balancer = make_balancer();
+    for (std::uint32_t i = 0; i < 100; i++)
+    {
+        // 自分が3Tick先行している
+        balancer.AddSample(1, 100 + i, 103 + i, 0us);
+        // もう1人とは揃っている
+        balancer.AddSample(2, 100 + i, 100 + i, 0us);
+    }
+    EXPECT_NEAR(3.f, balancer.GetMaxAdvantage(), 0.01f);
+    // 遊び1Tickを超えた2Tick分 × 2%
+    EXPECT_NEAR(0.04f, balancer.GetDilation(), 0.001f);
+    EXPECT_LT(TickPeriod, balancer.GetTickPeriod());
+
+    // 遅れている側は伸ばさない
+    auto behind = make_balancer();
+    for (std::uint32_t i = 0; i < 100; i++)
+        behind.AddSample(0, 103 + i, 100 + i, 0us);
+    EXPECT_NEAR(-3.f, *behind.GetAdvantage(0), 0.01f);
+    EXPECT_EQ(0.f, behind.GetDilation());
+}
+
+TEST(Net_FrameAdvantage, 伸ばす割合には上限がある)
+{
+    auto balancer = make_balancer();
+    balancer.AddSample(3, 0, 60, 0us);
+    EXPECT_EQ(0.05f, balancer.GetDilation());
+    EXPECT_NEAR(TickPeriod.count() * 1.05, balancer.GetTickPeriod().count(), 1);
+}
+
+TEST(Net_FrameAdvantage, 外れたサンプル1つでは大きく動かない)
+{
+    auto balancer = make_balancer();
+    balancer.AddSample(1, 100, 100, 0us);
+    balancer.AddSample(1, 101, 109, 0us);
+    EXPECT_NEAR(1.f, *balancer.GetAdvantage(1), 0.01f);
+}
+
+TEST(Net_FrameAdvantage, 相手の報告と差し引くと片道の見積もりの誤差が消える)
+{
+    // 2人は同じTickを進めているが、片道を実際より2Tick短く見積もっているので、どちらも2Tick先行しているように見える
+    auto a = make_balancer();
+    auto b = make_balancer();
+    for (std::uint32_t i = 0; i < 100; i++)
+    {
+        a.AddSample(1, 100 + i, 104 + i, TickPeriod * 2);
+        b.AddSample(0, 100 + i, 104 + i, TickPeriod * 2);
+    }
+    EXPECT_NEAR(2.f, *a.GetMeasuredAdvantage(1), 0.01f);
+    EXPECT_NEAR(2.f, *a.GetAdvantage(1), 0.01f);
+    EXPECT_LT(0.f, a.GetDilation());
+
+    // 報告し合えば、どちらも揃っていると分かるので伸ばさない
+    a.SetRemoteAdvantage(1, *b.GetMeasuredAdvantage(0));
+    b.SetRemoteAdvantage(0, *a.GetMeasuredAdvantage(1));
+    EXPECT_NEAR(0.f, *a.GetAdvantage(1), 0.01f);
+    EXPECT_NEAR(0.f, *b.GetAdvantage(0), 0.01f);
+    EXPECT_EQ(0.f, a.GetDilation());
+    EXPECT_EQ(0.f, b.GetDilation());
+}
+
+TEST(Net_FrameAdvantage, 実際の差は報告と差し引いても残る)
+{
+    // aが3Tick先行していて、片道の見積もりはどちらも1Tick短い
+    auto a = make_balancer();
+    auto b = make_balancer();
+    for (std::uint32_t i = 0; i < 100; i++)
+    {
+        a.AddSample(1, 100 + i, 105 + i, TickPeriod);
+        b.AddSample(0, 103 + i, 102 + i, TickPeriod);
+    }
+    a.SetRemoteAdvantage(1, *b.GetMeasuredAdvantage(0));
+    b.SetRemoteAdvantage(0, *a.GetMeasuredAdvantage(1));
+    EXPECT_NEAR(3.f, *a.GetAdvantage(1), 0.01f);
+    EXPECT_NEAR(-3.f, *b.GetAdvantage(0), 0.01f);
+    EXPECT_LT(0.f, a.GetDilation());
+    EXPECT_EQ(0.f, b.GetDilation());
+}
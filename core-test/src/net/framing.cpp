@@ -0,0 +1,164 @@
+﻿#include <gtest/gtest.h>
+
+#include <array>
+#include <vector>
+
+#include "tofu/net/framing.h"
+
+namespace
+{
+    struct Message
+    {
+        std::uint8_t _type = 0;
+        std::vector<std::byte> _data;
+        // OnDataが呼ばれた回数
+        std::size_t _chunks = 0;
+        bool _ended = false;
+    };
+
+    struct Collector
+    {
+        std::vector<Message> _messages;
+
+        void OnBegin(std::uint8_t type)
+        {
+            _messages.push_back(Message{ type, {}, 0, false });
+        }
+        void OnData(std::span<const std::byte> data)
+        {
+            auto& message = _messages.back();
+            message._data.insert(message._data.end(), data.begin(), data.end());
+            message._chunks++;
+        }
+        void OnEnd()
+        {
+            _messages.back()._ended = true;
+        }
+    };
+
+    std::vector<std::byte> make_data(std::size_t size)
+    {
+        std::vector<std::byte> data(size);
+        for (std::size_t i = 0; i < size; i++)
+            data[i] = static_cast<std::byte>(i * 7);
+        return data;
+    }
+
+    std::vector<std::byte> frame(std::uint8_t type, std::span<const std::byte> payload, bool more = false)
+    {
+        std::vector<std::byte> bytes(tofu::net::FrameHeaderSize(payload.size()));
+        tofu::net::WriteFrameHeader(bytes, type, payload.size(), more);
+        bytes.insert(bytes.end(), payload.begin(), payload.end());
+        return bytes;
+    }
+}
+
+TEST(Net_Framing, ヘッダの大きさは中身の大きさで変わる)
+{
+    EXPECT_EQ(tofu::net::FrameHeaderSize(0), 2);
+    EXPECT_EQ(tofu::net::FrameHeaderSize(63), 2);
+    EXPECT_EQ(tofu::net::FrameHeaderSize(64), 3);
+    EXPECT_EQ(tofu::net::FrameHeaderSize(300), 3);
+    EXPECT_EQ(tofu::net::FrameHeaderSize(tofu::net::MaxFramePayloadSize), tofu::net::MaxFrameHeaderSize);
+
+    std::array<std::byte, tofu::net::MaxFrameHeaderSize> bytes;
+    for (std::size_t size : { 0u, 63u, 64u, 300u, 70000u })
+    {
+        auto written = tofu::net::WriteFrameHeader(bytes, 0x42, size, size == 64);
+        EXPECT_EQ(written, tofu::net::FrameHeaderSize(size));
+
+        tofu::net::FrameHeader header;
+        // 1byte足りなければ、まだ読めない
+        EXPECT_EQ(tofu::net::ParseFrameHeader(std::span{ bytes }.first(written - 1), header), tofu::net::FrameStatus::Incomplete);
+        ASSERT_EQ(tofu::net::ParseFrameHeader(std::span{ bytes }.first(written), header), tofu::net::FrameStatus::Complete);
+        EXPECT_EQ(header._type, 0x42);
+        EXPECT_EQ(header._payloadSize, size);
+        EXPECT_EQ(header._more, size == 64);
+        EXPECT_EQ(header.FrameSize(), written + size);
+    }
+
+    // 可変長整数が長すぎる
+    std::array<std::byte, 6> broken;
+    broken.fill(std::byte{ 0xff });
+    tofu::net::FrameHeader header;
+    EXPECT_EQ(tofu::net::ParseFrameHeader(broken, header), tofu::net::FrameStatus::Broken);
+}
+
+TEST(Net_Framing, 1byteずつ届いても中身を届いた分から渡す)
+{
+    auto small = make_data(5);
+    auto large = make_data(1000);
+    std::vector<std::byte> stream;
+    for (auto& bytes : { frame(1, small), frame(2, large), frame(3, {}) })
+        stream.insert(stream.end(), bytes.begin(), bytes.end());
+
+    tofu::net::FrameDecoder decoder{ 4096 };
+    Collector collector;
+    for (auto byte : stream)
+    {
+        ASSERT_TRUE(decoder.Feed({ &byte, 1 }, collector));
+    }
+    EXPECT_TRUE(decoder.IsIdle());
+
+    ASSERT_EQ(collector._messages.size(), 3);
+    EXPECT_EQ(collector._messages[0]._data, small);
+    EXPECT_EQ(collector._messages[1]._type, 2);
+    EXPECT_EQ(collector._messages[1]._data, large);
+    // 全て揃うのを待たずに渡している
+    EXPECT_EQ(collector._messages[1]._chunks, 1000);
+    EXPECT_TRUE(collector._messages[2]._ended);
+    EXPECT_TRUE(collector._messages[2]._data.empty());
+}
+
+TEST(Net_Framing, 区切って書いたメッセージを1つにつなげて読む)
+{
+    auto data = make_data(250);
+    std::vector<std::byte> stream;
+    std::vector<std::size_t> frames;
+    auto send = [&](std::span<const std::byte> bytes) {
+        frames.push_back(bytes.size());
+        stream.insert(stream.end(), bytes.begin(), bytes.end());
+    };
+
+    tofu::net::FrameFragmenter fragmenter{ 7, 100 };
+    // 書く単位と区切る単位は関係ない
+    fragmenter.Write(std::span{ data }.first(30), send);
+    fragmenter.Write(std::span{ data }.subspan(30, 170), send);
+    fragmenter.Write(std::span{ data }.subspan(200), send);
+    fragmenter.Finish(send);
+    EXPECT_EQ(frames, (std::vector<std::size_t>{ 3 + 100, 3 + 100, 2 + 50 }));
+
+    // 後ろに別のメッセージが続いてもよい
+    auto other = frame(8, make_data(3));
+    stream.insert(stream.end(), other.begin(), other.end());
+
+    tofu::net::FrameDecoder decoder{ 250 };
+    Collector collector;
+    ASSERT_TRUE(decoder.Feed(stream, collector));
+    ASSERT_EQ(collector._messages.size(), 2);
+    EXPECT_EQ(collector._messages[0]._type, 7);
+    EXPECT_EQ(collector._messages[0]._data, data);
+    EXPECT_TRUE(collector._messages[0]._ended);
+    EXPECT_EQ(collector._messages[1]._type, 8);
+}
+
+TEST(Net_Framing, 大きすぎるメッセージや続きの種類が違うものは壊れている)
+{
+    Collector collector;
+    {
+        tofu::net::FrameDecoder decoder{ 100 };
+        auto first = frame(1, make_data(60), true);
+        auto second = frame(1, make_data(60));
+        EXPECT_TRUE(decoder.Feed(first, collector));
+        EXPECT_FALSE(decoder.Feed(second, collector));
+        EXPECT_TRUE(decoder.IsBroken());
+    }
+    {
+        tofu::net::FrameDecoder decoder{ 100 };
+        auto first = frame(1, make_data(10), true);
+        auto second = frame(2, make_data(10));
+        EXPECT_TRUE(decoder.Feed(first, collector));
+        EXPECT_FALSE(decoder.IsIdle());
+        EXPECT_FALSE(decoder.Feed(second, collector));
+    }
+}
@@ -0,0 +1,103 @@
+﻿#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "tofu/net/input_aggregator.h"
+
+using namespace std::chrono_literals;
+
+namespace
+{
+    using Aggregator = tofu::net::InputAggregator<int, 16>;
+
+    struct Emitted
+    {
+        tofu::GameTick _tick;
+        Aggregator::mask_type _players;
+        std::vector<int> _inputs;
+    };
+
+    std::vector<Emitted> collect(Aggregator& aggregator, Aggregator::clock::time_point now)
+    {
+        std::vector<Emitted> emitted;
+        aggregator.Collect(now, [&](tofu::GameTick tick, Aggregator::mask_type players, std::span<const int> inputs) {
+            emitted.push_back(Emitted{ tick, players, { inputs.begin(), inputs.end() } });
+        });
+        return emitted;
+    }
+}
+
+TEST(Net_InputAggregator, 全員分揃ったら1つにまとめて出す)
+{
+    Aggregator aggregator{ 3, 10ms };
+    Aggregator::clock::time_point now{};
+
+    aggregator.Add(2, 4, 20, now);
+    aggregator.Add(0, 4, 0, now);
+    EXPECT_TRUE(collect(aggregator, now).empty());
+
+    aggregator.Add(1, 4, 10, now);
+    auto emitted = collect(aggregator, now);
+    ASSERT_EQ(1u, emitted.size());
+    EXPECT_EQ(tofu::GameTick{ 4 }, emitted[0]._tick);
+    EXPECT_EQ(0b111, emitted[0]._players);
+    EXPECT_EQ((std::vector<int>{ 0, 10, 20 }), emitted[0]._inputs);
+    EXPECT_EQ(0u, aggregator.PendingWindowCount());
+}
+
+TEST(Net_InputAggregator, 待ちきれなければ揃った分だけ出し残りは後で出す)
+{
+    Aggregator aggregator{ 3, 10ms };
+    Aggregator::clock::time_point now{};
+
+    aggregator.Add(0, 4, 0, now);
+    aggregator.Add(2, 4, 20, now);
+    EXPECT_TRUE(collect(aggregator, now + 5ms).empty());
+
+    auto emitted = collect(aggregator, now + 10ms);
+    ASSERT_EQ(1u, emitted.size());
+    EXPECT_EQ(0b101, emitted[0]._players);
+    EXPECT_EQ((std::vector<int>{ 0, 20 }), emitted[0]._inputs);
+
+    // 出した分は繰り返さない
+    EXPECT_TRUE(collect(aggregator, now + 11ms).empty());
+
+    aggregator.Add(1, 4, 10, now + 12ms);
+    emitted = collect(aggregator, now + 12ms);
+    ASSERT_EQ(1u, emitted.size());
+    EXPECT_EQ(0b010, emitted[0]._players);
+    EXPECT_EQ((std::vector<int>{ 10 }), emitted[0]._inputs);
+    EXPECT_EQ(0u, aggregator.PendingWindowCount());
+}
+
+TEST(Net_InputAggregator, 古いTickから順に出す)
+{
+    Aggregator aggregator{ 2, 10ms };
+    Aggregator::clock::time_point now{};
+
+    aggregator.Add(0, 8, 8, now);
+    aggregator.Add(0, 6, 6, now);
+    aggregator.Add(1, 8, 18, now);
+    aggregator.Add(1, 6, 16, now);
+    // 重複は無視する
+    aggregator.Add(1, 6, 99, now);
+
+    auto emitted = collect(aggregator, now);
+    ASSERT_EQ(2u, emitted.size());
+    EXPECT_EQ(tofu::GameTick{ 6 }, emitted[0]._tick);
+    EXPECT_EQ((std::vector<int>{ 6, 16 }), emitted[0]._inputs);
+    EXPECT_EQ(tofu::GameTick{ 8 }, emitted[1]._tick);
+}
+
+TEST(Net_InputAggregator, 揃わないウィンドウはいずれ捨てる)
+{
+    Aggregator aggregator{ 2, 10ms, 100ms };
+    Aggregator::clock::time_point now{};
+
+    aggregator.Add(0, 4, 0, now);
+    EXPECT_EQ(1u, collect(aggregator, now + 10ms).size());
+    EXPECT_EQ(1u, aggregator.PendingWindowCount());
+
+    EXPECT_TRUE(collect(aggregator, now + 100ms).empty());
+    EXPECT_EQ(0u, aggregator.PendingWindowCount());
+}
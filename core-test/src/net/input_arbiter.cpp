@@ -0,0 +1,83 @@
+﻿#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "tofu/net/input_arbiter.h"
+
+using namespace std::chrono_literals;
+
+namespace
+{
+    using Arbiter = tofu::net::InputArbiter<int, 4>;
+    using clock = Arbiter::clock;
+
+    struct Decision
+    {
+        std::size_t _player;
+        std::uint32_t _tick;
+        int _input;
+
+        bool operator==(const Decision&) const = default;
+    };
+
+    // 直前の入力を繰り返す. なければ0
+    std::vector<Decision> collect(Arbiter& arbiter, clock::time_point now)
+    {
+        std::vector<Decision> decisions;
+        arbiter.Collect(now,
+            [](std::size_t, tofu::GameTick, const std::optional<int>& last) { return last.value_or(0); },
+            [&](std::size_t player, tofu::GameTick tick, int input) { decisions.push_back(Decision{ player, *tick, input }); });
+        return decisions;
+    }
+}
+
+TEST(Net_InputArbiter, 締め切りまでに全員届けば何も決めない)
+{
+    clock::time_point base{};
+    Arbiter arbiter{ 3, 50ms, 2 };
+
+    EXPECT_TRUE(arbiter.Add(0, 4, 10, base));
+    EXPECT_TRUE(arbiter.Add(1, 4, 11, base + 10ms));
+    EXPECT_TRUE(arbiter.Add(2, 4, 12, base + 40ms));
+
+    EXPECT_TRUE(collect(arbiter, base + 100ms).empty());
+    EXPECT_EQ(0u, arbiter.PendingWindowCount());
+    EXPECT_EQ(0u, arbiter.GetFilledCount());
+}
+
+TEST(Net_InputArbiter, 締め切りを過ぎたら届いていない人の分を決める)
+{
+    clock::time_point base{};
+    Arbiter arbiter{ 3, 50ms, 2 };
+
+    arbiter.Add(2, 2, 7, base);
+    arbiter.Add(0, 4, 10, base);
+    arbiter.Add(1, 4, 11, base + 10ms);
+
+    // 締め切り前は待つ
+    EXPECT_TRUE(collect(arbiter, base + 49ms).empty());
+
+    auto decisions = collect(arbiter, base + 50ms);
+    ASSERT_EQ(1u, decisions.size());
+    // 直前の入力を繰り返す
+    EXPECT_EQ((Decision{ 2, 4, 7 }), decisions[0]);
+    EXPECT_EQ(1u, arbiter.GetFilledCount());
+
+    // 遅れて届いた本物は捨てる. 次のウィンドウからは使う
+    EXPECT_FALSE(arbiter.Add(2, 4, 12, base + 60ms));
+    EXPECT_TRUE(arbiter.Add(2, 6, 13, base + 60ms));
+}
+
+TEST(Net_InputArbiter, 新しいウィンドウが締め切りを過ぎたら古いウィンドウも決める)
+{
+    clock::time_point base{};
+    Arbiter arbiter{ 2, 50ms, 2 };
+
+    // Tick2のウィンドウは後から作られたが、Tick4のウィンドウが先に締め切りを過ぎた
+    arbiter.Add(0, 4, 10, base);
+    arbiter.Add(1, 2, 5, base + 30ms);
+
+    auto decisions = collect(arbiter, base + 50ms);
+    // プレイヤー0はTick4を先に受け取っているので、Tick2は決めない
+    EXPECT_EQ((std::vector<Decision>{ { 1, 4, 5 } }), decisions);
+}
@@ -0,0 +1,94 @@
+﻿#include <gtest/gtest.h>
+
+#include <array>
+#include <vector>
+
+#include "tofu/net/input_codec.h"
+
+namespace
+{
+    // 何もしない / 移動 / ダッシュ
+    using Codec = tofu::net::InputCodec<3>;
+    using Input = Codec::Input;
+
+    std::vector<std::byte> encode(const std::vector<Input>& inputs)
+    {
+        std::vector<std::byte> buffer((Codec::MaxBits(inputs.size()) + 7) / 8);
+        tofu::BitWriter writer{ buffer };
+        Codec::Encoder encoder{ writer };
+        for (auto& input : inputs)
+        {
+            EXPECT_TRUE(encoder.Add(input));
+        }
+        buffer.resize(writer.Finish());
+        return buffer;
+    }
+
+    std::vector<Input> decode(const std::vector<std::byte>& buffer, std::size_t count)
+    {
+        tofu::BitReader reader{ buffer };
+        Codec::Decoder decoder{ reader };
+        std::vector<Input> inputs;
+        for (std::size_t i = 0; i < count; i++)
+        {
+            auto input = decoder.Next();
+            if (!input)
+                break;
+            inputs.push_back(*input);
+        }
+        return inputs;
+    }
+}
+
+TEST(Net_InputCodec, エンコードしてデコードすると元に戻る)
+{
+    std::vector<Input> inputs = {
+        Input{ 0 },
+        Input{ 1, 250, 400 },
+        Input{ 1, 250, 400 },
+        Input{ 1, 260, 390 },
+        Input{ 2, -3000, 32000 },
+        Input{ 0 },
+        Input{ 0 },
+        Input{ 2, -3000, 32000 },
+        Input{ 1, -2900, 31900 },
+    };
+    auto buffer = encode(inputs);
+    EXPECT_EQ(inputs, decode(buffer, inputs.size()));
+}
+
+TEST(Net_InputCodec, 何もしない入力と同じ入力の繰り返しは1Tick2ビットになる)
+{
+    std::vector<Input> idle(16, Input{ 0 });
+    EXPECT_EQ(4u, encode(idle).size());
+
+    std::vector<Input> hold(16, Input{ 1, 250, 400 });
+    // 最初の1Tickだけ座標を書く: 2 + 1 + 32 + 2 * 15 = 65ビット
+    EXPECT_EQ(9u, encode(hold).size());
+    EXPECT_EQ(hold, decode(encode(hold), hold.size()));
+}
+
+TEST(Net_InputCodec, 座標を格子に丸める)
+{
+    EXPECT_EQ(250, Codec::Quantize(2.5f));
+    EXPECT_EQ(-1, Codec::Quantize(-0.014f));
+    EXPECT_EQ(32767, Codec::Quantize(1000.f));
+    EXPECT_FLOAT_EQ(2.5f, Codec::Dequantize(Codec::Quantize(2.5f)));
+    // 丸めた値は何度丸めても変わらない
+    auto once = Codec::Dequantize(Codec::Quantize(1.23456f));
+    EXPECT_EQ(once, Codec::Dequantize(Codec::Quantize(once)));
+}
+
+TEST(Net_InputCodec, 壊れたデータは読めない)
+{
+    std::vector<Input> inputs = { Input{ 1, 250, 400 } };
+    auto buffer = encode(inputs);
+    buffer.resize(buffer.size() - 2);
+    EXPECT_TRUE(decode(buffer, 1).empty());
+
+    // 種類が4つなら3ビットのタグのうち5以上は使わない
+    std::vector<std::byte> broken = { std::byte{ 0xff } };
+    tofu::BitReader reader{ broken };
+    tofu::net::InputCodec<4>::Decoder decoder{ reader };
+    EXPECT_FALSE(decoder.Next());
+}
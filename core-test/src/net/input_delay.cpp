@@ -0,0 +1,77 @@
+﻿#include <gtest/gtest.h>
+
+#include "tofu/net/input_delay.h"
+
+using namespace std::chrono_literals;
+
+namespace
+{
+    using Controller = tofu::net::InputDelayController;
+
+    Controller::Config make_config()
+    {
+        return Controller::Config{
+            ._tickPeriod = 16'666us,
+            ._minDelay = 1,
+            ._maxDelay = 6,
+            ._extraDelay = 1,
+            ._jitterFactor = 4,
+            ._decreaseHold = 2s,
+        };
+    }
+}
+
+TEST(Net_InputDelayController, 遅延からTick数を求める)
+{
+    Controller controller{ make_config(), 4 };
+
+    // LANなら最小値
+    EXPECT_EQ(1u, controller.GetRequiredDelay(0us, 0us));
+    // 1Tickちょうどは1Tick, 少しでも超えたら切り上げる
+    EXPECT_EQ(2u, controller.GetRequiredDelay(16'666us, 0us));
+    EXPECT_EQ(3u, controller.GetRequiredDelay(16'667us, 0us));
+    // ジッタは4倍で見込む
+    EXPECT_EQ(3u, controller.GetRequiredDelay(10'000us, 5'000us));
+    // 最大値で頭打ち
+    EXPECT_EQ(6u, controller.GetRequiredDelay(1s, 0us));
+}
+
+TEST(Net_InputDelayController, 増やすのはすぐ減らすのはゆっくり)
+{
+    Controller controller{ make_config(), 2 };
+    Controller::clock::time_point now{};
+
+    EXPECT_EQ(std::optional<std::uint32_t>{ 5 }, controller.Update(60'000us, 0us, now));
+    EXPECT_EQ(5u, controller.GetDelay());
+
+    // 必要な遅延が1になっても、2秒続くまでは縮めない
+    EXPECT_EQ(std::nullopt, controller.Update(0us, 0us, now));
+    EXPECT_EQ(std::nullopt, controller.Update(0us, 0us, now + 1s));
+    EXPECT_EQ(std::optional<std::uint32_t>{ 4 }, controller.Update(0us, 0us, now + 2s));
+    // 1Tickずつ
+    EXPECT_EQ(std::nullopt, controller.Update(0us, 0us, now + 3s));
+    EXPECT_EQ(std::optional<std::uint32_t>{ 3 }, controller.Update(0us, 0us, now + 4s));
+
+    // 途中で必要な遅延に戻ったら、待ち時間はリセットされる
+    EXPECT_EQ(std::nullopt, controller.Update(0us, 0us, now + 5s));
+    EXPECT_EQ(std::nullopt, controller.Update(30'000us, 0us, now + 5500ms));
+    EXPECT_EQ(std::nullopt, controller.Update(0us, 0us, now + 6s));
+    EXPECT_EQ(std::nullopt, controller.Update(0us, 0us, now + 7s));
+    EXPECT_EQ(std::optional<std::uint32_t>{ 2 }, controller.Update(0us, 0us, now + 8s));
+}
+
+TEST(Net_InputDelaySchedule, 予約したTickから切り替わる)
+{
+    tofu::net::InputDelaySchedule schedule{ 4 };
+    schedule.Schedule(10, 2);
+    schedule.Schedule(20, 5);
+    EXPECT_TRUE(schedule.HasPendingChange());
+
+    EXPECT_EQ(4u, schedule.GetDelay(0));
+    EXPECT_EQ(4u, schedule.GetDelay(9));
+    EXPECT_EQ(2u, schedule.GetDelay(10));
+    EXPECT_EQ(2u, schedule.GetDelay(19));
+    // 飛ばして呼んでも途中の変更をまとめて適用する
+    EXPECT_EQ(5u, schedule.GetDelay(30));
+    EXPECT_FALSE(schedule.HasPendingChange());
+}
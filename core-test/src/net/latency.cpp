@@ -0,0 +1,53 @@
+﻿#include <gtest/gtest.h>
+
+#include "tofu/net/latency.h"
+
+using namespace std::chrono_literals;
+
+namespace
+{
+    constexpr std::chrono::microseconds TickPeriod = 16'666us;
+}
+
+TEST(Net_LatencyEstimator, RTTは平滑化される)
+{
+    tofu::net::LatencyEstimator estimator{ TickPeriod };
+    EXPECT_FALSE(estimator.HasRtt());
+
+    estimator.AddRttSample(40'000us);
+    EXPECT_TRUE(estimator.HasRtt());
+    EXPECT_EQ(40'000us, estimator.GetRtt());
+
+    // 1回の外れ値では1/8しか動かない
+    estimator.AddRttSample(120'000us);
+    EXPECT_EQ(50'000us, estimator.GetRtt());
+
+    for (int i = 0; i < 100; i++)
+        estimator.AddRttSample(120'000us);
+    EXPECT_NEAR(120'000, estimator.GetRtt().count(), 100);
+}
+
+TEST(Net_LatencyEstimator, 等間隔に届けばジッタは0)
+{
+    tofu::net::LatencyEstimator estimator{ TickPeriod };
+    tofu::net::LatencyEstimator::clock::time_point base{};
+    for (std::uint32_t tick = 0; tick < 100; tick += 2)
+    {
+        estimator.AddArrival(tick, base + 30ms + TickPeriod * tick);
+    }
+    EXPECT_EQ(0us, estimator.GetJitter());
+}
+
+TEST(Net_LatencyEstimator, 到着時刻が揺れるとジッタが増える)
+{
+    tofu::net::LatencyEstimator estimator{ TickPeriod };
+    tofu::net::LatencyEstimator::clock::time_point base{};
+    for (std::uint32_t tick = 0; tick < 200; tick += 2)
+    {
+        // 転送時間が 30ms と 40ms を交互に繰り返す
+        auto transit = (tick / 2) % 2 ? 40ms : 30ms;
+        estimator.AddArrival(tick, base + transit + TickPeriod * tick);
+    }
+    // 差は毎回10msなので、ジッタは10msに近づく
+    EXPECT_NEAR(10'000, estimator.GetJitter().count(), 100);
+}
@@ -0,0 +1,88 @@
+﻿#include <gtest/gtest.h>
+
+#include <array>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "tofu/net/message_dispatch.h"
+
+namespace
+{
+    struct Ping
+    {
+        static constexpr std::uint8_t message_type = 0x01;
+        std::uint32_t _seq = 0;
+
+        using wire_schema = tofu::net::WireSchema<tofu::net::wire::Var<&Ping::_seq>>;
+    };
+
+    struct Chat
+    {
+        static constexpr std::uint8_t message_type = 0x42;
+        char _text[16]{};
+
+        using wire_schema = tofu::net::WireSchema<tofu::net::wire::String<&Chat::_text>>;
+    };
+
+    using Dispatcher = tofu::net::MessageDispatcher<Ping, Chat>;
+
+    template<class T>
+    std::vector<std::byte> encode(const T& message)
+    {
+        std::vector<std::byte> buffer(T::wire_schema::MaxSize);
+        buffer.resize(tofu::net::wire_encode(message, buffer));
+        return buffer;
+    }
+}
+
+TEST(Net_MessageDispatch, 種類ごとのハンドラに渡す)
+{
+    std::vector<std::uint32_t> pings;
+    std::vector<std::string> chats;
+    auto handlers = tofu::net::MessageHandlers{
+        [&](const Ping& message) { pings.push_back(message._seq); },
+        [&](const Chat& message) { chats.emplace_back(message._text); },
+    };
+
+    Ping ping;
+    ping._seq = 300;
+    Chat chat;
+    std::strcpy(chat._text, "hello");
+
+    EXPECT_EQ(Dispatcher::Dispatch(Ping::message_type, encode(ping), handlers), tofu::net::DispatchResult::Dispatched);
+    EXPECT_EQ(Dispatcher::Dispatch(Chat::message_type, encode(chat), handlers), tofu::net::DispatchResult::Dispatched);
+    EXPECT_EQ(pings, (std::vector<std::uint32_t>{ 300 }));
+    EXPECT_EQ(chats, (std::vector<std::string>{ "hello" }));
+}
+
+TEST(Net_MessageDispatch, 表に無い種類と壊れた中身は渡さない)
+{
+    int called = 0;
+    auto handlers = tofu::net::MessageHandlers{
+        [&](const Ping&) { called++; },
+        [&](const Chat&) { called++; },
+    };
+
+    EXPECT_FALSE(Dispatcher::Contains(0x02));
+    EXPECT_TRUE(Dispatcher::Contains(Chat::message_type));
+    EXPECT_EQ(Dispatcher::Dispatch(0x02, encode(Ping{}), handlers), tofu::net::DispatchResult::UnknownType);
+
+    // 可変長整数の続きが無い
+    std::array<std::byte, 1> broken{ std::byte{ 0x80 } };
+    EXPECT_EQ(Dispatcher::Dispatch(Ping::message_type, broken, handlers), tofu::net::DispatchResult::Broken);
+    EXPECT_EQ(called, 0);
+}
+
+TEST(Net_MessageDispatch, ハンドラがfalseを返したら断ったことになる)
+{
+    auto handlers = tofu::net::MessageHandlers{
+        [](const Ping& message) { return message._seq != 0; },
+        [](const Chat&) {},
+    };
+
+    Ping ping;
+    EXPECT_EQ(Dispatcher::Dispatch(Ping::message_type, encode(ping), handlers), tofu::net::DispatchResult::Rejected);
+    ping._seq = 1;
+    EXPECT_EQ(Dispatcher::Dispatch(Ping::message_type, encode(ping), handlers), tofu::net::DispatchResult::Dispatched);
+}
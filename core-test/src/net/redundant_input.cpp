@@ -0,0 +1,121 @@
+﻿#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "tofu/net/redundant_input.h"
+
+using namespace std::chrono_literals;
+
+TEST(Net_RedundantInput, 損失率を推定する)
+{
+    tofu::net::LossEstimator estimator;
+    for (std::uint32_t seq = 0; seq < 100; seq++)
+    {
+        estimator.OnReceive(seq);
+    }
+    EXPECT_FLOAT_EQ(0.0f, estimator.GetLossRate());
+
+    // 2つに1つ落ちる
+    for (std::uint32_t seq = 100; seq < 400; seq += 2)
+    {
+        estimator.OnReceive(seq);
+    }
+    EXPECT_NEAR(0.5f, estimator.GetLossRate(), 0.05f);
+
+    // 追い越されて届いたものは数えない
+    auto before = estimator.GetLossRate();
+    estimator.OnReceive(101);
+    EXPECT_FLOAT_EQ(before, estimator.GetLossRate());
+}
+
+TEST(Net_RedundantInput, 損失率から冗長度を選ぶ)
+{
+    EXPECT_EQ(2u, tofu::net::choose_redundancy(0.0f, 2, 8));
+    EXPECT_EQ(2u, tofu::net::choose_redundancy(0.01f, 2, 8));
+    EXPECT_EQ(3u, tofu::net::choose_redundancy(0.05f, 2, 8));
+    EXPECT_EQ(6u, tofu::net::choose_redundancy(0.3f, 2, 8));
+    EXPECT_EQ(8u, tofu::net::choose_redundancy(0.9f, 2, 8));
+    EXPECT_EQ(8u, tofu::net::choose_redundancy(1.0f, 2, 8));
+}
+
+TEST(Net_RedundantInput, ACKされていない入力のうち新しいものを送る)
+{
+    tofu::net::RedundantInputSender<int, 8> sender{ 2 };
+    tofu::net::RedundantInputSender<int, 8>::clock::time_point now{};
+
+    sender.Push(4, 40, now);
+    sender.Push(6, 60, now);
+    sender.Push(8, 80, now);
+
+    std::array<int, 2> out;
+    auto [tick, count] = sender.CopyLatest(out);
+    EXPECT_EQ(tofu::GameTick{ 6 }, tick);
+    EXPECT_EQ(2u, count);
+    EXPECT_EQ(60, out[0]);
+    EXPECT_EQ(80, out[1]);
+
+    // 6, 7 Tickまで受け取った
+    sender.Ack(8);
+    EXPECT_EQ(1u, sender.UnackedCount());
+    std::tie(tick, count) = sender.CopyLatest(out);
+    EXPECT_EQ(tofu::GameTick{ 8 }, tick);
+    EXPECT_EQ(1u, count);
+
+    sender.Ack(10);
+    std::tie(tick, count) = sender.CopyLatest(out);
+    EXPECT_EQ(0u, count);
+}
+
+TEST(Net_RedundantInput, 届かない入力はフォールバックに回す)
+{
+    tofu::net::RedundantInputSender<int, 4> sender{ 2 };
+    tofu::net::RedundantInputSender<int, 4>::clock::time_point now{};
+
+    sender.Push(4, 40, now);
+    sender.Push(6, 60, now + 50ms);
+
+    std::vector<tofu::GameTick> fallback;
+    auto collect = [&](tofu::GameTick tick, int) { fallback.push_back(tick); };
+
+    sender.CollectFallback(now + 99ms, 100ms, collect);
+    EXPECT_TRUE(fallback.empty());
+
+    sender.CollectFallback(now + 100ms, 100ms, collect);
+    EXPECT_EQ((std::vector<tofu::GameTick>{ 4 }), fallback);
+    EXPECT_EQ(1u, sender.UnackedCount());
+
+    // 溜めきれない分も回す
+    sender.Push(8, 80, now + 100ms);
+    sender.Push(10, 100, now + 100ms);
+    sender.Push(12, 120, now + 100ms);
+    sender.CollectFallback(now + 100ms, 100ms, collect);
+    EXPECT_EQ((std::vector<tofu::GameTick>{ 4, 6 }), fallback);
+    EXPECT_EQ(3u, sender.UnackedCount());
+}
+
+TEST(Net_RedundantInput, 受信側は連続して揃った分だけ渡す)
+{
+    tofu::net::RedundantInputReceiver<int, 8> receiver{ 4, 2 };
+
+    std::vector<int> released;
+    auto release = [&](tofu::GameTick, int input) { released.push_back(input); };
+
+    // 4が落ちて、6と8が先に届いた
+    EXPECT_TRUE(receiver.Accept(6, 60));
+    EXPECT_TRUE(receiver.Accept(8, 80));
+    receiver.Release(release);
+    EXPECT_TRUE(released.empty());
+    EXPECT_EQ(tofu::GameTick{ 4 }, receiver.GetNextTick());
+
+    // 冗長に再送された分は重複として捨てる
+    EXPECT_TRUE(receiver.Accept(4, 40));
+    EXPECT_FALSE(receiver.Accept(6, 60));
+    receiver.Release(release);
+    EXPECT_EQ((std::vector<int>{ 40, 60, 80 }), released);
+    EXPECT_EQ(tofu::GameTick{ 10 }, receiver.GetNextTick());
+
+    // 渡し終えた分と、置き場所がないほど先のものは受け取らない
+    EXPECT_FALSE(receiver.Accept(8, 80));
+    EXPECT_FALSE(receiver.Accept(10 + 2 * 8, 0));
+    EXPECT_TRUE(receiver.Accept(10 + 2 * 7, 0));
+}
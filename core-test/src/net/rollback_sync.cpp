@@ -0,0 +1,208 @@
+﻿#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "tofu/net/rollback_sync.h"
+
+namespace
+{
+    constexpr std::size_t PlayerNum = 2;
+    constexpr std::uint32_t BufferSize = 16;
+    constexpr std::uint32_t MaxRollback = 6;
+
+    using System = tofu::net::RollbackSyncSystem<int, std::uint32_t, BufferSize>;
+
+    // 入力を足し込むだけのワールド. 状態は整数ひとつ
+    struct World
+    {
+        void Simulate(const std::vector<std::optional<int>>& inputs)
+        {
+            for (auto& input : inputs)
+            {
+                // 順序に依存する計算にして、どのTickの入力を使ったかが結果に残るようにする
+                _state = _state * 31 + *input;
+            }
+        }
+
+        // スナップショットを取ってからTopの入力で1Tick進める
+        void Tick(System& system)
+        {
+            system.CurrentSnapshot() = _state;
+            Simulate(system.Top());
+            system.Step();
+        }
+
+        void Rollback(System& system)
+        {
+            system.Rollback(
+                [this](const std::uint32_t& snapshot) { _state = snapshot; },
+                [this](std::uint32_t& snapshot) { snapshot = _state; },
+                [this, &system]() { Simulate(system.Top()); });
+        }
+
+        std::uint32_t _state = 0;
+    };
+}
+
+TEST(Net_RollbackSync, 入力が届いていなくても予測して進める)
+{
+    System system{ PlayerNum, 0, MaxRollback };
+    EXPECT_TRUE(system.CanStep());
+
+    system.SetData(0, tofu::GameTick{ 0 }, 5);
+    auto& top = system.Top();
+    EXPECT_EQ(5, top[0]);
+    // 届いていない入力は直前の値(最初はデフォルト値)で埋められる
+    EXPECT_EQ(0, top[1]);
+    system.Step();
+
+    // 次のTickも、直前に使った入力を繰り返す
+    EXPECT_EQ(5, system.Top()[0]);
+    EXPECT_FALSE(system.NeedsRollback());
+}
+
+TEST(Net_RollbackSync, 巻き戻せないほど入力が遅れたら止まる)
+{
+    System system{ PlayerNum, 0, MaxRollback };
+    World world;
+    for (std::uint32_t i = 0; i < MaxRollback; i++)
+    {
+        EXPECT_TRUE(system.CanStep());
+        system.SetData(0, tofu::GameTick{ 0 }, 1);
+        world.Tick(system);
+    }
+    // player 1 の入力が MaxRollback Tick 分届いていない
+    EXPECT_FALSE(system.CanStep());
+    EXPECT_EQ(0b10u, system.GetWaitingPlayers());
+
+    // 最古のTickの入力が届けば進める
+    auto oldest = static_cast<std::uint32_t>(-static_cast<std::int32_t>(MaxRollback));
+    system.SetData(1, tofu::GameTick{ oldest }, 0);
+    EXPECT_TRUE(system.CanStep());
+}
+
+TEST(Net_RollbackSync, 予測が外れたら巻き戻して再計算する)
+{
+    // player 1 の入力が3Tick遅れて届く
+    constexpr int TickNum = 40;
+    constexpr std::uint32_t Lag = 3;
+    auto input_of = [](int player, int tick) { return (tick / 5 + player * 7) % 4; };
+
+    // 全ての入力が揃っている場合の正解
+    World expected;
+    for (int tick = 0; tick < TickNum; tick++)
+    {
+        expected.Simulate({ input_of(0, tick), input_of(1, tick) });
+    }
+
+    System system{ PlayerNum, 0, MaxRollback };
+    World world;
+    int rollback_count = 0;
+    for (int tick = 0; tick < TickNum + static_cast<int>(Lag); tick++)
+    {
+        if (tick < TickNum)
+            system.SetData(0, tofu::GameTick{ 0 }, input_of(0, tick));
+        if (Lag <= static_cast<std::uint32_t>(tick))
+            system.SetData(1, tofu::GameTick{ static_cast<std::uint32_t>(-static_cast<std::int32_t>(Lag)) }, input_of(1, tick - Lag));
+
+        if (system.NeedsRollback())
+            rollback_count++;
+        world.Rollback(system);
+
+        if (tick < TickNum)
+        {
+            ASSERT_TRUE(system.CanStep());
+            world.Tick(system);
+        }
+    }
+
+    EXPECT_LT(0, rollback_count);
+    EXPECT_EQ(expected._state, world._state);
+}
+
+TEST(Net_RollbackSync, 予測が当たっていれば巻き戻さない)
+{
+    System system{ PlayerNum, 0, MaxRollback };
+    World world;
+    for (int tick = 0; tick < 3; tick++)
+    {
+        system.SetData(0, tofu::GameTick{ 0 }, 2);
+        world.Tick(system);
+    }
+    // player 1 は入力なし(=0)と予測されていた
+    system.SetData(1, tofu::GameTick{ static_cast<std::uint32_t>(-2) }, 0);
+    EXPECT_FALSE(system.NeedsRollback());
+
+    system.SetData(1, tofu::GameTick{ static_cast<std::uint32_t>(-1) }, 1);
+    EXPECT_TRUE(system.NeedsRollback());
+}
+
+TEST(Net_RollbackSync, 予測関数を差し替えられる)
+{
+    // 前の入力によらず常に0と予測する
+    System system{ PlayerNum, 0, MaxRollback, [](const int&) { return 0; } };
+    World world;
+
+    system.SetData(0, tofu::GameTick{ 0 }, 3);
+    system.SetData(1, tofu::GameTick{ 0 }, 3);
+    world.Tick(system);
+
+    EXPECT_EQ(0, system.Top()[0]);
+    EXPECT_EQ(0, system.Top()[1]);
+}
+
+TEST(Net_RollbackSync, 初期遅延分の入力は確定している)
+{
+    System system{ PlayerNum, 2, MaxRollback };
+    EXPECT_TRUE(system.HasData(tofu::GameTick{ 0 }, 0));
+    EXPECT_TRUE(system.HasData(tofu::GameTick{ 1 }, 1));
+    EXPECT_FALSE(system.HasData(tofu::GameTick{ 2 }, 0));
+}
+
+TEST(Net_RollbackSync, 巻き戻せなくなったTickの入力を取り出せる)
+{
+    System system{ PlayerNum, 0, MaxRollback };
+    World world;
+    for (std::uint32_t i = 0; i < MaxRollback; i++)
+    {
+        EXPECT_EQ(nullptr, system.Finalized());
+        system.SetData(0, tofu::GameTick{ 0 }, static_cast<int>(i) + 1);
+        system.SetData(1, tofu::GameTick{ 0 }, -static_cast<int>(i) - 1);
+        world.Tick(system);
+    }
+
+    for (std::uint32_t i = 0; i < MaxRollback; i++)
+    {
+        ASSERT_TRUE(system.CanStep());
+        auto finalized = system.Finalized();
+        ASSERT_NE(nullptr, finalized);
+        EXPECT_EQ(static_cast<int>(i) + 1, (*finalized)[0]);
+        EXPECT_EQ(-static_cast<int>(i) - 1, (*finalized)[1]);
+
+        system.SetData(0, tofu::GameTick{ 0 }, 0);
+        system.SetData(1, tofu::GameTick{ 0 }, 0);
+        world.Tick(system);
+    }
+}
+
+TEST(Net_RollbackSync, Tick0まで巻き戻しても届いていない入力は既定値で埋める)
+{
+    // 予測した値が分かるよう、直前の入力に100を足す
+    System system{ PlayerNum, 0, MaxRollback, [](const int& last) { return last + 100; } };
+    World world;
+    system.SetData(0, tofu::GameTick{ 0 }, 3);
+    EXPECT_EQ(0, system.Top()[1]);
+    world.Tick(system);
+    EXPECT_EQ(100, system.Top()[1]);
+    world.Tick(system);
+
+    // player 0 のTick 0の入力が変わり、Tick 0から再シミュレーションする. player 1 のTick 0は届いていないまま
+    system.SetData(0, tofu::GameTick{ static_cast<std::uint32_t>(-2) }, 4);
+    ASSERT_TRUE(system.NeedsRollback());
+    world.Rollback(system);
+
+    World expected;
+    expected.Simulate({ 4, 0 });
+    expected.Simulate({ 4 + 100, 100 });
+    EXPECT_EQ(expected._state, world._state);
+}
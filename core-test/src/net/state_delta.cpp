@@ -0,0 +1,117 @@
+﻿#include <gtest/gtest.h>
+
+#include <array>
+#include <vector>
+
+#include "tofu/net/state_delta.h"
+
+namespace
+{
+    constexpr std::size_t FieldCount = 3;
+    constexpr std::size_t MaxEntities = 8;
+
+    using Codec = tofu::net::StateDeltaCodec<FieldCount, MaxEntities>;
+    using Frame = Codec::Frame;
+
+    Frame make_frame(std::uint32_t tick, std::uint32_t count, std::int32_t seed)
+    {
+        Frame frame;
+        frame._tick = tick;
+        frame._count = count;
+        for (std::uint32_t e = 0; e < count; e++)
+        {
+            frame._entities[e] = { seed + static_cast<std::int32_t>(e) * 1000, -seed * 7, static_cast<std::int32_t>(e) };
+        }
+        return frame;
+    }
+
+    // 全エンティティを1つのバッファに書いて読み戻す
+    Frame round_trip(const Frame* base, const Frame& frame, std::size_t* size = nullptr)
+    {
+        std::array<std::byte, (Codec::MaxEntityBits * MaxEntities + 7) / 8> buffer;
+        auto result = Codec::Encode(base, frame, 0, buffer);
+        EXPECT_EQ(frame._count, result._count);
+        if (size)
+            *size = result._size;
+
+        Frame decoded;
+        decoded._count = frame._count;
+        decoded._tick = frame._tick;
+        EXPECT_TRUE(Codec::Decode(base, std::span{ buffer }.first(result._size), 0, result._count, decoded));
+        return decoded;
+    }
+}
+
+TEST(Net_StateDelta, 基準なしでも読み戻せる)
+{
+    auto frame = make_frame(10, 5, 12345);
+    auto decoded = round_trip(nullptr, frame);
+    EXPECT_EQ(frame._entities, decoded._entities);
+}
+
+TEST(Net_StateDelta, 変わっていないエンティティは1ビットで済む)
+{
+    auto base = make_frame(10, MaxEntities, 12345);
+    auto frame = base;
+    frame._tick = 11;
+
+    std::size_t size = 0;
+    auto decoded = round_trip(&base, frame, &size);
+    EXPECT_EQ(frame._entities, decoded._entities);
+    EXPECT_EQ((MaxEntities + 7) / 8, size);
+
+    // 1つのフィールドだけ少し動いた
+    frame._entities[3][1] += 5;
+    std::size_t moved_size = 0;
+    decoded = round_trip(&base, frame, &moved_size);
+    EXPECT_EQ(frame._entities, decoded._entities);
+    EXPECT_LT(moved_size, 5u);
+
+    std::size_t full_size = 0;
+    round_trip(nullptr, frame, &full_size);
+    EXPECT_LT(moved_size, full_size);
+}
+
+TEST(Net_StateDelta, 収まらない分は範囲を区切って書ける)
+{
+    auto frame = make_frame(10, MaxEntities, -400000);
+
+    // 1エンティティは必ず入る大きさ
+    std::array<std::byte, (Codec::MaxEntityBits + 7) / 8> buffer;
+    Frame decoded;
+    decoded._count = frame._count;
+
+    std::size_t first = 0;
+    std::size_t chunks = 0;
+    while (first < frame._count)
+    {
+        auto result = Codec::Encode(nullptr, frame, first, buffer);
+        ASSERT_LT(0u, result._count);
+        EXPECT_TRUE(Codec::Decode(nullptr, std::span{ buffer }.first(result._size), first, result._count, decoded));
+        first += result._count;
+        chunks++;
+    }
+    EXPECT_LT(1u, chunks);
+    EXPECT_EQ(frame._entities, decoded._entities);
+}
+
+TEST(Net_StateDelta, 壊れたデータは読めない)
+{
+    auto frame = make_frame(10, 4, 999);
+    std::array<std::byte, (Codec::MaxEntityBits * MaxEntities + 7) / 8> buffer;
+    auto result = Codec::Encode(nullptr, frame, 0, buffer);
+
+    Frame decoded;
+    decoded._count = frame._count;
+    EXPECT_FALSE(Codec::Decode(nullptr, std::span{ buffer }.first(result._size / 2), 0, result._count, decoded));
+    // 範囲がエンティティ数を越えている
+    EXPECT_FALSE(Codec::Decode(nullptr, std::span{ buffer }.first(result._size), 2, result._count, decoded));
+}
+
+TEST(Net_StateDelta, 丸めは範囲に収める)
+{
+    EXPECT_EQ(1234, Codec::Quantize(1.2344f, 1000.f));
+    EXPECT_EQ(-1234, Codec::Quantize(-1.2336f, 1000.f));
+    EXPECT_EQ(Codec::MaxValue, Codec::Quantize(1e30f, 1000.f));
+    EXPECT_FLOAT_EQ(1.234f, Codec::Dequantize(1234, 1000.f));
+}
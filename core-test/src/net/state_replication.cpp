@@ -0,0 +1,157 @@
+﻿#include <gtest/gtest.h>
+
+#include <array>
+
+#include "tofu/net/state_replication.h"
+
+namespace
+{
+    constexpr std::size_t FieldCount = 2;
+    constexpr std::size_t MaxEntities = 4;
+    constexpr std::uint32_t HistorySize = 8;
+
+    using Codec = tofu::net::StateDeltaCodec<FieldCount, MaxEntities>;
+    using Frame = Codec::Frame;
+    using Baselines = tofu::net::StateBaselines<Frame, HistorySize, 2>;
+    using Receiver = tofu::net::StateReceiver<Frame, HistorySize>;
+
+    Frame make_frame(std::uint32_t tick, std::int32_t x)
+    {
+        Frame frame;
+        frame._tick = tick;
+        frame._count = 2;
+        frame._entities[0] = { x, 0 };
+        frame._entities[1] = { -x, 100 };
+        return frame;
+    }
+
+    // 送り手と同じように、基準からの差分を全エンティティ分まとめて届ける
+    bool deliver(Receiver& receiver, const Frame* base, const Frame& frame)
+    {
+        std::array<std::byte, (Codec::MaxEntityBits * MaxEntities + 7) / 8> buffer;
+        auto result = Codec::Encode(base, frame, 0, buffer);
+        std::optional<tofu::GameTick> base_tick;
+        if (base)
+            base_tick = base->_tick;
+        return receiver.Receive(frame._tick, base_tick, frame._count, 0, result._count, std::span{ buffer }.first(result._size));
+    }
+}
+
+TEST(Net_StateReplication, ACKされたフレームを差分の基準にする)
+{
+    Baselines baselines;
+    for (std::uint32_t t = 1; t <= 4; t++)
+        baselines.Push(make_frame(t, static_cast<std::int32_t>(t)));
+
+    EXPECT_EQ(nullptr, baselines.GetBaseline(0));
+
+    baselines.Ack(0, tofu::GameTick{ 3 });
+    // 順番が入れ替わって届いた古いACKは無視する
+    baselines.Ack(0, tofu::GameTick{ 2 });
+    ASSERT_NE(nullptr, baselines.GetBaseline(0));
+    EXPECT_EQ(tofu::GameTick{ 3 }, baselines.GetBaseline(0)->_tick);
+    EXPECT_EQ(nullptr, baselines.GetBaseline(1));
+
+    // ACKされたフレームが履歴から消えたら、全体を送り直す
+    for (std::uint32_t t = 5; t <= 3 + HistorySize; t++)
+        baselines.Push(make_frame(t, static_cast<std::int32_t>(t)));
+    EXPECT_EQ(nullptr, baselines.GetBaseline(0));
+}
+
+TEST(Net_StateReplication, 相手が入れ替わったら全体を送り直す)
+{
+    Baselines baselines;
+    baselines.Push(make_frame(1, 1));
+    baselines.Push(make_frame(2, 2));
+    baselines.Ack(1, tofu::GameTick{ 2 });
+    ASSERT_NE(nullptr, baselines.GetBaseline(1));
+
+    baselines.Reset(1);
+    EXPECT_EQ(std::nullopt, baselines.GetAckedTick(1));
+    EXPECT_EQ(nullptr, baselines.GetBaseline(1));
+
+    // 新しい相手のACKは、前の相手のACKより古くても使う
+    baselines.Ack(1, tofu::GameTick{ 1 });
+    ASSERT_NE(nullptr, baselines.GetBaseline(1));
+    EXPECT_EQ(tofu::GameTick{ 1 }, baselines.GetBaseline(1)->_tick);
+}
+
+TEST(Net_StateReplication, 区切って届いたフレームを組み立てる)
+{
+    Receiver receiver;
+    auto frame = make_frame(5, 42);
+
+    std::array<std::byte, (Codec::MaxEntityBits + 7) / 8> buffer;
+    auto result = Codec::Encode(nullptr, frame, 1, std::span{ buffer });
+    ASSERT_EQ(1u, result._count);
+    EXPECT_TRUE(receiver.Receive(frame._tick, std::nullopt, frame._count, 1, 1, std::span{ buffer }.first(result._size)));
+    // まだ半分しか届いていない
+    EXPECT_FALSE(receiver.GetLatestTick());
+    EXPECT_EQ(nullptr, receiver.Find(frame._tick));
+
+    result = Codec::Encode(nullptr, frame, 0, std::span{ buffer });
+    EXPECT_TRUE(receiver.Receive(frame._tick, std::nullopt, frame._count, 0, 1, std::span{ buffer }.first(result._size)));
+    EXPECT_EQ(frame._tick, receiver.GetLatestTick());
+    ASSERT_NE(nullptr, receiver.Find(frame._tick));
+    EXPECT_EQ(frame._entities, receiver.Find(frame._tick)->_entities);
+}
+
+TEST(Net_StateReplication, 基準が手元になければ捨てる)
+{
+    Receiver receiver;
+    auto base = make_frame(1, 10);
+    auto frame = make_frame(2, 20);
+
+    EXPECT_FALSE(deliver(receiver, &base, frame));
+    EXPECT_FALSE(receiver.GetLatestTick());
+
+    EXPECT_TRUE(deliver(receiver, nullptr, base));
+    EXPECT_TRUE(deliver(receiver, &base, frame));
+    EXPECT_EQ(tofu::GameTick{ 2 }, receiver.GetLatestTick());
+    EXPECT_EQ(frame._entities, receiver.Find(tofu::GameTick{ 2 })->_entities);
+
+    // 揃ったフレームより古いものは使わない
+    EXPECT_FALSE(deliver(receiver, nullptr, base));
+}
+
+TEST(Net_StateReplication, 基準を追い出してしまう差分は捨てる)
+{
+    Receiver receiver;
+    auto base = make_frame(1, 10);
+    auto frame = make_frame(1 + HistorySize, 20);
+
+    EXPECT_TRUE(deliver(receiver, nullptr, base));
+    EXPECT_FALSE(deliver(receiver, &base, frame));
+    EXPECT_EQ(tofu::GameTick{ 1 }, receiver.GetLatestTick());
+    ASSERT_NE(nullptr, receiver.Find(tofu::GameTick{ 1 }));
+    EXPECT_EQ(base._entities, receiver.Find(tofu::GameTick{ 1 })->_entities);
+
+    // 全体を送り直されれば読める
+    EXPECT_TRUE(deliver(receiver, nullptr, frame));
+    EXPECT_EQ(tofu::GameTick{ 1 + HistorySize }, receiver.GetLatestTick());
+    EXPECT_EQ(frame._entities, receiver.Find(tofu::GameTick{ 1 + HistorySize })->_entities);
+}
+
+TEST(Net_StateReplication, 前後のフレームを補間する)
+{
+    Receiver receiver;
+    auto a = make_frame(10, 100);
+    auto b = make_frame(12, 200);
+    EXPECT_TRUE(deliver(receiver, nullptr, a));
+    EXPECT_TRUE(deliver(receiver, &a, b));
+
+    Frame out;
+    ASSERT_TRUE(receiver.Sample(11.0, out));
+    EXPECT_EQ(150, out._entities[0][0]);
+    EXPECT_EQ(-150, out._entities[1][0]);
+    EXPECT_EQ(100, out._entities[1][1]);
+
+    ASSERT_TRUE(receiver.Sample(10.5, out));
+    EXPECT_EQ(125, out._entities[0][0]);
+
+    // 最新より先は最新のまま、最古より前は最古のまま
+    ASSERT_TRUE(receiver.Sample(20.0, out));
+    EXPECT_EQ(200, out._entities[0][0]);
+    ASSERT_TRUE(receiver.Sample(3.0, out));
+    EXPECT_EQ(100, out._entities[0][0]);
+}
@@ -0,0 +1,220 @@
+﻿#include <gtest/gtest.h>
+
+#include <array>
+#include <cstring>
+#include <vector>
+
+#include "tofu/net/wire.h"
+#include "tofu/utils/strong_numeric.h"
+
+namespace
+{
+    using Tick = tofu::StrongNumeric<class Tag_Tick, std::uint32_t>;
+    using Player = tofu::StrongNumeric<class Tag_Player, std::int8_t>;
+
+    enum class Kind : std::uint8_t
+    {
+        A,
+        B,
+        C,
+    };
+
+    struct Payload
+    {
+        std::array<std::byte, 16> _data{};
+        std::uint8_t _size = 0;
+
+        using wire_schema = tofu::net::WireSchema<tofu::net::wire::Bytes<&Payload::_data, &Payload::_size>>;
+    };
+
+    struct Message
+    {
+        Player _player = 0;
+        Kind _kind = Kind::A;
+        bool _flag = false;
+        std::uint8_t _mode = 0;
+        Tick _tick = 0;
+        std::int32_t _delta = 0;
+        std::uint64_t _time = 0;
+        char _name[12]{};
+        std::uint8_t _count = 0;
+        std::array<std::uint32_t, 4> _hashes{};
+        Payload _payload;
+
+        using wire_schema = tofu::net::WireSchema<
+            tofu::net::wire::Fixed<&Message::_player>,
+            tofu::net::wire::Fixed<&Message::_kind>,
+            tofu::net::wire::Bits<&Message::_flag, 1>,
+            tofu::net::wire::Bits<&Message::_mode, 3>,
+            tofu::net::wire::Var<&Message::_tick>,
+            tofu::net::wire::Var<&Message::_delta>,
+            tofu::net::wire::Fixed<&Message::_time>,
+            tofu::net::wire::String<&Message::_name>,
+            tofu::net::wire::Fixed<&Message::_count>,
+            tofu::net::wire::Array<&Message::_hashes, &Message::_count>,
+            tofu::net::wire::Nested<&Message::_payload>>;
+    };
+
+    Message make_message()
+    {
+        Message message;
+        message._player = -1;
+        message._kind = Kind::C;
+        message._flag = true;
+        message._mode = 5;
+        message._tick = 300;
+        message._delta = -70;
+        message._time = 0x0102030405060708;
+        std::strcpy(message._name, "tofu");
+        message._count = 2;
+        message._hashes = { 0xdeadbeef, 0x12345678, 0, 0 };
+        message._payload._size = 3;
+        message._payload._data[0] = std::byte{ 1 };
+        message._payload._data[1] = std::byte{ 2 };
+        message._payload._data[2] = std::byte{ 3 };
+        return message;
+    }
+
+    std::vector<std::byte> encode(const Message& message)
+    {
+        std::vector<std::byte> buffer(Message::wire_schema::MaxSize);
+        auto size = tofu::net::wire_encode(message, buffer);
+        buffer.resize(size);
+        return buffer;
+    }
+}
+
+TEST(Net_Wire, 可変長整数は7ビットずつ書き符号付きはzigzagで書く)
+{
+    std::array<std::byte, 64> buffer;
+    tofu::net::WireWriter writer{ buffer };
+    writer.WriteVarUint(0);
+    writer.WriteVarUint(127);
+    writer.WriteVarUint(128);
+    writer.WriteVarUint(~std::uint64_t{ 0 });
+    writer.WriteVarInt(-1);
+    writer.WriteVarInt(1);
+    writer.WriteVarInt(INT64_MIN);
+    auto size = writer.Finish();
+    EXPECT_EQ(size, 1 + 1 + 2 + 10 + 1 + 1 + 10);
+    EXPECT_EQ(buffer[2], std::byte{ 0x80 });
+    EXPECT_EQ(buffer[3], std::byte{ 0x01 });
+    // -1 -> 1, 1 -> 2
+    EXPECT_EQ(buffer[14], std::byte{ 1 });
+    EXPECT_EQ(buffer[15], std::byte{ 2 });
+
+    tofu::net::WireReader reader{ std::span{ buffer }.first(size) };
+    EXPECT_EQ(reader.ReadVarUint(), 0u);
+    EXPECT_EQ(reader.ReadVarUint(), 127u);
+    EXPECT_EQ(reader.ReadVarUint(), 128u);
+    EXPECT_EQ(reader.ReadVarUint(), ~std::uint64_t{ 0 });
+    EXPECT_EQ(reader.ReadVarInt(), -1);
+    EXPECT_EQ(reader.ReadVarInt(), 1);
+    EXPECT_EQ(reader.ReadVarInt(), INT64_MIN);
+    EXPECT_EQ(reader.Remaining(), 0);
+    EXPECT_FALSE(reader.ReadVarUint());
+}
+
+TEST(Net_Wire, 固定長はリトルエンディアンでビットは1バイトに詰める)
+{
+    std::array<std::byte, 16> buffer;
+    tofu::net::WireWriter writer{ buffer };
+    writer.WriteBits(1, 1);
+    writer.WriteBits(0b101, 3);
+    writer.WriteFixed(std::uint32_t{ 0x11223344 });
+    writer.WriteBits(0x3ff, 10);
+    ASSERT_EQ(writer.Finish(), 1 + 4 + 2);
+    EXPECT_EQ(buffer[0], std::byte{ 0b1011 });
+    EXPECT_EQ(buffer[1], std::byte{ 0x44 });
+    EXPECT_EQ(buffer[4], std::byte{ 0x11 });
+
+    tofu::net::WireReader reader{ std::span{ buffer }.first(7) };
+    EXPECT_EQ(reader.ReadBits(1), 1u);
+    EXPECT_EQ(reader.ReadBits(3), 0b101u);
+    EXPECT_EQ(reader.ReadFixed<std::uint32_t>(), 0x11223344u);
+    EXPECT_EQ(reader.ReadBits(10), 0x3ffu);
+    EXPECT_EQ(reader.Remaining(), 0);
+}
+
+TEST(Net_Wire, 記述した通りに書いて読み戻せる)
+{
+    auto message = make_message();
+    auto bytes = encode(message);
+    // player 1 + kind 1 + bits 1 + tick 2 + delta 2 + time 8 + name 1+4 + count 1 + hashes 8 + payload 1+3
+    EXPECT_EQ(bytes.size(), 33);
+    EXPECT_LT(bytes.size(), sizeof(Message));
+
+    Message decoded;
+    ASSERT_TRUE(tofu::net::wire_decode(std::span<const std::byte>{ bytes }, decoded));
+    EXPECT_EQ(decoded._player, message._player);
+    EXPECT_EQ(decoded._kind, Kind::C);
+    EXPECT_TRUE(decoded._flag);
+    EXPECT_EQ(decoded._mode, 5);
+    EXPECT_EQ(decoded._tick, message._tick);
+    EXPECT_EQ(decoded._delta, -70);
+    EXPECT_EQ(decoded._time, message._time);
+    EXPECT_STREQ(decoded._name, "tofu");
+    EXPECT_EQ(decoded._count, 2);
+    EXPECT_EQ(decoded._hashes[0], 0xdeadbeef);
+    EXPECT_EQ(decoded._hashes[1], 0x12345678);
+    EXPECT_EQ(decoded._payload._size, 3);
+    EXPECT_EQ(decoded._payload._data[2], std::byte{ 3 });
+}
+
+TEST(Net_Wire, 読むときは受け取ったバッファを指す)
+{
+    std::array<std::byte, 8> buffer;
+    tofu::net::WireWriter writer{ buffer };
+    writer.WriteVarUint(3);
+    writer.WriteBytes(std::as_bytes(std::span{ "abc", 3 }));
+    auto size = writer.Finish();
+
+    tofu::net::WireReader reader{ std::span<const std::byte>{ buffer }.first(size) };
+    auto length = reader.ReadVarUint();
+    ASSERT_TRUE(length);
+    auto bytes = reader.ReadBytes(*length);
+    ASSERT_TRUE(bytes);
+    EXPECT_EQ(bytes->data(), buffer.data() + 1);
+    EXPECT_FALSE(reader.ReadBytes(1));
+}
+
+TEST(Net_Wire, 足りない余る壊れたバイト列は読めない)
+{
+    auto bytes = encode(make_message());
+    Message decoded;
+    for (std::size_t size = 0; size < bytes.size(); size++)
+    {
+        EXPECT_FALSE(tofu::net::wire_decode(std::span<const std::byte>{ bytes }.first(size), decoded)) << size;
+    }
+
+    auto longer = bytes;
+    longer.push_back(std::byte{ 0 });
+    EXPECT_FALSE(tofu::net::wire_decode(std::span<const std::byte>{ longer }, decoded));
+
+    // 配列の大きさを超える数
+    auto broken = bytes;
+    broken[20] = std::byte{ 5 };
+    EXPECT_FALSE(tofu::net::wire_decode(std::span<const std::byte>{ broken }, decoded));
+
+    // boolに1より大きな値
+    std::array<std::byte, 1> flag{ std::byte{ 2 } };
+    struct Flag
+    {
+        bool _value = false;
+        using wire_schema = tofu::net::WireSchema<tofu::net::wire::Fixed<&Flag::_value>>;
+    } value;
+    EXPECT_FALSE(tofu::net::wire_decode(std::span<const std::byte>{ flag }, value));
+}
+
+TEST(Net_Wire, 収まらなければ書いた大きさは0)
+{
+    auto message = make_message();
+    std::array<std::byte, 10> buffer;
+    EXPECT_EQ(tofu::net::wire_encode(message, buffer), 0);
+
+    std::array<std::byte, Message::wire_schema::MaxSize> enough;
+    std::memset(message._name, 'x', sizeof(message._name));
+    message._count = 4;
+    message._payload._size = 16;
+    EXPECT_NE(tofu::net::wire_encode(message, enough), 0);
+}
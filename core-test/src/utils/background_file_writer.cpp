@@ -0,0 +1,92 @@
+﻿#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+#include "tofu/utils/background_file_writer.h"
+
+namespace
+{
+    std::vector<char> read_all(const std::filesystem::path& path)
+    {
+        std::ifstream file{ path, std::ios::binary };
+        return { std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} };
+    }
+}
+
+TEST(Util_BackgroundFileWriter, 積んだ順に書き出される)
+{
+    auto path = std::filesystem::temp_directory_path() / "tofu_test_background_file_writer.bin";
+    {
+        tofu::BackgroundFileWriter writer;
+        ASSERT_FALSE(writer.Open(path.string()));
+        EXPECT_TRUE(writer.IsOpen());
+        for (std::uint32_t i = 0; i < 1000; i++)
+        {
+            writer.WriteValue(i);
+        }
+        writer.Flush();
+        // Flushが戻った時点でファイルに書かれている
+        EXPECT_EQ(sizeof(std::uint32_t) * 1000, std::filesystem::file_size(path));
+
+        writer.WriteValue(std::uint8_t{ 0xAB });
+        // 残りは閉じるときに書き出される
+    }
+
+    auto bytes = read_all(path);
+    ASSERT_EQ(sizeof(std::uint32_t) * 1000 + 1, bytes.size());
+    for (std::uint32_t i = 0; i < 1000; i++)
+    {
+        std::uint32_t value;
+        std::memcpy(&value, bytes.data() + i * sizeof(value), sizeof(value));
+        EXPECT_EQ(i, value);
+    }
+    EXPECT_EQ(static_cast<char>(0xAB), bytes.back());
+    std::filesystem::remove(path);
+}
+
+TEST(Util_BackgroundFileWriter, 複数スレッドから積める)
+{
+    constexpr std::size_t ThreadNum = 4;
+    constexpr std::size_t CountPerThread = 10000;
+
+    auto path = std::filesystem::temp_directory_path() / "tofu_test_background_file_writer_mt.bin";
+    {
+        tofu::BackgroundFileWriter writer;
+        ASSERT_FALSE(writer.Open(path.string()));
+        std::vector<std::thread> threads;
+        for (std::size_t t = 0; t < ThreadNum; t++)
+        {
+            threads.emplace_back([&writer, t]() {
+                for (std::size_t i = 0; i < CountPerThread; i++)
+                    writer.WriteValue(static_cast<std::uint8_t>(t));
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+    std::array<std::size_t, ThreadNum> counts{};
+    for (auto c : read_all(path))
+    {
+        ASSERT_LT(static_cast<std::size_t>(c), ThreadNum);
+        counts[static_cast<std::size_t>(c)]++;
+    }
+    for (auto count : counts)
+        EXPECT_EQ(CountPerThread, count);
+    std::filesystem::remove(path);
+}
+
+TEST(Util_BackgroundFileWriter, 開けなければエラー)
+{
+    tofu::BackgroundFileWriter writer;
+    auto path = std::filesystem::temp_directory_path() / "tofu_test_no_such_dir" / "file.bin";
+    EXPECT_TRUE(writer.Open(path.string()));
+    EXPECT_FALSE(writer.IsOpen());
+}
@@ -0,0 +1,38 @@
+﻿#include <gtest/gtest.h>
+
+#include <array>
+
+#include "tofu/utils/bit_stream.h"
+
+TEST(Util_BitStream, 書いたビット数ずつ読み戻せる)
+{
+    std::array<std::byte, 16> buffer{};
+    tofu::BitWriter writer{ buffer };
+    EXPECT_TRUE(writer.Write(0b101, 3));
+    EXPECT_TRUE(writer.Write(0, 1));
+    EXPECT_TRUE(writer.Write(0xabcd, 16));
+    EXPECT_TRUE(writer.Write(0xffffffff, 32));
+    EXPECT_TRUE(writer.Write(1, 1));
+    // 3 + 1 + 16 + 32 + 1 = 53ビットは7バイト
+    EXPECT_EQ(7u, writer.Finish());
+
+    tofu::BitReader reader{ std::span{ buffer }.first(7) };
+    EXPECT_EQ(0b101u, reader.Read(3));
+    EXPECT_EQ(0u, reader.Read(1));
+    EXPECT_EQ(0xabcdu, reader.Read(16));
+    EXPECT_EQ(0xffffffffu, reader.Read(32));
+    EXPECT_EQ(1u, reader.Read(1));
+    // 端数の詰め物は読めるが、その先は読めない
+    EXPECT_EQ(0u, reader.Read(3));
+    EXPECT_FALSE(reader.Read(1));
+}
+
+TEST(Util_BitStream, バッファに収まらなければ書かない)
+{
+    std::array<std::byte, 2> buffer{};
+    tofu::BitWriter writer{ buffer };
+    EXPECT_TRUE(writer.Write(0x3ff, 10));
+    EXPECT_FALSE(writer.Write(0x7f, 7));
+    EXPECT_TRUE(writer.Write(0x3f, 6));
+    EXPECT_EQ(2u, writer.Finish());
+}
@@ -1,5 +1,8 @@
 ﻿#include <gtest/gtest.h>
 
+#include <algorithm>
+#include <array>
+
 #include "tofu/utils/circular_queue_allocator.h"
 
 namespace
@@ -41,3 +44,39 @@ TEST(Util_CircularBufferAllocator, 通常動作)
     auto f = allocate<int>(allocator);
     EXPECT_TRUE(f);
 }
+
+TEST(Util_CircularContinuousBuffer, 折り返したデータを読める)
+{
+    tofu::CircularContinuousBuffer buffer{ 8 };
+    std::array<std::byte, 8> data;
+    for (std::size_t i = 0; i < data.size(); i++)
+        data[i] = static_cast<std::byte>(i);
+
+    buffer.Write(data.data(), 6);
+    buffer.Seek(6);
+    // 終わりの2byteと先頭の3byteに分かれる
+    buffer.Write(data.data(), 5);
+    EXPECT_EQ(buffer.Size(), 5);
+
+    auto contiguous = buffer.PeekContiguous(2);
+    ASSERT_EQ(contiguous.size(), 2);
+    EXPECT_EQ(contiguous[1], std::byte{ 1 });
+    EXPECT_TRUE(buffer.PeekContiguous(3).empty());
+
+    std::array<std::byte, 5> peeked{};
+    buffer.Peek(peeked.data(), peeked.size());
+    EXPECT_TRUE(std::equal(peeked.begin(), peeked.end(), data.begin()));
+
+    // 終わりまで読むと、続きは先頭から1続きで見える
+    buffer.Seek(2);
+    contiguous = buffer.PeekContiguous(3);
+    ASSERT_EQ(contiguous.size(), 3);
+    EXPECT_EQ(contiguous[0], std::byte{ 2 });
+
+    buffer.Seek(1);
+    std::array<std::byte, 2> read{};
+    buffer.Read(read.data(), read.size());
+    EXPECT_EQ(read[0], std::byte{ 3 });
+    EXPECT_EQ(read[1], std::byte{ 4 });
+    EXPECT_EQ(buffer.Size(), 0);
+}
@@ -0,0 +1,54 @@
+﻿#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+
+#include "tofu/utils/mapped_file.h"
+
+TEST(Util_MappedFile, ファイルの中身を読める)
+{
+    auto path = std::filesystem::temp_directory_path() / "tofu_test_mapped_file.bin";
+    {
+        std::ofstream file{ path, std::ios::binary };
+        for (std::uint32_t i = 0; i < 256; i++)
+            file.put(static_cast<char>(i));
+    }
+
+    tofu::MappedFile mapped;
+    ASSERT_FALSE(mapped.Open(path.string()));
+    EXPECT_TRUE(mapped.IsOpen());
+    auto bytes = mapped.Bytes();
+    ASSERT_EQ(256u, bytes.size());
+    for (std::uint32_t i = 0; i < 256; i++)
+        EXPECT_EQ(static_cast<std::byte>(i), bytes[i]);
+
+    // ムーブしても同じ領域を指す
+    tofu::MappedFile moved = std::move(mapped);
+    EXPECT_FALSE(mapped.IsOpen());
+    EXPECT_EQ(bytes.data(), moved.Bytes().data());
+
+    moved.Close();
+    EXPECT_TRUE(moved.Bytes().empty());
+    std::filesystem::remove(path);
+}
+
+TEST(Util_MappedFile, 空のファイルは空として開ける)
+{
+    auto path = std::filesystem::temp_directory_path() / "tofu_test_mapped_file_empty.bin";
+    std::ofstream{ path, std::ios::binary };
+
+    tofu::MappedFile mapped;
+    ASSERT_FALSE(mapped.Open(path.string()));
+    EXPECT_TRUE(mapped.IsOpen());
+    EXPECT_TRUE(mapped.Bytes().empty());
+    std::filesystem::remove(path);
+}
+
+TEST(Util_MappedFile, 無いファイルはエラー)
+{
+    tofu::MappedFile mapped;
+    auto path = std::filesystem::temp_directory_path() / "tofu_test_no_such_file.bin";
+    EXPECT_TRUE(mapped.Open(path.string()));
+    EXPECT_FALSE(mapped.IsOpen());
+}
@@ -36,6 +36,30 @@ TEST(Util_Scheduled_Update_Thread, Startするまで実行されない)
     scheduler.End(true);
 }
 
+TEST(Util_Scheduled_Update_Thread, 開始時刻を指定するとその時刻から実行される)
+{
+    std::atomic<int> counter = 0;
+    std::atomic<std::int64_t> first_run = 0;
+
+    tofu::ScheduledUpdateThread scheduler{std::chrono::milliseconds{10}, [&](auto&){
+        if (counter++ == 0)
+            first_run = std::chrono::system_clock::now().time_since_epoch().count();
+    }};
+    auto start_time = std::chrono::system_clock::now() + std::chrono::milliseconds{50};
+    scheduler.Start(start_time);
+    std::this_thread::sleep_for(std::chrono::milliseconds{30});
+
+    EXPECT_EQ(0, counter);
+
+    while(counter < 3)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+    scheduler.End(true);
+
+    EXPECT_LE(start_time.time_since_epoch().count(), first_run);
+}
+
 TEST(Util_Scheduled_Update_Thread, 実行せずに破棄できる)
 {
     tofu::ScheduledUpdateThread scheduler{std::chrono::milliseconds{10}, [&](auto&){}};
@@ -0,0 +1,94 @@
+﻿#include <gtest/gtest.h>
+
+#include <array>
+
+#include "tofu/utils/snapshot_buffer.h"
+
+namespace
+{
+    struct Pod
+    {
+        std::int32_t _a;
+        float _b;
+    };
+}
+
+TEST(Util_SnapshotBuffer, 書き込んだ順に読み出せる)
+{
+    tofu::SnapshotBuffer buffer;
+    buffer.Write(std::uint32_t{ 42 });
+    buffer.Write(Pod{ -1, 2.5f });
+    std::array<std::uint16_t, 3> values{ 1, 2, 3 };
+    buffer.WriteSpan(std::span<const std::uint16_t>{ values });
+
+    EXPECT_EQ(sizeof(std::uint32_t) + sizeof(Pod) + sizeof(values), buffer.Size());
+
+    tofu::SnapshotReader reader{ buffer };
+    std::uint32_t u;
+    Pod pod;
+    std::array<std::uint16_t, 3> read_values{};
+    EXPECT_TRUE(reader.Read(u));
+    EXPECT_TRUE(reader.Read(pod));
+    EXPECT_TRUE(reader.ReadSpan(std::span<std::uint16_t>{ read_values }));
+    EXPECT_TRUE(reader.IsEnd());
+
+    EXPECT_EQ(42u, u);
+    EXPECT_EQ(-1, pod._a);
+    EXPECT_EQ(2.5f, pod._b);
+    EXPECT_EQ(values, read_values);
+}
+
+TEST(Util_SnapshotBuffer, 足りない分は読み出さない)
+{
+    tofu::SnapshotBuffer buffer;
+    buffer.Write(std::uint16_t{ 7 });
+
+    tofu::SnapshotReader reader{ buffer };
+    std::uint32_t u = 123;
+    EXPECT_FALSE(reader.Read(u));
+    EXPECT_EQ(123u, u);
+    EXPECT_EQ(sizeof(std::uint16_t), reader.Remaining());
+
+    std::uint16_t s;
+    EXPECT_TRUE(reader.Read(s));
+    EXPECT_EQ(7u, s);
+    EXPECT_FALSE(reader.Read(s));
+}
+
+TEST(Util_SnapshotBuffer, Clearしても領域を再利用する)
+{
+    tofu::SnapshotBuffer buffer;
+    for (int i = 0; i < 100; i++)
+        buffer.Write(i);
+    auto capacity = buffer.Capacity();
+    auto data = buffer.Data();
+    EXPECT_LE(100 * sizeof(int), capacity);
+
+    buffer.Clear();
+    EXPECT_EQ(0u, buffer.Size());
+    for (int i = 0; i < 100; i++)
+        buffer.Write(i);
+    EXPECT_EQ(capacity, buffer.Capacity());
+    EXPECT_EQ(data, buffer.Data());
+}
+
+TEST(Util_SnapshotBuffer, 中身で比較できる)
+{
+    tofu::SnapshotBuffer a;
+    tofu::SnapshotBuffer b{ 256 };
+    EXPECT_EQ(a, b);
+
+    a.Write(1);
+    EXPECT_NE(a, b);
+    b.Write(1);
+    EXPECT_EQ(a, b);
+    b.Write(2);
+    EXPECT_NE(a, b);
+
+    auto c = b;
+    EXPECT_EQ(b, c);
+    EXPECT_NE(b.Data(), c.Data());
+
+    auto d = std::move(c);
+    EXPECT_EQ(b, d);
+}
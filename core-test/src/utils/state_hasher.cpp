@@ -0,0 +1,41 @@
+﻿#include <gtest/gtest.h>
+
+#include <array>
+#include <cmath>
+
+#include "tofu/utils/state_hasher.h"
+
+TEST(Util_StateHasher, 同じ値の列からは同じハッシュになる)
+{
+    auto hash = [](float x, float y, std::uint32_t tick) {
+        tofu::StateHasher hasher;
+        hasher.Add(tick);
+        hasher.Add(x);
+        hasher.Add(y);
+        return hasher.Get();
+    };
+
+    EXPECT_EQ(hash(1.0f, 2.0f, 3), hash(1.0f, 2.0f, 3));
+    EXPECT_NE(hash(1.0f, 2.0f, 3), hash(2.0f, 1.0f, 3));
+    EXPECT_NE(hash(1.0f, 2.0f, 3), hash(1.0f, 2.0f, 4));
+    // 1ビットでも違えば別のハッシュ
+    EXPECT_NE(hash(1.0f, 2.0f, 3), hash(std::nextafter(1.0f, 2.0f), 2.0f, 3));
+}
+
+TEST(Util_StateHasher, 加えた個数も区別する)
+{
+    tofu::StateHasher a;
+    a.Add(0.0f);
+
+    tofu::StateHasher b;
+    b.Add(0.0f);
+    b.Add(0.0f);
+
+    EXPECT_NE(a.Get(), b.Get());
+    EXPECT_NE(tofu::StateHasher{}.Get(), a.Get());
+
+    std::array<float, 2> values{ 0.0f, 0.0f };
+    tofu::StateHasher c;
+    c.AddSpan(std::span<const float>{ values });
+    EXPECT_EQ(b.Get(), c.Get());
+}
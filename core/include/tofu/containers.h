@@ -14,6 +14,9 @@
 #include <cmath>
 
 #include "containers/stack_vector.h"
+#include "containers/small_vector.h"
 #include "containers/triple_buffer.h"
 #include "containers/ring_buffer.h"
+#include "containers/concurrent_queue.h"
+#include "containers/flat_hash_map.h"
 
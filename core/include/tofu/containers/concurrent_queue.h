@@ -0,0 +1,381 @@
+﻿#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <concepts>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include <tofu/utils/cache_line.h>
+
+namespace tofu {
+    // スレッド間でメッセージを受け渡すための固定長キュー
+    //  SpscQueue : 書き込み者・読み込み者がそれぞれ1スレッドずつ
+    //  MpscQueue : 書き込み者は複数スレッド、読み込み者は1スレッド
+    //  どちらもロックを使わず、満杯・空のときは待たずに失敗を返す
+    //  OverflowQueue : 上のどちらかが満杯のときだけ、ロックを取る可変長のリストに溢れさせる. 書き込み側は待たずに必ず入れられる
+
+    // 書き込み者・読み込み者が1スレッドずつのキュー
+    //  Capacityは2の冪であること
+    template<class T, std::size_t Capacity>
+    class SpscQueue
+    {
+        static_assert(0 < Capacity && std::has_single_bit(Capacity), "Capacity must be a power of two.");
+        static constexpr std::size_t Mask = Capacity - 1;
+    public:
+        using value_type = T;
+        using size_type = std::size_t;
+
+        SpscQueue() noexcept = default;
+        ~SpscQueue()
+        {
+            auto head = _head.load(std::memory_order_relaxed);
+            auto tail = _tail.load(std::memory_order_relaxed);
+            for (; head != tail; head++)
+            {
+                std::destroy_at(slot(head));
+            }
+        }
+
+        // コピー・ムーブ禁止
+        SpscQueue(const SpscQueue&) = delete;
+        SpscQueue(SpscQueue&&) = delete;
+        SpscQueue& operator=(const SpscQueue&) = delete;
+        SpscQueue& operator=(SpscQueue&&) = delete;
+
+        static constexpr size_type capacity() noexcept
+        {
+            return Capacity;
+        }
+
+        // 書き込みスレッドから呼ぶ. 満杯ならfalse
+        template<class... Args>
+        bool try_emplace(Args&&... args)
+        {
+            auto tail = _tail.load(std::memory_order_relaxed);
+            if (tail - _cachedHead == Capacity)
+            {
+                _cachedHead = _head.load(std::memory_order_acquire);
+                if (tail - _cachedHead == Capacity)
+                    return false;
+            }
+            std::construct_at(slot(tail), std::forward<Args>(args)...);
+            _tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+        bool try_push(const T& value)
+        {
+            return try_emplace(value);
+        }
+        bool try_push(T&& value)
+        {
+            return try_emplace(std::move(value));
+        }
+
+        // 読み込みスレッドから呼ぶ. 空ならnullopt
+        std::optional<T> try_pop()
+        {
+            std::optional<T> ret;
+            pop_n(1, [&ret](T&& value) { ret.emplace(std::move(value)); });
+            return ret;
+        }
+
+        // 読み込みスレッドから呼ぶ. 最大n個を取り出して順にoutへ書き込み、取り出した個数を返す
+        template<std::output_iterator<T> OutputIt>
+        size_type pop_n(size_type n, OutputIt out)
+        {
+            return pop_n(n, [&out](T&& value) { *out++ = std::move(value); });
+        }
+        // 読み込みスレッドから呼ぶ. 最大n個を取り出して順にfuncを呼び、取り出した個数を返す
+        template<std::invocable<T&&> Func>
+        size_type pop_n(size_type n, Func&& func)
+        {
+            auto head = _head.load(std::memory_order_relaxed);
+            if (_cachedTail - head < n)
+            {
+                _cachedTail = _tail.load(std::memory_order_acquire);
+            }
+            auto count = std::min<size_type>(n, _cachedTail - head);
+            for (size_type i = 0; i < count; i++)
+            {
+                auto p = slot(head + i);
+                func(std::move(*p));
+                std::destroy_at(p);
+            }
+            // まとめて1回だけ公開する
+            _head.store(head + count, std::memory_order_release);
+            return count;
+        }
+
+        // 他スレッドが操作中の場合は概算値になる
+        size_type size_approx() const noexcept
+        {
+            auto tail = _tail.load(std::memory_order_acquire);
+            auto head = _head.load(std::memory_order_acquire);
+            return tail - head;
+        }
+        bool empty_approx() const noexcept
+        {
+            return size_approx() == 0;
+        }
+
+    private:
+        T* slot(size_type index) noexcept
+        {
+            return std::launder(reinterpret_cast<T*>(_buffer + sizeof(T) * (index & Mask)));
+        }
+
+        alignas(T) std::byte _buffer[sizeof(T) * Capacity];
+
+        // 読み込みスレッドが書き込み、書き込みスレッドが読む
+        alignas(CacheLineSize) std::atomic<size_type> _head = 0;
+        // 読み込みスレッドだけが触る
+        size_type _cachedTail = 0;
+
+        // 書き込みスレッドが書き込み、読み込みスレッドが読む
+        alignas(CacheLineSize) std::atomic<size_type> _tail = 0;
+        // 書き込みスレッドだけが触る
+        size_type _cachedHead = 0;
+    };
+
+    // 書き込み者が複数スレッド、読み込み者が1スレッドのキュー
+    //  各スロットに通し番号を持たせ、書き込み者はCASで書き込み位置を確保する (D. Vyukovのbounded queue)
+    //  Capacityは2の冪であること
+    template<class T, std::size_t Capacity>
+    class MpscQueue
+    {
+        static_assert(0 < Capacity && std::has_single_bit(Capacity), "Capacity must be a power of two.");
+        static constexpr std::size_t Mask = Capacity - 1;
+
+        struct Cell
+        {
+            std::atomic<std::size_t> _sequence;
+            alignas(T) std::byte _storage[sizeof(T)];
+
+            T* data() noexcept
+            {
+                return std::launder(reinterpret_cast<T*>(_storage));
+            }
+        };
+    public:
+        using value_type = T;
+        using size_type = std::size_t;
+
+        MpscQueue() noexcept
+        {
+            for (size_type i = 0; i < Capacity; i++)
+            {
+                _cells[i]._sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+        ~MpscQueue()
+        {
+            while (pop_n(Capacity, [](T&&) {}) != 0);
+        }
+
+        // コピー・ムーブ禁止
+        MpscQueue(const MpscQueue&) = delete;
+        MpscQueue(MpscQueue&&) = delete;
+        MpscQueue& operator=(const MpscQueue&) = delete;
+        MpscQueue& operator=(MpscQueue&&) = delete;
+
+        static constexpr size_type capacity() noexcept
+        {
+            return Capacity;
+        }
+
+        // 任意のスレッドから呼べる. 満杯ならfalse
+        template<class... Args>
+        bool try_emplace(Args&&... args)
+        {
+            auto tail = _tail.load(std::memory_order_relaxed);
+            Cell* cell;
+            while (true)
+            {
+                cell = &_cells[tail & Mask];
+                auto sequence = cell->_sequence.load(std::memory_order_acquire);
+                auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(tail);
+                if (diff == 0)
+                {
+                    // このスロットは空いている. 書き込み位置を確保できたら書き込む
+                    if (_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                {
+                    // 読み込み者がまだ1周前のデータを読んでいない
+                    return false;
+                }
+                else
+                {
+                    // 他の書き込み者に先を越された
+                    tail = _tail.load(std::memory_order_relaxed);
+                }
+            }
+
+            std::construct_at(cell->data(), std::forward<Args>(args)...);
+            cell->_sequence.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+        bool try_push(const T& value)
+        {
+            return try_emplace(value);
+        }
+        bool try_push(T&& value)
+        {
+            return try_emplace(std::move(value));
+        }
+
+        // 読み込みスレッドから呼ぶ. 空ならnullopt
+        std::optional<T> try_pop()
+        {
+            std::optional<T> ret;
+            pop_n(1, [&ret](T&& value) { ret.emplace(std::move(value)); });
+            return ret;
+        }
+
+        // 読み込みスレッドから呼ぶ. 最大n個を取り出して順にoutへ書き込み、取り出した個数を返す
+        template<std::output_iterator<T> OutputIt>
+        size_type pop_n(size_type n, OutputIt out)
+        {
+            return pop_n(n, [&out](T&& value) { *out++ = std::move(value); });
+        }
+        // 読み込みスレッドから呼ぶ. 最大n個を取り出して順にfuncを呼び、取り出した個数を返す
+        //  書き込み途中のスロットに当たったらそこで止まる
+        template<std::invocable<T&&> Func>
+        size_type pop_n(size_type n, Func&& func)
+        {
+            auto head = _head.load(std::memory_order_relaxed);
+            size_type count = 0;
+            for (; count < n; count++, head++)
+            {
+                auto& cell = _cells[head & Mask];
+                if (cell._sequence.load(std::memory_order_acquire) != head + 1)
+                    break;
+
+                auto p = cell.data();
+                func(std::move(*p));
+                std::destroy_at(p);
+                // 1周後の書き込み者のためにスロットを空ける
+                cell._sequence.store(head + Capacity, std::memory_order_release);
+            }
+            _head.store(head, std::memory_order_relaxed);
+            return count;
+        }
+
+        // 他スレッドが操作中の場合は概算値になる
+        size_type size_approx() const noexcept
+        {
+            auto tail = _tail.load(std::memory_order_relaxed);
+            auto head = _head.load(std::memory_order_relaxed);
+            return tail < head ? 0 : tail - head;
+        }
+        bool empty_approx() const noexcept
+        {
+            return size_approx() == 0;
+        }
+
+    private:
+        std::array<Cell, Capacity> _cells;
+
+        // 書き込み者たちが奪い合う
+        alignas(CacheLineSize) std::atomic<size_type> _tail = 0;
+        // 読み込みスレッドだけが書き込む
+        alignas(CacheLineSize) std::atomic<size_type> _head = 0;
+    };
+
+    // 落とせないメッセージを受け渡すキュー. TQueue (SpscQueue / MpscQueue) が満杯なら、ロックを取ってリストに溢れさせる
+    //  読み込み側が詰まっても、書き込み側は待たない. 溢れている間に書いたものもリストに積むので、書き込み者ごとの順番は保つ
+    //  溢れなければロックもメモリ確保もしない
+    template<class TQueue>
+    class OverflowQueue
+    {
+    public:
+        using value_type = typename TQueue::value_type;
+        using size_type = std::size_t;
+
+        OverflowQueue() = default;
+
+        // コピー・ムーブ禁止
+        OverflowQueue(const OverflowQueue&) = delete;
+        OverflowQueue(OverflowQueue&&) = delete;
+        OverflowQueue& operator=(const OverflowQueue&) = delete;
+        OverflowQueue& operator=(OverflowQueue&&) = delete;
+
+        // TQueueが書き込みを許すスレッドから呼ぶ (OverflowQueue自体は複数スレッドから書き込んでもよい)
+        void push(const value_type& value)
+        {
+            // 溢れている間はリストの後ろに積まないと、先に溢れたものを追い越す
+            if (_overflowSize.load(std::memory_order_acquire) == 0 && _queue.try_push(value))
+                return;
+
+            std::lock_guard lock{ _overflowMutex };
+            _overflow.push_back(value);
+            _overflowSize.store(_overflow.size(), std::memory_order_release);
+            _overflowCount.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // 読み込みスレッドから呼ぶ. 空ならnullopt
+        std::optional<value_type> try_pop()
+        {
+            std::optional<value_type> ret;
+            pop_n(1, [&ret](value_type&& value) { ret.emplace(std::move(value)); });
+            return ret;
+        }
+
+        // 読み込みスレッドから呼ぶ. 最大n個を取り出して順にfuncを呼び、取り出した個数を返す
+        //  リストに溢れたものは、TQueueに先に入ったものを全て取り出してから取り出す
+        template<std::invocable<value_type&&> Func>
+        size_type pop_n(size_type n, Func&& func)
+        {
+            auto count = _queue.pop_n(n, func);
+            if (count == n || _overflowSize.load(std::memory_order_acquire) == 0)
+                return count;
+
+            std::lock_guard lock{ _overflowMutex };
+            for (; count < n && !_overflow.empty(); count++)
+            {
+                func(std::move(_overflow.front()));
+                _overflow.pop_front();
+            }
+            _overflowSize.store(_overflow.size(), std::memory_order_release);
+            return count;
+        }
+
+        // 他スレッドが操作中の場合は概算値になる
+        size_type size_approx() const noexcept
+        {
+            return _queue.size_approx() + _overflowSize.load(std::memory_order_acquire);
+        }
+        bool empty_approx() const noexcept
+        {
+            return size_approx() == 0;
+        }
+
+        // TQueueに入りきらずにリストに溢れさせた数の累計. 読み込み側が追いついていないかの診断に使う
+        std::size_t overflow_count() const noexcept
+        {
+            return _overflowCount.load(std::memory_order_relaxed);
+        }
+
+    private:
+        TQueue _queue;
+
+        std::mutex _overflowMutex;
+        std::deque<value_type> _overflow;
+        // _overflowの要素数. ロックを取らずに溢れているかを見るために持つ
+        std::atomic<size_type> _overflowSize = 0;
+        std::atomic<std::size_t> _overflowCount = 0;
+    };
+}
@@ -0,0 +1,544 @@
+﻿#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace tofu {
+    // オープンアドレス法(Robin Hood hashing)のハッシュマップ
+    //  キーと値はノードを作らず連続した配列上に直接置かれる
+    //  削除は後ろの要素を詰める(backward shift)のでtombstoneを持たない
+    //  NOTE: 挿入・削除で要素が移動するので、変更操作をするとイテレータ・参照は無効になる
+    //  NOTE: value_typeは std::pair<Key, T> (キーはconstではない)。キーを書き換えないこと
+    template<class Key, class T, class Hash = std::hash<Key>, class KeyEqual = std::equal_to<Key>>
+    class flat_hash_map
+    {
+        // 0なら空、それ以外は本来の位置からの距離+1
+        //  偏ったハッシュで同じ位置に衝突が集中しても溢れないよう16bit持つ
+        using distance_type = std::uint16_t;
+        static constexpr distance_type Empty = 0;
+        static constexpr distance_type MaxDistance = 0xffff;
+
+        static constexpr std::size_t MinCapacity = 8;
+        static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+    public:
+        using key_type = Key;
+        using mapped_type = T;
+        using value_type = std::pair<Key, T>;
+        using size_type = std::size_t;
+        using difference_type = std::ptrdiff_t;
+        using hasher = Hash;
+        using key_equal = KeyEqual;
+        using reference = value_type&;
+        using const_reference = const value_type&;
+
+        template<bool IsConst>
+        class Iterator
+        {
+            friend class flat_hash_map;
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = flat_hash_map::value_type;
+            using difference_type = std::ptrdiff_t;
+            using pointer = std::conditional_t<IsConst, const value_type*, value_type*>;
+            using reference = std::conditional_t<IsConst, const value_type&, value_type&>;
+
+            Iterator() noexcept = default;
+            // iterator -> const_iterator の変換
+            template<bool OtherConst>
+                requires (IsConst && !OtherConst)
+            Iterator(const Iterator<OtherConst>& other) noexcept
+                : _distance(other._distance)
+                , _slot(other._slot)
+            {
+            }
+
+            reference operator*() const noexcept
+            {
+                return *_slot;
+            }
+            pointer operator->() const noexcept
+            {
+                return _slot;
+            }
+
+            Iterator& operator++() noexcept
+            {
+                do
+                {
+                    ++_distance;
+                    ++_slot;
+                } while (*_distance == Empty);
+                return *this;
+            }
+            Iterator operator++(int) noexcept
+            {
+                auto ret = *this;
+                ++*this;
+                return ret;
+            }
+
+            friend bool operator==(const Iterator& lhs, const Iterator& rhs) noexcept
+            {
+                return lhs._distance == rhs._distance;
+            }
+
+        private:
+            Iterator(const distance_type* distance, pointer slot) noexcept
+                : _distance(distance)
+                , _slot(slot)
+            {
+            }
+
+            // 空でない位置まで進める
+            Iterator& skip_empty() noexcept
+            {
+                while (*_distance == Empty)
+                {
+                    ++_distance;
+                    ++_slot;
+                }
+                return *this;
+            }
+
+            const distance_type* _distance = nullptr;
+            pointer _slot = nullptr;
+
+            friend class Iterator<!IsConst>;
+        };
+        using iterator = Iterator<false>;
+        using const_iterator = Iterator<true>;
+
+        flat_hash_map() noexcept = default;
+
+        explicit flat_hash_map(size_type bucket_count)
+        {
+            reserve(bucket_count);
+        }
+
+        flat_hash_map(std::initializer_list<value_type> init_list)
+        {
+            reserve(init_list.size());
+            for (auto& value : init_list)
+            {
+                insert(value);
+            }
+        }
+
+        flat_hash_map(const flat_hash_map& other)
+            : _hash(other._hash)
+            , _equal(other._equal)
+        {
+            reserve(other.size());
+            for (auto& value : other)
+            {
+                insert_unique(value_type{ value });
+            }
+        }
+
+        flat_hash_map(flat_hash_map&& other) noexcept
+        {
+            swap(other);
+        }
+
+        flat_hash_map& operator=(const flat_hash_map& other)
+        {
+            if (this != &other)
+            {
+                flat_hash_map tmp{ other };
+                swap(tmp);
+            }
+            return *this;
+        }
+
+        flat_hash_map& operator=(flat_hash_map&& other) noexcept
+        {
+            if (this != &other)
+            {
+                flat_hash_map tmp{ std::move(other) };
+                swap(tmp);
+            }
+            return *this;
+        }
+
+        ~flat_hash_map()
+        {
+            clear();
+            deallocate(_slots, _distances, _capacity);
+        }
+
+        // === Iterators
+        iterator begin() noexcept
+        {
+            if (_size == 0)
+                return end();
+            return iterator{ _distances, _slots }.skip_empty();
+        }
+        const_iterator begin() const noexcept
+        {
+            if (_size == 0)
+                return end();
+            return const_iterator{ _distances, _slots }.skip_empty();
+        }
+        const_iterator cbegin() const noexcept
+        {
+            return begin();
+        }
+        iterator end() noexcept
+        {
+            return iterator{ _distances + _capacity, _slots + _capacity };
+        }
+        const_iterator end() const noexcept
+        {
+            return const_iterator{ _distances + _capacity, _slots + _capacity };
+        }
+        const_iterator cend() const noexcept
+        {
+            return end();
+        }
+
+        // === Capacity
+        bool empty() const noexcept
+        {
+            return _size == 0;
+        }
+        size_type size() const noexcept
+        {
+            return _size;
+        }
+        size_type bucket_count() const noexcept
+        {
+            return _capacity;
+        }
+        float load_factor() const noexcept
+        {
+            return _capacity == 0 ? 0.0f : static_cast<float>(_size) / static_cast<float>(_capacity);
+        }
+
+        // n要素を再配置なしで格納できるようにする
+        void reserve(size_type n)
+        {
+            auto required = capacity_for(n);
+            if (_capacity < required)
+            {
+                rehash(required);
+            }
+        }
+
+        // === Modifiers
+        void clear() noexcept
+        {
+            if (_size == 0)
+                return;
+
+            for (size_type i = 0; i < _capacity; i++)
+            {
+                if (_distances[i] != Empty)
+                {
+                    std::destroy_at(&_slots[i]);
+                    _distances[i] = Empty;
+                }
+            }
+            _size = 0;
+        }
+
+        std::pair<iterator, bool> insert(const value_type& value)
+        {
+            return try_emplace(value.first, value.second);
+        }
+        std::pair<iterator, bool> insert(value_type&& value)
+        {
+            return try_emplace(std::move(value.first), std::move(value.second));
+        }
+
+        template<class... Args>
+        std::pair<iterator, bool> emplace(Args&&... args)
+        {
+            value_type value(std::forward<Args>(args)...);
+            if (auto index = find_index(value.first); index != npos)
+                return { iterator_at(index), false };
+
+            return { iterator_at(insert_unique(std::move(value))), true };
+        }
+
+        // キーが存在しなければargsから値を構築して挿入する
+        template<class K, class... Args>
+        std::pair<iterator, bool> try_emplace(K&& key, Args&&... args)
+        {
+            if (auto index = find_index(key); index != npos)
+                return { iterator_at(index), false };
+
+            auto index = insert_unique(value_type(std::piecewise_construct,
+                std::forward_as_tuple(std::forward<K>(key)),
+                std::forward_as_tuple(std::forward<Args>(args)...)));
+            return { iterator_at(index), true };
+        }
+
+        template<class K, class M>
+        std::pair<iterator, bool> insert_or_assign(K&& key, M&& obj)
+        {
+            auto res = try_emplace(std::forward<K>(key), std::forward<M>(obj));
+            if (!res.second)
+            {
+                res.first->second = std::forward<M>(obj);
+            }
+            return res;
+        }
+
+        size_type erase(const Key& key)
+        {
+            auto index = find_index(key);
+            if (index == npos)
+                return 0;
+
+            erase_at(index);
+            return 1;
+        }
+        void erase(const_iterator pos)
+        {
+            erase_at(static_cast<size_type>(pos._slot - _slots));
+        }
+
+        void swap(flat_hash_map& other) noexcept
+        {
+            std::swap(_slots, other._slots);
+            std::swap(_distances, other._distances);
+            std::swap(_capacity, other._capacity);
+            std::swap(_size, other._size);
+            std::swap(_shift, other._shift);
+            std::swap(_hash, other._hash);
+            std::swap(_equal, other._equal);
+        }
+
+        // === Lookup
+        iterator find(const Key& key)
+        {
+            auto index = find_index(key);
+            return index == npos ? end() : iterator_at(index);
+        }
+        const_iterator find(const Key& key) const
+        {
+            auto index = find_index(key);
+            return index == npos ? end() : const_iterator{ _distances + index, _slots + index };
+        }
+        bool contains(const Key& key) const
+        {
+            return find_index(key) != npos;
+        }
+        size_type count(const Key& key) const
+        {
+            return contains(key) ? 1 : 0;
+        }
+
+        T& at(const Key& key)
+        {
+            auto index = find_index(key);
+            if (index == npos)
+                throw std::out_of_range("flat_hash_map: key not found");
+            return _slots[index].second;
+        }
+        const T& at(const Key& key) const
+        {
+            auto index = find_index(key);
+            if (index == npos)
+                throw std::out_of_range("flat_hash_map: key not found");
+            return _slots[index].second;
+        }
+
+        T& operator[](const Key& key)
+        {
+            return try_emplace(key).first->second;
+        }
+        T& operator[](Key&& key)
+        {
+            return try_emplace(std::move(key)).first->second;
+        }
+
+    private:
+        // 最大負荷率 7/8 でn要素を格納できる2の冪の容量
+        static size_type capacity_for(size_type n) noexcept
+        {
+            if (n == 0)
+                return 0;
+            return std::max(MinCapacity, std::bit_ceil(n + n / 7 + 1));
+        }
+
+        size_type mask() const noexcept
+        {
+            return _capacity - 1;
+        }
+
+        // 弱いハッシュ(整数の恒等写像など)でも偏らないよう、フィボナッチハッシュで上位ビットを使う
+        size_type home_index(const Key& key) const noexcept
+        {
+            auto hash = static_cast<std::uint64_t>(_hash(key));
+            return static_cast<size_type>((hash * 0x9E3779B97F4A7C15ull) >> _shift);
+        }
+
+        iterator iterator_at(size_type index) noexcept
+        {
+            return iterator{ _distances + index, _slots + index };
+        }
+
+        size_type find_index(const Key& key) const
+        {
+            if (_size == 0)
+                return npos;
+
+            auto index = home_index(key);
+            for (size_type distance = 1;; distance++)
+            {
+                auto current = _distances[index];
+                // 空、もしくは自分より本来の位置に近い要素に当たったら、それ以降には存在しない
+                if (current < distance)
+                    return npos;
+                if (current == distance && _equal(_slots[index].first, key))
+                    return index;
+                index = (index + 1) & mask();
+            }
+        }
+
+        // キーが存在しないことが分かっている値を挿入し、その位置を返す
+        size_type insert_unique(value_type&& value)
+        {
+            if (capacity_for(_size + 1) > _capacity)
+            {
+                rehash(std::max(capacity_for(_size + 1), _capacity * 2));
+            }
+
+            size_type placed;
+            if (place(value, placed))
+                return placed;
+
+            // 探索距離が上限を超えた。valueには押し出された別の要素が入っているかもしれない
+            if (placed == npos)
+            {
+                rehash(_capacity * 2);
+                return insert_unique(std::move(value));
+            }
+
+            Key key = _slots[placed].first;
+            rehash(_capacity * 2);
+            insert_unique(std::move(value));
+            return find_index(key);
+        }
+
+        // Robin Hood方式で挿入する
+        //  本来の位置から遠い要素を優先し、近い要素を押し出して後ろへ進める
+        //  valueが置けた位置をplacedに書く (置けていなければnpos)
+        //  探索距離が上限を超えたらfalseを返し、そのとき手に持っている要素をvalueに残す
+        bool place(value_type& value, size_type& placed)
+        {
+            placed = npos;
+            bool holding_original = true;
+
+            auto index = home_index(value.first);
+            distance_type distance = 1;
+            while (true)
+            {
+                auto& current = _distances[index];
+                if (current == Empty)
+                {
+                    std::construct_at(&_slots[index], std::move(value));
+                    current = distance;
+                    _size++;
+                    if (holding_original)
+                        placed = index;
+                    return true;
+                }
+                if (current < distance)
+                {
+                    using std::swap;
+                    swap(value, _slots[index]);
+                    swap(distance, current);
+                    if (holding_original)
+                    {
+                        placed = index;
+                        holding_original = false;
+                    }
+                }
+
+                if (distance == MaxDistance)
+                    return false;
+                distance++;
+                index = (index + 1) & mask();
+            }
+        }
+
+        // 削除後、後続の要素を1つずつ前に詰める
+        void erase_at(size_type index)
+        {
+            assert(_distances[index] != Empty);
+
+            std::destroy_at(&_slots[index]);
+            _distances[index] = Empty;
+            _size--;
+
+            auto next = (index + 1) & mask();
+            while (1 < _distances[next])
+            {
+                std::construct_at(&_slots[index], std::move(_slots[next]));
+                std::destroy_at(&_slots[next]);
+                _distances[index] = _distances[next] - 1;
+                _distances[next] = Empty;
+
+                index = next;
+                next = (next + 1) & mask();
+            }
+        }
+
+        void rehash(size_type new_capacity)
+        {
+            assert(std::has_single_bit(new_capacity));
+
+            auto old_slots = std::exchange(_slots, nullptr);
+            auto old_distances = std::exchange(_distances, nullptr);
+            auto old_capacity = std::exchange(_capacity, new_capacity);
+
+            _slots = std::allocator<value_type>{}.allocate(new_capacity);
+            _distances = std::allocator<distance_type>{}.allocate(new_capacity + 1);
+            std::fill_n(_distances, new_capacity, Empty);
+            // イテレータが末尾で止まるための番兵
+            _distances[new_capacity] = 1;
+            _shift = 64 - std::countr_zero(new_capacity);
+            _size = 0;
+
+            for (size_type i = 0; i < old_capacity; i++)
+            {
+                if (old_distances[i] != Empty)
+                {
+                    insert_unique(std::move(old_slots[i]));
+                    std::destroy_at(&old_slots[i]);
+                }
+            }
+            deallocate(old_slots, old_distances, old_capacity);
+        }
+
+        static void deallocate(value_type* slots, distance_type* distances, size_type capacity) noexcept
+        {
+            if (capacity == 0)
+                return;
+            std::allocator<value_type>{}.deallocate(slots, capacity);
+            std::allocator<distance_type>{}.deallocate(distances, capacity + 1);
+        }
+
+        value_type* _slots = nullptr;
+        distance_type* _distances = nullptr;
+        size_type _capacity = 0;
+        size_type _size = 0;
+        int _shift = 64;
+
+        [[no_unique_address]] Hash _hash;
+        [[no_unique_address]] KeyEqual _equal;
+    };
+}
@@ -1,7 +1,14 @@
 ﻿#pragma once
 
-#include <optional>
+#include <cassert>
+#include <cstddef>
 #include <array>
+#include <span>
+#include <memory>
+#include <utility>
+#include <iterator>
+#include <ranges>
+#include <type_traits>
 
 namespace tofu {
     namespace ring_buffer
@@ -30,22 +37,146 @@ namespace tofu {
                 return static_cast<const TRingBuffer*>(this)->at_from_tail(index);
             }
         };
+
+        // head側からtail側へ進むランダムアクセスイテレータ
+        template<class TRingBuffer, class T>
+        class Iterator
+        {
+        public:
+            using iterator_concept = std::random_access_iterator_tag;
+            using iterator_category = std::random_access_iterator_tag;
+            using value_type = std::remove_const_t<T>;
+            using difference_type = std::ptrdiff_t;
+            using pointer = T*;
+            using reference = T&;
+
+            constexpr Iterator() noexcept
+                : _parent(nullptr)
+                , _index(0)
+            {
+            }
+            constexpr Iterator(TRingBuffer* parent, difference_type index) noexcept
+                : _parent(parent)
+                , _index(index)
+            {
+            }
+            // iterator -> const_iterator の変換
+            template<class UParent, class U>
+            constexpr Iterator(const Iterator<UParent, U>& other) noexcept
+                requires std::is_convertible_v<UParent*, TRingBuffer*>
+                : _parent(other._parent)
+                , _index(other._index)
+            {
+            }
+
+            constexpr reference operator*() const noexcept
+            {
+                return _parent->at_from_head(_index);
+            }
+            constexpr pointer operator->() const noexcept
+            {
+                return &_parent->at_from_head(_index);
+            }
+            constexpr reference operator[](difference_type n) const noexcept
+            {
+                return _parent->at_from_head(_index + n);
+            }
+
+            constexpr Iterator& operator++() noexcept { ++_index; return *this; }
+            constexpr Iterator operator++(int) noexcept { auto ret = *this; ++_index; return ret; }
+            constexpr Iterator& operator--() noexcept { --_index; return *this; }
+            constexpr Iterator operator--(int) noexcept { auto ret = *this; --_index; return ret; }
+            constexpr Iterator& operator+=(difference_type n) noexcept { _index += n; return *this; }
+            constexpr Iterator& operator-=(difference_type n) noexcept { _index -= n; return *this; }
+
+            friend constexpr Iterator operator+(Iterator it, difference_type n) noexcept { it += n; return it; }
+            friend constexpr Iterator operator+(difference_type n, Iterator it) noexcept { it += n; return it; }
+            friend constexpr Iterator operator-(Iterator it, difference_type n) noexcept { it -= n; return it; }
+            friend constexpr difference_type operator-(const Iterator& lhs, const Iterator& rhs) noexcept { return lhs._index - rhs._index; }
+
+            friend constexpr bool operator==(const Iterator& lhs, const Iterator& rhs) noexcept { return lhs._index == rhs._index; }
+            friend constexpr auto operator<=>(const Iterator& lhs, const Iterator& rhs) noexcept { return lhs._index <=> rhs._index; }
+
+        private:
+            template<class, class>
+            friend class Iterator;
+
+            TRingBuffer* _parent;
+            difference_type _index;
+        };
     }
 
+    // 固定長のリングバッファ
+    //  Capacityが2の累乗のときはインデックス計算がマスクだけで済む
     template<class T, std::size_t Capacity, template<class, class, class> class TOrigin = ring_buffer::HeadOrigin>
     class RingBuffer : public TOrigin<RingBuffer<T, Capacity, TOrigin>, T, std::ptrdiff_t>
     {
+        static_assert(0 < Capacity);
     public:
         using reference = T&;
         using const_reference = const T&;
         using size_type = std::size_t;
         using difference_type = std::ptrdiff_t;
         using value_type = T;
+        using iterator = ring_buffer::Iterator<RingBuffer, T>;
+        using const_iterator = ring_buffer::Iterator<const RingBuffer, const T>;
+        using reverse_iterator = std::reverse_iterator<iterator>;
+        using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+        static constexpr bool is_power_of_two = (Capacity & (Capacity - 1)) == 0;
 
         constexpr RingBuffer() noexcept
-            : _size(0)
-            , _head(0)
+            : _head(0)
+            , _size(0)
+        {
+        }
+
+        constexpr RingBuffer(const RingBuffer& other)
+            : _head(0)
+            , _size(0)
+        {
+            *this = other;
+        }
+
+        constexpr RingBuffer(RingBuffer&& other) noexcept(std::is_nothrow_move_constructible_v<T>)
+            : _head(0)
+            , _size(0)
+        {
+            *this = std::move(other);
+        }
+
+        ~RingBuffer()
+        {
+            clear();
+        }
+
+        constexpr RingBuffer& operator=(const RingBuffer& other)
+        {
+            if (this == &other)
+                return *this;
+
+            clear();
+            for (auto [first, second] = other.as_spans(); auto& segment : { first, second })
+            {
+                std::uninitialized_copy_n(segment.data(), segment.size(), data() + _size);
+                _size += segment.size();
+            }
+            return *this;
+        }
+
+        constexpr RingBuffer& operator=(RingBuffer&& other) noexcept(std::is_nothrow_move_constructible_v<T>)
         {
+            if (this == &other)
+                return *this;
+
+            clear();
+            for (auto [first, second] = other.as_spans(); auto& segment : { first, second })
+            {
+                std::uninitialized_move_n(segment.data(), segment.size(), data() + _size);
+                _size += segment.size();
+            }
+            other.clear();
+            return *this;
         }
 
         constexpr size_type size() const noexcept
@@ -58,61 +189,103 @@ namespace tofu {
             return Capacity;
         }
 
+        constexpr bool empty() const noexcept
+        {
+            return _size == 0;
+        }
+
+        constexpr bool full() const noexcept
+        {
+            return _size == Capacity;
+        }
+
         // headが0でtail方向に正に増えていくアクセサ
         constexpr T& at_from_head(difference_type index) noexcept
         {
-            assert(0 <= index);
-            return *_buffer[get_index(index)];
+            assert(0 <= index && static_cast<size_type>(index) < _size);
+            return data()[physical_index(index)];
         }
         constexpr const T& at_from_head(difference_type index) const noexcept
         {
-            assert(0 <= index);
-            return *_buffer[get_index(index)];
+            assert(0 <= index && static_cast<size_type>(index) < _size);
+            return data()[physical_index(index)];
         }
 
         // tailが0でhead方向に負に増えていくアクセサ
         constexpr T& at_from_tail(difference_type index) noexcept
         {
             assert(index <= 0);
-            return *_buffer[get_index(_size - 1 + index)];
+            return at_from_head(static_cast<difference_type>(_size) - 1 + index);
         }
         constexpr const T& at_from_tail(difference_type index) const noexcept
         {
             assert(index <= 0);
-            return *_buffer[get_index(_size - 1 + index)];
+            return at_from_head(static_cast<difference_type>(_size) - 1 + index);
         }
 
+        constexpr T& front() noexcept { return at_from_head(0); }
+        constexpr const T& front() const noexcept { return at_from_head(0); }
+        constexpr T& back() noexcept { return at_from_tail(0); }
+        constexpr const T& back() const noexcept { return at_from_tail(0); }
+
+        constexpr iterator begin() noexcept { return iterator{ this, 0 }; }
+        constexpr iterator end() noexcept { return iterator{ this, static_cast<difference_type>(_size) }; }
+        constexpr const_iterator begin() const noexcept { return const_iterator{ this, 0 }; }
+        constexpr const_iterator end() const noexcept { return const_iterator{ this, static_cast<difference_type>(_size) }; }
+        constexpr const_iterator cbegin() const noexcept { return begin(); }
+        constexpr const_iterator cend() const noexcept { return end(); }
+        constexpr reverse_iterator rbegin() noexcept { return reverse_iterator{ end() }; }
+        constexpr reverse_iterator rend() noexcept { return reverse_iterator{ begin() }; }
+        constexpr const_reverse_iterator rbegin() const noexcept { return const_reverse_iterator{ end() }; }
+        constexpr const_reverse_iterator rend() const noexcept { return const_reverse_iterator{ begin() }; }
+
         template<class U = T>
         constexpr void push_back(U&& value)
             requires std::is_convertible_v<U, T>
         {
-            assert(_size < Capacity);
-
-            _buffer[get_index(_size)] = std::forward<U>(value);
-            _size++;
+            emplace_back(std::forward<U>(value));
         }
 
         template<class U = T>
         constexpr void push_front(U&& value)
             requires std::is_convertible_v<U, T>
         {
-            assert(_size < Capacity);
+            emplace_front(std::forward<U>(value));
+        }
+
+        template<class... Args>
+        constexpr T& emplace_back(Args&&... args)
+        {
+            assert(!full());
 
-            _buffer[get_index(-1)] = std::forward<U>(value);
+            auto ptr = std::construct_at(data() + physical_index(_size), std::forward<Args>(args)...);
             _size++;
-            _head--;
+            return *ptr;
+        }
+
+        template<class... Args>
+        constexpr T& emplace_front(Args&&... args)
+        {
+            assert(!full());
 
-            _head = (_head + Capacity) % Capacity;
+            auto head = wrap(_head + Capacity - 1);
+            auto ptr = std::construct_at(data() + head, std::forward<Args>(args)...);
+            _head = head;
+            _size++;
+            return *ptr;
         }
 
         constexpr T pop_front()
         {
             assert(0 < _size);
 
+            T& slot = data()[_head];
+            T ret = std::move(slot);
+            std::destroy_at(&slot);
+
+            _head = wrap(_head + 1);
             _size--;
-            _head++;
-            _head = (_head + Capacity) % Capacity;
-            return *std::exchange(_buffer[get_index(-1)], std::nullopt);
+            return ret;
         }
 
         constexpr T pop_back()
@@ -120,30 +293,108 @@ namespace tofu {
             assert(0 < _size);
 
             _size--;
-            return *std::exchange(_buffer[get_index(_size)], std::nullopt);
+            T& slot = data()[physical_index(_size)];
+            T ret = std::move(slot);
+            std::destroy_at(&slot);
+            return ret;
         }
 
-        constexpr void clear()
+        // [first, first + n) を末尾にまとめて追加する
+        template<std::input_iterator InputIt>
+        constexpr void push_back_n(InputIt first, size_type n)
         {
-            _size = 0;
-            for (auto& val : _buffer)
+            assert(n <= Capacity - _size);
+
+            auto tail = physical_index(_size);
+            auto first_length = std::min(n, Capacity - tail);
+            auto it = std::ranges::uninitialized_copy_n(first, first_length, data() + tail, data() + Capacity).in;
+            std::uninitialized_copy_n(it, n - first_length, data());
+            _size += n;
+        }
+
+        // 先頭からn個を破棄する
+        constexpr void pop_front_n(size_type n) noexcept
+        {
+            assert(n <= _size);
+
+            if constexpr (!std::is_trivially_destructible_v<T>)
+            {
+                auto first_length = std::min(n, Capacity - _head);
+                std::destroy_n(data() + _head, first_length);
+                std::destroy_n(data(), n - first_length);
+            }
+            _head = wrap(_head + n);
+            _size -= n;
+        }
+
+        // 先頭からn個をoutに書き出して取り除く
+        template<class OutputIt>
+        constexpr OutputIt pop_front_n(size_type n, OutputIt out)
+        {
+            assert(n <= _size);
+
+            auto first_length = std::min(n, Capacity - _head);
+            out = std::move(data() + _head, data() + _head + first_length, out);
+            out = std::move(data(), data() + (n - first_length), out);
+            pop_front_n(n);
+            return out;
+        }
+
+        // 格納されている要素を、物理的に連続した2つの区間として返す (head側, 折り返した側)
+        constexpr std::array<std::span<T>, 2> as_spans() noexcept
+        {
+            auto first_length = std::min(_size, Capacity - _head);
+            return { std::span<T>{ data() + _head, first_length }, std::span<T>{ data(), _size - first_length } };
+        }
+        constexpr std::array<std::span<const T>, 2> as_spans() const noexcept
+        {
+            auto first_length = std::min(_size, Capacity - _head);
+            return { std::span<const T>{ data() + _head, first_length }, std::span<const T>{ data(), _size - first_length } };
+        }
+
+        constexpr void clear() noexcept
+        {
+            if constexpr (!std::is_trivially_destructible_v<T>)
             {
-                val = std::nullopt;
+                pop_front_n(_size);
             }
+            _head = 0;
+            _size = 0;
         }
 
     private:
-        constexpr difference_type get_index(difference_type idx) const noexcept
+        // 0 <= idx < 2 * Capacity の範囲を [0, Capacity) に畳む
+        static constexpr size_type wrap(size_type idx) noexcept
+        {
+            if constexpr (is_power_of_two)
+            {
+                return idx & (Capacity - 1);
+            }
+            else
+            {
+                return idx < Capacity ? idx : idx - Capacity;
+            }
+        }
+
+        // headからの論理インデックスを物理インデックスに変換する
+        constexpr size_type physical_index(size_type index) const noexcept
         {
-            idx %= Capacity;
-            return (Capacity + _head + idx) % Capacity;
+            return wrap(_head + index);
+        }
+
+        constexpr T* data() noexcept
+        {
+            return reinterpret_cast<T*>(_buffer);
+        }
+        constexpr const T* data() const noexcept
+        {
+            return reinterpret_cast<const T*>(_buffer);
         }
 
     private:
         size_type _head;
         size_type _size;
-        std::array<std::optional<T>, Capacity> _buffer;
+        alignas(T) std::byte _buffer[sizeof(T) * Capacity];
     };
 
 }
-
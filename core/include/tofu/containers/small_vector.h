@@ -0,0 +1,513 @@
+﻿#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace tofu {
+    // N要素まではオブジェクト内の領域にデータを置き、溢れたらヒープに移るvector
+    //  トリビアルコピー可能な型はmemcpy/memmoveで再配置する
+    template<class T, std::size_t N>
+    class small_vector
+    {
+        static_assert(0 < N);
+
+        // 再配置(ムーブ + 元の破棄)をmemmoveで済ませてよい型か
+        static constexpr bool is_trivially_relocatable = std::is_trivially_copyable_v<T>;
+    public:
+        using reference = T&;
+        using const_reference = const T&;
+        using pointer = T*;
+        using const_pointer = const T*;
+        using iterator = T*;
+        using const_iterator = const T*;
+        using size_type = std::size_t;
+        using difference_type = std::ptrdiff_t;
+        using value_type = T;
+        using reverse_iterator = std::reverse_iterator<iterator>;
+        using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+        static constexpr size_type inline_capacity = N;
+
+        small_vector() noexcept
+            : _data(inline_data())
+            , _size(0)
+            , _capacity(N)
+        {
+        }
+
+        explicit small_vector(size_type n)
+            : small_vector()
+        {
+            resize(n);
+        }
+
+        small_vector(size_type n, const T& value)
+            : small_vector()
+        {
+            assign(n, value);
+        }
+
+        template<std::input_iterator InputIt>
+        small_vector(InputIt first, InputIt last)
+            : small_vector()
+        {
+            assign(first, last);
+        }
+
+        small_vector(std::initializer_list<T> init_list)
+            : small_vector()
+        {
+            assign(init_list);
+        }
+
+        small_vector(const small_vector& other)
+            : small_vector()
+        {
+            assign(other.begin(), other.end());
+        }
+
+        small_vector(small_vector&& other) noexcept(std::is_nothrow_move_constructible_v<T>)
+            : small_vector()
+        {
+            steal(std::move(other));
+        }
+
+        ~small_vector()
+        {
+            clear();
+            deallocate();
+        }
+
+        small_vector& operator=(const small_vector& other)
+        {
+            if (this != &other)
+                assign(other.begin(), other.end());
+            return *this;
+        }
+
+        small_vector& operator=(small_vector&& other) noexcept(std::is_nothrow_move_constructible_v<T>)
+        {
+            if (this != &other)
+            {
+                clear();
+                steal(std::move(other));
+            }
+            return *this;
+        }
+
+        small_vector& operator=(std::initializer_list<T> init_list)
+        {
+            assign(init_list);
+            return *this;
+        }
+
+        void assign(size_type n, const T& value)
+        {
+            clear();
+            reserve(n);
+            std::uninitialized_fill_n(_data, n, value);
+            _size = n;
+        }
+
+        template<std::input_iterator InputIt>
+        void assign(InputIt first, InputIt last)
+        {
+            clear();
+            if constexpr (std::forward_iterator<InputIt>)
+            {
+                auto n = static_cast<size_type>(std::distance(first, last));
+                reserve(n);
+                std::uninitialized_copy(first, last, _data);
+                _size = n;
+            }
+            else
+            {
+                for (; first != last; ++first)
+                    emplace_back(*first);
+            }
+        }
+
+        void assign(std::initializer_list<T> init_list)
+        {
+            assign(init_list.begin(), init_list.end());
+        }
+
+        iterator begin() noexcept { return _data; }
+        iterator end() noexcept { return _data + _size; }
+        const_iterator begin() const noexcept { return _data; }
+        const_iterator end() const noexcept { return _data + _size; }
+        const_iterator cbegin() const noexcept { return _data; }
+        const_iterator cend() const noexcept { return _data + _size; }
+        reverse_iterator rbegin() noexcept { return reverse_iterator{ end() }; }
+        reverse_iterator rend() noexcept { return reverse_iterator{ begin() }; }
+        const_reverse_iterator rbegin() const noexcept { return const_reverse_iterator{ end() }; }
+        const_reverse_iterator rend() const noexcept { return const_reverse_iterator{ begin() }; }
+        const_reverse_iterator crbegin() const noexcept { return const_reverse_iterator{ cend() }; }
+        const_reverse_iterator crend() const noexcept { return const_reverse_iterator{ cbegin() }; }
+
+        size_type size() const noexcept { return _size; }
+        size_type capacity() const noexcept { return _capacity; }
+        bool empty() const noexcept { return _size == 0; }
+        // 内部領域を使っているか (ヒープに移っていないか)
+        bool is_inline() const noexcept { return _data == inline_data(); }
+
+        reference operator[](size_type n) noexcept
+        {
+            assert(n < size());
+            return _data[n];
+        }
+        const_reference operator[](size_type n) const noexcept
+        {
+            assert(n < size());
+            return _data[n];
+        }
+
+        reference at(size_type n)
+        {
+            if (size() <= n)
+                throw std::out_of_range("small_vector: out of range");
+            return _data[n];
+        }
+        const_reference at(size_type n) const
+        {
+            if (size() <= n)
+                throw std::out_of_range("small_vector: out of range");
+            return _data[n];
+        }
+
+        reference front() noexcept { assert(!empty()); return _data[0]; }
+        const_reference front() const noexcept { assert(!empty()); return _data[0]; }
+        reference back() noexcept { assert(!empty()); return _data[_size - 1]; }
+        const_reference back() const noexcept { assert(!empty()); return _data[_size - 1]; }
+
+        T* data() noexcept { return _data; }
+        const T* data() const noexcept { return _data; }
+
+        void reserve(size_type n)
+        {
+            if (n <= _capacity)
+                return;
+            reallocate(n);
+        }
+
+        // ヒープ上にあり、要素数が内部領域に収まるなら内部領域に戻す
+        void shrink_to_fit()
+        {
+            if (is_inline() || _size == _capacity)
+                return;
+            if (_size <= N)
+            {
+                T* old = _data;
+                relocate(old, _size, inline_data());
+                std::allocator<T>{}.deallocate(old, _capacity);
+                _data = inline_data();
+                _capacity = N;
+            }
+            else
+            {
+                reallocate(_size);
+            }
+        }
+
+        void resize(size_type n)
+        {
+            if (n < _size)
+            {
+                std::destroy(_data + n, _data + _size);
+            }
+            else
+            {
+                reserve(n);
+                std::uninitialized_value_construct(_data + _size, _data + n);
+            }
+            _size = n;
+        }
+
+        void resize(size_type n, const T& value)
+        {
+            if (n < _size)
+            {
+                std::destroy(_data + n, _data + _size);
+                _size = n;
+            }
+            else
+            {
+                insert(end(), n - _size, value);
+            }
+        }
+
+    public:
+        void push_back(const T& x)
+        {
+            emplace_back(x);
+        }
+
+        void push_back(T&& x)
+        {
+            emplace_back(std::move(x));
+        }
+
+        template<class... Args>
+        reference emplace_back(Args&&... args)
+        {
+            if (_size < _capacity)
+            {
+                auto ptr = std::construct_at(_data + _size, std::forward<Args>(args)...);
+                _size++;
+                return *ptr;
+            }
+
+            // argsが自身の要素を指しているかもしれないので、先に新しい領域に構築してから再配置する
+            auto new_capacity = grown_capacity(_size + 1);
+            T* new_data = std::allocator<T>{}.allocate(new_capacity);
+            auto ptr = std::construct_at(new_data + _size, std::forward<Args>(args)...);
+            relocate(_data, _size, new_data);
+            deallocate();
+            _data = new_data;
+            _capacity = new_capacity;
+            _size++;
+            return *ptr;
+        }
+
+        void pop_back() noexcept
+        {
+            assert(!empty());
+            _size--;
+            std::destroy_at(_data + _size);
+        }
+
+        void clear() noexcept
+        {
+            std::destroy(_data, _data + _size);
+            _size = 0;
+        }
+
+        template<class... Args>
+        iterator emplace(const_iterator position, Args&&... args)
+        {
+            auto index = position - cbegin();
+            if (position == cend())
+            {
+                emplace_back(std::forward<Args>(args)...);
+                return begin() + index;
+            }
+
+            // argsが自身の要素を指しているかもしれないので、先に値を確定させる
+            T value(std::forward<Args>(args)...);
+            T* gap = open_gap(index, 1);
+            std::construct_at(gap, std::move(value));
+            return gap;
+        }
+
+        iterator insert(const_iterator position, const T& x)
+        {
+            return emplace(position, x);
+        }
+
+        iterator insert(const_iterator position, T&& x)
+        {
+            return emplace(position, std::move(x));
+        }
+
+        iterator insert(const_iterator position, size_type n, const T& x)
+        {
+            auto index = position - cbegin();
+            if (n == 0)
+                return begin() + index;
+
+            T value(x);
+            T* gap = open_gap(index, n);
+            std::uninitialized_fill_n(gap, n, value);
+            return gap;
+        }
+
+        template<std::input_iterator InputIt>
+        iterator insert(const_iterator position, InputIt first, InputIt last)
+        {
+            auto index = position - cbegin();
+            if constexpr (std::forward_iterator<InputIt>)
+            {
+                auto n = static_cast<size_type>(std::distance(first, last));
+                if (n == 0)
+                    return begin() + index;
+
+                T* gap = open_gap(index, n);
+                std::uninitialized_copy(first, last, gap);
+                return gap;
+            }
+            else
+            {
+                auto old_size = _size;
+                for (; first != last; ++first)
+                    emplace_back(*first);
+                std::rotate(begin() + index, begin() + old_size, end());
+                return begin() + index;
+            }
+        }
+
+        iterator insert(const_iterator position, std::initializer_list<T> init_list)
+        {
+            return insert(position, init_list.begin(), init_list.end());
+        }
+
+        iterator erase(const_iterator position)
+        {
+            assert(position < cend());
+            return erase(position, position + 1);
+        }
+
+        iterator erase(const_iterator first, const_iterator last)
+        {
+            auto index = first - cbegin();
+            auto n = static_cast<size_type>(last - first);
+            if (n == 0)
+                return begin() + index;
+
+            T* dest = _data + index;
+            if constexpr (is_trivially_relocatable)
+            {
+                std::memmove(static_cast<void*>(dest), dest + n, (_size - index - n) * sizeof(T));
+            }
+            else
+            {
+                std::move(dest + n, end(), dest);
+                std::destroy(end() - n, end());
+            }
+            _size -= n;
+            return dest;
+        }
+
+        void swap(small_vector& other) noexcept(std::is_nothrow_move_constructible_v<T>)
+        {
+            small_vector tmp = std::move(other);
+            other = std::move(*this);
+            *this = std::move(tmp);
+        }
+
+        friend void swap(small_vector& lhs, small_vector& rhs) noexcept(std::is_nothrow_move_constructible_v<T>)
+        {
+            lhs.swap(rhs);
+        }
+
+        friend bool operator==(const small_vector& lhs, const small_vector& rhs)
+        {
+            return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+        }
+
+    private:
+        T* inline_data() noexcept
+        {
+            return reinterpret_cast<T*>(_inline);
+        }
+        const T* inline_data() const noexcept
+        {
+            return reinterpret_cast<const T*>(_inline);
+        }
+
+        size_type grown_capacity(size_type required) const noexcept
+        {
+            return std::max(required, _capacity * 2);
+        }
+
+        // srcのn要素をdestへ移し、src側は破棄済みにする
+        static void relocate(T* src, size_type n, T* dest) noexcept
+        {
+            if constexpr (is_trivially_relocatable)
+            {
+                if (n)
+                    std::memmove(static_cast<void*>(dest), src, n * sizeof(T));
+            }
+            else if (dest < src)
+            {
+                for (size_type i = 0; i < n; i++)
+                {
+                    std::construct_at(dest + i, std::move(src[i]));
+                    std::destroy_at(src + i);
+                }
+            }
+            else
+            {
+                for (size_type i = n; 0 < i; i--)
+                {
+                    std::construct_at(dest + i - 1, std::move(src[i - 1]));
+                    std::destroy_at(src + i - 1);
+                }
+            }
+        }
+
+        void reallocate(size_type new_capacity)
+        {
+            assert(_size <= new_capacity);
+            T* new_data = std::allocator<T>{}.allocate(new_capacity);
+            relocate(_data, _size, new_data);
+            deallocate();
+            _data = new_data;
+            _capacity = new_capacity;
+        }
+
+        // index位置に未初期化のn要素分の隙間を空け、その先頭を返す
+        T* open_gap(size_type index, size_type n)
+        {
+            assert(index <= _size);
+            if (_capacity < _size + n)
+            {
+                auto new_capacity = grown_capacity(_size + n);
+                T* new_data = std::allocator<T>{}.allocate(new_capacity);
+                relocate(_data, index, new_data);
+                relocate(_data + index, _size - index, new_data + index + n);
+                deallocate();
+                _data = new_data;
+                _capacity = new_capacity;
+            }
+            else
+            {
+                relocate(_data + index, _size - index, _data + index + n);
+            }
+            _size += n;
+            return _data + index;
+        }
+
+        void deallocate() noexcept
+        {
+            if (!is_inline())
+            {
+                std::allocator<T>{}.deallocate(_data, _capacity);
+                _data = inline_data();
+                _capacity = N;
+            }
+        }
+
+        // otherの中身を奪う。自身は空であること
+        void steal(small_vector&& other) noexcept
+        {
+            assert(empty());
+            if (other.is_inline())
+            {
+                relocate(other._data, other._size, _data);
+                _size = other._size;
+                other._size = 0;
+            }
+            else
+            {
+                deallocate();
+                _data = std::exchange(other._data, other.inline_data());
+                _size = std::exchange(other._size, 0);
+                _capacity = std::exchange(other._capacity, N);
+            }
+        }
+
+    private:
+        T* _data;
+        size_type _size;
+        size_type _capacity;
+        alignas(T) std::byte _inline[sizeof(T) * N];
+    };
+}
@@ -1,20 +1,35 @@
 ﻿#pragma once
 
+#include <cassert>
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <utility>
+
+#include <tofu/utils/observer_ptr.h>
+#include <tofu/utils/cache_line.h>
+
 namespace tofu {
-    // TODO: テストを書く
-    // TODO: 説明を書く
+    // 書き込みスレッドが断続的に更新するデータのうち、最新のものを読み込みスレッドが取得するためのクラス
+    //  書き込み者・読み込み者はそれぞれ1スレッドずつであること
+    //  3つのバッファを 書き込み用 / 受け渡し用 / 読み込み用 として持ち、
+    //  受け渡し用バッファのインデックスと「未読データがあるか」のフラグを1つのatomicにまとめて交換するので、ロックせずに(wait-freeで)動作する
     template<class T>
     class TripleBuffer
     {
-        enum class State 
+        using state_type = std::uint8_t;
+
+        // _stateのビット配置
+        static constexpr state_type IndexMask = 0b011; // 受け渡し用バッファのインデックス
+        static constexpr state_type FreshBit = 0b100;  // 受け渡し用バッファに未読のデータが入っている
+
+        enum class Role
         {
-            Invalid, // 有効なデータが入ってない
-            Writing, // 書き込み中
-            Valid,   // 有効なデータが入っていて読み取れる
-            Reading, // 読み取り中
-            Used,    // 一度読み取った
+            Writer,
+            Reader,
         };
-        struct Buffer 
+
+        struct Buffer
         {
             // コピー・ムーブ禁止
             Buffer() = default;
@@ -24,7 +39,6 @@ namespace tofu {
             Buffer& operator=(Buffer&&) = delete;
 
             T _data;
-            State _state;
         };
     public:
         class Ownership
@@ -34,13 +48,12 @@ namespace tofu {
             using element_type = T;
 
             constexpr Ownership() noexcept
-                : _parent(nullptr)
-                , _buffer(nullptr)
             {
             }
-            constexpr Ownership(observer_ptr<TripleBuffer> parent, observer_ptr<Buffer> buffer) noexcept
+            constexpr Ownership(observer_ptr<TripleBuffer> parent, observer_ptr<Buffer> buffer, Role role) noexcept
                 : _parent(parent)
                 , _buffer(buffer)
+                , _role(role)
             {
             }
 
@@ -62,6 +75,7 @@ namespace tofu {
                 Disown();
                 std::swap(_parent, other._parent);
                 std::swap(_buffer, other._buffer);
+                std::swap(_role, other._role);
 
                 return *this;
             }
@@ -70,7 +84,7 @@ namespace tofu {
             {
                 if (_parent && _buffer)
                 {
-                    _parent->Disown(_buffer);
+                    _parent->Disown(_role);
                 }
                 _parent = nullptr;
                 _buffer = nullptr;
@@ -96,115 +110,85 @@ namespace tofu {
 
 
         private:
-            observer_ptr<TripleBuffer> _parent;
-            observer_ptr<Buffer> _buffer;
+            observer_ptr<TripleBuffer> _parent = nullptr;
+            observer_ptr<Buffer> _buffer = nullptr;
+            Role _role = Role::Reader;
         };
 
-        TripleBuffer()
+        TripleBuffer() noexcept
+            : _state(1)
+            , _writeIndex(0)
+            , _readIndex(2)
         {
-            for (auto& buffer : _buffers)
-            {
-                buffer._state = State::Invalid;
-            }
         }
 
+        // 未読のデータがあるか
         bool CanRead() const noexcept
         {
-            return findForState(State::Valid);
+            return _state.load(std::memory_order_acquire) & FreshBit;
         }
+        // 前回読んだデータが残っているか (読み込み側スレッドから呼ぶこと)
         bool CanReadUsed() const noexcept
         {
-            return findForState(State::Used);
+            return _hasRead;
         }
 
-        // 書き込み者として所有権を得る。実行中ロックされる
-        Ownership ownAsWriter()
+        // 書き込み者として所有権を得る。所有権を手放したときに書いた内容が公開される
+        Ownership ownAsWriter() noexcept
         {
-            std::lock_guard lock(_mutex);
-            auto buffer = findForState(State::Invalid);
-            if (!buffer)
-                buffer = findForState(State::Used);
-            assert(buffer);
-            buffer->_state = State::Writing;
-            return Ownership{this, buffer};
+            assert(!_isWriting);
+            _isWriting = true;
+            return Ownership{ this, &_buffers[_writeIndex], Role::Writer };
         }
-        // 読み込み者として所有権を得る。実行中ロックされる
-        Ownership ownAsReader()
+        // 読み込み者として所有権を得る。未読のデータがあること
+        Ownership ownAsReader() noexcept
         {
-            std::lock_guard lock(_mutex);
-            auto buffer = findForState(State::Valid);
-            assert(buffer);
-            buffer->_state = State::Reading;
-            return Ownership{this, buffer};
+            assert(CanRead());
+            acquireFresh();
+            return Ownership{ this, &_buffers[_readIndex], Role::Reader };
         }
-        // 読み込み者として所有権を得る。実行中ロックされる。最新データがなければ前と同じデータを読む
-        Ownership ownAsReaderAllowUsed()
+        // 読み込み者として所有権を得る。最新データがなければ前と同じデータを読む
+        Ownership ownAsReaderAllowUsed() noexcept
         {
-            std::lock_guard lock(_mutex);
-            auto buffer = findForState(State::Valid);
-            if (!buffer)
-                buffer = findForState(State::Used);
-            assert(buffer);
-            buffer->_state = State::Reading;
-            return Ownership{this, buffer};
+            if (CanRead())
+                acquireFresh();
+            assert(_hasRead);
+            return Ownership{ this, &_buffers[_readIndex], Role::Reader };
         }
 
     private:
-        Buffer* findForState(State state)
+        // 受け渡し用バッファと読み込み用バッファを入れ替える
+        void acquireFresh() noexcept
         {
-            for (auto& buffer : _buffers)
-            {
-                if (buffer._state == state)
-                    return &buffer;
-            }
-            return nullptr;
+            auto prev = _state.exchange(_readIndex, std::memory_order_acq_rel);
+            assert(prev & FreshBit);
+            _readIndex = prev & IndexMask;
+            _hasRead = true;
         }
-        const Buffer* findForState(State state) const
+
+        // 所有権を返す
+        void Disown(Role role) noexcept
         {
-            for (auto& buffer : _buffers)
+            if (role == Role::Writer)
             {
-                if (buffer._state == state)
-                    return &buffer;
+                // 書き込み用バッファを受け渡し用として公開し、古い受け渡し用バッファを次の書き込み先にする
+                auto prev = _state.exchange(_writeIndex | FreshBit, std::memory_order_acq_rel);
+                _writeIndex = prev & IndexMask;
+                _isWriting = false;
             }
-            return nullptr;
+            // 読み込み用バッファは読み込み者が持ち続けるので何もしない
         }
 
-        // 所有権を返す。実行中ロックされる
-        void Disown(observer_ptr<Buffer> buffer) 
-        {
-            std::lock_guard lock(_mutex);
+        std::array<Buffer, 3> _buffers;
 
-            switch (buffer->_state)
-            {
-            case State::Writing:
-            {
-                // 古いデータは無効にしておく
-                {
-                    auto old_data = findForState(State::Valid);
-                    if (old_data)
-                        old_data->_state = State::Invalid;
-                }
-                {
-                    auto old_data = findForState(State::Used);
-                    if (old_data)
-                        old_data->_state = State::Invalid;
-                }
+        alignas(CacheLineSize) std::atomic<state_type> _state;
 
-                buffer->_state = State::Valid;
-            }
-                break;
-            default:
-            case State::Reading:
-                if (findForState(State::Valid))
-                    buffer->_state = State::Invalid;
-                else
-                    buffer->_state = State::Used;
-                break;
-            }
-        }
+        // 書き込みスレッドだけが触る
+        alignas(CacheLineSize) state_type _writeIndex;
+        bool _isWriting = false;
 
-        std::array<Buffer, 3> _buffers;
-        std::mutex _mutex;
+        // 読み込みスレッドだけが触る
+        alignas(CacheLineSize) state_type _readIndex;
+        bool _hasRead = false;
     };
 }
-
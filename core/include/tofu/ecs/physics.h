@@ -3,6 +3,9 @@
 #include <box2d/box2d.h>
 
 #include <tofu/utils.h>
+#include <tofu/utils/error.h>
+#include <tofu/utils/snapshot_buffer.h>
+#include <tofu/utils/state_hasher.h>
 #include <tofu/ecs/core.h>
 
 namespace tofu
@@ -26,6 +29,22 @@ namespace tofu
         RigidBody& GenerateBody(entt::entity entity);
         RigidBody& GenerateBody(entt::entity entity, const b2BodyDef& body_def);
 
+        // box2d世界の状態(剛体の位置・速度・スリープ状態、接触の撃力)をbufferに追記する
+        void SaveSnapshot(SnapshotBuffer& buffer) const;
+        // SaveSnapshotした状態に戻す. ボディを作り直さずその場で書き換える
+        //  ボディの構成が保存時と変わっていないこと
+        //  NOTE: スリープまでの経過時間や接触の並び順など、box2dが公開していない状態は復元されない
+        //        巻き戻した後も同じ結果にするには、保存する前と復元した後にDiscardTransientStateを呼ぶ
+        Error LoadSnapshot(SnapshotReader& reader);
+        // スナップショットに入らない状態 (接触、スリープまでの経過時間、ブロードフェーズの木) を捨て、ボディとフィクスチャだけからワールドを作り直す
+        //  ボディの状態が同じなら、それまでの経過によらず同じワールドになる. RigidBody::_bodyは作り直したボディに差し替わる
+        //  次のStepは接触を作るところから始めるので、前のTickの撃力を使った収束 (warm starting) は効かず、Tickをまたいでスリープすることもない
+        void DiscardTransientState();
+
+        // 剛体の位置・速度・スリープ状態をhasherに加える. ピア間でシミュレーションが一致しているかの確認に使う
+        //  接触はフィクスチャをポインタでしか識別できず、ピア間で比べられないので加えない
+        void HashState(StateHasher& hasher) const;
+
     private:
         observer_ptr<entt::registry> _registry;
         std::unique_ptr<b2World> _world;
@@ -0,0 +1,130 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace tofu::net
+{
+	// 途中から参加した相手に、それまでの記録を区切って送る側
+	//  相手が受け取ったと返した量からwindow以上先は送らない. 一度に送り過ぎて、同じ接続の他の通信を詰まらせない
+	class CatchUpSender
+	{
+	public:
+		// chunk_size: 1回に送る最大の大きさ. window: 受け取りを返されていない分として送ってよい最大の大きさ
+		CatchUpSender(std::size_t chunk_size, std::size_t window) noexcept
+			: _chunkSize(chunk_size)
+			, _window(window)
+		{
+			assert(0 < chunk_size && chunk_size <= window);
+		}
+
+		// sizeバイトを送り始める. 送りかけのものは忘れる
+		void Begin(std::size_t size) noexcept
+		{
+			_size = size;
+			_sent = 0;
+			_acked = 0;
+		}
+
+		// 相手が先頭からreceivedバイトまで受け取った. 古い通知で戻さない
+		void Ack(std::size_t received) noexcept
+		{
+			_acked = std::max(_acked, std::min(received, _sent));
+		}
+
+		// 送ってよい分を、chunk_size以下に区切ってsend(std::span<const std::byte>)に渡す
+		//  dataは送るもの全体. 呼ぶたびに同じ内容であること (後ろに書き足されていてもよい)
+		template<class TSend>
+		void Collect(std::span<const std::byte> data, TSend&& send)
+		{
+			assert(_size <= data.size());
+			while (_sent < _size && _sent - _acked < _window)
+			{
+				auto size = std::min({ _chunkSize, _size - _sent, _window - (_sent - _acked) });
+				send(data.subspan(_sent, size));
+				_sent += size;
+			}
+		}
+
+		// 全て送り、全て受け取られた
+		bool IsDone() const noexcept
+		{
+			return _acked == _size;
+		}
+		std::size_t GetSize() const noexcept
+		{
+			return _size;
+		}
+		std::size_t GetSent() const noexcept
+		{
+			return _sent;
+		}
+		std::size_t GetAcked() const noexcept
+		{
+			return _acked;
+		}
+
+	private:
+		std::size_t _chunkSize;
+		std::size_t _window;
+
+		std::size_t _size = 0;
+		std::size_t _sent = 0;
+		std::size_t _acked = 0;
+	};
+
+	// 途中から参加したときに、区切って届く記録を読んだ量を数え、送り手に返す頃合いを決める側
+	//  送り手は返された量からwindow先までしか送らないので、ack_intervalはwindowより小さくすること
+	class CatchUpReceiver
+	{
+	public:
+		explicit CatchUpReceiver(std::size_t ack_interval) noexcept
+			: _ackInterval(ack_interval)
+		{
+			assert(0 < ack_interval);
+		}
+
+		// sizeバイト届く
+		void Begin(std::size_t size) noexcept
+		{
+			_size = size;
+			_consumed = 0;
+			_acked = 0;
+		}
+
+		// sizeバイト読んだ. 読んだ量を送り手に返すべきならtrue (前回からack_interval以上読んだか、全て読んだ)
+		bool Consume(std::size_t size) noexcept
+		{
+			assert(_consumed + size <= _size);
+			_consumed += size;
+			if (_consumed - _acked < _ackInterval && _consumed != _size)
+				return false;
+			_acked = _consumed;
+			return true;
+		}
+
+		// 全て読んだ. 何も届かないときは始めから読み終えている
+		bool IsComplete() const noexcept
+		{
+			return _consumed == _size;
+		}
+		std::size_t GetSize() const noexcept
+		{
+			return _size;
+		}
+		std::size_t GetConsumed() const noexcept
+		{
+			return _consumed;
+		}
+
+	private:
+		std::size_t _ackInterval;
+
+		std::size_t _size = 0;
+		std::size_t _consumed = 0;
+		std::size_t _acked = 0;
+	};
+}
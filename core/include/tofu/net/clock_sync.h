@@ -0,0 +1,141 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+namespace tofu::net
+{
+	// ピアの時計とのずれ(オフセット)と、進む速さの差(ドリフト)を推定する (NTPと同じ4つの時刻を使う)
+	//  t0: こちらが要求を送った時刻, t3: こちらが応答を受け取った時刻 (こちらの時計)
+	//  t1: ピアが要求を受け取った時刻, t2: ピアが応答を送った時刻 (ピアの時計)
+	//  オフセット = ((t1 - t0) + (t2 - t3)) / 2, 往復遅延 = (t3 - t0) - (t2 - t1)
+	//  行きと帰りの遅延の差がそのまま誤差になるので、往復遅延の小さいサンプル(キューで待たされなかったもの)だけを使い、
+	//  それらに直線を当てはめて、傾きをドリフトとする
+	class ClockSyncEstimator
+	{
+	public:
+		using clock = std::chrono::system_clock;
+		using duration = std::chrono::microseconds;
+		using time_point = std::chrono::time_point<clock, duration>;
+
+		// 覚えておくサンプルの数
+		static constexpr std::size_t Capacity = 32;
+		// ドリフトを求めるのに使うサンプルの最小数. 少ないうちは0とする
+		static constexpr std::size_t MinDriftSamples = 4;
+		// 水晶発振器の精度を大きく超えるドリフトは、外れ値に引きずられたものとして切り詰める
+		static constexpr double MaxDrift = 500e-6;
+
+		static time_point Now() noexcept
+		{
+			return std::chrono::time_point_cast<duration>(clock::now());
+		}
+
+		void AddSample(time_point t0, time_point t1, time_point t2, time_point t3) noexcept
+		{
+			auto delay = (t3 - t0) - (t2 - t1);
+			// どちらかの時計が飛んだサンプルは使わない
+			if (delay < duration::zero())
+				return;
+
+			_samples[_next] = Sample{
+				._local = t0 + (t3 - t0) / 2,
+				._offset = ((t1 - t0) + (t2 - t3)) / 2,
+				._delay = delay,
+			};
+			_next = (_next + 1) % Capacity;
+			_count = std::min(_count + 1, Capacity);
+			update();
+		}
+
+		std::size_t GetSampleCount() const noexcept
+		{
+			return _count;
+		}
+		// 最も往復遅延の小さいサンプルの往復遅延
+		duration GetRoundTrip() const noexcept
+		{
+			return _roundTrip;
+		}
+		// こちらの時計がlocalのときの、ピアの時計 - こちらの時計
+		duration GetOffset(time_point local) const noexcept
+		{
+			auto elapsed = static_cast<double>((local - _reference).count());
+			return _offset + duration{ std::llround(_drift * elapsed) };
+		}
+		// こちらの時計が1進む間に、ピアの時計がどれだけ余分に進むか
+		double GetDrift() const noexcept
+		{
+			return _drift;
+		}
+
+		// こちらの時計の時刻を、ピアの時計の時刻にする
+		time_point ToRemote(time_point local) const noexcept
+		{
+			return local + GetOffset(local);
+		}
+
+	private:
+		struct Sample
+		{
+			time_point _local;
+			duration _offset;
+			duration _delay;
+		};
+
+		void update() noexcept
+		{
+			std::array<Sample, Capacity> sorted;
+			std::copy_n(_samples.begin(), _count, sorted.begin());
+			// 往復遅延の小さい方から半分 (少なくとも1つ)
+			auto used = (_count + 1) / 2;
+			std::partial_sort(sorted.begin(), sorted.begin() + used, sorted.begin() + _count, [](const Sample& a, const Sample& b) {
+				return a._delay < b._delay;
+			});
+			_roundTrip = sorted[0]._delay;
+
+			if (used < MinDriftSamples)
+			{
+				_reference = sorted[0]._local;
+				_offset = sorted[0]._offset;
+				_drift = 0;
+				return;
+			}
+
+			// 最小二乗法で offset = _offset + _drift * (local - _reference) を求める. 桁落ちしないよう最初のサンプルからの差で計算する
+			auto origin = sorted[0]._local;
+			double mean_x = 0, mean_y = 0;
+			for (std::size_t i = 0; i < used; i++)
+			{
+				mean_x += static_cast<double>((sorted[i]._local - origin).count());
+				mean_y += static_cast<double>(sorted[i]._offset.count());
+			}
+			mean_x /= static_cast<double>(used);
+			mean_y /= static_cast<double>(used);
+
+			double sxx = 0, sxy = 0;
+			for (std::size_t i = 0; i < used; i++)
+			{
+				auto dx = static_cast<double>((sorted[i]._local - origin).count()) - mean_x;
+				auto dy = static_cast<double>(sorted[i]._offset.count()) - mean_y;
+				sxx += dx * dx;
+				sxy += dx * dy;
+			}
+
+			_reference = origin + duration{ std::llround(mean_x) };
+			_offset = duration{ std::llround(mean_y) };
+			_drift = sxx == 0 ? 0 : std::clamp(sxy / sxx, -MaxDrift, MaxDrift);
+		}
+
+		std::array<Sample, Capacity> _samples;
+		std::size_t _next = 0;
+		std::size_t _count = 0;
+
+		time_point _reference;
+		duration _offset{ 0 };
+		double _drift = 0;
+		duration _roundTrip{ 0 };
+	};
+}
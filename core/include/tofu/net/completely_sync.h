@@ -1,83 +1,127 @@
 ﻿#pragma once
 
-#include <optional>
-#include <vector>
+#include <cassert>
+#include <cstdint>
+#include <array>
+#include <limits>
+#include <span>
+#include <type_traits>
 #include <tofu/ecs/core.h>
 #include <tofu/containers/ring_buffer.h>
 
 namespace tofu::net
 {
+	namespace completely_sync
+	{
+		// MaxPlayers人分のビットを持てる最小の符号なし整数型
+		template<std::size_t MaxPlayers>
+		using player_mask_t =
+			std::conditional_t<MaxPlayers <= 8, std::uint8_t,
+			std::conditional_t<MaxPlayers <= 16, std::uint16_t,
+			std::conditional_t<MaxPlayers <= 32, std::uint32_t,
+			std::uint64_t>>>;
+
+		// player_num人分のビットが全て立ったマスク. TMaskの幅と同じ人数のときもシフトで溢れさせない
+		template<class TMask>
+		constexpr TMask all_players(std::size_t player_num) noexcept
+		{
+			assert(player_num <= std::numeric_limits<TMask>::digits);
+			if (player_num == std::numeric_limits<TMask>::digits)
+				return static_cast<TMask>(~TMask{ 0 });
+			return static_cast<TMask>((TMask{ 1 } << player_num) - 1);
+		}
+	}
+
 	// 完全同期方式でゲームをStepするシステム
-	//  TODO: テストを書く
-	template<class TSyncType, std::uint32_t BufferSize>
+	//  MaxPlayers: 参加できる最大人数. 入力はTickごとに固定長の配列で持ち、届いたかどうかはビットマスクで管理する
+	//  構築後はメモリを確保しない
+	template<class TSyncType, std::uint32_t BufferSize, std::size_t MaxPlayers>
 	class CompletelySyncSystem
 	{
-		struct State
-		{
-			constexpr State(std::size_t player_num)
-				: _state(player_num)
-			{
-			}
+		static_assert(0 < MaxPlayers && MaxPlayers <= 64, "MaxPlayers must be in [1, 64].");
 
-			constexpr bool HasAllPlayerData() const noexcept
-			{
-				for (auto& state : _state)
-				{
-					if (!state)
-						return false;
-				}
-				return true;
-			}
+	public:
+		using mask_type = completely_sync::player_mask_t<MaxPlayers>;
 
-			std::vector<std::optional<TSyncType>> _state;
+	private:
+		struct Frame
+		{
+			std::array<TSyncType, MaxPlayers> _data{};
+			// 入力が届いたプレイヤーのビット
+			mask_type _received = 0;
 		};
 
+		static constexpr mask_type bit(std::size_t player_id) noexcept
+		{
+			return static_cast<mask_type>(mask_type{ 1 } << player_id);
+		}
+
 	public:
 		// default_delay: 入力の遅延フレーム
 		CompletelySyncSystem(std::size_t player_num, std::uint32_t default_delay)
 			: _playerNum(player_num)
+			, _allPlayers(completely_sync::all_players<mask_type>(player_num))
 		{
+			assert(0 < player_num && player_num <= MaxPlayers);
+			assert(default_delay < BufferSize);
+
 			for (std::uint32_t i = 0; i < BufferSize; i++) 
 			{
-				_buffer.push_back(State{ player_num });
+				_buffer.emplace_back();
 			}
 			for (std::uint32_t i = 0; i < default_delay; i++) 
-				for (std::size_t p = 0; p < player_num; p++)
-					_buffer[i]._state[p] = TSyncType{};
+				_buffer[i]._received = _allPlayers;
 		}
 
 		bool CanStep() const noexcept
 		{
-			return _buffer[0].HasAllPlayerData();
+			return _buffer[0]._received == _allPlayers;
 		}
 
 		bool HasData(GameTick tick_after, std::size_t player_id) const noexcept
 		{
 			assert(tick_after < BufferSize);
-			return _buffer[*tick_after]._state[player_id];
+			assert(player_id < _playerNum);
+			return _buffer[*tick_after]._received & bit(player_id);
 		}
 
-		const std::vector<std::optional<TSyncType>>& Top() const noexcept
+		// 現在のTickの入力. CanStep()のときだけ全員分揃っている
+		std::span<const TSyncType> Top() const noexcept
 		{
-			return _buffer[0]._state;
+			return { _buffer[0]._data.data(), _playerNum };
+		}
+
+		// 現在のTickの入力が届いていないプレイヤーのビットマスク
+		//  進められないときに、誰を待っているかの診断に使う
+		mask_type GetWaitingPlayers() const noexcept
+		{
+			return _allPlayers & ~_buffer[0]._received;
 		}
 
 		void Step() noexcept
 		{
 			_buffer.pop_front();
-			_buffer.push_back(State{ _playerNum });
+			_buffer.emplace_back();
 		}
 
 		void SetData(std::size_t player_id, GameTick tick_after, const TSyncType& data) noexcept
 		{
 			assert(tick_after < BufferSize);
-			_buffer[*tick_after]._state[player_id] = data;
+			assert(player_id < _playerNum);
+			auto& frame = _buffer[*tick_after];
+			frame._data[player_id] = data;
+			frame._received |= bit(player_id);
+		}
+
+		std::size_t GetPlayerNum() const noexcept
+		{
+			return _playerNum;
 		}
 
 	private:
 		std::size_t _playerNum;
-		RingBuffer<State, BufferSize> _buffer;
-		GameTick _nextTick = 0;
+		mask_type _allPlayers;
+		RingBuffer<Frame, BufferSize> _buffer;
 	};
 
 }
@@ -0,0 +1,178 @@
+﻿#pragma once
+
+#include <cassert>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include <tofu/ecs/core.h>
+#include <tofu/net/completely_sync.h>
+
+namespace tofu::net
+{
+	// 各プレイヤーから届いたTickごとの状態のハッシュを突き合わせ、最初に食い違ったTickを見つける
+	//  ハッシュはプレイヤーごとにバラバラの順で届いてよい. 参加しているプレイヤー全員分が揃ったTickから比べる
+	//  試合の途中で抜けたプレイヤーはRemovePlayerで待つのをやめ、戻ってきたらAddPlayerで加え直す
+	template<std::size_t MaxPlayers>
+	class DesyncDetector
+	{
+	public:
+		using mask_type = completely_sync::player_mask_t<MaxPlayers>;
+
+		struct Desync
+		{
+			GameTick _tick;
+			// プレイヤーIDが最も小さい人とハッシュが異なるプレイヤー
+			mask_type _players;
+		};
+
+	private:
+		struct Entry
+		{
+			GameTick _tick;
+			mask_type _received;
+			std::array<std::uint64_t, MaxPlayers> _hashes;
+		};
+
+	public:
+		// max_pending: 揃うのを待っておけるTick数. 超えたら古いものから捨てる
+		DesyncDetector(std::size_t player_num, std::size_t max_pending = 256)
+			: _allPlayers(completely_sync::all_players<mask_type>(player_num))
+			, _activePlayers(_allPlayers)
+			, _maxPending(max_pending)
+		{
+			assert(0 < player_num && player_num <= MaxPlayers);
+			_pending.reserve(max_pending + 1);
+		}
+
+		// ハッシュを加える. このTickで初めて食い違いが見つかったら、それを返す
+		//  一度食い違えばその後のTickも食い違い続けるので、返すのは最初の1回だけ
+		//  参加していないプレイヤーや、参加する前のTickのハッシュは使わない
+		std::optional<Desync> Add(std::size_t player_id, GameTick tick, std::uint64_t hash)
+		{
+			assert(player_id < MaxPlayers);
+			if (_firstDesync && _firstDesync->_tick <= tick)
+				return std::nullopt;
+			if ((_activePlayers >> player_id & 1) == 0 || tick < _activeFrom[player_id])
+				return std::nullopt;
+
+			auto it = _pending.begin();
+			for (; it != _pending.end() && it->_tick < tick; ++it)
+			{
+			}
+			if (it == _pending.end() || it->_tick != tick)
+			{
+				it = _pending.insert(it, Entry{ ._tick = tick, ._received = 0, ._hashes = {} });
+			}
+
+			auto bit = static_cast<mask_type>(mask_type{ 1 } << player_id);
+			it->_hashes[player_id] = hash;
+			it->_received |= bit;
+			if (!IsComplete(*it))
+			{
+				if (_maxPending < _pending.size())
+					_pending.erase(_pending.begin());
+				return std::nullopt;
+			}
+
+			auto entry = *it;
+			_pending.erase(it);
+			return Compare(entry);
+		}
+
+		// player_idのハッシュを待つのをやめる. 試合の途中で抜けたときに呼ぶ
+		//  待っていたTickが残りの全員分揃っていれば、その場で比べて最初の食い違いを返す
+		std::optional<Desync> RemovePlayer(std::size_t player_id)
+		{
+			assert(player_id < MaxPlayers);
+			_activePlayers &= static_cast<mask_type>(~(mask_type{ 1 } << player_id));
+
+			std::optional<Desync> result;
+			for (auto it = _pending.begin(); it != _pending.end();)
+			{
+				if (!IsComplete(*it))
+				{
+					++it;
+					continue;
+				}
+				auto entry = *it;
+				it = _pending.erase(it);
+				if (auto desync = Compare(entry); desync && !result)
+					result = desync;
+			}
+			return result;
+		}
+		// player_idのハッシュを、tick以降で比べる. 途中から参加したときは、追いつくまでに進めたTickのハッシュも届くが、
+		//  それより前のTickは他の全員の分で既に比べ終わっているので使わない
+		void AddPlayer(std::size_t player_id, GameTick tick)
+		{
+			assert((_allPlayers >> player_id & 1) != 0);
+			_activePlayers |= static_cast<mask_type>(mask_type{ 1 } << player_id);
+			_activeFrom[player_id] = tick;
+		}
+		mask_type GetActivePlayers() const noexcept
+		{
+			return _activePlayers;
+		}
+
+		const std::optional<Desync>& GetFirstDesync() const noexcept
+		{
+			return _firstDesync;
+		}
+
+		std::size_t PendingCount() const noexcept
+		{
+			return _pending.size();
+		}
+
+	private:
+		// tickのハッシュを比べるプレイヤー
+		mask_type GetExpectedPlayers(GameTick tick) const noexcept
+		{
+			mask_type expected = 0;
+			for (std::size_t i = 0; i < MaxPlayers; i++)
+			{
+				if ((_activePlayers >> i & 1) && _activeFrom[i] <= tick)
+					expected |= static_cast<mask_type>(mask_type{ 1 } << i);
+			}
+			return expected;
+		}
+		bool IsComplete(const Entry& entry) const noexcept
+		{
+			auto expected = GetExpectedPlayers(entry._tick);
+			return expected != 0 && (entry._received & expected) == expected;
+		}
+		// 揃ったentryを比べる. これまでに見つけたものより前のTickで食い違っていれば、それを返す
+		std::optional<Desync> Compare(const Entry& entry)
+		{
+			if (_firstDesync && _firstDesync->_tick <= entry._tick)
+				return std::nullopt;
+
+			auto expected = GetExpectedPlayers(entry._tick);
+			mask_type differs = 0;
+			auto base = entry._hashes[std::countr_zero(expected)];
+			for (std::size_t i = 0; i < MaxPlayers; i++)
+			{
+				if ((expected >> i & 1) && entry._hashes[i] != base)
+					differs |= static_cast<mask_type>(mask_type{ 1 } << i);
+			}
+			if (!differs)
+				return std::nullopt;
+
+			// 後から届いた、より前のTickで食い違うこともある
+			_firstDesync = Desync{ entry._tick, differs };
+			return _firstDesync;
+		}
+
+		mask_type _allPlayers;
+		// ハッシュを待っているプレイヤーと、それぞれ比べ始めるTick
+		mask_type _activePlayers;
+		std::array<GameTick, MaxPlayers> _activeFrom{};
+		std::size_t _maxPending;
+
+		// Tick順
+		std::vector<Entry> _pending;
+		std::optional<Desync> _firstDesync;
+	};
+}
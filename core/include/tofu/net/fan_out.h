@@ -0,0 +1,65 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <span>
+#include <tofu/utils/snapshot_buffer.h>
+
+namespace tofu::net
+{
+	// 同じメッセージ列を複数の宛先に送るための送信バッファ
+	//  メッセージはAppendした時点で一度だけバイト列にし、Flushで全宛先に同じバイト列を渡す
+	//  宛先ごとにメッセージを組み立てて送るのに比べ、エンコードは1回、送信の呼び出しは宛先ごとに1回で済む
+	class FanOutBuffer
+	{
+	public:
+		// エンコード済みの1メッセージ分のバイト列を後ろに積む
+		void AppendBytes(std::span<const std::byte> message)
+		{
+			_buffer.WriteBytes(message.data(), message.size());
+			_messageCount++;
+		}
+
+		// 溜まっているバイト列を全宛先に渡して空にする
+		//  send(target, std::span<const std::byte>)
+		template<class TTargets, class TSend>
+		void Flush(TTargets&& targets, TSend&& send)
+		{
+			if (Empty())
+				return;
+			auto data = Data();
+			for (auto&& target : targets)
+			{
+				send(target, data);
+			}
+			Clear();
+		}
+
+		std::span<const std::byte> Data() const noexcept
+		{
+			return _buffer.AsSpan();
+		}
+		std::size_t Size() const noexcept
+		{
+			return _buffer.Size();
+		}
+		std::size_t MessageCount() const noexcept
+		{
+			return _messageCount;
+		}
+		bool Empty() const noexcept
+		{
+			return _messageCount == 0;
+		}
+
+		// 領域は解放しないので、毎Tick使い回しても確保は起きない
+		void Clear() noexcept
+		{
+			_buffer.Clear();
+			_messageCount = 0;
+		}
+
+	private:
+		SnapshotBuffer _buffer;
+		std::size_t _messageCount = 0;
+	};
+}
@@ -0,0 +1,113 @@
+﻿#pragma once
+
+#include <cassert>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <tofu/ecs/core.h>
+
+namespace tofu::net
+{
+	// 他のピアよりどれだけ先のTickを進んでいるか(フレームアドバンテージ)を推定し、
+	//  先行しているピアの1Tickを少しだけ長くして、止まらずに差を縮める (time dilation)
+	//  ロックステップでは遅れているピアの入力が揃うまで先行側が止まるしかないが、数%ずつ遅らせれば見た目には分からない
+	//  片道の時間の見積もりが外れていると、測ったアドバンテージは両方のピアで同じ向きにずれる
+	//  相手が測った値を報告してもらえれば、自分の値との差を取って打ち消せる (SetRemoteAdvantage)
+	template<std::size_t MaxPlayers>
+	class FrameAdvantageBalancer
+	{
+	public:
+		using duration = std::chrono::microseconds;
+
+		struct Config
+		{
+			duration _tickPeriod;
+			// これ以下のアドバンテージは揺らぎとみなして、1Tickを伸ばさない (単位はTick)
+			float _deadband = 1.0f;
+			// _deadbandを超えたアドバンテージ1Tickあたりに、1Tickを伸ばす割合
+			float _gain = 0.02f;
+			// 1Tickを伸ばす割合の上限
+			float _maxDilation = 0.05f;
+		};
+
+		explicit FrameAdvantageBalancer(const Config& config) noexcept
+			: _config(config)
+		{
+		}
+
+		// playerがremote_tickを進めていたときに送ったデータを、自分がlocal_tickのときに受け取った
+		//  one_way: 届くまでにかかった片道の時間. その間に相手が進めたTickの分を足して比べる
+		//  両方のTickに同じ数を足して渡してもよい (引き算で負にならないようにするため)
+		void AddSample(std::size_t player, GameTick remote_tick, GameTick local_tick, duration one_way) noexcept
+		{
+			assert(player < MaxPlayers);
+			auto in_flight = static_cast<float>(one_way.count()) / static_cast<float>(_config._tickPeriod.count());
+			auto advantage = static_cast<float>(static_cast<std::int64_t>(*local_tick) - static_cast<std::int64_t>(*remote_tick)) - in_flight;
+
+			// 入力はまとめて送られるので、1つずつのサンプルは揺れる. RTTと同じく1/8ずつ寄せる
+			auto& current = _measured[player];
+			if (!current)
+				current = advantage;
+			else
+				*current += (advantage - *current) / 8;
+		}
+
+		// playerが測った、自分に対するplayerのアドバンテージ (playerのGetMeasuredAdvantage)
+		void SetRemoteAdvantage(std::size_t player, float advantage) noexcept
+		{
+			assert(player < MaxPlayers);
+			_remote[player] = advantage;
+		}
+
+		// playerに対して、自分が測ったアドバンテージ. 片道の時間の見積もりの誤差を含む. 相手に報告するのはこの値
+		std::optional<float> GetMeasuredAdvantage(std::size_t player) const noexcept
+		{
+			assert(player < MaxPlayers);
+			return _measured[player];
+		}
+		// playerに対するアドバンテージ. 正なら自分が先行している
+		//  相手から報告があれば、お互いの測った値の差の半分. 両方に同じだけ乗っている誤差は打ち消される
+		std::optional<float> GetAdvantage(std::size_t player) const noexcept
+		{
+			assert(player < MaxPlayers);
+			auto& measured = _measured[player];
+			auto& remote = _remote[player];
+			if (measured && remote)
+				return (*measured - *remote) / 2;
+			return measured;
+		}
+		// 最も遅れているピアに対するアドバンテージ. サンプルがなければ0
+		float GetMaxAdvantage() const noexcept
+		{
+			float result = 0;
+			for (std::size_t i = 0; i < MaxPlayers; i++)
+			{
+				if (auto advantage = GetAdvantage(i))
+					result = std::max(result, *advantage);
+			}
+			return result;
+		}
+
+		// 1Tickを伸ばす割合
+		float GetDilation() const noexcept
+		{
+			auto excess = GetMaxAdvantage() - _config._deadband;
+			if (excess <= 0)
+				return 0;
+			return std::min(_config._maxDilation, _config._gain * excess);
+		}
+		// 伸ばした後の1Tickの長さ
+		duration GetTickPeriod() const noexcept
+		{
+			auto period = static_cast<float>(_config._tickPeriod.count()) * (1 + GetDilation());
+			return duration{ static_cast<duration::rep>(period) };
+		}
+
+	private:
+		Config _config;
+		std::array<std::optional<float>, MaxPlayers> _measured;
+		std::array<std::optional<float>, MaxPlayers> _remote;
+	};
+}
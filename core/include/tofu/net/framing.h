@@ -0,0 +1,273 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace tofu::net
+{
+	// ストリームに並べるメッセージの区切り
+	//  [可変長整数: 中身の大きさ << 1 | 続き][種類 1byte][中身]
+	//  可変長整数はLEB128. 続きのビットが立っていれば、次のフレームが同じメッセージの続き (大きなメッセージを区切って送るとき)
+	struct FrameHeader
+	{
+		std::uint8_t _type = 0;
+		// このフレームの中身の大きさ
+		std::uint32_t _payloadSize = 0;
+		// 次のフレームが同じメッセージの続き
+		bool _more = false;
+		// ヘッダの大きさ
+		std::uint8_t _headerSize = 0;
+
+		// ヘッダ込みの大きさ
+		std::size_t FrameSize() const noexcept
+		{
+			return _headerSize + static_cast<std::size_t>(_payloadSize);
+		}
+	};
+
+	// 1フレームの中身の最大の大きさ. 続きのビットと合わせて32ビットに収まる
+	inline constexpr std::size_t MaxFramePayloadSize = 0x7fff'ffff;
+	// ヘッダの最大の大きさ. 可変長整数の5byteと種類の1byte
+	inline constexpr std::size_t MaxFrameHeaderSize = 5 + 1;
+
+	enum class FrameStatus
+	{
+		Complete,
+		// ヘッダが全て届いていない
+		Incomplete,
+		Broken,
+	};
+
+	constexpr std::size_t FrameHeaderSize(std::size_t payload_size) noexcept
+	{
+		auto value = static_cast<std::uint64_t>(payload_size) << 1;
+		std::size_t size = 1;
+		while (0x80 <= value)
+		{
+			value >>= 7;
+			size++;
+		}
+		return size + 1;
+	}
+
+	// ヘッダを書き、書いたバイト数を返す. outにはFrameHeaderSize(payload_size)以上の大きさが要る
+	inline std::size_t WriteFrameHeader(std::span<std::byte> out, std::uint8_t type, std::size_t payload_size, bool more = false) noexcept
+	{
+		assert(payload_size <= MaxFramePayloadSize);
+		assert(FrameHeaderSize(payload_size) <= out.size());
+
+		auto value = static_cast<std::uint32_t>(payload_size) << 1 | (more ? 1u : 0u);
+		std::size_t size = 0;
+		while (0x80 <= value)
+		{
+			out[size++] = static_cast<std::byte>((value & 0x7f) | 0x80);
+			value >>= 7;
+		}
+		out[size++] = static_cast<std::byte>(value);
+		out[size++] = static_cast<std::byte>(type);
+		return size;
+	}
+
+	// bytesの先頭からヘッダを読む
+	inline FrameStatus ParseFrameHeader(std::span<const std::byte> bytes, FrameHeader& out) noexcept
+	{
+		std::uint64_t value = 0;
+		for (std::size_t i = 0; i < MaxFrameHeaderSize - 1; i++)
+		{
+			if (bytes.size() <= i)
+				return FrameStatus::Incomplete;
+			auto byte = std::to_integer<std::uint8_t>(bytes[i]);
+			value |= static_cast<std::uint64_t>(byte & 0x7f) << (i * 7);
+			if (byte & 0x80)
+				continue;
+
+			if (0xffff'ffff < value)
+				return FrameStatus::Broken;
+			if (bytes.size() <= i + 1)
+				return FrameStatus::Incomplete;
+			out._payloadSize = static_cast<std::uint32_t>(value >> 1);
+			out._more = (value & 1) != 0;
+			out._type = std::to_integer<std::uint8_t>(bytes[i + 1]);
+			out._headerSize = static_cast<std::uint8_t>(i + 2);
+			return FrameStatus::Complete;
+		}
+		// 5byte目にも続きがある
+		return FrameStatus::Broken;
+	}
+
+	// 大きなメッセージを、fragment_size以下の中身のフレームに区切って書く. メッセージ全体を手元に揃えなくてよい
+	//  Writeで渡した分がfragment_sizeを超えたら、それまでを続きのあるフレームとしてsend(std::span<const std::byte>)に渡す
+	//  Finishで残りを最後のフレームとして渡す. 相手はFrameDecoderで1つのメッセージとして読める
+	class FrameFragmenter
+	{
+	public:
+		FrameFragmenter(std::uint8_t type, std::size_t fragment_size)
+			: _type(type)
+			, _fragmentSize(fragment_size)
+		{
+			assert(0 < fragment_size && fragment_size <= MaxFramePayloadSize);
+			_buffer.reserve(MaxFrameHeaderSize + fragment_size);
+			_buffer.resize(MaxFrameHeaderSize);
+		}
+
+		template<class TSend>
+		void Write(std::span<const std::byte> bytes, TSend&& send)
+		{
+			while (!bytes.empty())
+			{
+				// 続きがあると分かってから送る. 最後のフレームに続きのビットを立てないため
+				if (PayloadSize() == _fragmentSize)
+					Flush(true, send);
+				auto size = std::min(bytes.size(), _fragmentSize - PayloadSize());
+				_buffer.insert(_buffer.end(), bytes.begin(), bytes.begin() + size);
+				bytes = bytes.subspan(size);
+			}
+		}
+
+		template<class TSend>
+		void Finish(TSend&& send)
+		{
+			Flush(false, send);
+		}
+
+	private:
+		std::size_t PayloadSize() const noexcept
+		{
+			return _buffer.size() - MaxFrameHeaderSize;
+		}
+
+		template<class TSend>
+		void Flush(bool more, TSend& send)
+		{
+			// ヘッダは中身の直前に詰めて書く
+			auto payload_size = PayloadSize();
+			auto offset = MaxFrameHeaderSize - FrameHeaderSize(payload_size);
+			WriteFrameHeader(std::span{ _buffer }.subspan(offset), _type, payload_size, more);
+			send(std::span<const std::byte>{ _buffer }.subspan(offset));
+			_buffer.resize(MaxFrameHeaderSize);
+		}
+
+		std::uint8_t _type;
+		std::size_t _fragmentSize;
+		std::vector<std::byte> _buffer;
+	};
+
+	// 区切って届くバイト列からフレームを読み、メッセージごとにhandlerへ渡す. メッセージ全体が届くのを待たずに読み始める
+	//  handler.OnBegin(type) → handler.OnData(std::span<const std::byte>) (0回以上) → handler.OnEnd() の順に呼ぶ
+	//  続きのあるフレームは、つなげて1つのメッセージとして渡す
+	class FrameDecoder
+	{
+	public:
+		// max_message_size: 1メッセージ (続きを含めた合計) の最大の大きさ. 超えたら壊れているとみなす
+		explicit FrameDecoder(std::size_t max_message_size) noexcept
+			: _maxMessageSize(max_message_size)
+		{
+		}
+
+		// bytesを全て読む. 壊れていたらfalse. 壊れた後は何も読まない
+		template<class THandler>
+		bool Feed(std::span<const std::byte> bytes, THandler& handler)
+		{
+			while (!bytes.empty() && !_broken)
+			{
+				if (!_inFrame)
+				{
+					// ヘッダは短いので、1byteずつ溜めて読む
+					_header[_headerFill++] = bytes.front();
+					bytes = bytes.subspan(1);
+					BeginFrame(handler);
+					continue;
+				}
+
+				auto size = std::min<std::size_t>(bytes.size(), _remaining);
+				handler.OnData(bytes.first(size));
+				bytes = bytes.subspan(size);
+				_remaining -= size;
+				if (_remaining == 0)
+					EndFrame(handler);
+			}
+			return !_broken;
+		}
+
+		bool IsBroken() const noexcept
+		{
+			return _broken;
+		}
+		// メッセージの途中で止まっていない
+		bool IsIdle() const noexcept
+		{
+			return !_inMessage && _headerFill == 0;
+		}
+
+	private:
+		template<class THandler>
+		void BeginFrame(THandler& handler)
+		{
+			FrameHeader header;
+			auto status = ParseFrameHeader(std::span{ _header }.first(_headerFill), header);
+			if (status == FrameStatus::Incomplete)
+				return;
+			_headerFill = 0;
+			if (status == FrameStatus::Broken)
+			{
+				_broken = true;
+				return;
+			}
+
+			if (!_inMessage)
+			{
+				_inMessage = true;
+				_type = header._type;
+				_messageSize = 0;
+				handler.OnBegin(_type);
+			}
+			else if (header._type != _type)
+			{
+				// 続きのはずが、別のメッセージになっている
+				_broken = true;
+				return;
+			}
+
+			_messageSize += header._payloadSize;
+			if (_maxMessageSize < _messageSize)
+			{
+				_broken = true;
+				return;
+			}
+			_inFrame = true;
+			_more = header._more;
+			_remaining = header._payloadSize;
+			if (_remaining == 0)
+				EndFrame(handler);
+		}
+
+		template<class THandler>
+		void EndFrame(THandler& handler)
+		{
+			_inFrame = false;
+			if (_more)
+				return;
+			_inMessage = false;
+			handler.OnEnd();
+		}
+
+		std::size_t _maxMessageSize;
+
+		std::array<std::byte, MaxFrameHeaderSize> _header{};
+		std::size_t _headerFill = 0;
+
+		bool _inMessage = false;
+		bool _inFrame = false;
+		bool _more = false;
+		std::uint8_t _type = 0;
+		std::size_t _messageSize = 0;
+		std::size_t _remaining = 0;
+
+		bool _broken = false;
+	};
+}
@@ -0,0 +1,115 @@
+﻿#pragma once
+
+#include <cassert>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <span>
+#include <vector>
+#include <tofu/ecs/core.h>
+#include <tofu/net/completely_sync.h>
+
+namespace tofu::net
+{
+	// サーバーが受け取った各プレイヤーの入力を、Tick範囲(ウィンドウ)ごとに1つにまとめる
+	//  全員分揃ったら、揃わなくても最初の入力からmax_wait経ったら、まだ出していないプレイヤーの分をまとめて出す
+	//  TWindow: 1プレイヤー・1ウィンドウ分の入力
+	template<class TWindow, std::size_t MaxPlayers>
+	class InputAggregator
+	{
+	public:
+		using clock = std::chrono::steady_clock;
+		using mask_type = completely_sync::player_mask_t<MaxPlayers>;
+
+	private:
+		struct Window
+		{
+			GameTick _tick;
+			mask_type _received;
+			mask_type _sent;
+			clock::time_point _firstArrival;
+			std::array<TWindow, MaxPlayers> _inputs;
+		};
+
+	public:
+		// max_wait: 揃わないウィンドウを、揃った分だけで出すまでの時間
+		// expire: 揃わないウィンドウを捨てるまでの時間. 遅れて届いた分は新しいウィンドウとして扱う
+		InputAggregator(std::size_t player_num, clock::duration max_wait, clock::duration expire = std::chrono::seconds{ 1 })
+			: _allPlayers(completely_sync::all_players<mask_type>(player_num))
+			, _maxWait(max_wait)
+			, _expire(expire)
+		{
+			assert(0 < player_num && player_num <= MaxPlayers);
+		}
+
+		void Add(std::size_t player_id, GameTick tick, const TWindow& input, clock::time_point now)
+		{
+			auto bit = static_cast<mask_type>(mask_type{ 1 } << player_id);
+			auto& window = findOrInsert(tick, now);
+			// 同じ入力が2度届いても最初の1回だけ使う
+			if (window._received & bit)
+				return;
+			window._inputs[player_id] = input;
+			window._received |= bit;
+		}
+
+		// 出せるものを emit(GameTick tick, mask_type players, std::span<const TWindow> inputs) に渡す
+		//  inputsはplayersのビットが立っているプレイヤーの分をID順に詰めたもの. Tickの古い順に呼ぶ
+		template<class TEmit>
+		void Collect(clock::time_point now, TEmit&& emit)
+		{
+			std::size_t kept = 0;
+			for (std::size_t i = 0; i < _windows.size(); i++)
+			{
+				auto& window = _windows[i];
+				auto waited = now - window._firstArrival;
+
+				mask_type pending = window._received & ~window._sent;
+				if (pending && (window._received == _allPlayers || _maxWait <= waited))
+				{
+					std::size_t count = 0;
+					for (mask_type rest = pending; rest; rest &= rest - 1)
+					{
+						_packed[count++] = window._inputs[std::countr_zero(rest)];
+					}
+					emit(window._tick, pending, std::span<const TWindow>{ _packed.data(), count });
+					window._sent |= pending;
+				}
+
+				if (window._sent == _allPlayers || _expire <= waited)
+					continue;
+				if (kept != i)
+					_windows[kept] = window;
+				kept++;
+			}
+			_windows.resize(kept);
+		}
+
+		std::size_t PendingWindowCount() const noexcept
+		{
+			return _windows.size();
+		}
+
+	private:
+		Window& findOrInsert(GameTick tick, clock::time_point now)
+		{
+			// ウィンドウは数個しか溜まらないので線形に探す. Tick順に並べておく
+			auto it = _windows.begin();
+			for (; it != _windows.end(); ++it)
+			{
+				if (it->_tick == tick)
+					return *it;
+				if (tick < it->_tick)
+					break;
+			}
+			return *_windows.insert(it, Window{ ._tick = tick, ._received = 0, ._sent = 0, ._firstArrival = now, ._inputs = {} });
+		}
+
+		mask_type _allPlayers;
+		clock::duration _maxWait;
+		clock::duration _expire;
+
+		std::vector<Window> _windows;
+		std::array<TWindow, MaxPlayers> _packed{};
+	};
+}
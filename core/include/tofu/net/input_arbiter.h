@@ -0,0 +1,142 @@
+﻿#pragma once
+
+#include <cassert>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <optional>
+#include <vector>
+#include <tofu/ecs/core.h>
+#include <tofu/net/completely_sync.h>
+
+namespace tofu::net
+{
+	// サーバーが各プレイヤーの入力の締め切りを管理し、締め切りまでに届かなかった入力をサーバーが代わりに決める
+	//  締め切りは、同じTick範囲(ウィンドウ)の入力を誰かから最初に受け取ってからdeadline後
+	//  代わりに決めた後に届いた本物の入力は捨てる. 1人の通信が遅くても、他の人が待たされるのはdeadlineまでで済む
+	//  TWindow: 1プレイヤー・1ウィンドウ分の入力
+	template<class TWindow, std::size_t MaxPlayers>
+	class InputArbiter
+	{
+	public:
+		using clock = std::chrono::steady_clock;
+		using mask_type = completely_sync::player_mask_t<MaxPlayers>;
+
+	private:
+		struct Window
+		{
+			GameTick _tick;
+			// 入力が決まったプレイヤー (本物が届いたか、代わりに決めたか)
+			mask_type _decided;
+			clock::time_point _firstArrival;
+			// 締め切りを過ぎた. Collectの中だけで使う
+			bool _due;
+		};
+
+	public:
+		// stride: 1ウィンドウのTick数
+		InputArbiter(std::size_t player_num, clock::duration deadline, std::uint32_t stride)
+			: _allPlayers(completely_sync::all_players<mask_type>(player_num))
+			, _deadline(deadline)
+			, _stride(stride)
+		{
+			assert(0 < player_num && player_num <= MaxPlayers);
+		}
+
+		// 本物の入力が届いた. 使ってよければtrue、既に決まっているTickなら(締め切りに遅れたので)false
+		//  1人のプレイヤーの入力はTick順に渡すこと
+		bool Add(std::size_t player_id, GameTick tick, const TWindow& input, clock::time_point now)
+		{
+			assert(player_id < MaxPlayers);
+			if (tick < _nextTick[player_id])
+				return false;
+
+			findOrInsert(tick, now)._decided |= static_cast<mask_type>(mask_type{ 1 } << player_id);
+			decide(player_id, tick, input);
+			return true;
+		}
+
+		// 締め切りを過ぎたウィンドウで入力が届いていないプレイヤーの分を決める. Tickの古い順に決める
+		//  fill(std::size_t player_id, GameTick tick, const std::optional<TWindow>& last) -> TWindow
+		//    lastはそのプレイヤーの直前に決まった入力. 返した入力をそのプレイヤーの入力とする
+		//  emit(std::size_t player_id, GameTick tick, const TWindow& input): 決めた入力を配る
+		template<class TFill, class TEmit>
+		void Collect(clock::time_point now, TFill&& fill, TEmit&& emit)
+		{
+			// 新しいウィンドウの締め切りを過ぎていれば、それより古いウィンドウも過ぎたものとして扱う
+			bool due = false;
+			for (auto it = _windows.rbegin(); it != _windows.rend(); ++it)
+			{
+				due = due || _deadline <= now - it->_firstArrival;
+				it->_due = due;
+			}
+
+			std::size_t kept = 0;
+			for (std::size_t i = 0; i < _windows.size(); i++)
+			{
+				auto window = _windows[i];
+				if (window._decided == _allPlayers)
+					continue;
+				if (window._due)
+				{
+					for (mask_type rest = _allPlayers & ~window._decided; rest; rest &= rest - 1)
+					{
+						auto player_id = static_cast<std::size_t>(std::countr_zero(rest));
+						// 代わりに決めるより先に、このウィンドウより後の本物の入力を受け取っていることはない (Tick順に渡されるので)
+						if (window._tick < _nextTick[player_id])
+							continue;
+						auto input = fill(player_id, window._tick, _last[player_id]);
+						decide(player_id, window._tick, input);
+						emit(player_id, window._tick, input);
+						_filledCount++;
+					}
+					continue;
+				}
+				if (kept != i)
+					_windows[kept] = window;
+				kept++;
+			}
+			_windows.resize(kept);
+		}
+
+		std::size_t PendingWindowCount() const noexcept
+		{
+			return _windows.size();
+		}
+		// これまでに代わりに決めた入力の数
+		std::size_t GetFilledCount() const noexcept
+		{
+			return _filledCount;
+		}
+
+	private:
+		void decide(std::size_t player_id, GameTick tick, const TWindow& input)
+		{
+			_last[player_id] = input;
+			_nextTick[player_id] = tick + GameTick{ _stride };
+		}
+
+		Window& findOrInsert(GameTick tick, clock::time_point now)
+		{
+			// ウィンドウは締め切りまでの数個しか溜まらないので線形に探す. Tick順に並べておく
+			auto it = _windows.begin();
+			for (; it != _windows.end(); ++it)
+			{
+				if (it->_tick == tick)
+					return *it;
+				if (tick < it->_tick)
+					break;
+			}
+			return *_windows.insert(it, Window{ ._tick = tick, ._decided = 0, ._firstArrival = now, ._due = false });
+		}
+
+		mask_type _allPlayers;
+		clock::duration _deadline;
+		std::uint32_t _stride;
+
+		std::vector<Window> _windows;
+		std::array<GameTick, MaxPlayers> _nextTick{};
+		std::array<std::optional<TWindow>, MaxPlayers> _last;
+		std::size_t _filledCount = 0;
+	};
+}
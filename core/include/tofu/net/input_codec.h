@@ -0,0 +1,171 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <tofu/utils/bit_stream.h>
+
+namespace tofu::net
+{
+	// 連続したTickの入力を、少ないビット数に詰める
+	//  1Tickの入力は「種類」と、種類が0以外のときの「目標座標」からなる. 種類0は何もしない入力とする
+	//  目標座標は固定の格子(1/GridScale刻み)に丸めて整数で持つ. 全ピアが丸めた後の値でシミュレーションすること
+	//
+	//  1Tickごとに、まずタグをTagBitsビットで書く
+	//    0 ~ KindCount-1: その種類. 0以外なら続けて目標座標を書く
+	//    KindCount: 直前のTickと同じ入力 (何もしない入力が続くことと、同じ目標を押し続けることが多い)
+	//  目標座標は、直前の目標との差が小さければ 1 + DeltaBits*2 ビット、そうでなければ 1 + 16*2 ビットで書く
+	template<std::size_t KindCount>
+	class InputCodec
+	{
+	public:
+		static_assert(1 < KindCount);
+
+		struct Input
+		{
+			std::uint8_t _kind = 0;
+			std::int16_t _x = 0;
+			std::int16_t _y = 0;
+
+			bool operator==(const Input&) const = default;
+		};
+
+		static constexpr unsigned TagBits = std::bit_width(KindCount);
+		static constexpr std::uint32_t RepeatTag = KindCount;
+		static constexpr unsigned DeltaBits = 8;
+
+		// 1cm刻み. ±327m まで表せる
+		static constexpr float GridScale = 100.f;
+
+		// count Tick分の入力を書くのに必要な最大のビット数
+		static constexpr std::size_t MaxBits(std::size_t count) noexcept
+		{
+			return count * (TagBits + 1 + 16 * 2);
+		}
+
+		static std::int16_t Quantize(float value) noexcept
+		{
+			auto scaled = std::round(value * GridScale);
+			return static_cast<std::int16_t>(std::clamp(scaled, static_cast<float>(std::numeric_limits<std::int16_t>::min()), static_cast<float>(std::numeric_limits<std::int16_t>::max())));
+		}
+		static float Dequantize(std::int16_t value) noexcept
+		{
+			return static_cast<float>(value) / GridScale;
+		}
+
+		// 1続きの入力を書く. 直前の入力を覚えているので、続きごとに作り直すこと
+		class Encoder
+		{
+		public:
+			explicit Encoder(BitWriter& writer) noexcept
+				: _writer(writer)
+			{
+			}
+
+			bool Add(const Input& input) noexcept
+			{
+				if (_previous && input._kind != 0 && *_previous == input)
+				{
+					return _writer.Write(RepeatTag, TagBits);
+				}
+				_previous = input;
+
+				if (!_writer.Write(input._kind, TagBits))
+					return false;
+				if (input._kind == 0)
+					return true;
+
+				auto dx = input._x - _target._x;
+				auto dy = input._y - _target._y;
+				_target = input;
+				if (fitsDelta(dx) && fitsDelta(dy))
+				{
+					return _writer.Write(1, 1)
+						&& _writer.Write(static_cast<std::uint32_t>(dx) & DeltaMask, DeltaBits)
+						&& _writer.Write(static_cast<std::uint32_t>(dy) & DeltaMask, DeltaBits);
+				}
+				return _writer.Write(0, 1)
+					&& _writer.Write(static_cast<std::uint16_t>(input._x), 16)
+					&& _writer.Write(static_cast<std::uint16_t>(input._y), 16);
+			}
+
+		private:
+			static bool fitsDelta(int d) noexcept
+			{
+				return -(1 << (DeltaBits - 1)) <= d && d < (1 << (DeltaBits - 1));
+			}
+
+			BitWriter& _writer;
+			std::optional<Input> _previous;
+			Input _target;
+		};
+
+		// Encoderで書いた1続きの入力を読む
+		class Decoder
+		{
+		public:
+			explicit Decoder(BitReader& reader) noexcept
+				: _reader(reader)
+			{
+			}
+
+			// 壊れたデータならnullopt
+			std::optional<Input> Next() noexcept
+			{
+				auto tag = _reader.Read(TagBits);
+				if (!tag || RepeatTag < *tag)
+					return std::nullopt;
+				if (*tag == RepeatTag)
+					return _previous;
+
+				Input input;
+				input._kind = static_cast<std::uint8_t>(*tag);
+				if (input._kind != 0)
+				{
+					auto is_delta = _reader.Read(1);
+					if (!is_delta)
+						return std::nullopt;
+					if (*is_delta)
+					{
+						auto dx = _reader.Read(DeltaBits);
+						auto dy = _reader.Read(DeltaBits);
+						if (!dx || !dy)
+							return std::nullopt;
+						input._x = static_cast<std::int16_t>(_target._x + signExtend(*dx));
+						input._y = static_cast<std::int16_t>(_target._y + signExtend(*dy));
+					}
+					else
+					{
+						auto x = _reader.Read(16);
+						auto y = _reader.Read(16);
+						if (!x || !y)
+							return std::nullopt;
+						input._x = static_cast<std::int16_t>(static_cast<std::uint16_t>(*x));
+						input._y = static_cast<std::int16_t>(static_cast<std::uint16_t>(*y));
+					}
+					_target = input;
+				}
+				_previous = input;
+				return input;
+			}
+
+		private:
+			static int signExtend(std::uint32_t value) noexcept
+			{
+				return static_cast<int>(value ^ SignBit) - static_cast<int>(SignBit);
+			}
+
+			BitReader& _reader;
+			// 最初のTickから「直前と同じ」は来ないが、壊れたデータでも何もしない入力になるだけにしておく
+			std::optional<Input> _previous = Input{};
+			Input _target;
+		};
+
+	private:
+		static constexpr std::uint32_t DeltaMask = (1u << DeltaBits) - 1;
+		static constexpr std::uint32_t SignBit = 1u << (DeltaBits - 1);
+	};
+}
@@ -0,0 +1,134 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <optional>
+#include <tofu/ecs/core.h>
+#include <tofu/containers/small_vector.h>
+
+namespace tofu::net
+{
+	// 測定した遅延から、試合全体で使う入力遅延(Tick数)を決める
+	//  必要な遅延が増えたらすぐに伸ばし、減った場合は一定時間その状態が続いてから1Tickずつ縮める
+	//  (測定値の揺れで遅延が行ったり来たりしないようにするため)
+	class InputDelayController
+	{
+	public:
+		using clock = std::chrono::steady_clock;
+		using duration = std::chrono::microseconds;
+
+		struct Config
+		{
+			// 1Tickの長さ
+			duration _tickPeriod;
+			std::uint32_t _minDelay;
+			std::uint32_t _maxDelay;
+			// 通信時間とは別に必要なTick数 (入力をまとめて送る分など)
+			std::uint32_t _extraDelay = 0;
+			// ジッタの何倍を余裕として見込むか
+			std::uint32_t _jitterFactor = 4;
+			// 遅延を縮めるまでに、必要な遅延が下回り続けていなければならない時間
+			duration _decreaseHold = std::chrono::seconds{ 2 };
+		};
+
+		InputDelayController(const Config& config, std::uint32_t initial_delay) noexcept
+			: _config(config)
+			, _delay(std::clamp(initial_delay, config._minDelay, config._maxDelay))
+		{
+			assert(config._minDelay <= config._maxDelay);
+		}
+
+		// one_way: 入力が他のプレイヤーに届くまでの時間
+		std::uint32_t GetRequiredDelay(duration one_way, duration jitter) const noexcept
+		{
+			auto latency = one_way + jitter * _config._jitterFactor;
+			auto ticks = static_cast<std::uint32_t>((latency + _config._tickPeriod - duration{ 1 }) / _config._tickPeriod);
+			return std::clamp(ticks + _config._extraDelay, _config._minDelay, _config._maxDelay);
+		}
+
+		// 測定値を与えて遅延を更新する. 変わった場合は新しい遅延を返す
+		std::optional<std::uint32_t> Update(duration one_way, duration jitter, clock::time_point now) noexcept
+		{
+			auto required = GetRequiredDelay(one_way, jitter);
+			if (_delay < required)
+			{
+				_lowSince = std::nullopt;
+				_delay = required;
+				return _delay;
+			}
+			if (required == _delay)
+			{
+				_lowSince = std::nullopt;
+				return std::nullopt;
+			}
+
+			if (!_lowSince)
+				_lowSince = now;
+			if (now - *_lowSince < _config._decreaseHold)
+				return std::nullopt;
+
+			// 次の1Tick分もまた一定時間様子を見る
+			_lowSince = now;
+			_delay--;
+			return _delay;
+		}
+
+		std::uint32_t GetDelay() const noexcept
+		{
+			return _delay;
+		}
+
+	private:
+		Config _config;
+		std::uint32_t _delay;
+		std::optional<clock::time_point> _lowSince;
+	};
+
+	// Tickごとの入力遅延
+	//  遅延の変更は「このTickから」という形で予約し、全員が同じTickで切り替えることで決定性を保つ
+	class InputDelaySchedule
+	{
+		struct Change
+		{
+			GameTick _tick;
+			std::uint32_t _delay;
+		};
+
+	public:
+		explicit InputDelaySchedule(std::uint32_t initial_delay) noexcept
+			: _delay(initial_delay)
+		{
+		}
+
+		// tick以降の遅延をdelayにする. tickは予約済みの変更より後であること
+		void Schedule(GameTick tick, std::uint32_t delay)
+		{
+			assert(_changes.empty() || _changes.back()._tick < tick);
+			_changes.push_back(Change{ tick, delay });
+		}
+
+		// tickでの遅延を返す. tickは前回の呼び出し以降であること
+		std::uint32_t GetDelay(GameTick tick) noexcept
+		{
+			std::size_t applied = 0;
+			while (applied < _changes.size() && _changes[applied]._tick <= tick)
+			{
+				_delay = _changes[applied]._delay;
+				applied++;
+			}
+			if (applied)
+				_changes.erase(_changes.begin(), _changes.begin() + applied);
+			return _delay;
+		}
+
+		bool HasPendingChange() const noexcept
+		{
+			return !_changes.empty();
+		}
+
+	private:
+		std::uint32_t _delay;
+		small_vector<Change, 4> _changes;
+	};
+}
@@ -0,0 +1,77 @@
+﻿#pragma once
+
+#include <chrono>
+#include <tofu/ecs/core.h>
+
+namespace tofu::net
+{
+	// ピアとの往復遅延(RTT)と、その揺らぎ(ジッタ)を推定する
+	//  RTTはトランスポートの測定値(picoquic_get_rttなど)を平滑化し、
+	//  ジッタは一定間隔のTickごとに送られてくるデータの到着時刻のずれから求める (RFC 3550 の interarrival jitter)
+	class LatencyEstimator
+	{
+	public:
+		using clock = std::chrono::steady_clock;
+		using duration = std::chrono::microseconds;
+
+		// tick_period: 1Tickの長さ
+		explicit LatencyEstimator(duration tick_period) noexcept
+			: _tickPeriod(tick_period)
+		{
+		}
+
+		// RTTの測定値を加える
+		void AddRttSample(duration rtt) noexcept
+		{
+			if (!_hasRtt)
+			{
+				_rtt = rtt;
+				_hasRtt = true;
+				return;
+			}
+			// SRTT = 7/8 SRTT + 1/8 RTT (RFC 6298)
+			_rtt += (rtt - _rtt) / 8;
+		}
+
+		// tickのデータがarrivalに届いたことを記録する
+		void AddArrival(GameTick tick, clock::time_point arrival) noexcept
+		{
+			// 送信側が一定間隔でTickを進めていれば、到着時刻からTick分の時間を引いた値(転送時間)は一定になる
+			auto transit = std::chrono::duration_cast<duration>(arrival.time_since_epoch()) - _tickPeriod * static_cast<std::int64_t>(*tick);
+			if (_hasArrival)
+			{
+				auto diff = transit - _lastTransit;
+				if (diff < duration::zero())
+					diff = -diff;
+				// J = J + (|D| - J) / 16
+				_jitter += (diff - _jitter) / 16;
+			}
+			_lastTransit = transit;
+			_hasArrival = true;
+		}
+
+		bool HasRtt() const noexcept
+		{
+			return _hasRtt;
+		}
+
+		duration GetRtt() const noexcept
+		{
+			return _rtt;
+		}
+		duration GetJitter() const noexcept
+		{
+			return _jitter;
+		}
+
+	private:
+		duration _tickPeriod;
+
+		bool _hasRtt = false;
+		duration _rtt{ 0 };
+
+		bool _hasArrival = false;
+		duration _lastTransit{ 0 };
+		duration _jitter{ 0 };
+	};
+}
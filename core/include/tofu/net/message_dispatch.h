@@ -0,0 +1,101 @@
+﻿#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+
+#include <tofu/net/wire.h>
+
+namespace tofu::net
+{
+	enum class DispatchResult
+	{
+		// 読んでハンドラに渡した
+		Dispatched,
+		// 表に無い種類
+		UnknownType,
+		// 中身が壊れていて読めなかった
+		Broken,
+		// ハンドラがfalseを返した
+		Rejected,
+	};
+
+	// ラムダを並べて、メッセージの型ごとに呼び分けるハンドラにする
+	template<class... TFunctions>
+	struct MessageHandlers : TFunctions...
+	{
+		using TFunctions::operator()...;
+	};
+	template<class... TFunctions>
+	MessageHandlers(TFunctions...) -> MessageHandlers<TFunctions...>;
+
+	// 受け取るメッセージの型を並べたもの. 種類の値から、その型として読んでハンドラに渡す関数を引く表をコンパイル時に作る
+	//  型はmessage_type (1byte) とwire_schemaを持つこと
+	//  ハンドラは並べた全ての型Tについてhandler(const T&)を呼べること. 戻り値はvoidか、続けてよければtrueのbool
+	template<class... TMessages>
+	class MessageDispatcher
+	{
+		static constexpr bool has_unique_types() noexcept
+		{
+			constexpr std::array<std::uint8_t, sizeof...(TMessages)> types{ static_cast<std::uint8_t>(TMessages::message_type)... };
+			for (std::size_t i = 0; i < types.size(); i++)
+			{
+				for (std::size_t k = i + 1; k < types.size(); k++)
+				{
+					if (types[i] == types[k])
+						return false;
+				}
+			}
+			return true;
+		}
+		static_assert(has_unique_types(), "Message types must be unique.");
+
+		template<class THandler>
+		using Entry = DispatchResult (*)(std::span<const std::byte>, THandler&);
+
+	public:
+		static constexpr bool Contains(std::uint8_t type) noexcept
+		{
+			return ((static_cast<std::uint8_t>(TMessages::message_type) == type) || ...);
+		}
+
+		// payload (ヘッダを除いた部分) をtypeのメッセージとして読み、handlerに渡す
+		template<class THandler>
+		static DispatchResult Dispatch(std::uint8_t type, std::span<const std::byte> payload, THandler& handler)
+		{
+			auto entry = entries<THandler>[type];
+			if (!entry)
+				return DispatchResult::UnknownType;
+			return entry(payload, handler);
+		}
+
+	private:
+		template<class THandler, class T>
+		static DispatchResult dispatch(std::span<const std::byte> payload, THandler& handler)
+		{
+			T message;
+			if (!wire_decode(payload, message))
+				return DispatchResult::Broken;
+
+			if constexpr (std::is_void_v<std::invoke_result_t<THandler&, const T&>>)
+			{
+				handler(static_cast<const T&>(message));
+				return DispatchResult::Dispatched;
+			}
+			else
+			{
+				return handler(static_cast<const T&>(message)) ? DispatchResult::Dispatched : DispatchResult::Rejected;
+			}
+		}
+
+		// 種類の値で引く表. 並べていない種類はnullptr
+		template<class THandler>
+		static constexpr std::array<Entry<THandler>, 256> entries = [] {
+			std::array<Entry<THandler>, 256> table{};
+			((table[static_cast<std::uint8_t>(TMessages::message_type)] = &dispatch<THandler, TMessages>), ...);
+			return table;
+		}();
+	};
+}
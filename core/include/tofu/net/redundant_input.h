@@ -0,0 +1,211 @@
+﻿#pragma once
+
+#include <cassert>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <tuple>
+#include <tofu/ecs/core.h>
+#include <tofu/containers/ring_buffer.h>
+
+namespace tofu::net
+{
+	// 信頼性のない経路(QUICのDATAGRAMなど)で入力を送るための部品
+	//  送信側は確認応答(ACK)されていない入力のうち新しいものを毎回まとめて送り、1つ落ちても次の送信で届くようにする
+	//  受信側は連続して揃ったTickの次のTickをACKとして返す
+	//  入力1つはstride Tick分 (SyncWindowSize Tick分をまとめて送るなら stride = SyncWindowSize)
+
+	// データグラムの連番の抜けから損失率を推定する
+	class LossEstimator
+	{
+	public:
+		void OnReceive(std::uint32_t seq) noexcept
+		{
+			if (!_hasReceived)
+			{
+				_hasReceived = true;
+				_nextSeq = seq + 1;
+				return;
+			}
+			// 追い越された古いデータグラムは、既に損失として数えている
+			if (seq < _nextSeq)
+				return;
+
+			// 抜けた数だけ損失を、届いた1つ分は損失なしを加える
+			for (std::uint32_t lost = std::min<std::uint32_t>(seq - _nextSeq, MaxGap); 0 < lost; lost--)
+			{
+				_lossRate += (1.0f - _lossRate) / 16;
+			}
+			_lossRate -= _lossRate / 16;
+			_nextSeq = seq + 1;
+		}
+
+		// 0.0 ~ 1.0
+		float GetLossRate() const noexcept
+		{
+			return _lossRate;
+		}
+
+	private:
+		// 長く途絶えた後でも推定値が1に張り付かないよう、一度に数える損失の上限
+		static constexpr std::uint32_t MaxGap = 16;
+
+		bool _hasReceived = false;
+		std::uint32_t _nextSeq = 0;
+		float _lossRate = 0;
+	};
+
+	// 損失率loss_rateのとき、同じ入力をk回送って全て落ちる確率 loss_rate^k が target_loss 以下になるkを選ぶ
+	inline std::size_t choose_redundancy(float loss_rate, std::size_t min_redundancy, std::size_t max_redundancy, float target_loss = 0.001f) noexcept
+	{
+		assert(0 < min_redundancy && min_redundancy <= max_redundancy);
+		if (loss_rate <= 0)
+			return min_redundancy;
+		if (1 <= loss_rate)
+			return max_redundancy;
+		auto k = static_cast<std::size_t>(std::ceil(std::log(target_loss) / std::log(loss_rate)));
+		return std::clamp(k, min_redundancy, max_redundancy);
+	}
+
+	template<class T, std::size_t Capacity>
+	class RedundantInputSender
+	{
+		struct Entry
+		{
+			GameTick _tick;
+			T _input;
+			std::chrono::steady_clock::time_point _pushedAt;
+		};
+	public:
+		using clock = std::chrono::steady_clock;
+
+		explicit RedundantInputSender(GameTick::value_type stride) noexcept
+			: _stride(stride)
+		{
+			assert(0 < stride);
+		}
+
+		// tickから始まる入力を積む. Tickは前に積んだ入力の続きであること
+		void Push(GameTick tick, const T& input, clock::time_point now)
+		{
+			assert(_unacked.empty() || tick == _unacked.back()._tick + GameTick{ _stride });
+			assert(!_unacked.full());
+			_unacked.emplace_back(Entry{ tick, input, now });
+		}
+
+		// 受信側がnext_tickより前の入力を全て受け取った
+		void Ack(GameTick next_tick) noexcept
+		{
+			while (!_unacked.empty() && _unacked.front()._tick + GameTick{ _stride } <= next_tick)
+			{
+				_unacked.pop_front();
+			}
+		}
+
+		// timeout以上ACKされない入力と、これ以上溜められない入力を fallback(GameTick, const T&) に渡して手放す
+		//  fallbackでは確実に届く経路(ストリーム)で送ること
+		template<class TFallback>
+		void CollectFallback(clock::time_point now, clock::duration timeout, TFallback&& fallback)
+		{
+			// 次のPushの分を空けておく
+			while (!_unacked.empty() && (timeout <= now - _unacked.front()._pushedAt || _unacked.full()))
+			{
+				auto entry = _unacked.pop_front();
+				fallback(entry._tick, entry._input);
+			}
+		}
+
+		// ACKされていない入力のうち新しい方からout.size()個までを古い順にoutに書き、先頭のTickと個数を返す
+		std::tuple<GameTick, std::size_t> CopyLatest(std::span<T> out) const
+		{
+			auto count = std::min(out.size(), _unacked.size());
+			auto first = static_cast<std::ptrdiff_t>(_unacked.size() - count);
+			for (std::size_t i = 0; i < count; i++)
+			{
+				out[i] = _unacked.at_from_head(first + static_cast<std::ptrdiff_t>(i))._input;
+			}
+			if (count == 0)
+				return { GameTick{ 0 }, 0 };
+			return { _unacked.at_from_head(first)._tick, count };
+		}
+
+		std::size_t UnackedCount() const noexcept
+		{
+			return _unacked.size();
+		}
+
+	private:
+		GameTick::value_type _stride;
+		RingBuffer<Entry, Capacity> _unacked;
+	};
+
+	template<class T, std::size_t Capacity>
+	class RedundantInputReceiver
+	{
+		struct Slot
+		{
+			GameTick _tick;
+			bool _received = false;
+			T _input;
+		};
+	public:
+		// first_tick: 最初に届くはずの入力のTick
+		RedundantInputReceiver(GameTick first_tick, GameTick::value_type stride) noexcept
+			: _nextTick(first_tick)
+			, _stride(stride)
+		{
+			assert(0 < stride);
+		}
+
+		// 届いた入力を受け取る. 新しく受け取ったらtrue. 受け取り済みのものや、先すぎて置けないものはfalse
+		//  同じ入力が冗長化やストリームでの再送で何度届いてもよい
+		bool Accept(GameTick tick, const T& input) noexcept
+		{
+			if (tick < _nextTick)
+				return false;
+			auto offset = (*tick - *_nextTick) / _stride;
+			if (Capacity <= offset)
+				return false;
+
+			auto& slot = _slots[slotIndex(tick)];
+			if (slot._received && slot._tick == tick)
+				return false;
+			slot = Slot{ tick, true, input };
+			return true;
+		}
+
+		// 先頭から連続して揃った入力を release(GameTick, const T&) に渡す
+		template<class TRelease>
+		void Release(TRelease&& release)
+		{
+			while (true)
+			{
+				auto& slot = _slots[slotIndex(_nextTick)];
+				if (!slot._received || slot._tick != _nextTick)
+					return;
+				slot._received = false;
+				release(slot._tick, slot._input);
+				_nextTick = _nextTick + GameTick{ _stride };
+			}
+		}
+
+		// 次に必要な入力のTick. これより前は全て受け取っているので、これをACKとして返す
+		GameTick GetNextTick() const noexcept
+		{
+			return _nextTick;
+		}
+
+	private:
+		std::size_t slotIndex(GameTick tick) const noexcept
+		{
+			return (*tick / _stride) % Capacity;
+		}
+
+		GameTick _nextTick;
+		GameTick::value_type _stride;
+		std::array<Slot, Capacity> _slots{};
+	};
+}
@@ -0,0 +1,257 @@
+﻿#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <array>
+#include <bit>
+#include <functional>
+#include <optional>
+#include <vector>
+
+#include <tofu/ecs/core.h>
+
+namespace tofu::net
+{
+	// ロールバック(予測)方式でゲームをStepするシステム
+	//  全プレイヤーの入力が揃うのを待たず、届いていない入力は予測して進める
+	//  過去Tickの入力が後から届き、予測が外れていたことが分かったら、そのTickのスナップショットまで巻き戻して再シミュレーションする
+	//
+	//  BufferSize: 保持するTick数 (巻き戻せる過去 + 先行して受け取れる未来). 2の冪であること
+	//  TSnapshot: 1Tick分のワールドの状態. 中身の保存・復元はRollback()に渡す関数が行う
+	template<class TSyncType, class TSnapshot, std::uint32_t BufferSize>
+	class RollbackSyncSystem
+	{
+		static_assert(std::has_single_bit(BufferSize), "BufferSize must be a power of two.");
+
+		struct Frame
+		{
+			// 確定した入力
+			std::vector<std::optional<TSyncType>> _confirmed;
+			// シミュレーションに実際に使った入力 (確定済み or 予測)
+			std::vector<TSyncType> _used;
+			// このTickをシミュレーションする直前のワールドの状態
+			TSnapshot _snapshot{};
+		};
+
+	public:
+		using predictor_type = std::function<TSyncType(const TSyncType& last)>;
+
+		// default_delay: 入力の遅延フレーム
+		// max_rollback: 巻き戻せる最大Tick数. これ以上古い入力が揃っていなければ、揃うまで待つ
+		// predictor: 最後に確定した入力から、まだ届いていない入力を予測する関数. 省略時は直前の入力を繰り返す
+		RollbackSyncSystem(std::size_t player_num, std::uint32_t default_delay, std::uint32_t max_rollback, predictor_type predictor = nullptr)
+			: _playerNum(player_num)
+			, _maxRollback(max_rollback)
+			, _predictor(std::move(predictor))
+			, _top(player_num)
+		{
+			assert(0 < max_rollback && max_rollback < BufferSize);
+			for (auto& frame : _frames)
+			{
+				frame._confirmed.resize(player_num);
+				frame._used.resize(player_num);
+			}
+			for (std::uint32_t i = 0; i < default_delay; i++)
+				for (std::size_t p = 0; p < player_num; p++)
+					frame(i)._confirmed[p] = TSyncType{};
+		}
+
+		// 現在のTickを(予測込みで)進めてよいか
+		//  max_rollback Tick前の入力が揃っていない場合は、進めるとそこまで巻き戻せなくなるので進めない
+		//  (それより前のTickは、このチェックを通ってきたので揃っている)
+		bool CanStep() const noexcept
+		{
+			if (_current < _maxRollback)
+				return true;
+			for (auto& data : frame(_current - _maxRollback)._confirmed)
+			{
+				if (!data)
+					return false;
+			}
+			return true;
+		}
+
+		// CanStep()を満たすために入力を待っているプレイヤーのビットマスク. 64人まで
+		std::uint64_t GetWaitingPlayers() const noexcept
+		{
+			std::uint64_t waiting = 0;
+			if (_current < _maxRollback)
+				return waiting;
+			auto& confirmed = frame(_current - _maxRollback)._confirmed;
+			for (std::size_t p = 0; p < _playerNum && p < 64; p++)
+			{
+				if (!confirmed[p])
+					waiting |= std::uint64_t{ 1 } << p;
+			}
+			return waiting;
+		}
+
+		// tick_after: 現在のTickからの相対Tick. 符号付きとして解釈するので、過去のTickも指定できる
+		bool HasData(GameTick tick_after, std::size_t player_id) const noexcept
+		{
+			auto tick = toAbsolute(tick_after);
+			assert(inWindow(tick));
+			return frame(tick)._confirmed[player_id].has_value();
+		}
+
+		// 現在のTickの入力. 届いていないものは予測で埋められている
+		const std::vector<std::optional<TSyncType>>& Top() const
+		{
+			for (std::size_t p = 0; p < _playerNum; p++)
+			{
+				_top[p] = input(_current, p);
+			}
+			return _top;
+		}
+
+		// max_rollback Tick前の確定した入力. まだそのTickがなければnullptr
+		//  CanStep()のときは全員分揃っていて、このTickまで巻き戻すことはもうないので、シミュレーションの結果も確定している
+		const std::vector<std::optional<TSyncType>>* Finalized() const noexcept
+		{
+			if (_current < _maxRollback)
+				return nullptr;
+			return &frame(_current - _maxRollback)._confirmed;
+		}
+
+		// 現在のTickを終え、使った入力を記録して次のTickへ進む
+		void Step()
+		{
+			auto& current = frame(_current);
+			for (std::size_t p = 0; p < _playerNum; p++)
+			{
+				current._used[p] = input(_current, p);
+			}
+
+			_current++;
+
+			// 窓から外れた最古のTickの枠を、新しく入ってくる最も未来のTick用に空ける
+			auto& reused = frame(_current + BufferSize - _maxRollback - 1);
+			for (auto& data : reused._confirmed)
+			{
+				data.reset();
+			}
+		}
+
+		// tick_after: 現在のTickからの相対Tick. 符号付きとして解釈するので、過去のTickも指定できる
+		//  シミュレーション済みのTickの入力で、使った予測と異なっていたら巻き戻しを予約する
+		void SetData(std::size_t player_id, GameTick tick_after, const TSyncType& data)
+		{
+			auto tick = toAbsolute(tick_after);
+			if (!inWindow(tick))
+			{
+				// 巻き戻せないほど古い入力. CanStep()が止めるので通常は来ない
+				assert(false);
+				return;
+			}
+
+			auto& target = frame(tick);
+			target._confirmed[player_id] = data;
+
+			if (tick < _current && !(target._used[player_id] == data))
+			{
+				if (!_rollbackFrom || tick < *_rollbackFrom)
+					_rollbackFrom = tick;
+			}
+		}
+
+		// 今シミュレーションするTickのスナップショットの格納先
+		//  シミュレーション前にここへ書き込んでおくこと
+		TSnapshot& CurrentSnapshot() noexcept
+		{
+			return frame(_current)._snapshot;
+		}
+		const TSnapshot& CurrentSnapshot() const noexcept
+		{
+			return frame(_current)._snapshot;
+		}
+
+		// 巻き戻しが必要か
+		bool NeedsRollback() const noexcept
+		{
+			return _rollbackFrom.has_value();
+		}
+
+		// 予測が外れていた最古のTickまで巻き戻し、現在のTickまで再シミュレーションする
+		//  restore(const TSnapshot&): ワールドをスナップショットの状態に戻す
+		//  save(TSnapshot&): 現在のワールドの状態をスナップショットに書き込む
+		//  simulate(): Top()の入力で1Tick分シミュレーションする (Step()は呼ばないこと)
+		//  再シミュレーションしたTick数を返す
+		template<class TRestore, class TSave, class TSimulate>
+		std::uint32_t Rollback(TRestore&& restore, TSave&& save, TSimulate&& simulate)
+		{
+			if (!_rollbackFrom)
+				return 0;
+
+			auto target = _current;
+			_current = *_rollbackFrom;
+			_rollbackFrom.reset();
+
+			restore(CurrentSnapshot());
+			std::uint32_t count = 0;
+			while (_current != target)
+			{
+				if (count != 0)
+					save(CurrentSnapshot());
+				simulate();
+				// Step()と違い、未来の枠は既に空けてあるので使った入力の記録だけ行う
+				auto& current = frame(_current);
+				for (std::size_t p = 0; p < _playerNum; p++)
+				{
+					current._used[p] = input(_current, p);
+				}
+				_current++;
+				count++;
+			}
+			return count;
+		}
+
+	private:
+		Frame& frame(std::uint32_t tick) noexcept
+		{
+			return _frames[tick & (BufferSize - 1)];
+		}
+		const Frame& frame(std::uint32_t tick) const noexcept
+		{
+			return _frames[tick & (BufferSize - 1)];
+		}
+
+		std::uint32_t toAbsolute(GameTick tick_after) const noexcept
+		{
+			return _current + static_cast<std::uint32_t>(static_cast<std::int32_t>(*tick_after));
+		}
+
+		// 過去 max_rollback Tick から、未来 BufferSize - max_rollback Tick までを保持する
+		bool inWindow(std::uint32_t tick) const noexcept
+		{
+			auto diff = static_cast<std::int32_t>(tick - _current);
+			return -static_cast<std::int32_t>(_maxRollback) <= diff && diff < static_cast<std::int32_t>(BufferSize - _maxRollback);
+		}
+
+		// 確定していればその入力を、していなければ予測した入力を返す
+		TSyncType input(std::uint32_t tick, std::size_t player_id) const
+		{
+			if (auto& data = frame(tick)._confirmed[player_id])
+				return *data;
+
+			// 直前のTickに使った入力から予測する. Tick 0の前は無いので既定値にする
+			//  (tick - 1 は最後の枠を指してしまい、そこには関係のないTickの入力が入っている)
+			if (tick == 0)
+				return TSyncType{};
+			auto prev = tick - 1;
+			const TSyncType& last = frame(prev)._confirmed[player_id] ? *frame(prev)._confirmed[player_id] : frame(prev)._used[player_id];
+			return _predictor ? _predictor(last) : last;
+		}
+
+		std::size_t _playerNum;
+		std::uint32_t _maxRollback;
+		predictor_type _predictor;
+
+		// シミュレーション中のTick (開始からのStep数)
+		std::uint32_t _current = 0;
+		std::optional<std::uint32_t> _rollbackFrom;
+
+		std::array<Frame, BufferSize> _frames;
+		mutable std::vector<std::optional<TSyncType>> _top;
+	};
+
+}
@@ -0,0 +1,181 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include <tofu/utils/bit_stream.h>
+#include <tofu/ecs/core.h>
+
+namespace tofu::net
+{
+	// 1Tick分の、同期するエンティティ全ての状態
+	//  状態は固定小数点に丸めた整数のフィールドで持つ. 丸めた値で比べるので、変わっていないものは送らずに済む
+	template<std::size_t FieldCount, std::size_t MaxEntities>
+	struct StateFrame
+	{
+		using Fields = std::array<std::int32_t, FieldCount>;
+		static constexpr std::size_t field_count = FieldCount;
+		static constexpr std::size_t max_entities = MaxEntities;
+
+		GameTick _tick = 0;
+		std::uint32_t _count = 0;
+		std::array<Fields, MaxEntities> _entities{};
+	};
+
+	// StateFrameを、相手が持っている過去のフレーム(基準)との差分として詰める
+	//  エンティティごとに変わったかを1ビットで書き、変わっていればフィールドごとに
+	//    変わったか(1ビット) + 差分のビット長(LengthBits) + zigzag符号化した差分
+	//  を書く. 基準がなければ、全フィールドが0のフレームを基準にする
+	//  1つのDATAGRAMに収まらないときのために、エンティティの範囲を区切って書ける. 区切った範囲はそれぞれ単独で読める
+	template<std::size_t FieldCount, std::size_t MaxEntities>
+	class StateDeltaCodec
+	{
+	public:
+		using Frame = StateFrame<FieldCount, MaxEntities>;
+		using Fields = typename Frame::Fields;
+
+		static constexpr unsigned LengthBits = 5;
+		// 差分をzigzag符号化してもLengthBitsで表せる31ビットに収まるよう、フィールドの値はこの範囲に丸める
+		static constexpr std::int32_t MaxValue = (1 << 29) - 1;
+		// 1エンティティを書くのに要る最大のビット数
+		static constexpr std::size_t MaxEntityBits = 1 + FieldCount * (1 + LengthBits + 31);
+
+		// scale分の1刻みの整数に丸める
+		static std::int32_t Quantize(float value, float scale) noexcept
+		{
+			auto scaled = std::round(static_cast<double>(value) * scale);
+			return static_cast<std::int32_t>(std::clamp(scaled, static_cast<double>(-MaxValue), static_cast<double>(MaxValue)));
+		}
+		static float Dequantize(std::int32_t value, float scale) noexcept
+		{
+			return static_cast<float>(value / static_cast<double>(scale));
+		}
+
+		// frameの[first, frame._count)のエンティティを、outに収まるだけ書く
+		//  baseは差分の基準. なければnullptr
+		struct EncodeResult
+		{
+			// 書いたエンティティの数. outがMaxEntityBits以上あれば、少なくとも1つは書ける
+			std::size_t _count;
+			// 書いたバイト数
+			std::size_t _size;
+		};
+		static EncodeResult Encode(const Frame* base, const Frame& frame, std::size_t first, std::span<std::byte> out) noexcept
+		{
+			assert(frame._count <= MaxEntities);
+			BitWriter writer{ out };
+			std::size_t bits = 0;
+			auto i = first;
+			for (; i < frame._count; i++)
+			{
+				auto& base_fields = baseFields(base, i);
+				auto& fields = frame._entities[i];
+				auto entity_bits = countBits(base_fields, fields);
+				if (out.size() * 8 < bits + entity_bits)
+					break;
+				bits += entity_bits;
+				[[maybe_unused]] auto written = writeEntity(writer, base_fields, fields);
+				assert(written);
+			}
+			return { i - first, writer.Finish() };
+		}
+
+		// Encodeで書いた[first, first + count)のエンティティを読み、frameに書き込む. 壊れていればfalse
+		//  frame._countは読む側で設定しておくこと
+		static bool Decode(const Frame* base, std::span<const std::byte> in, std::size_t first, std::size_t count, Frame& frame) noexcept
+		{
+			if (frame._count < first + count)
+				return false;
+			BitReader reader{ in };
+			for (auto i = first; i < first + count; i++)
+			{
+				auto& base_fields = baseFields(base, i);
+				auto& fields = frame._entities[i];
+				auto changed = reader.Read(1);
+				if (!changed)
+					return false;
+				fields = base_fields;
+				if (!*changed)
+					continue;
+
+				for (std::size_t f = 0; f < FieldCount; f++)
+				{
+					auto field_changed = reader.Read(1);
+					if (!field_changed)
+						return false;
+					if (!*field_changed)
+						continue;
+					auto length = reader.Read(LengthBits);
+					if (!length || *length == 0)
+						return false;
+					auto encoded = reader.Read(*length);
+					if (!encoded)
+						return false;
+					fields[f] = static_cast<std::int32_t>(static_cast<std::uint32_t>(base_fields[f]) + static_cast<std::uint32_t>(unzigzag(*encoded)));
+				}
+			}
+			return true;
+		}
+
+	private:
+		static const Fields& baseFields(const Frame* base, std::size_t index) noexcept
+		{
+			static constexpr Fields zero{};
+			if (!base || base->_count <= index)
+				return zero;
+			return base->_entities[index];
+		}
+
+		static std::uint32_t zigzag(std::int32_t value) noexcept
+		{
+			return (static_cast<std::uint32_t>(value) << 1) ^ static_cast<std::uint32_t>(value >> 31);
+		}
+		static std::int32_t unzigzag(std::uint32_t value) noexcept
+		{
+			return static_cast<std::int32_t>(value >> 1) ^ -static_cast<std::int32_t>(value & 1);
+		}
+
+		static std::size_t countBits(const Fields& base, const Fields& fields) noexcept
+		{
+			if (base == fields)
+				return 1;
+			std::size_t bits = 1;
+			for (std::size_t f = 0; f < FieldCount; f++)
+			{
+				bits += 1;
+				if (base[f] != fields[f])
+					bits += LengthBits + std::bit_width(zigzag(fields[f] - base[f]));
+			}
+			return bits;
+		}
+
+		static bool writeEntity(BitWriter& writer, const Fields& base, const Fields& fields) noexcept
+		{
+			if (base == fields)
+				return writer.Write(0, 1);
+			if (!writer.Write(1, 1))
+				return false;
+			for (std::size_t f = 0; f < FieldCount; f++)
+			{
+				if (base[f] == fields[f])
+				{
+					if (!writer.Write(0, 1))
+						return false;
+					continue;
+				}
+				auto encoded = zigzag(fields[f] - base[f]);
+				auto length = static_cast<unsigned>(std::bit_width(encoded));
+				assert(length < (1u << LengthBits));
+				if (!writer.Write(1, 1) || !writer.Write(length, LengthBits) || !writer.Write(encoded, length))
+					return false;
+			}
+			return true;
+		}
+	};
+}
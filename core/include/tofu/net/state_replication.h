@@ -0,0 +1,249 @@
+﻿#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+#include <tofu/ecs/core.h>
+#include <tofu/net/state_delta.h>
+
+namespace tofu::net
+{
+	// 最近のTickのフレームを、Tickで引けるように保持する
+	//  TFrameは_tickを持つこと. Sizeは2の冪で、Size Tick前のフレームは新しいフレームで上書きされる
+	template<class TFrame, std::uint32_t Size>
+	class StateHistory
+	{
+		static_assert(std::has_single_bit(Size), "Size must be a power of two.");
+
+	public:
+		void Push(const TFrame& frame) noexcept
+		{
+			_frames[slot(frame._tick)] = frame;
+		}
+
+		// tickのフレーム. もう上書きされていれば(まだ無ければ)nullptr
+		TFrame* Find(GameTick tick) noexcept
+		{
+			auto& frame = _frames[slot(tick)];
+			return frame && frame->_tick == tick ? &*frame : nullptr;
+		}
+		const TFrame* Find(GameTick tick) const noexcept
+		{
+			auto& frame = _frames[slot(tick)];
+			return frame && frame->_tick == tick ? &*frame : nullptr;
+		}
+
+		void Clear(GameTick tick) noexcept
+		{
+			_frames[slot(tick)].reset();
+		}
+
+	private:
+		static std::size_t slot(GameTick tick) noexcept
+		{
+			return *tick & (Size - 1);
+		}
+
+		std::array<std::optional<TFrame>, Size> _frames;
+	};
+
+	// 状態を配る側で、送ったフレームと、相手ごとにACKされた最新のフレームを管理する
+	//  ACKされたフレームは相手が必ず持っているので、差分の基準にできる
+	template<class TFrame, std::uint32_t HistorySize, std::size_t MaxPeers>
+	class StateBaselines
+	{
+	public:
+		// 今Tickのフレームを記録する. ゲームスレッドから呼ぶ
+		void Push(const TFrame& frame) noexcept
+		{
+			_history.Push(frame);
+		}
+
+		// peerがtickのフレームを全て受け取った. どのスレッドから呼んでもよい
+		//  DATAGRAMで届くので順番が入れ替わることがある. 古いACKは無視する
+		void Ack(std::size_t peer, GameTick tick) noexcept
+		{
+			assert(peer < MaxPeers);
+			auto& acked = _acked[peer];
+			// 0はACKなしを表すので、Tickに1足して持つ
+			auto value = *tick + 1;
+			auto current = acked.load(std::memory_order_relaxed);
+			while (current < value && !acked.compare_exchange_weak(current, value, std::memory_order_relaxed))
+			{
+			}
+		}
+
+		// peerが入れ替わった. 新しい相手は何も持っていないので、次は全体を送る
+		void Reset(std::size_t peer) noexcept
+		{
+			assert(peer < MaxPeers);
+			_acked[peer].store(0, std::memory_order_relaxed);
+		}
+
+		std::optional<GameTick> GetAckedTick(std::size_t peer) const noexcept
+		{
+			assert(peer < MaxPeers);
+			auto value = _acked[peer].load(std::memory_order_relaxed);
+			if (value == 0)
+				return std::nullopt;
+			return GameTick{ value - 1 };
+		}
+
+		// peerに送る差分の基準. ACKされていないか、ACKされたフレームがもう残っていなければnullptr (全体を送る)
+		const TFrame* GetBaseline(std::size_t peer) const noexcept
+		{
+			auto tick = GetAckedTick(peer);
+			if (!tick)
+				return nullptr;
+			return _history.Find(*tick);
+		}
+
+	private:
+		StateHistory<TFrame, HistorySize> _history;
+		std::array<std::atomic<GameTick::value_type>, MaxPeers> _acked{};
+	};
+
+	// 状態を受け取る側で、区切って届いたフレームを組み立て、揃ったフレームを補間して取り出す
+	template<class TFrame, std::uint32_t HistorySize>
+	class StateReceiver
+	{
+		using Codec = StateDeltaCodec<TFrame::field_count, TFrame::max_entities>;
+		static_assert(TFrame::max_entities <= 64);
+
+		struct Entry
+		{
+			GameTick _tick;
+			TFrame _frame;
+			// 届いたエンティティのビット
+			std::uint64_t _received = 0;
+
+			bool IsComplete() const noexcept
+			{
+				return _received == all(_frame._count);
+			}
+		};
+
+		static constexpr std::uint64_t all(std::size_t count) noexcept
+		{
+			return count == 64 ? ~std::uint64_t{ 0 } : (std::uint64_t{ 1 } << count) - 1;
+		}
+
+	public:
+		// tickのフレームのうち、[first, first + count)のエンティティを詰めたdataを読む
+		//  base_tickは差分の基準. 基準が手元に揃っていなければ読めないので捨てる. 壊れていても捨てる
+		//  読めたらtrue
+		bool Receive(GameTick tick, std::optional<GameTick> base_tick, std::size_t entity_count, std::size_t first, std::size_t count, std::span<const std::byte> data) noexcept
+		{
+			if (TFrame::max_entities < entity_count || entity_count < first + count)
+				return false;
+			// 揃ったフレームより古いものは、もう使わない
+			if (_latest && tick <= *_latest)
+				return false;
+
+			const TFrame* base = nullptr;
+			if (base_tick)
+			{
+				base = Find(*base_tick);
+				if (!base)
+					return false;
+				// 組み立てるフレームと基準が同じ場所に入ると、組み立て始めた時点で基準を追い出してしまう
+				//  読めずに捨てれば、ACKが返らないので送り手が全体を送り直す
+				if (!_entries.Find(tick) && ((*tick - **base_tick) & (HistorySize - 1)) == 0)
+					return false;
+			}
+
+			auto entry = _entries.Find(tick);
+			if (!entry)
+			{
+				Entry created;
+				created._tick = tick;
+				created._frame._tick = tick;
+				created._frame._count = static_cast<std::uint32_t>(entity_count);
+				_entries.Push(created);
+				entry = _entries.Find(tick);
+			}
+			if (entry->_frame._count != entity_count)
+				return false;
+
+			auto mask = all(first + count) & ~all(first);
+			if ((entry->_received & mask) == mask)
+				return true;
+			if (!Codec::Decode(base, data, first, count, entry->_frame))
+			{
+				// 途中まで書き込んでいるかもしれないので、その範囲は届いていないことにする
+				entry->_received &= ~mask;
+				return false;
+			}
+			entry->_received |= mask;
+			if (entry->IsComplete())
+				_latest = tick;
+			return true;
+		}
+
+		// 揃った最新のフレームのTick
+		std::optional<GameTick> GetLatestTick() const noexcept
+		{
+			return _latest;
+		}
+
+		// 揃ったフレーム. 無ければnullptr
+		const TFrame* Find(GameTick tick) const noexcept
+		{
+			auto entry = _entries.Find(tick);
+			return entry && entry->IsComplete() ? &entry->_frame : nullptr;
+		}
+
+		// tick(小数も可)の状態を、前後の揃ったフレームから線形補間してoutに書く
+		//  前後どちらかにしかフレームが無ければ、近い方をそのまま使う. 揃ったフレームが1つも無ければfalse
+		bool Sample(double tick, TFrame& out) const noexcept
+		{
+			if (!_latest)
+				return false;
+
+			const TFrame* before = nullptr;
+			const TFrame* after = nullptr;
+			for (std::uint32_t i = 0; i < HistorySize; i++)
+			{
+				auto frame = Find(*_latest - GameTick{ i });
+				if (!frame)
+					continue;
+				if (static_cast<double>(*frame->_tick) <= tick)
+				{
+					before = frame;
+					break;
+				}
+				after = frame;
+			}
+
+			if (!before || !after)
+			{
+				out = before ? *before : *after;
+				return true;
+			}
+
+			auto t = (tick - *before->_tick) / static_cast<double>(*after->_tick - *before->_tick);
+			out = *before;
+			for (std::size_t e = 0; e < before->_count && e < after->_count; e++)
+			{
+				for (std::size_t f = 0; f < TFrame::field_count; f++)
+				{
+					auto from = before->_entities[e][f];
+					auto to = after->_entities[e][f];
+					out._entities[e][f] = static_cast<std::int32_t>(from + std::llround((static_cast<double>(to) - from) * t));
+				}
+			}
+			return true;
+		}
+
+	private:
+		StateHistory<Entry, HistorySize> _entries;
+		std::optional<GameTick> _latest;
+	};
+}
@@ -0,0 +1,581 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+namespace tofu::net
+{
+	// 通信するメッセージを、構造体の並びやパディングに依らないバイト列に書く
+	//  整数はリトルエンディアン. 可変長整数はLEB128 (符号付きはzigzag符号化してから)
+	//  WriteBitsで書いたビットは、次にバイト単位の値を書くまで同じバイトに詰める
+	class WireWriter
+	{
+	public:
+		explicit WireWriter(std::span<std::byte> buffer) noexcept
+			: _buffer(buffer)
+		{
+		}
+
+		template<std::unsigned_integral T>
+		void WriteFixed(T value) noexcept
+		{
+			FlushBits();
+			if (!Reserve(sizeof(T)))
+				return;
+			for (std::size_t i = 0; i < sizeof(T); i++)
+			{
+				_buffer[_position++] = static_cast<std::byte>(value >> (i * 8) & 0xff);
+			}
+		}
+
+		void WriteVarUint(std::uint64_t value) noexcept
+		{
+			FlushBits();
+			do
+			{
+				if (!Reserve(1))
+					return;
+				auto byte = static_cast<std::uint8_t>(value & 0x7f);
+				value >>= 7;
+				_buffer[_position++] = static_cast<std::byte>(value != 0 ? byte | 0x80 : byte);
+			} while (value != 0);
+		}
+
+		void WriteVarInt(std::int64_t value) noexcept
+		{
+			WriteVarUint((static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63));
+		}
+
+		// valueの下位bitsビットを書く
+		void WriteBits(std::uint32_t value, unsigned bits) noexcept
+		{
+			assert(bits <= 32);
+			assert(bits == 32 || value < (std::uint64_t{ 1 } << bits));
+			_bits |= static_cast<std::uint64_t>(value) << _bitCount;
+			_bitCount += bits;
+			while (8 <= _bitCount)
+			{
+				if (!Reserve(1))
+					return;
+				_buffer[_position++] = static_cast<std::byte>(_bits & 0xff);
+				_bits >>= 8;
+				_bitCount -= 8;
+			}
+		}
+
+		void WriteBytes(std::span<const std::byte> bytes) noexcept
+		{
+			FlushBits();
+			if (!Reserve(bytes.size()))
+				return;
+			std::memcpy(_buffer.data() + _position, bytes.data(), bytes.size());
+			_position += bytes.size();
+		}
+
+		// 端数のビットを書き出し、書いたバイト数を返す. バッファに収まらなかったら0
+		std::size_t Finish() noexcept
+		{
+			FlushBits();
+			return _overflow ? 0 : _position;
+		}
+
+		// バッファに収まらなかった
+		bool HasOverflowed() const noexcept
+		{
+			return _overflow;
+		}
+
+	private:
+		bool Reserve(std::size_t size) noexcept
+		{
+			if (_overflow || _buffer.size() < _position + size)
+			{
+				_overflow = true;
+				return false;
+			}
+			return true;
+		}
+
+		void FlushBits() noexcept
+		{
+			if (_bitCount == 0)
+				return;
+			if (Reserve(1))
+				_buffer[_position++] = static_cast<std::byte>(_bits & 0xff);
+			_bits = 0;
+			_bitCount = 0;
+		}
+
+		std::span<std::byte> _buffer;
+		std::size_t _position = 0;
+		bool _overflow = false;
+
+		std::uint64_t _bits = 0;
+		unsigned _bitCount = 0;
+	};
+
+	// WireWriterで書いたバイト列を、受け取ったバッファの上でそのまま読む
+	//  どれも終わりを越えたり、値が壊れていたりすればnullopt
+	class WireReader
+	{
+	public:
+		explicit WireReader(std::span<const std::byte> buffer) noexcept
+			: _buffer(buffer)
+		{
+		}
+
+		template<std::unsigned_integral T>
+		std::optional<T> ReadFixed() noexcept
+		{
+			DropBits();
+			if (Remaining() < sizeof(T))
+				return std::nullopt;
+			T value = 0;
+			for (std::size_t i = 0; i < sizeof(T); i++)
+			{
+				value |= static_cast<T>(static_cast<T>(std::to_integer<std::uint8_t>(_buffer[_position++])) << (i * 8));
+			}
+			return value;
+		}
+
+		std::optional<std::uint64_t> ReadVarUint() noexcept
+		{
+			DropBits();
+			std::uint64_t value = 0;
+			for (unsigned shift = 0; shift < 64; shift += 7)
+			{
+				if (Remaining() == 0)
+					return std::nullopt;
+				auto byte = std::to_integer<std::uint8_t>(_buffer[_position++]);
+				value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+				if ((byte & 0x80) == 0)
+					return value;
+			}
+			// 10バイト目にも続きがある
+			return std::nullopt;
+		}
+
+		std::optional<std::int64_t> ReadVarInt() noexcept
+		{
+			auto value = ReadVarUint();
+			if (!value)
+				return std::nullopt;
+			return static_cast<std::int64_t>(*value >> 1) ^ -static_cast<std::int64_t>(*value & 1);
+		}
+
+		std::optional<std::uint32_t> ReadBits(unsigned bits) noexcept
+		{
+			assert(bits <= 32);
+			while (_bitCount < bits)
+			{
+				if (Remaining() == 0)
+					return std::nullopt;
+				_bits |= static_cast<std::uint64_t>(std::to_integer<std::uint8_t>(_buffer[_position++])) << _bitCount;
+				_bitCount += 8;
+			}
+			auto value = static_cast<std::uint32_t>(_bits & ((std::uint64_t{ 1 } << bits) - 1));
+			_bits >>= bits;
+			_bitCount -= bits;
+			return value;
+		}
+
+		// sizeバイトを、コピーせずに受け取ったバッファの一部として返す
+		std::optional<std::span<const std::byte>> ReadBytes(std::size_t size) noexcept
+		{
+			DropBits();
+			if (Remaining() < size)
+				return std::nullopt;
+			auto bytes = _buffer.subspan(_position, size);
+			_position += size;
+			return bytes;
+		}
+
+		std::size_t Remaining() const noexcept
+		{
+			return _buffer.size() - _position;
+		}
+
+	private:
+		// WireWriterが端数のビットを書き出すのに合わせ、読み残したビットを捨てる
+		void DropBits() noexcept
+		{
+			_bits = 0;
+			_bitCount = 0;
+		}
+
+		std::span<const std::byte> _buffer;
+		std::size_t _position = 0;
+
+		std::uint64_t _bits = 0;
+		unsigned _bitCount = 0;
+	};
+
+	// メッセージのメンバーをどう書くかの記述子. 構造体に
+	//   using wire_schema = WireSchema<wire::Var<&T::_tick>, wire::Fixed<&T::_player>, ...>;
+	//  と並べた順に書く. 書かないメンバーは読んでも既定値のまま
+	//  整数として書けるのは、整数・列挙型・bool・StrongNumeric
+	namespace wire
+	{
+		// リトルエンディアンの固定長. 大きな値になりやすいもの (時刻やハッシュ) に使う
+		template<auto Member>
+		struct Fixed
+		{
+		};
+		// 可変長整数. 小さな値が多いもの (Tickや数) に使う
+		template<auto Member>
+		struct Var
+		{
+		};
+		// 下位BitCountビットだけを書く. 続くBitsと同じバイトに詰める. 符号なしの値かboolに使う
+		template<auto Member, unsigned BitCount>
+		struct Bits
+		{
+		};
+		// char配列の文字列. 終端の0までを長さ付きで書く
+		template<auto Member>
+		struct String
+		{
+		};
+		// std::array<std::byte, N>のうち、先頭からSizeMemberバイトを長さ付きで書く. SizeMemberは読むときに設定される
+		template<auto Member, auto SizeMember>
+		struct Bytes
+		{
+		};
+		// std::arrayのうち、先頭からCountMember個を固定長で書く. CountMemberはこれより前に書いておくこと
+		template<auto Member, auto CountMember>
+		struct Array
+		{
+		};
+		// wire_schemaを持つメンバーを、その記述の通りに書く
+		template<auto Member>
+		struct Nested
+		{
+		};
+	}
+
+	namespace wire_detail
+	{
+		template<class T>
+		struct member_type;
+		template<class TClass, class TMember>
+		struct member_type<TMember TClass::*>
+		{
+			using type = TMember;
+		};
+		template<auto Member>
+		using member_type_t = typename member_type<decltype(Member)>::type;
+
+		template<class T>
+		concept strong_numeric = requires(const T& value) {
+			typename T::value_type;
+			{ *value } -> std::same_as<typename T::value_type>;
+		} && std::is_constructible_v<T, typename T::value_type>;
+
+		// 整数として書くときの型
+		template<class T>
+		struct integer
+		{
+			using type = T;
+		};
+		template<class T>
+			requires std::is_enum_v<T>
+		struct integer<T>
+		{
+			using type = std::underlying_type_t<T>;
+		};
+		template<>
+		struct integer<bool>
+		{
+			using type = std::uint8_t;
+		};
+		template<strong_numeric T>
+		struct integer<T>
+		{
+			using type = typename T::value_type;
+		};
+		template<class T>
+		using integer_t = typename integer<T>::type;
+
+		template<class T>
+		integer_t<T> to_integer(const T& value) noexcept
+		{
+			if constexpr (strong_numeric<T>)
+				return *value;
+			else
+				return static_cast<integer_t<T>>(value);
+		}
+		template<class T>
+		T from_integer(integer_t<T> value) noexcept
+		{
+			if constexpr (strong_numeric<T>)
+				return T{ value };
+			else
+				return static_cast<T>(value);
+		}
+
+		// 読んだ整数がTに収まらなければfalse
+		template<class T, class TValue>
+		bool narrow(TValue value, T& out) noexcept
+		{
+			using I = integer_t<T>;
+			if constexpr (std::is_same_v<T, bool>)
+			{
+				if (1 < value)
+					return false;
+			}
+			else if (!std::in_range<I>(value))
+			{
+				return false;
+			}
+			out = from_integer<T>(static_cast<I>(value));
+			return true;
+		}
+
+		constexpr std::size_t var_size(std::size_t bits) noexcept
+		{
+			return (bits + 6) / 7;
+		}
+
+		template<class T>
+		struct array_traits;
+		template<class T, std::size_t N>
+		struct array_traits<std::array<T, N>>
+		{
+			using element_type = T;
+			static constexpr std::size_t size = N;
+		};
+
+		// === 書く
+		template<class T, auto Member>
+		void encode(WireWriter& writer, const T& value, wire::Fixed<Member>) noexcept
+		{
+			using I = integer_t<member_type_t<Member>>;
+			writer.WriteFixed(static_cast<std::make_unsigned_t<I>>(to_integer(value.*Member)));
+		}
+		template<class T, auto Member>
+		void encode(WireWriter& writer, const T& value, wire::Var<Member>) noexcept
+		{
+			using I = integer_t<member_type_t<Member>>;
+			if constexpr (std::is_signed_v<I>)
+				writer.WriteVarInt(to_integer(value.*Member));
+			else
+				writer.WriteVarUint(to_integer(value.*Member));
+		}
+		template<class T, auto Member, unsigned BitCount>
+		void encode(WireWriter& writer, const T& value, wire::Bits<Member, BitCount>) noexcept
+		{
+			static_assert(std::is_unsigned_v<integer_t<member_type_t<Member>>> && BitCount <= 32);
+			writer.WriteBits(static_cast<std::uint32_t>(to_integer(value.*Member)), BitCount);
+		}
+		template<class T, auto Member>
+		void encode(WireWriter& writer, const T& value, wire::String<Member>) noexcept
+		{
+			auto& text = value.*Member;
+			auto size = strnlen(text, std::size(text));
+			writer.WriteVarUint(size);
+			writer.WriteBytes(std::as_bytes(std::span{ text, size }));
+		}
+		template<class T, auto Member, auto SizeMember>
+		void encode(WireWriter& writer, const T& value, wire::Bytes<Member, SizeMember>) noexcept
+		{
+			auto& bytes = value.*Member;
+			auto size = static_cast<std::size_t>(value.*SizeMember);
+			assert(size <= bytes.size());
+			writer.WriteVarUint(size);
+			writer.WriteBytes(std::span{ bytes }.first(std::min(size, bytes.size())));
+		}
+		template<class T, auto Member, auto CountMember>
+		void encode(WireWriter& writer, const T& value, wire::Array<Member, CountMember>) noexcept
+		{
+			using E = typename array_traits<member_type_t<Member>>::element_type;
+			auto& elements = value.*Member;
+			auto count = std::min(static_cast<std::size_t>(value.*CountMember), elements.size());
+			for (std::size_t i = 0; i < count; i++)
+			{
+				writer.WriteFixed(static_cast<std::make_unsigned_t<integer_t<E>>>(to_integer(elements[i])));
+			}
+		}
+		template<class T, auto Member>
+		void encode(WireWriter& writer, const T& value, wire::Nested<Member>) noexcept
+		{
+			member_type_t<Member>::wire_schema::Encode(writer, value.*Member);
+		}
+
+		// === 読む
+		template<class T, auto Member>
+		bool decode(WireReader& reader, T& value, wire::Fixed<Member>) noexcept
+		{
+			using M = member_type_t<Member>;
+			using I = integer_t<M>;
+			auto read = reader.ReadFixed<std::make_unsigned_t<I>>();
+			if (!read)
+				return false;
+			if constexpr (std::is_same_v<M, bool>)
+				return narrow(*read, value.*Member);
+			value.*Member = from_integer<M>(static_cast<I>(*read));
+			return true;
+		}
+		template<class T, auto Member>
+		bool decode(WireReader& reader, T& value, wire::Var<Member>) noexcept
+		{
+			using I = integer_t<member_type_t<Member>>;
+			if constexpr (std::is_signed_v<I>)
+			{
+				auto read = reader.ReadVarInt();
+				return read && narrow(*read, value.*Member);
+			}
+			else
+			{
+				auto read = reader.ReadVarUint();
+				return read && narrow(*read, value.*Member);
+			}
+		}
+		template<class T, auto Member, unsigned BitCount>
+		bool decode(WireReader& reader, T& value, wire::Bits<Member, BitCount>) noexcept
+		{
+			auto read = reader.ReadBits(BitCount);
+			return read && narrow(*read, value.*Member);
+		}
+		template<class T, auto Member>
+		bool decode(WireReader& reader, T& value, wire::String<Member>) noexcept
+		{
+			auto& text = value.*Member;
+			auto size = reader.ReadVarUint();
+			if (!size || std::size(text) < *size)
+				return false;
+			auto bytes = reader.ReadBytes(*size);
+			if (!bytes)
+				return false;
+			std::memset(text, 0, sizeof(text));
+			std::memcpy(text, bytes->data(), bytes->size());
+			return true;
+		}
+		template<class T, auto Member, auto SizeMember>
+		bool decode(WireReader& reader, T& value, wire::Bytes<Member, SizeMember>) noexcept
+		{
+			auto& out = value.*Member;
+			auto size = reader.ReadVarUint();
+			if (!size || out.size() < *size || !narrow(*size, value.*SizeMember))
+				return false;
+			auto bytes = reader.ReadBytes(*size);
+			if (!bytes)
+				return false;
+			std::memcpy(out.data(), bytes->data(), bytes->size());
+			return true;
+		}
+		template<class T, auto Member, auto CountMember>
+		bool decode(WireReader& reader, T& value, wire::Array<Member, CountMember>) noexcept
+		{
+			using E = typename array_traits<member_type_t<Member>>::element_type;
+			auto& elements = value.*Member;
+			auto count = static_cast<std::size_t>(value.*CountMember);
+			if (elements.size() < count)
+				return false;
+			for (std::size_t i = 0; i < count; i++)
+			{
+				auto read = reader.ReadFixed<std::make_unsigned_t<integer_t<E>>>();
+				if (!read)
+					return false;
+				elements[i] = from_integer<E>(static_cast<integer_t<E>>(*read));
+			}
+			return true;
+		}
+		template<class T, auto Member>
+		bool decode(WireReader& reader, T& value, wire::Nested<Member>) noexcept
+		{
+			return member_type_t<Member>::wire_schema::Decode(reader, value.*Member);
+		}
+
+		// === 書いたときの最大の大きさ. Bitsは詰めずに数えるので、実際より大きめになる
+		template<auto Member>
+		constexpr std::size_t max_size(wire::Fixed<Member>) noexcept
+		{
+			return sizeof(integer_t<member_type_t<Member>>);
+		}
+		template<auto Member>
+		constexpr std::size_t max_size(wire::Var<Member>) noexcept
+		{
+			return var_size(sizeof(integer_t<member_type_t<Member>>) * 8 + 1);
+		}
+		template<auto Member, unsigned BitCount>
+		constexpr std::size_t max_size(wire::Bits<Member, BitCount>) noexcept
+		{
+			return (BitCount + 7) / 8;
+		}
+		template<auto Member>
+		constexpr std::size_t max_size(wire::String<Member>) noexcept
+		{
+			constexpr auto size = std::extent_v<member_type_t<Member>>;
+			return var_size(std::bit_width(size)) + size;
+		}
+		template<auto Member, auto SizeMember>
+		constexpr std::size_t max_size(wire::Bytes<Member, SizeMember>) noexcept
+		{
+			constexpr auto size = array_traits<member_type_t<Member>>::size;
+			return var_size(std::bit_width(size)) + size;
+		}
+		template<auto Member, auto CountMember>
+		constexpr std::size_t max_size(wire::Array<Member, CountMember>) noexcept
+		{
+			using traits = array_traits<member_type_t<Member>>;
+			return traits::size * sizeof(integer_t<typename traits::element_type>);
+		}
+		template<auto Member>
+		constexpr std::size_t max_size(wire::Nested<Member>) noexcept
+		{
+			return member_type_t<Member>::wire_schema::MaxSize;
+		}
+	}
+
+	// メンバーの書き方を並べたもの. 並べた順に書き、同じ順に読む
+	template<class... TFields>
+	struct WireSchema
+	{
+		// 書いたときの最大の大きさ. バッファの大きさを決めるのに使う
+		static constexpr std::size_t MaxSize = (wire_detail::max_size(TFields{}) + ... + 0);
+
+		template<class T>
+		static void Encode(WireWriter& writer, const T& value) noexcept
+		{
+			(wire_detail::encode(writer, value, TFields{}), ...);
+		}
+		// 壊れていればfalse. 途中まで読んだメンバーは書き換わっている
+		template<class T>
+		static bool Decode(WireReader& reader, T& value) noexcept
+		{
+			return (wire_detail::decode(reader, value, TFields{}) && ...);
+		}
+	};
+
+	template<class T>
+	concept WireSerializable = requires {
+		T::wire_schema::MaxSize;
+	};
+
+	// valueをoutに書き、書いたバイト数を返す. 収まらなければ0
+	template<WireSerializable T>
+	std::size_t wire_encode(const T& value, std::span<std::byte> out) noexcept
+	{
+		WireWriter writer{ out };
+		T::wire_schema::Encode(writer, value);
+		return writer.Finish();
+	}
+
+	// bytesをちょうど全て読んでvalueにする. 足りない・余る・値が壊れていればfalse
+	template<WireSerializable T>
+	bool wire_decode(std::span<const std::byte> bytes, T& value) noexcept
+	{
+		WireReader reader{ bytes };
+		return T::wire_schema::Decode(reader, value) && reader.Remaining() == 0;
+	}
+}
@@ -0,0 +1,152 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <tofu/utils/error.h>
+
+namespace tofu
+{
+    // ファイルへの追記を別スレッドで行うクラス
+    //  Write()はメモリ上のバッファに積むだけなので、ゲームスレッドをディスクの書き込みで止めずに済む
+    //  積んだデータはFlushIntervalごと、FlushSize以上溜まったとき、Flush()・Close()のときに書き出される
+    class BackgroundFileWriter
+    {
+    public:
+        static constexpr std::chrono::milliseconds FlushInterval{ 100 };
+        static constexpr std::size_t FlushSize = 64 * 1024;
+
+        BackgroundFileWriter() = default;
+        ~BackgroundFileWriter()
+        {
+            Close();
+        }
+
+        // コピー・ムーブ禁止
+        BackgroundFileWriter(const BackgroundFileWriter&) = delete;
+        BackgroundFileWriter& operator=(const BackgroundFileWriter&) = delete;
+
+        // ファイルを作り直し、書き込みスレッドを始める
+        Error Open(const std::string& path)
+        {
+            Close();
+            _file.open(path, std::ios::binary | std::ios::trunc);
+            if (!_file)
+                return TOFU_MAKE_ERROR("Failed to open file. path=({})", path);
+
+            _end = false;
+            _failed = false;
+            _thread = std::thread{ [this]() { Entrypoint(); } };
+            return std::nullopt;
+        }
+
+        bool IsOpen() const noexcept
+        {
+            return _thread.joinable();
+        }
+
+        // 書き込みに失敗したことがあるか. 失敗した後に積んだデータは失われる
+        bool HasFailed() const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _failed;
+        }
+
+        // dataを末尾に積む. どのスレッドから呼んでもよい
+        void Write(std::span<const std::byte> data)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _pending.insert(_pending.end(), data.begin(), data.end());
+            if (FlushSize <= _pending.size())
+                _cv.notify_one();
+        }
+        template<class T>
+        void WriteValue(const T& value)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            Write(std::as_bytes(std::span{ &value, 1 }));
+        }
+
+        // それまでに積んだデータがファイルに書き出されるまで待つ
+        void Flush()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (!IsOpen())
+                return;
+            _flushRequested = true;
+            _cv.notify_one();
+            _flushedCv.wait(lock, [this] { return _pending.empty() && !_writing; });
+        }
+
+        // 残りを書き出してファイルを閉じる
+        void Close()
+        {
+            if (!IsOpen())
+                return;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _end = true;
+                _cv.notify_one();
+            }
+            _thread.join();
+            _file.close();
+        }
+
+    private:
+        void Entrypoint()
+        {
+            // 積む側を待たせないよう、積まれたバッファと交換してからロックの外で書く
+            std::vector<std::byte> buffer;
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (true)
+            {
+                _cv.wait_for(lock, FlushInterval, [this] { return _end || _flushRequested || FlushSize <= _pending.size(); });
+                _flushRequested = false;
+                buffer.swap(_pending);
+                _writing = true;
+                auto end = _end;
+                lock.unlock();
+
+                auto ok = true;
+                if (!buffer.empty())
+                {
+                    _file.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+                    _file.flush();
+                    ok = static_cast<bool>(_file);
+                    buffer.clear();
+                }
+
+                lock.lock();
+                _writing = false;
+                _failed = _failed || !ok;
+                _flushedCv.notify_all();
+                if (end && _pending.empty())
+                    break;
+            }
+        }
+
+        std::ofstream _file;
+        std::thread _thread;
+
+        mutable std::mutex _mutex;
+        // 書き込みスレッドを起こす
+        std::condition_variable _cv;
+        // 書き出し終えたことをFlush()に知らせる
+        std::condition_variable _flushedCv;
+
+        // 以下は_mutexで守る
+        std::vector<std::byte> _pending;
+        bool _writing = false;
+        bool _flushRequested = false;
+        bool _end = false;
+        bool _failed = false;
+    };
+}
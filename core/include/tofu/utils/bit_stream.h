@@ -0,0 +1,94 @@
+﻿#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+namespace tofu
+{
+    // 固定長のバッファに、値を必要なビット数だけ詰めて書き込む
+    //  下位ビットから順に詰める. 書き終えたらFinishで端数のビットを書き出すこと
+    class BitWriter
+    {
+    public:
+        explicit BitWriter(std::span<std::byte> buffer) noexcept
+            : _buffer(buffer)
+        {
+        }
+
+        // valueの下位bitsビットを書き込む. バッファに収まらなければfalse
+        bool Write(std::uint32_t value, unsigned bits) noexcept
+        {
+            assert(bits <= 32);
+            assert(bits == 32 || value < (std::uint64_t{ 1 } << bits));
+            if (_buffer.size() * 8 < (_position + _accumulatedBits) + bits)
+                return false;
+
+            _accumulator |= static_cast<std::uint64_t>(value) << _accumulatedBits;
+            _accumulatedBits += bits;
+            while (8 <= _accumulatedBits)
+            {
+                _buffer[_position / 8] = static_cast<std::byte>(_accumulator & 0xff);
+                _accumulator >>= 8;
+                _accumulatedBits -= 8;
+                _position += 8;
+            }
+            return true;
+        }
+
+        // 端数のビットを書き出し、書いたバイト数を返す
+        std::size_t Finish() noexcept
+        {
+            if (0 < _accumulatedBits)
+            {
+                _buffer[_position / 8] = static_cast<std::byte>(_accumulator & 0xff);
+                _position += 8;
+                _accumulator = 0;
+                _accumulatedBits = 0;
+            }
+            return _position / 8;
+        }
+
+    private:
+        std::span<std::byte> _buffer;
+        // 書き出し済みのビット数. 常に8の倍数
+        std::size_t _position = 0;
+        std::uint64_t _accumulator = 0;
+        unsigned _accumulatedBits = 0;
+    };
+
+    // BitWriterで書いたバッファから値を読む
+    class BitReader
+    {
+    public:
+        explicit BitReader(std::span<const std::byte> buffer) noexcept
+            : _buffer(buffer)
+        {
+        }
+
+        // bitsビット読む. バッファの終わりを越えたらnullopt
+        std::optional<std::uint32_t> Read(unsigned bits) noexcept
+        {
+            assert(bits <= 32);
+            while (_accumulatedBits < bits)
+            {
+                if (_buffer.size() <= _position)
+                    return std::nullopt;
+                _accumulator |= static_cast<std::uint64_t>(_buffer[_position++]) << _accumulatedBits;
+                _accumulatedBits += 8;
+            }
+            auto value = static_cast<std::uint32_t>(_accumulator & ((std::uint64_t{ 1 } << bits) - 1));
+            _accumulator >>= bits;
+            _accumulatedBits -= bits;
+            return value;
+        }
+
+    private:
+        std::span<const std::byte> _buffer;
+        std::size_t _position = 0;
+        std::uint64_t _accumulator = 0;
+        unsigned _accumulatedBits = 0;
+    };
+}
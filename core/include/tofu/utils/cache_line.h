@@ -0,0 +1,9 @@
+﻿#pragma once
+
+#include <cstddef>
+
+namespace tofu {
+    // スレッド間で共有する変数の偽共有を避けるためのアライメント
+    //  std::hardware_destructive_interference_sizeはコンパイラによって未実装だったり警告が出たりするので固定値で持つ
+    inline constexpr std::size_t CacheLineSize = 64;
+}
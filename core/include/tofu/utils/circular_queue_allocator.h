@@ -3,6 +3,7 @@
 #include <cassert>
 #include <memory>
 #include <algorithm>
+#include <span>
 #include <tofu/utils/observer_ptr.h>
 
 namespace tofu
@@ -334,10 +335,22 @@ namespace tofu
             memcpy(write_to, _front, blength);
             if (flength)
             {
-                memcpy(write_to + flength, _buffer.get(), flength);
+                memcpy(write_to + blength, _buffer.get(), flength);
             }
         }
 
+        // 先頭からlength byte分を、コピーせずに見る。見たデータは破棄されない
+        //  バッファの終わりで折り返していて1続きになっていなければ空
+        std::span<const std::byte> PeekContiguous(std::size_t length) const noexcept
+        {
+            assert(length <= _size);
+            if (UsedBackward() < length)
+            {
+                return {};
+            }
+            return { _front, length };
+        }
+
         // 先頭からlength byte分見て、そのデータは破棄される
         void Read(std::byte* write_to, std::size_t length)
         {
@@ -348,8 +361,9 @@ namespace tofu
         // length byte分読み終わった
         void Seek(std::size_t length)
         {
-            auto backward_length = std::min<std::size_t>(length, RemainBackward());
-            auto forward_length = std::min<std::size_t>(length - backward_length, RemainForward());
+            assert(length <= _size);
+            auto backward_length = std::min<std::size_t>(length, UsedBackward());
+            auto forward_length = length - backward_length;
 
             if (forward_length == 0)
             {
@@ -357,7 +371,13 @@ namespace tofu
             }
             else
             {
-                _front = _buffer.get() + backward_length;
+                _front = _buffer.get() + forward_length;
+            }
+
+            // 終わりまで読んだら先頭に戻し、続きを1続きで見られるようにする
+            if (_front == _buffer.get() + _capacity)
+            {
+                _front = _buffer.get();
             }
 
             _size -= length;
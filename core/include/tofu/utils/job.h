@@ -7,6 +7,8 @@
 #include <set>
 #include <cassert>
 
+#include <tofu/containers/small_vector.h>
+
 // 超簡易な、依存関係を解決するシングルスレッドジョブスケジューラ
 namespace tofu
 {
@@ -28,6 +30,9 @@ namespace tofu
     class Job
     {
     public:
+        // 依存・条件はたいてい数個なので、ヒープ確保せずに持てるようにする
+        using tag_list = small_vector<job_tag, 4>;
+
         using task_t = std::function<std::optional<condition_tag>()>;
         Job(job_tag tag, std::initializer_list<job_tag> dependency, std::initializer_list<condition_tag> conditions, const task_t& task)
             : _tag(tag)
@@ -72,12 +77,12 @@ namespace tofu
             _conditions.push_back(tag);
         }
 
-        const std::vector<job_tag>& GetDependency() const noexcept
+        const tag_list& GetDependency() const noexcept
         {
             return _dependency;
         }
 
-        const std::vector<condition_tag>& GetConditions() const noexcept
+        const tag_list& GetConditions() const noexcept
         {
             return _conditions;
         }
@@ -90,8 +95,8 @@ namespace tofu
     private:
         job_tag    _tag;
         task_t _task;
-        std::vector<job_tag> _dependency;
-        std::vector<condition_tag> _conditions;
+        tag_list _dependency;
+        tag_list _conditions;
 
         bool _done = false;
     };
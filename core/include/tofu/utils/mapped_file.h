@@ -0,0 +1,56 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <utility>
+
+#include <tofu/utils/error.h>
+
+namespace tofu
+{
+    // ファイルを読み込み専用でメモリにマップするクラス
+    //  読み込むためにバッファへコピーしないので、大きなファイルを頭から順に読むのが速い
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        ~MappedFile()
+        {
+            Close();
+        }
+
+        // コピー禁止
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        MappedFile(MappedFile&& other) noexcept
+        {
+            *this = std::move(other);
+        }
+        MappedFile& operator=(MappedFile&& other) noexcept;
+
+        Error Open(const std::string& path);
+        void Close() noexcept;
+
+        bool IsOpen() const noexcept
+        {
+            return _isOpen;
+        }
+
+        // ファイルの中身. Close()するまで有効
+        std::span<const std::byte> Bytes() const noexcept
+        {
+            return { _data, _size };
+        }
+
+    private:
+        const std::byte* _data = nullptr;
+        std::size_t _size = 0;
+        bool _isOpen = false;
+#ifdef _WIN32
+        void* _file = nullptr;
+        void* _mapping = nullptr;
+#endif
+    };
+}
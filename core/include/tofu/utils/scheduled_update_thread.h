@@ -1,9 +1,11 @@
 ﻿#pragma once
 
+#include <atomic>
 #include <functional>
 #include <thread>
 #include <condition_variable>
 #include <chrono>
+#include <optional>
 
 namespace tofu 
 {
@@ -11,6 +13,7 @@ namespace tofu
     {
     public:
         using func_type = std::function<void(ScheduledUpdateThread&)>;
+        using time_point = std::chrono::system_clock::time_point;
 
         template<class TFunc>
         ScheduledUpdateThread(std::chrono::system_clock::duration period, const TFunc& func)
@@ -33,6 +36,16 @@ namespace tofu
             _started = true;
             _start_cv.notify_all();
         }
+        // start_timeから周期を数え始める. start_timeまでは実行しない
+        //  複数のマシンで時計を合わせてから同じ時刻を渡せば、同じ位相で実行される
+        void Start(time_point start_time)
+        {
+            std::lock_guard<std::mutex> lock(_start_mutex);
+
+            _startTime = start_time;
+            _started = true;
+            _start_cv.notify_all();
+        }
 
         void End(bool wait = false)
         {
@@ -48,6 +61,17 @@ namespace tofu
             }
         }
 
+        // 1Tickあたりの時間を変える. 実行中でも、どのスレッドから呼んでもよい
+        //  次の周期から反映される
+        void SetPeriod(std::chrono::system_clock::duration period)
+        {
+            _period.store(period, std::memory_order_relaxed);
+        }
+        std::chrono::system_clock::duration GetPeriod() const
+        {
+            return _period.load(std::memory_order_relaxed);
+        }
+
         bool IsRunning() const
         {
             return _thread.joinable();
@@ -56,13 +80,15 @@ namespace tofu
     private:
         void Entrypoint()
         {
+            std::optional<time_point> start_time;
             {
                 std::unique_lock<std::mutex> lock(_start_mutex);
                 _start_cv.wait(lock, [&] { return _started; });
+                start_time = _startTime;
             }
 
             using namespace std::chrono;
-            time_point start = system_clock::now();
+            time_point start = start_time.value_or(system_clock::now());
 
             time_point next = start;
 
@@ -74,14 +100,14 @@ namespace tofu
                     std::this_thread::sleep_for(next - now);
                     continue;
                 }
-                else if (_period * 2 < now - next)
+                else if (GetPeriod() * 2 < now - next)
                 {
                     // 二周遅れ以上だから適当にスキップ
                     next = now;
                 }
 
                 _func(*this);
-                next += _period;
+                next += GetPeriod();
             }
         }
 
@@ -90,9 +116,10 @@ namespace tofu
         std::condition_variable _start_cv;
         bool _started;
         bool _end;
+        std::optional<time_point> _startTime;
 
         // 1Tickあたりの時間
-        std::chrono::system_clock::duration _period;
+        std::atomic<std::chrono::system_clock::duration> _period;
         func_type _func;
     };
 
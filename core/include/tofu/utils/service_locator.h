@@ -1,9 +1,10 @@
 ﻿#pragma once
 
-#include <unordered_map>
+#include <memory>
 #include <typeindex>
 
 #include "observer_ptr.h"
+#include "../containers/flat_hash_map.h"
 
 namespace tofu {
     // シンプルなサービスロケータ
@@ -43,7 +44,7 @@ namespace tofu {
             return std::type_index{ typeid(std::decay_t<T>) };
         }
 
-        std::unordered_map<std::type_index, std::shared_ptr<void>> _container;
+        flat_hash_map<std::type_index, std::shared_ptr<void>> _container;
     };
 
 }
@@ -0,0 +1,165 @@
+﻿#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+namespace tofu
+{
+    // スナップショットを書き込むための平坦なバイト列
+    //  トリビアルコピー可能な値をそのままmemcpyで詰めていく
+    //  Clear()しても領域は解放しないので、毎Tick同じバッファに書き込めば確保は最初の数回しか起きない
+    class SnapshotBuffer
+    {
+    public:
+        SnapshotBuffer() noexcept = default;
+        explicit SnapshotBuffer(std::size_t capacity)
+        {
+            Reserve(capacity);
+        }
+
+        SnapshotBuffer(const SnapshotBuffer& other)
+        {
+            *this = other;
+        }
+        SnapshotBuffer& operator=(const SnapshotBuffer& other)
+        {
+            if (this != &other)
+            {
+                Clear();
+                WriteBytes(other.Data(), other.Size());
+            }
+            return *this;
+        }
+        SnapshotBuffer(SnapshotBuffer&&) noexcept = default;
+        SnapshotBuffer& operator=(SnapshotBuffer&&) noexcept = default;
+
+        void Reserve(std::size_t capacity)
+        {
+            if (capacity <= _capacity)
+                return;
+
+            // 直後に上書きするので0初期化しない
+            auto buffer = std::unique_ptr<std::byte[]>(new std::byte[capacity]);
+            if (_size)
+                std::memcpy(buffer.get(), _buffer.get(), _size);
+            _buffer = std::move(buffer);
+            _capacity = capacity;
+        }
+
+        void Clear() noexcept
+        {
+            _size = 0;
+        }
+
+        template<class T>
+        void Write(const T& value)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            WriteBytes(reinterpret_cast<const std::byte*>(&value), sizeof(T));
+        }
+
+        template<class T>
+        void WriteSpan(std::span<const T> values)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            WriteBytes(reinterpret_cast<const std::byte*>(values.data()), values.size_bytes());
+        }
+
+        void WriteBytes(const std::byte* data, std::size_t size)
+        {
+            if (_capacity < _size + size)
+            {
+                Reserve(std::max(_size + size, _capacity * 2));
+            }
+            if (size)
+                std::memcpy(_buffer.get() + _size, data, size);
+            _size += size;
+        }
+
+        const std::byte* Data() const noexcept
+        {
+            return _buffer.get();
+        }
+        std::size_t Size() const noexcept
+        {
+            return _size;
+        }
+        std::size_t Capacity() const noexcept
+        {
+            return _capacity;
+        }
+
+        std::span<const std::byte> AsSpan() const noexcept
+        {
+            return { _buffer.get(), _size };
+        }
+
+        friend bool operator==(const SnapshotBuffer& lhs, const SnapshotBuffer& rhs) noexcept
+        {
+            return lhs._size == rhs._size && (lhs._size == 0 || std::memcmp(lhs.Data(), rhs.Data(), lhs._size) == 0);
+        }
+
+    private:
+        std::unique_ptr<std::byte[]> _buffer;
+        std::size_t _size = 0;
+        std::size_t _capacity = 0;
+    };
+
+    // SnapshotBufferに書き込んだ値を、書き込んだ順に読み出す
+    class SnapshotReader
+    {
+    public:
+        SnapshotReader(std::span<const std::byte> data) noexcept
+            : _data(data)
+        {
+        }
+        SnapshotReader(const SnapshotBuffer& buffer) noexcept
+            : _data(buffer.AsSpan())
+        {
+        }
+
+        // 残りが足りなければfalseを返し、outは変更しない
+        template<class T>
+        [[nodiscard]] bool Read(T& out) noexcept
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            return ReadBytes(reinterpret_cast<std::byte*>(&out), sizeof(T));
+        }
+
+        template<class T>
+        [[nodiscard]] bool ReadSpan(std::span<T> out) noexcept
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            return ReadBytes(reinterpret_cast<std::byte*>(out.data()), out.size_bytes());
+        }
+
+        [[nodiscard]] bool ReadBytes(std::byte* out, std::size_t size) noexcept
+        {
+            if (Remaining() < size)
+                return false;
+            if (size)
+                std::memcpy(out, _data.data() + _position, size);
+            _position += size;
+            return true;
+        }
+
+        std::size_t Remaining() const noexcept
+        {
+            return _data.size() - _position;
+        }
+        bool IsEnd() const noexcept
+        {
+            return Remaining() == 0;
+        }
+
+    private:
+        std::span<const std::byte> _data;
+        std::size_t _position = 0;
+    };
+}
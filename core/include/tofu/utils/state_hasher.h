@@ -0,0 +1,59 @@
+﻿#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <type_traits>
+
+namespace tofu
+{
+    // シミュレーションの状態が一致しているかを確かめるための、暗号学的でない高速なハッシュ
+    //  値をビット列のまま8byteずつ混ぜるので、浮動小数点数はビット単位で一致しなければ別の値になる
+    //  構造体のパディングを混ぜないよう、値はメンバごとに加えること
+    class StateHasher
+    {
+    public:
+        template<class T>
+            requires std::is_arithmetic_v<T>
+        void Add(T value) noexcept
+        {
+            static_assert(sizeof(T) <= sizeof(std::uint64_t));
+            std::uint64_t word = 0;
+            std::memcpy(&word, &value, sizeof(T));
+            mix(word);
+        }
+
+        template<class T>
+        void AddSpan(std::span<const T> values) noexcept
+        {
+            for (auto value : values)
+            {
+                Add(value);
+            }
+        }
+
+        std::uint64_t Get() const noexcept
+        {
+            // 最後に全ビットへ行き渡らせる (MurmurHash3 の fmix64)
+            auto hash = _state ^ _count;
+            hash ^= hash >> 33;
+            hash *= 0xff51afd7ed558ccdull;
+            hash ^= hash >> 33;
+            hash *= 0xc4ceb9fe1a85ec53ull;
+            hash ^= hash >> 33;
+            return hash;
+        }
+
+    private:
+        void mix(std::uint64_t word) noexcept
+        {
+            _state ^= word * 0x9e3779b97f4a7c15ull;
+            _state = std::rotl(_state, 27) * 0x87c37b91114253d5ull;
+            _count++;
+        }
+
+        std::uint64_t _state = 0x243f6a8885a308d3ull;
+        std::uint64_t _count = 0;
+    };
+}
@@ -1,7 +1,50 @@
 ﻿#include <tofu/ecs/physics.h>
 
+#include <cassert>
+
 #include <box2d/box2d.h>
 
+#include <tofu/containers/small_vector.h>
+
+namespace
+{
+    // スナップショット上の1ボディ分の状態
+    //  バイト列を比較できるよう、パディングが入らない並びにしている
+    struct BodyState
+    {
+        b2Vec2 _position;
+        float _angle;
+        b2Vec2 _linearVelocity;
+        float _angularVelocity;
+        std::uint32_t _awake;
+    };
+    static_assert(sizeof(BodyState) == sizeof(float) * 6 + sizeof(std::uint32_t));
+
+    // スナップショット上の1接触分の状態
+    //  同じb2World上でのみ復元するので、フィクスチャはポインタで識別する
+    struct ContactState
+    {
+        std::uint64_t _fixtureA;
+        std::uint64_t _fixtureB;
+        std::int32_t _childA;
+        std::int32_t _childB;
+        std::uint32_t _enabled;
+        std::int32_t _pointCount;
+        std::uint32_t _ids[b2_maxManifoldPoints];
+        float _normalImpulses[b2_maxManifoldPoints];
+        float _tangentImpulses[b2_maxManifoldPoints];
+    };
+    static_assert(sizeof(ContactState) == sizeof(std::uint64_t) * 2 + sizeof(std::int32_t) * (4 + b2_maxManifoldPoints * 3));
+
+    bool is_same_contact(const ContactState& state, b2Contact* contact)
+    {
+        return state._fixtureA == reinterpret_cast<std::uintptr_t>(contact->GetFixtureA())
+            && state._fixtureB == reinterpret_cast<std::uintptr_t>(contact->GetFixtureB())
+            && state._childA == contact->GetChildIndexA()
+            && state._childB == contact->GetChildIndexB();
+    }
+}
+
 namespace tofu
 {
     Physics::Physics(observer_ptr<entt::registry> registry)
@@ -56,4 +99,176 @@ namespace tofu
 
         return _registry->emplace<RigidBody>(entity, body);
     }
-}
+
+    void Physics::DiscardTransientState()
+    {
+        auto world = std::make_unique<b2World>(_world->GetGravity());
+        world->SetAllowSleeping(_world->GetAllowSleeping());
+        world->SetWarmStarting(_world->GetWarmStarting());
+        world->SetContinuousPhysics(_world->GetContinuousPhysics());
+        world->SetSubStepping(_world->GetSubStepping());
+        assert(_world->GetJointCount() == 0);
+
+        // CreateBodyとCreateFixtureはリストの先頭に足すので、後ろから作り直して同じ並びにする
+        small_vector<b2Body*, 64> bodies;
+        for (auto body = _world->GetBodyList(); body; body = body->GetNext())
+            bodies.push_back(body);
+        for (auto it = bodies.rbegin(); it != bodies.rend(); ++it)
+        {
+            auto old_body = *it;
+            b2BodyDef body_def;
+            body_def.type = old_body->GetType();
+            body_def.position = old_body->GetPosition();
+            body_def.angle = old_body->GetAngle();
+            body_def.linearVelocity = old_body->GetLinearVelocity();
+            body_def.angularVelocity = old_body->GetAngularVelocity();
+            body_def.linearDamping = old_body->GetLinearDamping();
+            body_def.angularDamping = old_body->GetAngularDamping();
+            body_def.allowSleep = old_body->IsSleepingAllowed();
+            body_def.awake = old_body->IsAwake();
+            body_def.fixedRotation = old_body->IsFixedRotation();
+            body_def.bullet = old_body->IsBullet();
+            body_def.enabled = old_body->IsEnabled();
+            body_def.userData = old_body->GetUserData();
+            body_def.gravityScale = old_body->GetGravityScale();
+            auto body = world->CreateBody(&body_def);
+
+            small_vector<b2Fixture*, 8> fixtures;
+            for (auto fixture = old_body->GetFixtureList(); fixture; fixture = fixture->GetNext())
+                fixtures.push_back(fixture);
+            for (auto fixture_it = fixtures.rbegin(); fixture_it != fixtures.rend(); ++fixture_it)
+            {
+                auto old_fixture = *fixture_it;
+                b2FixtureDef fixture_def;
+                fixture_def.shape = old_fixture->GetShape();
+                fixture_def.userData = old_fixture->GetUserData();
+                fixture_def.friction = old_fixture->GetFriction();
+                fixture_def.restitution = old_fixture->GetRestitution();
+                fixture_def.restitutionThreshold = old_fixture->GetRestitutionThreshold();
+                fixture_def.density = old_fixture->GetDensity();
+                fixture_def.isSensor = old_fixture->IsSensor();
+                fixture_def.filter = old_fixture->GetFilterData();
+                body->CreateFixture(&fixture_def);
+            }
+            // 質量はフィクスチャから計算し直される. SetMassDataで変えると、作り直すたびに戻ってしまうので使わないこと
+
+            auto entity = static_cast<entt::entity>(old_body->GetUserData().pointer);
+            _registry->get<RigidBody>(entity)._body = body;
+        }
+
+        // シェイプは作り直したフィクスチャにコピーされているので、古いワールドはここで捨ててよい
+        _world = std::move(world);
+    }
+
+    void Physics::SaveSnapshot(SnapshotBuffer& buffer) const
+    {
+        buffer.Write(static_cast<std::uint32_t>(_world->GetBodyCount()));
+        for (auto body = _world->GetBodyList(); body; body = body->GetNext())
+        {
+            buffer.Write(BodyState{
+                ._position = body->GetPosition(),
+                ._angle = body->GetAngle(),
+                ._linearVelocity = body->GetLinearVelocity(),
+                ._angularVelocity = body->GetAngularVelocity(),
+                ._awake = body->IsAwake(),
+                });
+        }
+
+        buffer.Write(static_cast<std::uint32_t>(_world->GetContactCount()));
+        for (auto contact = _world->GetContactList(); contact; contact = contact->GetNext())
+        {
+            ContactState state{
+                ._fixtureA = reinterpret_cast<std::uintptr_t>(contact->GetFixtureA()),
+                ._fixtureB = reinterpret_cast<std::uintptr_t>(contact->GetFixtureB()),
+                ._childA = contact->GetChildIndexA(),
+                ._childB = contact->GetChildIndexB(),
+                ._enabled = contact->IsEnabled(),
+                ._pointCount = contact->GetManifold()->pointCount,
+            };
+            for (int i = 0; i < b2_maxManifoldPoints; i++)
+            {
+                auto& point = contact->GetManifold()->points[i];
+                bool used = i < state._pointCount;
+                state._ids[i] = used ? point.id.key : 0;
+                state._normalImpulses[i] = used ? point.normalImpulse : 0.f;
+                state._tangentImpulses[i] = used ? point.tangentImpulse : 0.f;
+            }
+            buffer.Write(state);
+        }
+    }
+
+    void Physics::HashState(StateHasher& hasher) const
+    {
+        hasher.Add(_world->GetBodyCount());
+        for (auto body = _world->GetBodyList(); body; body = body->GetNext())
+        {
+            auto& position = body->GetPosition();
+            auto& velocity = body->GetLinearVelocity();
+            hasher.Add(position.x);
+            hasher.Add(position.y);
+            hasher.Add(body->GetAngle());
+            hasher.Add(velocity.x);
+            hasher.Add(velocity.y);
+            hasher.Add(body->GetAngularVelocity());
+            hasher.Add(body->IsAwake());
+        }
+    }
+
+    Error Physics::LoadSnapshot(SnapshotReader& reader)
+    {
+        std::uint32_t body_count;
+        if (!reader.Read(body_count))
+            return TOFU_MAKE_ERROR("Physics snapshot is truncated.");
+        if (body_count != static_cast<std::uint32_t>(_world->GetBodyCount()))
+            return TOFU_MAKE_ERROR("Physics snapshot body count mismatch. snapshot={}, world={}", body_count, _world->GetBodyCount());
+
+        for (auto body = _world->GetBodyList(); body; body = body->GetNext())
+        {
+            BodyState state;
+            if (!reader.Read(state))
+                return TOFU_MAKE_ERROR("Physics snapshot is truncated.");
+
+            // SetTransformはブロードフェーズの更新を伴うので、動いていないボディは触らない
+            if (!(body->GetPosition() == state._position) || body->GetAngle() != state._angle)
+                body->SetTransform(state._position, state._angle);
+            body->SetLinearVelocity(state._linearVelocity);
+            body->SetAngularVelocity(state._angularVelocity);
+            body->SetAwake(state._awake != 0);
+        }
+
+        std::uint32_t contact_count;
+        if (!reader.Read(contact_count))
+            return TOFU_MAKE_ERROR("Physics snapshot is truncated.");
+        small_vector<ContactState, 32> contacts(contact_count);
+        if (!reader.ReadSpan(std::span{ contacts.data(), contacts.size() }))
+            return TOFU_MAKE_ERROR("Physics snapshot is truncated.");
+
+        // 接触の生成・破棄は次のStepでbox2dが行うので、今ある接触のうち保存時にもあったものの撃力だけを戻す
+        //  保存時に無かった接触は、新しく生まれた接触と同じく撃力0から始める
+        for (auto contact = _world->GetContactList(); contact; contact = contact->GetNext())
+        {
+            auto it = std::find_if(contacts.begin(), contacts.end(), [contact](const ContactState& state) { return is_same_contact(state, contact); });
+            auto manifold = contact->GetManifold();
+            for (int i = 0; i < manifold->pointCount; i++)
+            {
+                auto& point = manifold->points[i];
+                point.normalImpulse = 0.f;
+                point.tangentImpulse = 0.f;
+                if (it == contacts.end())
+                    continue;
+                for (int k = 0; k < it->_pointCount; k++)
+                {
+                    if (it->_ids[k] == point.id.key)
+                    {
+                        point.normalImpulse = it->_normalImpulses[k];
+                        point.tangentImpulse = it->_tangentImpulses[k];
+                    }
+                }
+            }
+            if (it != contacts.end())
+                contact->SetEnabled(it->_enabled != 0);
+        }
+
+        return std::nullopt;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,133 @@
+﻿#include <tofu/utils/mapped_file.h>
+
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace tofu
+{
+    MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+    {
+        Close();
+        std::swap(_data, other._data);
+        std::swap(_size, other._size);
+        std::swap(_isOpen, other._isOpen);
+#ifdef _WIN32
+        std::swap(_file, other._file);
+        std::swap(_mapping, other._mapping);
+#endif
+        return *this;
+    }
+
+#ifdef _WIN32
+    Error MappedFile::Open(const std::string& path)
+    {
+        Close();
+
+        auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return TOFU_MAKE_ERROR("Failed to open file. path=({}), error=({})", path, GetLastError());
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size))
+        {
+            CloseHandle(file);
+            return TOFU_MAKE_ERROR("Failed to get file size. path=({}), error=({})", path, GetLastError());
+        }
+
+        // 大きさ0のファイルはマップできないので、空として扱う
+        if (size.QuadPart != 0)
+        {
+            auto mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (!mapping)
+            {
+                CloseHandle(file);
+                return TOFU_MAKE_ERROR("Failed to map file. path=({}), error=({})", path, GetLastError());
+            }
+            auto data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            if (!data)
+            {
+                CloseHandle(mapping);
+                CloseHandle(file);
+                return TOFU_MAKE_ERROR("Failed to map file. path=({}), error=({})", path, GetLastError());
+            }
+            _mapping = mapping;
+            _data = static_cast<const std::byte*>(data);
+            _size = static_cast<std::size_t>(size.QuadPart);
+        }
+        _file = file;
+        _isOpen = true;
+        return std::nullopt;
+    }
+
+    void MappedFile::Close() noexcept
+    {
+        if (_data)
+            UnmapViewOfFile(_data);
+        if (_mapping)
+            CloseHandle(_mapping);
+        if (_file)
+            CloseHandle(_file);
+        _data = nullptr;
+        _size = 0;
+        _mapping = nullptr;
+        _file = nullptr;
+        _isOpen = false;
+    }
+#else
+    Error MappedFile::Open(const std::string& path)
+    {
+        Close();
+
+        auto fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return TOFU_MAKE_ERROR("Failed to open file. path=({}), errno=({})", path, errno);
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            return TOFU_MAKE_ERROR("Failed to get file size. path=({}), errno=({})", path, errno);
+        }
+
+        // 大きさ0のファイルはマップできないので、空として扱う
+        if (st.st_size != 0)
+        {
+            auto size = static_cast<std::size_t>(st.st_size);
+            auto data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED)
+            {
+                ::close(fd);
+                return TOFU_MAKE_ERROR("Failed to map file. path=({}), errno=({})", path, errno);
+            }
+            // 頭から順に読むので、先読みしてもらう
+            ::madvise(data, size, MADV_SEQUENTIAL);
+            _data = static_cast<const std::byte*>(data);
+            _size = size;
+        }
+        // マップした領域はファイルを閉じても残る
+        ::close(fd);
+        _isOpen = true;
+        return std::nullopt;
+    }
+
+    void MappedFile::Close() noexcept
+    {
+        if (_data)
+            ::munmap(const_cast<std::byte*>(_data), _size);
+        _data = nullptr;
+        _size = 0;
+        _isOpen = false;
+    }
+#endif
+}
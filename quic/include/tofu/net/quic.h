@@ -2,9 +2,9 @@
 
 #include <filesystem>
 #include <optional>
+#include <span>
 #include <thread>
 #include <set>
-#include <unordered_map>
 #include <mutex>
 #include <chrono>
 
@@ -12,6 +12,7 @@
 #include <tofu/utils/observer_ptr.h>
 #include <tofu/utils/error.h>
 #include <tofu/utils/circular_queue_allocator.h>
+#include <tofu/containers/flat_hash_map.h>
 
 #include <picoquic.h>
 #include <picoquic_packet_loop.h>
@@ -44,6 +45,47 @@ namespace tofu::net
         std::chrono::microseconds _pingInterval = std::chrono::microseconds{ 100 * 1000 };
     };
 
+    // 接続確立にかかった時間. 再接続でハンドシェイクを省けているかを確かめる
+    struct QuicHandshakeMetrics
+    {
+        // セッションチケットを使い、ハンドシェイクを待たずに0-RTTで送り始めた (クライアントのみ)
+        bool _zeroRtt = false;
+        // 接続を始めてから、アプリケーションのデータを送れるようになるまで. 0-RTTなら0
+        std::chrono::microseconds _untilSendable{ 0 };
+        // 接続を始めてから、ハンドシェイクが確定するまで
+        std::chrono::microseconds _untilReady{ 0 };
+    };
+
+    // ストリームの送信の様子. 送った分を数え続けるので、見たい区間の前後の差を取って使う
+    struct QuicSendMetrics
+    {
+        // Uncorkした回数. Tickの終わりにUncorkしていれば経過したTick数
+        std::uint64_t _ticks = 0;
+        // picoquicに送るものがあると知らせた回数
+        std::uint64_t _activations = 0;
+        // このストリームのデータを載せたパケットの数
+        std::uint64_t _packets = 0;
+        // 送ったバイト数
+        std::uint64_t _bytes = 0;
+
+        double PacketsPerTick() const noexcept
+        {
+            return _ticks ? static_cast<double>(_packets) / _ticks : 0.0;
+        }
+        double AveragePayload() const noexcept
+        {
+            return _packets ? static_cast<double>(_bytes) / _packets : 0.0;
+        }
+
+        QuicSendMetrics operator-(const QuicSendMetrics& rhs) const noexcept
+        {
+            return { _ticks - rhs._ticks, _activations - rhs._activations, _packets - rhs._packets, _bytes - rhs._bytes };
+        }
+    };
+
+    // Corkしている間に、溜めずにpicoquicへ渡し始める量. 1パケットに載るくらい
+    inline constexpr std::size_t DefaultCorkThreshold = 1200;
+
     class QuicConnection;
     class QuicServer;
     class QuicClient;
@@ -58,6 +100,9 @@ namespace tofu::net
 
         std::size_t ReceivedSize() noexcept;
         void Peek(std::byte* data, std::size_t length);
+        // 先頭からlength byteを受信バッファの上でそのまま見る. 折り返していて1続きでなければ空
+        //  Seekするまで有効. 読むのは1つのスレッドだけにすること
+        std::span<const std::byte> PeekContiguous(std::size_t length);
         void Read(std::byte* data, std::size_t length);
         void Seek(std::size_t length);
         bool IsReceiveFinished();
@@ -66,6 +111,15 @@ namespace tofu::net
         void FinishSend();
         bool IsSendFinished() const;
 
+        // Uncorkするまで、Sendしたものを溜めてpicoquicに渡さない. 同じTickに送る小さなメッセージを少ないパケットにまとめる
+        //  溜まった量がthresholdを超えたら、そこまでは待たずに送る
+        void Cork(std::size_t threshold = DefaultCorkThreshold);
+        // 溜めていたものを1度に送る. Tickの終わりに呼ぶ
+        void Uncork();
+        // Corkしたまま、溜めている分を今すぐ送る. 遅らせたくないメッセージを送った後に呼ぶ
+        void Flush();
+        QuicSendMetrics GetSendMetrics();
+
         void Close();
 
     protected:
@@ -83,9 +137,18 @@ namespace tofu::net
         std::atomic<bool> _isArrivedFinish = false;
         CircularContinuousBuffer _recvBuffer;
 
+        // 溜めているものを送れるようにして、picoquicに知らせる. _sendMutexを取ってから呼ぶ
+        void ActivateSend();
+
         std::mutex _sendMutex;
         std::atomic<bool> _isSendFinish = false;
         CircularContinuousBuffer _sendBuffer;
+        // 以下は_sendMutexで守る
+        bool _isCorked = false;
+        std::size_t _corkThreshold = 0;
+        // _sendBufferの後ろのうち、Corkして溜めている分. まだpicoquicに渡さない
+        std::size_t _corkedSize = 0;
+        QuicSendMetrics _sendMetrics;
     };
 
     class QuicConnection
@@ -119,6 +182,24 @@ namespace tofu::net
             return _isDisconnected;
         }
 
+        // ハンドシェイクが終わる前でも、0-RTT(サーバーは0.5-RTT)で送れるならtrue
+        bool IsSendable() const
+        {
+            return _isSendable && !_isDisconnected;
+        }
+
+        // 0-RTTで送り始める. セッションチケットがあるときにクライアントが接続を始める直後に呼ぶ
+        void StartEarlyData();
+
+        // ハンドシェイクが確定するまではnullopt
+        std::optional<QuicHandshakeMetrics> GetHandshakeMetrics() const;
+
+        // picoquicが推定している平滑化済みのRTT
+        std::chrono::microseconds GetRtt() const
+        {
+            return std::chrono::microseconds{ picoquic_get_rtt(_cnx) };
+        }
+
         // === Stream
         std::shared_ptr<QuicStream> OpenStream(StreamId stream_id, bool is_remote);
         std::shared_ptr<QuicStream> GetStream(StreamId stream_id);
@@ -132,10 +213,17 @@ namespace tofu::net
         int CallbackConnection(picoquic_cnx_t* cnx, std::uint64_t stream_id, std::uint8_t* bytes, std::size_t length, picoquic_call_back_event_t fin_or_event, void* callback_ctx, void* v_stream_ctx);
 
     private:
+        // 接続を始めてからの時間
+        std::chrono::microseconds GetElapsedSinceStart() const;
+
         picoquic_cnx_t* _cnx;
         std::atomic<bool> _isReady = false;
+        std::atomic<bool> _isSendable = false;
         std::atomic<bool> _isDisconnected = false;
 
+        // 書き込むのは通信スレッドだけ. _isReadyより後に読めば揃っている
+        QuicHandshakeMetrics _handshake;
+
         // とりあえず別々に持ったけどインターフェース切るなりしたほうがいいか後で考える
         observer_ptr<QuicServer> _server = nullptr;
         observer_ptr<QuicClient> _client = nullptr;
@@ -146,7 +234,7 @@ namespace tofu::net
         CircularQueueBuffer _unreliableRecvBuffer;
 
         std::mutex _streamMutex;
-        std::unordered_map<StreamId, std::shared_ptr<QuicStream>> _streams;
+        flat_hash_map<StreamId, std::shared_ptr<QuicStream>> _streams;
     };
 }
 
@@ -18,6 +18,13 @@ namespace tofu::net
         std::string _serverName;
         Port _port;
         std::string _alpn;
+
+        // セッションチケットを保存するファイル. 空ならQuicClientの中にだけ持ち、Startし直したときに使う
+        std::filesystem::path _ticketFile;
+        // サーバーから受け取ったアドレス検証用のトークンを保存するファイル. あればサーバーにRetryを求められない
+        std::filesystem::path _tokenFile;
+        // セッションチケットがあれば、ハンドシェイクを待たずに0-RTTで送り始める
+        bool _zeroRtt = true;
     };
     class QuicClient
     {
@@ -27,7 +34,9 @@ namespace tofu::net
         QuicClient(const QuicClientConfig& config);
         ~QuicClient();
 
+        // 接続を始める. Exitの後にもう一度呼ぶと、前の接続で受け取ったセッションチケットで再開する
         void Start();
+        // 接続を閉じ、セッションチケットとトークンをファイルに保存する
         void Exit();
 
         std::shared_ptr<QuicConnection> GetConnection();
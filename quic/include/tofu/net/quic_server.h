@@ -2,11 +2,24 @@
 
 #include <set>
 #include <functional>
+#include <vector>
 
 #include "tofu/net/quic.h"
 
 namespace tofu::net
 {
+    // 送信元アドレスを確かめるため、接続してきた相手にRetryを求めるかどうか
+    //  Retryを求めると、ハンドシェイクが1往復長くなる
+    enum class QuicRetryPolicy
+    {
+        // 求めない. 送信元を偽った接続要求にも応答してしまう
+        Never,
+        // ハンドシェイク途中の接続が多いときだけ求める. 次の接続用のトークンを配り、トークンを持つ相手には求めない
+        UnderLoad,
+        // トークンを持たない相手には必ず求める
+        Always,
+    };
+
     struct QuicServerConfig
     {
         QuicConfig _config;
@@ -15,6 +28,13 @@ namespace tofu::net
         std::filesystem::path _certFile;
         std::filesystem::path _secretFile;
         std::string _alpn;
+
+        // セッションチケットを暗号化する鍵のファイル. 無ければ作る
+        //  空なら起動ごとに鍵が変わるので、再起動する前に配ったチケットでは再開できない
+        std::filesystem::path _ticketKeyFile;
+        QuicRetryPolicy _retryPolicy = QuicRetryPolicy::UnderLoad;
+        // UnderLoadのとき、ハンドシェイク途中の接続がこの数に達したらRetryを求める
+        std::uint32_t _maxHalfOpenBeforeRetry = 64;
     };
 
     class QuicServer
@@ -67,6 +87,9 @@ namespace tofu::net
         }
 
     private:
+        // セッションチケットを暗号化する鍵を読む. 無ければ作って保存する
+        std::vector<std::uint8_t> LoadTicketKey();
+
         QuicServerConfig _config;
         Error _error;
 
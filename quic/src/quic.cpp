@@ -32,6 +32,13 @@ namespace tofu::net {
         _recvBuffer.Peek(data, length);
     }
 
+    std::span<const std::byte> QuicStream::PeekContiguous(std::size_t length)
+    {
+        // 受信側は後ろに書き足すだけなので、Seekするまで先頭のlength byteは書き換わらない
+        std::lock_guard lock{ _recvMutex };
+        return _recvBuffer.PeekContiguous(length);
+    }
+
     void QuicStream::Read(std::byte* data, std::size_t length)
     {
         std::lock_guard lock{ _recvMutex };
@@ -56,7 +63,13 @@ namespace tofu::net {
         std::lock_guard lock{ _sendMutex };
         _sendBuffer.Write(data, length);
 
-        picoquic_mark_active_stream(_connection->GetRaw(), *_streamId, true, this);
+        if (_isCorked)
+        {
+            _corkedSize += length;
+            if (_corkedSize < _corkThreshold)
+                return;
+        }
+        ActivateSend();
     }
 
     void QuicStream::FinishSend()
@@ -70,6 +83,42 @@ namespace tofu::net {
         return _isSendFinish;
     }
 
+    void QuicStream::Cork(std::size_t threshold)
+    {
+        std::lock_guard lock{ _sendMutex };
+        _isCorked = true;
+        _corkThreshold = threshold;
+    }
+
+    void QuicStream::Uncork()
+    {
+        std::lock_guard lock{ _sendMutex };
+        _isCorked = false;
+        _sendMetrics._ticks++;
+        if (_corkedSize)
+            ActivateSend();
+    }
+
+    void QuicStream::Flush()
+    {
+        std::lock_guard lock{ _sendMutex };
+        if (_corkedSize)
+            ActivateSend();
+    }
+
+    QuicSendMetrics QuicStream::GetSendMetrics()
+    {
+        std::lock_guard lock{ _sendMutex };
+        return _sendMetrics;
+    }
+
+    void QuicStream::ActivateSend()
+    {
+        _corkedSize = 0;
+        _sendMetrics._activations++;
+        picoquic_mark_active_stream(_connection->GetRaw(), *_streamId, true, this);
+    }
+
     void QuicStream::Close()
     {
         FinishSend();
@@ -89,17 +138,22 @@ namespace tofu::net {
     {
         std::lock_guard lock{ _sendMutex };
 
-        auto send_length = std::min<std::size_t>(length, _sendBuffer.Size());
+        // Corkして溜めている分は、Uncorkされるまで送らない
+        auto sendable = _sendBuffer.Size() - _corkedSize;
+        auto send_length = std::min<std::size_t>(length, sendable);
         if (!send_length)
             return 0;
 
-        bool is_fin = _isSendFinish;
+        // 終わりは、溜めている分も含めて全て送るときだけ付ける
+        bool is_fin = _isSendFinish && send_length == _sendBuffer.Size();
 
-        auto buffer = picoquic_provide_stream_data_buffer(context, send_length, is_fin, _sendBuffer.Remain() == length);
+        auto buffer = picoquic_provide_stream_data_buffer(context, send_length, is_fin, send_length < sendable);
         if (!buffer)
             return -1;
 
         _sendBuffer.Read(reinterpret_cast<std::byte*>(buffer), send_length);
+        _sendMetrics._packets++;
+        _sendMetrics._bytes += send_length;
 
         return 0;
     }
@@ -138,6 +192,26 @@ namespace tofu::net {
         }
     }
 
+    void QuicConnection::StartEarlyData()
+    {
+        _handshake._zeroRtt = true;
+        _isSendable = true;
+    }
+
+    std::chrono::microseconds QuicConnection::GetElapsedSinceStart() const
+    {
+        // サーバー側のQuicConnectionは最初のコールバックで作られるので、picoquicが覚えている開始時刻から数える
+        auto now = picoquic_get_quic_time(picoquic_get_quic_ctx(_cnx));
+        return std::chrono::microseconds{ now - picoquic_get_cnx_start_time(_cnx) };
+    }
+
+    std::optional<QuicHandshakeMetrics> QuicConnection::GetHandshakeMetrics() const
+    {
+        if (!_isReady)
+            return std::nullopt;
+        return _handshake;
+    }
+
     void QuicConnection::CheckSendable()
     {
         return;
@@ -313,11 +387,27 @@ namespace tofu::net {
             break;
         case picoquic_callback_almost_ready:
             TOFU_QUIC_LOG("[QuicConnection] Connection to the server completed, almost ready.\n");
+            if (!_isSendable)
+            {
+                _handshake._untilSendable = GetElapsedSinceStart();
+                _isSendable = true;
+            }
             break;
         case picoquic_callback_ready:
         {
             TOFU_QUIC_LOG("[QuicConnection] Connection to the server confirmed.\n");
+            _handshake._untilReady = GetElapsedSinceStart();
+            // almost_readyを経ずにreadyになることもある
+            if (!_isSendable)
+            {
+                _handshake._untilSendable = _handshake._untilReady;
+                _isSendable = true;
+            }
             _isReady = true;
+
+            auto rtt = GetRtt();
+            fmt::print("[QuicConnection] Handshake: sendable after {}us, ready after {}us (RTT {}us){}\n",
+                _handshake._untilSendable.count(), _handshake._untilReady.count(), rtt.count(), _handshake._zeroRtt ? " 0-RTT" : "");
             break;
         }
         default:
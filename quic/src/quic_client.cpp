@@ -20,11 +20,17 @@ namespace tofu::net
     QuicClient::~QuicClient()
     {
         Exit();
+
+        if (_quic)
+            picoquic_free(_quic);
+        _quic = nullptr;
     }
 
     void QuicClient::Start()
     {
         std::atomic<bool> ready = false;
+        _end = false;
+        _loopReturnCode = 0;
         _thread = std::thread{ [this, &ready]() {
 
             auto current_time = picoquic_current_time();
@@ -42,27 +48,34 @@ namespace tofu::net
             if (is_name)
                 sni = _config._serverName;
 
-            _quic = picoquic_create(1, nullptr, nullptr, nullptr,
-                _config._alpn.c_str(), nullptr, nullptr, nullptr, nullptr, nullptr,
-                current_time, nullptr,
-                nullptr, // ticket_file_name
-                nullptr, 0);
-
+            // 作り直すとセッションチケットを失うので、Startし直すときは前のものを使う
             if (!_quic)
             {
-                _error = TOFU_MAKE_ERROR("Could not create quic context");
-                return;
-            }
+                // ファイルが無ければ、チケットを持たずに始める
+                auto ticket_file = _config._ticketFile.string();
+                _quic = picoquic_create(1, nullptr, nullptr, nullptr,
+                    _config._alpn.c_str(), nullptr, nullptr, nullptr, nullptr, nullptr,
+                    current_time, nullptr,
+                    ticket_file.empty() ? nullptr : ticket_file.c_str(),
+                    nullptr, 0);
+
+                if (!_quic)
+                {
+                    _error = TOFU_MAKE_ERROR("Could not create quic context");
+                    return;
+                }
 
-            // picoquic_load_retry_tokens
+                if (!_config._tokenFile.empty())
+                    picoquic_load_retry_tokens(_quic, _config._tokenFile.string().c_str());
 
-            picoquic_set_default_congestion_algorithm(_quic, picoquic_bbr_algorithm);
+                picoquic_set_default_congestion_algorithm(_quic, picoquic_bbr_algorithm);
 
-            picoquic_set_key_log_file_from_env(_quic);
-            if (!_config._config._qlogDirectory.empty())
-            {
-                picoquic_set_qlog(_quic, _config._config._qlogDirectory.string().c_str());
-                picoquic_set_log_level(_quic, _config._config._qlogLevel);
+                picoquic_set_key_log_file_from_env(_quic);
+                if (!_config._config._qlogDirectory.empty())
+                {
+                    picoquic_set_qlog(_quic, _config._config._qlogDirectory.string().c_str());
+                    picoquic_set_log_level(_quic, _config._config._qlogLevel);
+                }
             }
 
             // ==================================
@@ -91,6 +104,13 @@ namespace tofu::net
                 return;
             }
 
+            // チケットが見つかれば、ハンドシェイクの完了を待たずに送れる
+            if (_config._zeroRtt && picoquic_is_0rtt_available(cnx))
+            {
+                fmt::print("[QuicClient] Resuming with 0-RTT\n");
+                _connection->StartEarlyData();
+            }
+
             auto icid = picoquic_get_initial_cnxid(cnx);
             fmt::print("[QuicClient] Initial connection ID: ");
             for (int i = 0; i < icid.id_len; i++)
@@ -139,10 +159,18 @@ namespace tofu::net
             _error = TOFU_MAKE_ERROR("picoquic_packet_loop_win() did not complete successfully. error_code = {}", _loopReturnCode);
         }
 
-        if (_quic)
-            picoquic_free(_quic);
+        // 次に起動したときに、ハンドシェイクを省いて再開できるようにする
+        if (_quic && !_config._ticketFile.empty())
+        {
+            if (int ret = picoquic_save_session_tickets(_quic, _config._ticketFile.string().c_str()); ret != 0)
+                fmt::print("[QuicClient] Could not save session tickets. path={}, error_code={}\n", _config._ticketFile.string(), ret);
+        }
+        if (_quic && !_config._tokenFile.empty())
+        {
+            if (int ret = picoquic_save_retry_tokens(_quic, _config._tokenFile.string().c_str()); ret != 0)
+                fmt::print("[QuicClient] Could not save retry tokens. path={}, error_code={}\n", _config._tokenFile.string(), ret);
+        }
 
-        _quic = nullptr;
         _connection = nullptr;
     }
 
@@ -1,5 +1,17 @@
 ﻿#include <fmt/core.h>
 
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <span>
+
+#ifndef _WINDOWS
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include <picoquic.h>
 #include <picoquic_utils.h>
 #include <picoquic_packet_loop.h>
@@ -8,6 +20,29 @@
 
 #include "tofu/net/quic_server.h"
 
+namespace
+{
+    // 持ち主だけが読み書きできるファイルとして保存する
+    bool save_private_file(const std::filesystem::path& path, std::span<const std::uint8_t> bytes)
+    {
+#ifdef _WINDOWS
+        // 既定のACLに任せる. 置き場所はユーザーごとのディレクトリにすること
+        std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+        file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        return static_cast<bool>(file);
+#else
+        // 作ってから権限を狭めると、その間に読まれるかもしれないので、作るときから0600にする
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+        if (fd < 0)
+            return false;
+        // 既にあったファイルは、前の権限のまま開かれる
+        bool saved = ::fchmod(fd, S_IRUSR | S_IWUSR) == 0
+            && ::write(fd, bytes.data(), bytes.size()) == static_cast<ssize_t>(bytes.size());
+        return ::close(fd) == 0 && saved;
+#endif
+    }
+}
+
 namespace tofu::net
 {
     QuicServer::QuicServer(const QuicServerConfig& config)
@@ -25,6 +60,7 @@ namespace tofu::net
     {
         fmt::print("[QuicServer] Starting server on port {}\n", *_config._port);
         auto current_time = picoquic_current_time();
+        auto ticket_key = LoadTicketKey();
 
         _quic = picoquic_create(
             1, // nb_connections
@@ -42,8 +78,8 @@ namespace tofu::net
                 current_time, //seed
                 nullptr, // p_simulated_time
                 nullptr, // ticket_file_name
-                nullptr, // ticket_encryption_key
-                0 // ticket_encryption_key_length
+                ticket_key.empty() ? nullptr : ticket_key.data(), // ticket_encryption_key
+                ticket_key.size() // ticket_encryption_key_length
                 );
 
         if (!_quic)
@@ -52,7 +88,21 @@ namespace tofu::net
             return;
         }
 
-        picoquic_set_cookie_mode(_quic, 2);
+        // cookie_mode: 1 = トークンを持たない相手には必ずRetryを求める, 2 = 次の接続用のトークンを配る
+        switch (_config._retryPolicy)
+        {
+        case QuicRetryPolicy::Never:
+            picoquic_set_cookie_mode(_quic, 0);
+            picoquic_set_max_half_open_retry_threshold(_quic, std::numeric_limits<std::uint32_t>::max());
+            break;
+        case QuicRetryPolicy::UnderLoad:
+            picoquic_set_cookie_mode(_quic, 2);
+            picoquic_set_max_half_open_retry_threshold(_quic, _config._maxHalfOpenBeforeRetry);
+            break;
+        case QuicRetryPolicy::Always:
+            picoquic_set_cookie_mode(_quic, 3);
+            break;
+        }
         picoquic_set_default_congestion_algorithm(_quic, picoquic_bbr_algorithm);
         picoquic_set_qlog(_quic, _config._config._qlogDirectory.string().c_str());
         picoquic_set_log_level(_quic, _config._config._qlogLevel);
@@ -108,6 +158,48 @@ namespace tofu::net
         _quic = nullptr;
     }
 
+    std::vector<std::uint8_t> QuicServer::LoadTicketKey()
+    {
+        // picoquicが鍵を導出するときに使う長さ
+        constexpr std::size_t KeySize = 32;
+
+        if (_config._ticketKeyFile.empty())
+            return {};
+
+        if (std::ifstream file{ _config._ticketKeyFile, std::ios::binary })
+        {
+            std::vector<std::uint8_t> key{ std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} };
+            if (key.size() == KeySize)
+            {
+#ifndef _WINDOWS
+                // 鍵を知っていればチケットを復号・偽造できる. 他のユーザーから読めるようになっていたら狭める
+                using std::filesystem::perms;
+                std::error_code error;
+                auto permissions = std::filesystem::status(_config._ticketKeyFile, error).permissions();
+                if (!error && (permissions & (perms::group_all | perms::others_all)) != perms::none)
+                {
+                    fmt::print("[QuicServer] The ticket key was readable by other users. Restricted it to the owner. path={}\n", _config._ticketKeyFile.string());
+                    std::filesystem::permissions(_config._ticketKeyFile, perms::owner_read | perms::owner_write, error);
+                }
+#endif
+                return key;
+            }
+            fmt::print("[QuicServer] Ignored a broken ticket key. path={}, size={}\n", _config._ticketKeyFile.string(), key.size());
+        }
+
+        std::random_device random;
+        std::vector<std::uint8_t> key(KeySize);
+        for (auto& byte : key)
+        {
+            byte = static_cast<std::uint8_t>(random());
+        }
+
+        // 保存できなくても、この起動の間は使える
+        if (!save_private_file(_config._ticketKeyFile, key))
+            fmt::print("[QuicServer] Could not save the ticket key. path={}\n", _config._ticketKeyFile.string());
+        return key;
+    }
+
     void QuicServer::OnCloseConnection(const std::shared_ptr<QuicConnection>& connection)
     {
         fmt::print("[QuicServer] OnCloseConnection()\n");